@@ -0,0 +1,354 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "analysis.h"
+#include "message.h"
+#include "parallel.h"
+
+// The number of frames decoded and measured at a time by analyze_frames.
+#define ANALYSIS_BLOCK_FRAMES 4096
+
+// The fewest blocks analyzed by each worker thread.
+#define MIN_BLOCKS_PER_THREAD 16
+
+// The most silences listed when an analysis is printed. The sidecar file holds them all.
+#define PRINTED_SILENCES 8
+
+// Arguments for analyzing a range of blocks on a worker thread. The analysis of the blocks starting at block i
+// is stored in parts[i].
+typedef struct analysis_task {
+    audio_analysis* analysis;
+    char* frames;
+    size_t first;
+    size_t count;
+    audio_analysis** parts;
+    int failed;
+} analysis_task;
+
+// A function for allocating an empty analysis of frames starting at first, without reporting errors so worker
+// threads can call it.
+// Returns NULL if there is an error.
+static audio_analysis* allocate_analysis(int encoding, int num_channels, int sample_rate, size_t first) {
+    audio_analysis* analysis = calloc(1, sizeof(audio_analysis));
+    sample_measure* channels = calloc(num_channels, sizeof(sample_measure));
+    if (analysis == NULL || channels == NULL) {
+        free(analysis);
+        free(channels);
+        return NULL;
+    }
+    analysis->encoding = encoding;
+    analysis->num_channels = num_channels;
+    analysis->sample_rate = sample_rate;
+    analysis->clip_level = is_float_encoding(encoding) ? 1.0f : (float)(1.0 - ldexp(1.0, 1 - 8 * encoding_size(encoding)));
+    analysis->min_silence_frames = (size_t)(ANALYSIS_MIN_SILENCE_SECONDS * sample_rate) > 0 ?
+                                   (size_t)(ANALYSIS_MIN_SILENCE_SECONDS * sample_rate) : 1;
+    analysis->first_frame = first;
+    analysis->channels = channels;
+    return analysis;
+}
+
+// A function for creating an empty analysis of audio with an encoding, number of channels and sample rate.
+// Returns NULL if there is an error.
+audio_analysis* new_audio_analysis(int encoding, int num_channels, int sample_rate) {
+    audio_analysis* analysis = allocate_analysis(encoding, num_channels, sample_rate, 0);
+    if (analysis == NULL) {
+        print_message("Error allocating memory for analysis.\n\n");
+    }
+    return analysis;
+}
+
+// A function for freeing an analysis.
+void free_audio_analysis(audio_analysis* analysis) {
+    free(analysis->channels);
+    free(analysis->silences);
+    free(analysis);
+}
+
+// A function for determining whether a silence is reported: it is long enough, or it touches an end of the
+// frames analyzed and may be continued by the frames next to them.
+static int keeps_silence(audio_analysis* analysis, silence_region* silence) {
+    return silence->count >= analysis->min_silence_frames || silence->first == analysis->first_frame ||
+           silence->first + silence->count == analysis->first_frame + analysis->num_frames;
+}
+
+// A function for adding a run of silent frames after the silences of an analysis, joining it to the last silence
+// when they meet. A short last silence that the run does not continue is replaced, so short runs do not pile up.
+// Returns -1 if there is an error.
+static int add_silence(audio_analysis* analysis, size_t first, size_t count) {
+    silence_region* last = analysis->num_silences > 0 ? analysis->silences + analysis->num_silences - 1 : NULL;
+    if (last != NULL && last->first + last->count == first) {
+        last->count += count;
+        return 0;
+    }
+    if (last != NULL && last->count < analysis->min_silence_frames && last->first != analysis->first_frame) {
+        *last = (silence_region){ first, count };
+        return 0;
+    }
+    if (analysis->num_silences == analysis->silence_capacity) {
+        int capacity = analysis->silence_capacity > 0 ? analysis->silence_capacity * 2 : 16;
+        silence_region* silences = realloc(analysis->silences, capacity * sizeof(silence_region));
+        if (silences == NULL) {
+            return -1;
+        }
+        analysis->silences = silences;
+        analysis->silence_capacity = capacity;
+    }
+    analysis->silences[analysis->num_silences++] = (silence_region){ first, count };
+    return 0;
+}
+
+// A function for removing the silences of an analysis that are too short and no longer touch an end of its frames.
+static void prune_silences(audio_analysis* analysis) {
+    int num_silences = 0;
+    for (int i = 0; i < analysis->num_silences; ++i) {
+        if (keeps_silence(analysis, analysis->silences + i)) {
+            analysis->silences[num_silences++] = analysis->silences[i];
+        }
+    }
+    analysis->num_silences = num_silences;
+}
+
+// A function for merging the analysis of the frames just before or just after the frames of an analysis into it.
+// Returns -1 if there is an error.
+static int merge_analysis(audio_analysis* analysis, audio_analysis* part) {
+    int after = part->first_frame == analysis->first_frame + analysis->num_frames;
+    audio_analysis* earlier = after ? analysis : part;
+    audio_analysis* later = after ? part : analysis;
+
+    // Join the silences in order, with a silence ending the earlier frames continued by one starting the later ones.
+    int capacity = earlier->num_silences + later->num_silences;
+    silence_region* silences = capacity > 0 ? malloc(capacity * sizeof(silence_region)) : NULL;
+    if (capacity > 0 && silences == NULL) {
+        return -1;
+    }
+    int num_silences = earlier->num_silences;
+    if (num_silences > 0) {
+        memcpy(silences, earlier->silences, num_silences * sizeof(silence_region));
+    }
+    for (int i = 0; i < later->num_silences; ++i) {
+        silence_region* silence = later->silences + i;
+        if (i == 0 && num_silences > 0 && silences[num_silences - 1].first + silences[num_silences - 1].count == silence->first) {
+            silences[num_silences - 1].count += silence->count;
+        } else {
+            silences[num_silences++] = *silence;
+        }
+    }
+    free(analysis->silences);
+    analysis->silences = silences;
+    analysis->num_silences = num_silences;
+    analysis->silence_capacity = capacity;
+
+    for (int c = 0; c < analysis->num_channels; ++c) {
+        sample_measure* channel = analysis->channels + c;
+        channel->peak = part->channels[c].peak > channel->peak ? part->channels[c].peak : channel->peak;
+        channel->sum += part->channels[c].sum;
+        channel->sum_squares += part->channels[c].sum_squares;
+        channel->clips += part->channels[c].clips;
+    }
+    analysis->first_frame = earlier->first_frame;
+    analysis->num_frames += part->num_frames;
+    prune_silences(analysis);
+    return 0;
+}
+
+// A function for finding the first frame at or after a frame whose mark is not set, comparing 8 marks at a time.
+static size_t skip_loud(unsigned char* loud, size_t frame, size_t count) {
+    for (; frame + 8 <= count; frame += 8) {
+        uint64_t marks;
+        memcpy(&marks, loud + frame, 8);
+        if (marks != 0x0101010101010101ull) {
+            break;
+        }
+    }
+    while (frame < count && loud[frame]) {
+        ++frame;
+    }
+    return frame;
+}
+
+// A function for analyzing a range of blocks on a worker thread into an analysis of its own. The channels of each
+// block are decoded into planes, measured, and their loud samples marked in one array, whose unmarked runs are the
+// silent frames.
+static void analyze_blocks(void* argument, size_t first_block, size_t last_block) {
+    analysis_task* task = argument;
+    audio_analysis* analysis = task->analysis;
+    int num_channels = analysis->num_channels;
+    size_t frame_size = (size_t)num_channels * encoding_size(analysis->encoding);
+
+    // Allocate the analysis and scratch memory for one block, return on error.
+    audio_analysis* part = allocate_analysis(analysis->encoding, num_channels, analysis->sample_rate,
+                                             task->first + first_block * ANALYSIS_BLOCK_FRAMES);
+    float* samples = malloc((size_t)ANALYSIS_BLOCK_FRAMES * num_channels * sizeof(float));
+    unsigned char* loud = malloc(ANALYSIS_BLOCK_FRAMES * sizeof(char));
+    int failed = part == NULL || samples == NULL || loud == NULL;
+
+    for (size_t block = first_block; block < last_block && !failed; ++block) {
+        size_t first = block * ANALYSIS_BLOCK_FRAMES;
+        size_t count = task->count - first < ANALYSIS_BLOCK_FRAMES ? task->count - first : ANALYSIS_BLOCK_FRAMES;
+        decode_frames(task->frames + first * frame_size, samples, count, num_channels, analysis->encoding, count);
+        memset(loud, 0, count);
+        for (int c = 0; c < num_channels; ++c) {
+            measure_samples(samples + c * count, count, analysis->clip_level, ANALYSIS_SILENCE_THRESHOLD,
+                            part->channels + c, loud);
+        }
+        for (size_t i = 0; i < count && !failed;) {
+            size_t start = i;
+            unsigned char* next_loud = memchr(loud + i, 1, count - i);
+            i = next_loud != NULL ? (size_t)(next_loud - loud) : count;
+            failed = i > start && add_silence(part, task->first + first + start, i - start) == -1;
+            i = skip_loud(loud, i, count);
+        }
+        part->num_frames += count;
+    }
+    free(samples);
+    free(loud);
+    if (failed) {
+        task->failed = 1;
+        if (part != NULL) {
+            free_audio_analysis(part);
+        }
+        return;
+    }
+    prune_silences(part);
+    task->parts[first_block] = part;
+}
+
+// A function for analyzing frames [first, first + count), which must follow or precede the frames analyzed so far.
+// The frames are split into blocks analyzed on worker threads, whose analyses are merged in order.
+// Returns -1 if there is an error.
+int analyze_frames(audio_analysis* analysis, char* frames, size_t first, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    if (analysis->num_frames == 0) {
+        analysis->first_frame = first;
+    }
+    int after = first == analysis->first_frame + analysis->num_frames;
+    if (!after && first + count != analysis->first_frame) {
+        print_message("Error - Frames are not analyzed in order.\n\n");
+        return -1;
+    }
+
+    // Analyze the blocks, return -1 on error.
+    size_t num_blocks = (count + ANALYSIS_BLOCK_FRAMES - 1) / ANALYSIS_BLOCK_FRAMES;
+    audio_analysis** parts = calloc(num_blocks, sizeof(audio_analysis*));
+    if (parts == NULL) {
+        print_message("Error allocating memory for analysis.\n\n");
+        return -1;
+    }
+    analysis_task task = { analysis, frames, first, count, parts, 0 };
+    parallel_for(num_blocks, MIN_BLOCKS_PER_THREAD, analyze_blocks, &task);
+
+    // Merge the analyses of the ranges in order, from the last for frames that precede the frames analyzed so far.
+    for (size_t i = 0; i < num_blocks; ++i) {
+        audio_analysis* part = parts[after ? i : num_blocks - 1 - i];
+        if (part != NULL) {
+            task.failed |= !task.failed && merge_analysis(analysis, part) == -1;
+            free_audio_analysis(part);
+        }
+    }
+    free(parts);
+    if (task.failed) {
+        print_message("Error allocating memory for analysis.\n\n");
+        return -1;
+    }
+    return 0;
+}
+
+// A function for converting a magnitude to decibels relative to full scale.
+static double decibels(double magnitude) {
+    return magnitude > 0 ? 20 * log10(magnitude) : -HUGE_VAL;
+}
+
+// A function for writing an analysis to an open file as a line of JSON. Decibels of silent channels are null.
+static void write_analysis_json(FILE* destination, audio_analysis* analysis) {
+    double sample_rate = analysis->sample_rate > 0 ? analysis->sample_rate : 1;
+    fprintf(destination, "{\"frames\": %zu, \"duration\": %.6f, \"channels\": %i, \"sample_rate\": %i, "
+            "\"sample_format\": \"%s\", \"silence_threshold_dbfs\": %.1f, \"min_silence_duration\": %.3f, "
+            "\"channel_stats\": [", analysis->num_frames, analysis->num_frames / sample_rate, analysis->num_channels,
+            analysis->sample_rate, encoding_name(analysis->encoding), decibels(ANALYSIS_SILENCE_THRESHOLD),
+            ANALYSIS_MIN_SILENCE_SECONDS);
+    for (int c = 0; c < analysis->num_channels; ++c) {
+        sample_measure* channel = analysis->channels + c;
+        double frames = analysis->num_frames > 0 ? analysis->num_frames : 1;
+        double rms = sqrt(channel->sum_squares / frames);
+        fprintf(destination, "%s{\"channel\": %i, \"peak\": %.9f, \"peak_dbfs\": ", c > 0 ? ", " : "", c + 1,
+                channel->peak);
+        fprintf(destination, channel->peak > 0 ? "%.3f" : "null", decibels(channel->peak));
+        fprintf(destination, ", \"rms\": %.9f, \"rms_dbfs\": ", rms);
+        fprintf(destination, rms > 0 ? "%.3f" : "null", decibels(rms));
+        fprintf(destination, ", \"dc_offset\": %.9f, \"clipped_samples\": %zu}", channel->sum / frames, channel->clips);
+    }
+    fprintf(destination, "], \"silences\": [");
+    int num_written = 0;
+    for (int i = 0; i < analysis->num_silences; ++i) {
+        silence_region* silence = analysis->silences + i;
+        if (silence->count >= analysis->min_silence_frames) {
+            fprintf(destination, "%s{\"first_frame\": %zu, \"frames\": %zu, \"start\": %.6f, \"duration\": %.6f}",
+                    num_written++ > 0 ? ", " : "", silence->first, silence->count, silence->first / sample_rate,
+                    silence->count / sample_rate);
+        }
+    }
+    fprintf(destination, "]}\n");
+}
+
+// A function for printing an analysis to the user, and writing it as a line of JSON to a sidecar file unless
+// file_name is NULL. Only silences of at least ANALYSIS_MIN_SILENCE_SECONDS are reported.
+// Returns -1 if there is an error.
+int report_analysis(audio_analysis* analysis, char* file_name) {
+    double sample_rate = analysis->sample_rate > 0 ? analysis->sample_rate : 1;
+    double frames = analysis->num_frames > 0 ? analysis->num_frames : 1;
+    char label[32];
+    print_message("Audio analysis:     %zu frames, %.3f seconds\n", analysis->num_frames, analysis->num_frames / sample_rate);
+    for (int c = 0; c < analysis->num_channels; ++c) {
+        sample_measure* channel = analysis->channels + c;
+        snprintf(label, sizeof(label), "Channel %i:", c + 1);
+        print_message("%-20speak %.2f dBFS, RMS %.2f dBFS, DC offset %.6f, %zu clipped samples\n", label,
+                      decibels(channel->peak), decibels(sqrt(channel->sum_squares / frames)), channel->sum / frames,
+                      channel->clips);
+    }
+
+    // List the silences, up to PRINTED_SILENCES of them.
+    int num_silences = 0;
+    double silent_frames = 0;
+    for (int i = 0; i < analysis->num_silences; ++i) {
+        if (analysis->silences[i].count >= analysis->min_silence_frames) {
+            ++num_silences;
+            silent_frames += analysis->silences[i].count;
+        }
+    }
+    print_message("Silences:           %i, %.3f seconds at or below %.0f dBFS\n", num_silences, silent_frames / sample_rate,
+                  decibels(ANALYSIS_SILENCE_THRESHOLD));
+    int num_printed = 0;
+    for (int i = 0; i < analysis->num_silences && num_printed < PRINTED_SILENCES; ++i) {
+        silence_region* silence = analysis->silences + i;
+        if (silence->count >= analysis->min_silence_frames) {
+            print_message("                    %.3f to %.3f seconds\n", silence->first / sample_rate,
+                          (silence->first + silence->count) / sample_rate);
+            ++num_printed;
+        }
+    }
+    if (num_silences > num_printed) {
+        print_message("                    and %i more\n", num_silences - num_printed);
+    }
+    print_message("\n");
+
+    // Write the sidecar file, return -1 on error.
+    if (file_name == NULL) {
+        return 0;
+    }
+    FILE* destination = fopen(file_name, "w");
+    if (destination == NULL) {
+        print_message("Error writing file. Unable to open %s.\n\n", file_name);
+        return -1;
+    }
+    write_analysis_json(destination, analysis);
+    if (fclose(destination)) {
+        print_message("Error writing file %s.\n\n", file_name);
+        return -1;
+    }
+    print_message("Wrote the analysis to %s.\n\n", file_name);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef H_ANALYSIS
+#define H_ANALYSIS
+
+#include <stddef.h>
+#include "sample.h"
+
+// The magnitude at or below which every channel of a frame must be for the frame to be silent, -60 dBFS.
+#define ANALYSIS_SILENCE_THRESHOLD 0.001f
+
+// The shortest run of silent frames reported as a silence, in seconds.
+#define ANALYSIS_MIN_SILENCE_SECONDS 0.5
+
+// A run of silent frames.
+typedef struct silence_region {
+    size_t first;
+    size_t count;
+} silence_region;
+
+// The statistics of a contiguous range of the frames of some audio: the peak, RMS, DC offset and clipped samples of
+// each channel, and the runs of silent frames. Ranges are analyzed in blocks on worker threads and the results of
+// adjacent ranges merged, so silences that touch either end of the range are kept whatever their length, as they
+// may continue into the next range.
+typedef struct audio_analysis {
+    int encoding;
+    int num_channels;
+    int sample_rate;
+    float clip_level; // magnitude of the largest sample of the encoding
+    size_t min_silence_frames;
+
+    // range of frames analyzed
+    size_t first_frame;
+    size_t num_frames;
+
+    sample_measure* channels;
+    silence_region* silences;
+    int num_silences;
+    int silence_capacity;
+} audio_analysis;
+
+// A function for creating an empty analysis of audio with an encoding, number of channels and sample rate.
+audio_analysis* new_audio_analysis(int encoding, int num_channels, int sample_rate);
+
+// A function for freeing an analysis.
+void free_audio_analysis(audio_analysis* analysis);
+
+// A function for analyzing frames [first, first + count), which must follow or precede the frames analyzed so far.
+int analyze_frames(audio_analysis* analysis, char* frames, size_t first, size_t count);
+
+// A function for printing an analysis to the user, and writing it as a line of JSON to a sidecar file unless
+// file_name is NULL.
+int report_analysis(audio_analysis* analysis, char* file_name);
+
+#endif
@@ -0,0 +1,778 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "async.h"
+
+// The number of files each thread follows to read ahead of.
+#define ASYNC_CURSORS 4
+
+// States of a slot.
+//   SLOT_FREE       the slot can be used.
+//   SLOT_IN_FLIGHT  the slot's block has been submitted.
+//   SLOT_DONE       the slot's block has been moved, and its result is waiting to be taken.
+enum slot_state { SLOT_FREE, SLOT_IN_FLIGHT, SLOT_DONE };
+
+// Kinds of block a slot moves.
+//   SLOT_READ_AHEAD    a block read into the slot's buffer before it is asked for.
+//   SLOT_WRITE_BEHIND  a block copied into the slot's buffer and written after write_chars returns.
+//   SLOT_READ          a piece of a larger read, read straight into the caller's buffer.
+//   SLOT_WRITE         a piece of a larger write, written straight from the caller's buffer.
+enum slot_kind { SLOT_READ_AHEAD, SLOT_WRITE_BEHIND, SLOT_READ, SLOT_WRITE };
+
+// A block of a file moved without waiting for it.
+typedef struct async_slot {
+    int state;
+    int kind;
+    int fd;
+    off_t offset;
+    size_t size;
+    ssize_t result; // the chars moved, or -1 if there is an error
+    int stale; // a block read ahead that is no longer wanted
+    off_t copied_low, copied_high; // the range of a block read ahead that reads have copied
+    unsigned long sequence; // the order the slot was submitted in
+    struct iovec iov;
+    char* buffer;
+    size_t capacity;
+} async_slot;
+
+// A file being read by a thread, with the direction it is read in: 1 when the reads move forward, -1 when they
+// move backward and 0 when they are not in order. The direction follows the momentum of the reads, half of the
+// last momentum plus the distance from the last read, so a file read backward in blocks that are each read
+// forward in pieces is still read backward.
+typedef struct async_cursor {
+    int fd;
+    off_t offset;
+    size_t size;
+    off_t momentum;
+    int direction;
+    off_t file_size;
+    unsigned long last_used;
+} async_cursor;
+
+// The blocks in flight for a thread and the backend that moves them.
+typedef struct async_engine {
+    int backend;
+    int depth;
+    size_t block_size;
+    async_slot slots[ASYNC_MAX_QUEUE_DEPTH];
+    async_cursor cursors[ASYNC_CURSORS];
+    unsigned long sequence;
+
+    // io_uring rings
+    int ring_fd;
+    char* sq_ring;
+    size_t sq_ring_size;
+    char* cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    // I/O thread and the queues of slots submitted to it and moved by it
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted;
+    pthread_cond_t completed;
+    int queue[ASYNC_MAX_QUEUE_DEPTH];
+    int queue_first;
+    int queue_length;
+    int done[ASYNC_MAX_QUEUE_DEPTH];
+    int done_length;
+    int stop;
+} async_engine;
+
+static int queue_depth = ASYNC_DEFAULT_QUEUE_DEPTH;
+static size_t async_block_size = ASYNC_DEFAULT_BLOCK_SIZE;
+static pthread_once_t engine_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t engine_key;
+static __thread async_engine* engine = NULL;
+static __thread int engine_failed = 0;
+
+// Function for selecting the number of blocks each thread moves at the same time and the size of a block.
+// Threads that have started moving blocks keep their settings.
+void set_async_options(int depth, size_t block_size) {
+    queue_depth = depth < 1 ? 1 : depth < ASYNC_MAX_QUEUE_DEPTH ? depth : ASYNC_MAX_QUEUE_DEPTH;
+    async_block_size = block_size > 0 ? block_size : ASYNC_DEFAULT_BLOCK_SIZE;
+}
+
+// Function for retrieving the name of a backend.
+char* async_backend_name(int backend) {
+    static char* names[] = { "io_uring", "thread" };
+    return backend >= 0 ? names[backend] : "blocking";
+}
+
+// Function for moving chars between a buffer and a range of a file, until size chars are moved or a read
+// reaches the end of the file.
+// Returns the number of chars moved or -1 if there is an error.
+static ssize_t move_chars(int write, int fd, char* buffer, size_t size, off_t offset) {
+    size_t chars_moved = 0;
+    while (chars_moved < size) {
+        ssize_t result = write ? pwrite(fd, buffer + chars_moved, size - chars_moved, offset + chars_moved) :
+                                 pread(fd, buffer + chars_moved, size - chars_moved, offset + chars_moved);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result == -1) {
+            return -1;
+        }
+        if (result == 0) {
+            break;
+        }
+        chars_moved += result;
+    }
+    return chars_moved;
+}
+
+// Function for determining whether a slot writes its block.
+static int is_write(async_slot* slot) {
+    return slot->kind == SLOT_WRITE_BEHIND || slot->kind == SLOT_WRITE;
+}
+
+// Function for entering an io_uring, retrying when a signal interrupts it.
+// Returns -1 if there is an error.
+static int enter_ring(async_engine* e, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    int result;
+    do {
+        result = syscall(__NR_io_uring_enter, e->ring_fd, to_submit, min_complete, flags, NULL, 0);
+    } while (result == -1 && errno == EINTR);
+    return result;
+}
+
+// Function for determining the state of a slot whose block has been moved. Blocks written behind are freed unless
+// they failed, so the error can be reported, and so are blocks read ahead that are no longer wanted.
+static int moved_state(async_slot* slot) {
+    int unwanted = slot->kind == SLOT_WRITE_BEHIND ? slot->result != -1 : slot->kind == SLOT_READ_AHEAD && slot->stale;
+    return unwanted ? SLOT_FREE : SLOT_DONE;
+}
+
+// Function for recording the result of a slot whose block has been moved. A block the kernel moved only part of
+// is finished here.
+static void complete_slot(async_slot* slot, ssize_t result) {
+    if (result > 0 && (size_t)result < slot->size) {
+        ssize_t rest = move_chars(is_write(slot), slot->fd, (char*)slot->iov.iov_base + result, slot->size - result,
+                                  slot->offset + result);
+        result = rest == -1 ? -1 : result + rest;
+    } else if (result == 0 && is_write(slot) && slot->size > 0) {
+        result = -1;
+    }
+    slot->result = result;
+    slot->state = moved_state(slot);
+}
+
+// Function for taking the results of the blocks that have been moved, waiting for one when wait is set and
+// none has been.
+static void reap_slots(async_engine* e, int wait) {
+    if (e->backend == ASYNC_THREAD) {
+        pthread_mutex_lock(&e->lock);
+        while (wait && e->done_length == 0) {
+            pthread_cond_wait(&e->completed, &e->lock);
+        }
+        for (int i = 0; i < e->done_length; ++i) {
+            async_slot* slot = e->slots + e->done[i];
+            slot->state = moved_state(slot);
+        }
+        e->done_length = 0;
+        pthread_mutex_unlock(&e->lock);
+        return;
+    }
+
+    for (;;) {
+        unsigned head = *e->cq_head;
+        unsigned tail = __atomic_load_n(e->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (!wait || enter_ring(e, 0, 1, IORING_ENTER_GETEVENTS) == -1) {
+                return;
+            }
+            continue;
+        }
+        for (; head != tail; ++head) {
+            struct io_uring_cqe* cqe = e->cqes + (head & *e->cq_mask);
+            complete_slot(e->slots + cqe->user_data, cqe->res < 0 ? -1 : cqe->res);
+        }
+        __atomic_store_n(e->cq_head, head, __ATOMIC_RELEASE);
+        return;
+    }
+}
+
+// Function for submitting the block of a slot, which has its file, range and buffer set. A block the ring cannot
+// take is moved before returning.
+static void submit_slot(async_engine* e, async_slot* slot) {
+    slot->iov.iov_len = slot->size;
+    slot->sequence = ++e->sequence;
+    slot->state = SLOT_IN_FLIGHT;
+    slot->stale = 0;
+    slot->copied_low = slot->copied_high = slot->offset;
+    if (e->backend == ASYNC_THREAD) {
+        pthread_mutex_lock(&e->lock);
+        e->queue[(e->queue_first + e->queue_length++) % ASYNC_MAX_QUEUE_DEPTH] = slot - e->slots;
+        pthread_cond_signal(&e->submitted);
+        pthread_mutex_unlock(&e->lock);
+        return;
+    }
+
+    unsigned tail = *e->sq_tail;
+    unsigned index = tail & *e->sq_mask;
+    struct io_uring_sqe* sqe = e->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = is_write(slot) ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = slot->fd;
+    sqe->addr = (unsigned long)&slot->iov;
+    sqe->len = 1;
+    sqe->off = slot->offset;
+    sqe->user_data = slot - e->slots;
+    e->sq_array[index] = index;
+    __atomic_store_n(e->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    if (enter_ring(e, 1, 0, 0) != 1) {
+        __atomic_store_n(e->sq_tail, tail, __ATOMIC_RELEASE);
+        complete_slot(slot, move_chars(is_write(slot), slot->fd, slot->iov.iov_base, slot->size, slot->offset));
+    }
+}
+
+// Function for waiting until the block of a slot has been moved.
+static void wait_slot(async_engine* e, async_slot* slot) {
+    while (slot->state == SLOT_IN_FLIGHT) {
+        reap_slots(e, 1);
+    }
+}
+
+// Function for moving the submitted blocks on the I/O thread, in the order they were submitted.
+static void* run_io_thread(void* engine_pointer) {
+    async_engine* e = engine_pointer;
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        while (e->queue_length == 0 && !e->stop) {
+            pthread_cond_wait(&e->submitted, &e->lock);
+        }
+        if (e->queue_length == 0) {
+            break;
+        }
+        async_slot* slot = e->slots + e->queue[e->queue_first];
+        e->queue_first = (e->queue_first + 1) % ASYNC_MAX_QUEUE_DEPTH;
+        --e->queue_length;
+        pthread_mutex_unlock(&e->lock);
+
+        ssize_t result = move_chars(is_write(slot), slot->fd, slot->iov.iov_base, slot->size, slot->offset);
+
+        pthread_mutex_lock(&e->lock);
+        slot->result = result;
+        e->done[e->done_length++] = slot - e->slots;
+        pthread_cond_signal(&e->completed);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+// Function for unmapping the rings of an io_uring and closing it.
+static void close_ring(async_engine* e) {
+    if (e->sqes != NULL && e->sqes != MAP_FAILED) {
+        munmap(e->sqes, e->sqes_size);
+    }
+    if (e->cq_ring != NULL && e->cq_ring != MAP_FAILED && e->cq_ring != e->sq_ring) {
+        munmap(e->cq_ring, e->cq_ring_size);
+    }
+    if (e->sq_ring != NULL && e->sq_ring != MAP_FAILED) {
+        munmap(e->sq_ring, e->sq_ring_size);
+    }
+    close(e->ring_fd);
+}
+
+// Function for setting up an io_uring with an entry for each slot. The WAVE_IO_URING environment variable
+// turns io_uring off when it is "0".
+// Returns -1 if there is an error.
+static int open_ring(async_engine* e) {
+    char* enabled = getenv("WAVE_IO_URING");
+    if (enabled != NULL && !strcmp(enabled, "0")) {
+        return -1;
+    }
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    e->ring_fd = syscall(__NR_io_uring_setup, e->depth, &params);
+    if (e->ring_fd == -1) {
+        return -1;
+    }
+
+    // Map the submission and completion rings, which share a mapping on newer kernels, and the submission entries.
+    e->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    e->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        e->sq_ring_size = e->sq_ring_size > e->cq_ring_size ? e->sq_ring_size : e->cq_ring_size;
+        e->cq_ring_size = e->sq_ring_size;
+    }
+    e->sq_ring = mmap(NULL, e->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, e->ring_fd,
+                      IORING_OFF_SQ_RING);
+    e->cq_ring = params.features & IORING_FEAT_SINGLE_MMAP ? e->sq_ring :
+                 mmap(NULL, e->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, e->ring_fd,
+                      IORING_OFF_CQ_RING);
+    e->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    e->sqes = mmap(NULL, e->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, e->ring_fd, IORING_OFF_SQES);
+    if (e->sq_ring == MAP_FAILED || e->cq_ring == MAP_FAILED || e->sqes == MAP_FAILED) {
+        close_ring(e);
+        return -1;
+    }
+
+    e->sq_tail = (unsigned*)(e->sq_ring + params.sq_off.tail);
+    e->sq_mask = (unsigned*)(e->sq_ring + params.sq_off.ring_mask);
+    e->sq_array = (unsigned*)(e->sq_ring + params.sq_off.array);
+    e->cq_head = (unsigned*)(e->cq_ring + params.cq_off.head);
+    e->cq_tail = (unsigned*)(e->cq_ring + params.cq_off.tail);
+    e->cq_mask = (unsigned*)(e->cq_ring + params.cq_off.ring_mask);
+    e->cqes = (struct io_uring_cqe*)(e->cq_ring + params.cq_off.cqes);
+    return 0;
+}
+
+// Function for freeing the engine of a thread when the thread exits, after its blocks have been moved.
+static void free_engine(void* engine_pointer) {
+    async_engine* e = engine_pointer;
+    for (int i = 0; i < e->depth; ++i) {
+        wait_slot(e, e->slots + i);
+        free(e->slots[i].buffer);
+    }
+    if (e->backend == ASYNC_THREAD) {
+        pthread_mutex_lock(&e->lock);
+        e->stop = 1;
+        pthread_cond_signal(&e->submitted);
+        pthread_mutex_unlock(&e->lock);
+        pthread_join(e->thread, NULL);
+        pthread_mutex_destroy(&e->lock);
+        pthread_cond_destroy(&e->submitted);
+        pthread_cond_destroy(&e->completed);
+    } else {
+        close_ring(e);
+    }
+    free(e);
+}
+
+// Function for creating the key that frees the engine of a thread when it exits.
+static void create_engine_key() {
+    pthread_key_create(&engine_key, free_engine);
+}
+
+// Function for retrieving the engine of the calling thread, which is created with an io_uring, or with an I/O
+// thread when io_uring cannot be used, on the thread's first call.
+// Returns NULL if there is an error, and the blocks are then moved before returning.
+static async_engine* get_engine() {
+    if (engine != NULL || engine_failed) {
+        return engine;
+    }
+    pthread_once(&engine_key_once, create_engine_key);
+    async_engine* e = calloc(1, sizeof(async_engine));
+    if (e == NULL) {
+        engine_failed = 1;
+        return NULL;
+    }
+    e->depth = queue_depth;
+    e->block_size = async_block_size;
+    for (int i = 0; i < ASYNC_CURSORS; ++i) {
+        e->cursors[i].fd = -1;
+    }
+    if (open_ring(e) == -1) {
+        e->backend = ASYNC_THREAD;
+        pthread_mutex_init(&e->lock, NULL);
+        pthread_cond_init(&e->submitted, NULL);
+        pthread_cond_init(&e->completed, NULL);
+        if (pthread_create(&e->thread, NULL, run_io_thread, e)) {
+            free(e);
+            engine_failed = 1;
+            return NULL;
+        }
+    }
+    pthread_setspecific(engine_key, e);
+    engine = e;
+    return e;
+}
+
+// Function for retrieving the backend the calling thread moves blocks with.
+// Returns -1 if the thread cannot move blocks without waiting for them.
+int get_async_backend() {
+    async_engine* e = get_engine();
+    return e != NULL ? e->backend : -1;
+}
+
+// Function for taking a slot for a new block: a free slot, or else, with wait set, one freed by the oldest block
+// written behind, or else, with steal set, the one holding the block read ahead furthest, or else, with wait set,
+// the one of the oldest block in flight. Blocks written behind that failed keep their slots until the error is
+// reported.
+// Returns NULL if there is no slot.
+static async_slot* take_slot(async_engine* e, int wait, int steal) {
+    for (;;) {
+        async_slot* oldest = NULL;
+        async_slot* oldest_write = NULL;
+        async_slot* read_ahead = NULL;
+        for (int i = 0; i < e->depth; ++i) {
+            async_slot* slot = e->slots + i;
+            if (slot->state == SLOT_FREE) {
+                return slot;
+            } else if (slot->state == SLOT_DONE && slot->kind == SLOT_READ_AHEAD) {
+                read_ahead = read_ahead == NULL || slot->sequence > read_ahead->sequence ? slot : read_ahead;
+            } else if (slot->state == SLOT_IN_FLIGHT) {
+                oldest = oldest == NULL || slot->sequence < oldest->sequence ? slot : oldest;
+                if (slot->kind == SLOT_WRITE_BEHIND) {
+                    oldest_write = oldest_write == NULL || slot->sequence < oldest_write->sequence ? slot : oldest_write;
+                }
+            }
+        }
+        if (wait && oldest_write != NULL) {
+            wait_slot(e, oldest_write);
+        } else if (steal && read_ahead != NULL) {
+            read_ahead->state = SLOT_FREE;
+            return read_ahead;
+        } else if (wait && oldest != NULL) {
+            wait_slot(e, oldest);
+        } else {
+            return NULL;
+        }
+    }
+}
+
+// Function for making sure the buffer of a slot holds at least size chars.
+// Returns -1 if there is an error.
+static int reserve_slot(async_slot* slot, size_t size) {
+    if (size > slot->capacity) {
+        char* buffer = realloc(slot->buffer, size);
+        if (buffer == NULL) {
+            return -1;
+        }
+        slot->buffer = buffer;
+        slot->capacity = size;
+    }
+    return 0;
+}
+
+// Function for dropping a block read ahead that is no longer wanted. A block still in flight keeps its slot until
+// it has been read.
+static void drop_slot(async_slot* slot) {
+    slot->stale = 1;
+    slot->state = slot->state == SLOT_DONE ? SLOT_FREE : slot->state;
+}
+
+// Function for determining whether a slot holds a wanted block read ahead of a file.
+static int is_read_ahead(async_slot* slot, int fd) {
+    return slot->kind == SLOT_READ_AHEAD && slot->fd == fd && slot->state != SLOT_FREE && !slot->stale;
+}
+
+// Function for finding the block read ahead of a file that holds the char at an offset.
+// Returns NULL if no block holds it.
+static async_slot* find_read_ahead(async_engine* e, int fd, off_t offset) {
+    for (int i = 0; i < e->depth; ++i) {
+        async_slot* slot = e->slots + i;
+        if (is_read_ahead(slot, fd) && slot->offset <= offset && offset < slot->offset + (off_t)slot->size) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+// Function for dropping the blocks read ahead of a file and forgetting how it was read, after it is written.
+static void drop_read_ahead(async_engine* e, int fd) {
+    for (int i = 0; i < e->depth; ++i) {
+        if (is_read_ahead(e->slots + i, fd)) {
+            drop_slot(e->slots + i);
+        }
+    }
+    for (int i = 0; i < ASYNC_CURSORS; ++i) {
+        if (e->cursors[i].fd == fd) {
+            e->cursors[i].fd = -1;
+        }
+    }
+}
+
+// Function for waiting until the blocks written behind to a file have been written.
+// Returns -1 if one of them failed, freeing its slot.
+static int finish_writes(async_engine* e, int fd) {
+    int result = 0;
+    for (int i = 0; i < e->depth; ++i) {
+        async_slot* slot = e->slots + i;
+        if (slot->kind == SLOT_WRITE_BEHIND && slot->fd == fd && slot->state != SLOT_FREE) {
+            wait_slot(e, slot);
+            if (slot->state == SLOT_DONE) {
+                result = -1;
+                slot->state = SLOT_FREE;
+            }
+        }
+    }
+    return result;
+}
+
+// Function for moving a range larger than a block, split into blocks that are in flight at the same time and
+// moved straight between the file and the caller's buffer.
+// Returns the number of chars moved, which is less than size when a read reaches the end of the file, or -1 if
+// there is an error.
+static ssize_t move_blocks(async_engine* e, int write, int fd, char* buffer, size_t size, off_t offset) {
+    size_t submitted = 0;
+    size_t chars_moved = size;
+    int failed = 0;
+    for (;;) {
+        // Take the results of the pieces that have been moved. A read that stops short is at the end of the file.
+        int num_in_flight = 0;
+        for (int i = 0; i < e->depth; ++i) {
+            async_slot* slot = e->slots + i;
+            if ((slot->kind == SLOT_READ || slot->kind == SLOT_WRITE) && slot->state == SLOT_DONE) {
+                size_t start = slot->offset - offset;
+                if (slot->result == -1) {
+                    failed = 1;
+                } else if ((size_t)slot->result < slot->size && start + slot->result < chars_moved) {
+                    chars_moved = start + slot->result;
+                }
+                slot->state = SLOT_FREE;
+            } else if ((slot->kind == SLOT_READ || slot->kind == SLOT_WRITE) && slot->state == SLOT_IN_FLIGHT) {
+                ++num_in_flight;
+            }
+        }
+        if (submitted == size && num_in_flight == 0) {
+            break;
+        }
+
+        // Submit the next piece, or wait for a piece when every slot is taken.
+        async_slot* slot = submitted < size ? take_slot(e, num_in_flight == 0, 1) : NULL;
+        if (slot != NULL) {
+            slot->kind = write ? SLOT_WRITE : SLOT_READ;
+            slot->fd = fd;
+            slot->offset = offset + submitted;
+            slot->size = size - submitted < e->block_size ? size - submitted : e->block_size;
+            slot->iov.iov_base = buffer + submitted;
+            submitted += slot->size;
+            submit_slot(e, slot);
+        } else if (num_in_flight > 0) {
+            reap_slots(e, 1);
+        } else {
+            // No slot can be taken, so the rest is moved before returning.
+            ssize_t rest = move_chars(write, fd, buffer + submitted, size - submitted, offset + submitted);
+            failed = failed || rest == -1;
+            chars_moved = rest != -1 && submitted + rest < chars_moved ? submitted + rest : chars_moved;
+            submitted = size;
+        }
+    }
+    return failed ? -1 : (ssize_t)chars_moved;
+}
+
+// Function for finding the cursor of a file, or the least recently used one for a file not being followed, and
+// moving it to a read. A read further from the last one than twice the window read ahead is not in order.
+static async_cursor* follow_read(async_engine* e, int fd, size_t size, off_t offset) {
+    async_cursor* cursor = e->cursors;
+    for (int i = 0; i < ASYNC_CURSORS; ++i) {
+        if (e->cursors[i].fd == fd) {
+            cursor = e->cursors + i;
+            break;
+        }
+        cursor = e->cursors[i].last_used < cursor->last_used ? e->cursors + i : cursor;
+    }
+    off_t distance = offset - cursor->offset;
+    if (cursor->fd != fd) {
+        struct stat st;
+        cursor->fd = fd;
+        cursor->momentum = 0;
+        cursor->file_size = fstat(fd, &st) ? 0 : st.st_size;
+    } else if (distance > 2 * (e->depth - 1) * (off_t)size || -distance > 2 * (e->depth - 1) * (off_t)size) {
+        cursor->momentum = 0;
+    } else {
+        cursor->momentum = cursor->momentum / 2 + distance;
+    }
+    cursor->direction = cursor->momentum > 0 ? 1 : cursor->momentum < 0 ? -1 : 0;
+    cursor->offset = offset;
+    cursor->size = size;
+    cursor->last_used = ++e->sequence;
+    return cursor;
+}
+
+// Function for reading ahead of a file in the direction it is read in, in blocks as large as the last read, into
+// free slots, leaving a slot for a block written behind. Blocks read ahead further from the last read than twice
+// the window are dropped.
+static void read_ahead(async_engine* e, async_cursor* cursor) {
+    int window = cursor->direction != 0 ? e->depth - 1 : 0;
+    off_t length = cursor->size;
+    off_t low = cursor->direction > 0 ? cursor->offset + length : cursor->offset - window * length;
+    off_t high = low + window * length;
+    for (int i = 0; i < e->depth; ++i) {
+        async_slot* slot = e->slots + i;
+        if (is_read_ahead(slot, cursor->fd) && (window == 0 || slot->offset + (off_t)slot->size <= low - window * length ||
+                                                slot->offset >= high + window * length)) {
+            drop_slot(slot);
+        }
+    }
+    if (window == 0 || length == 0) {
+        return;
+    }
+
+    // Fill the gaps of the window, starting next to the last read.
+    off_t position = cursor->direction > 0 ? low : high;
+    while (cursor->direction > 0 ? position < high && position < cursor->file_size : position > low && position > 0) {
+        async_slot* slot = find_read_ahead(e, cursor->fd, cursor->direction > 0 ? position : position - 1);
+        if (slot != NULL) {
+            position = cursor->direction > 0 ? slot->offset + (off_t)slot->size : slot->offset;
+            continue;
+        }
+        slot = take_slot(e, 0, 0);
+        if (slot == NULL || reserve_slot(slot, length) == -1) {
+            break;
+        }
+        off_t start = cursor->direction > 0 ? position : position - length > 0 ? position - length : 0;
+        off_t end = cursor->direction > 0 ? (position + length < cursor->file_size ? position + length : cursor->file_size) :
+                                            position;
+        slot->kind = SLOT_READ_AHEAD;
+        slot->fd = cursor->fd;
+        slot->offset = start;
+        slot->size = end - start;
+        slot->iov.iov_base = slot->buffer;
+        submit_slot(e, slot);
+        position = cursor->direction > 0 ? end : start;
+    }
+}
+
+// Function for reading a range of a file, from blocks read ahead when the file is read in order. Writes to the
+// file that are still in flight are finished first.
+// Returns the number of chars read, which is less than size at the end of the file, or -1 if there is an error.
+ssize_t async_read_range(int fd, char* buffer, size_t size, off_t offset) {
+    async_engine* e = get_engine();
+    if (e == NULL) {
+        return move_chars(0, fd, buffer, size, offset);
+    }
+    if (finish_writes(e, fd) == -1) {
+        return -1;
+    }
+    if (size > e->block_size) {
+        drop_read_ahead(e, fd);
+        return move_blocks(e, 0, fd, buffer, size, offset);
+    }
+
+    // Copy the parts of the range that were read ahead, and read the parts between them before returning.
+    size_t chars_read = 0;
+    while (chars_read < size) {
+        off_t position = offset + chars_read;
+        async_slot* slot = find_read_ahead(e, fd, position);
+        if (slot != NULL) {
+            wait_slot(e, slot);
+            if (slot->result == -1) {
+                drop_slot(slot);
+                continue;
+            }
+            off_t available = slot->offset + slot->result - position;
+            size_t length = available < (off_t)(size - chars_read) ? (size_t)(available > 0 ? available : 0) :
+                                                                     size - chars_read;
+            memcpy(buffer + chars_read, slot->buffer + (position - slot->offset), length);
+            chars_read += length;
+            if (length == 0) {
+                break;
+            }
+
+            // Free the block once all of it has been copied.
+            slot->copied_low = position < slot->copied_low ? position : slot->copied_low;
+            slot->copied_high = position + (off_t)length > slot->copied_high ? position + (off_t)length : slot->copied_high;
+            if (slot->copied_low <= slot->offset && slot->copied_high >= slot->offset + slot->result) {
+                drop_slot(slot);
+            }
+        } else {
+            size_t length = size - chars_read;
+            for (int i = 0; i < e->depth; ++i) {
+                async_slot* next = e->slots + i;
+                if (is_read_ahead(next, fd) && next->offset > position && next->offset < position + (off_t)length) {
+                    length = next->offset - position;
+                }
+            }
+            ssize_t result = move_chars(0, fd, buffer + chars_read, length, position);
+            if (result == -1) {
+                return -1;
+            }
+            chars_read += result;
+            if ((size_t)result < length) {
+                break;
+            }
+        }
+    }
+
+    // Read the blocks that follow in the direction the file is read in.
+    read_ahead(e, follow_read(e, fd, size, offset));
+    return chars_read;
+}
+
+// Function for writing chars to a range of a file, finishing the writes to the file that are still in flight
+// first.
+// Returns the number of chars written or -1 if there is an error.
+ssize_t async_write_range(int fd, char* buffer, size_t size, off_t offset) {
+    async_engine* e = get_engine();
+    if (e == NULL) {
+        return move_chars(1, fd, buffer, size, offset);
+    }
+    drop_read_ahead(e, fd);
+    if (finish_writes(e, fd) == -1) {
+        return -1;
+    }
+    return size > e->block_size ? move_blocks(e, 1, fd, buffer, size, offset) : move_chars(1, fd, buffer, size, offset);
+}
+
+// Function for writing chars at the position of a file and moving the position past them. Up to a block of
+// chars is copied and written behind, and more are written in blocks at the same time before returning.
+// Returns the number of chars written, or -1 if there is an error, including an error of an earlier write.
+ssize_t async_write_chars(int fd, char* buffer, size_t size) {
+    async_engine* e = get_engine();
+    if (size == 0) {
+        return 0;
+    }
+
+    // Report a failed write behind, then claim the range at the position.
+    for (int i = 0; e != NULL && i < e->depth; ++i) {
+        async_slot* slot = e->slots + i;
+        if (slot->kind == SLOT_WRITE_BEHIND && slot->fd == fd && slot->state == SLOT_DONE) {
+            slot->state = SLOT_FREE;
+            return -1;
+        }
+    }
+    off_t end = lseek(fd, size, SEEK_CUR);
+    if (end == -1) {
+        return -1;
+    }
+    off_t offset = end - size;
+    if (e == NULL) {
+        return move_chars(1, fd, buffer, size, offset);
+    }
+    drop_read_ahead(e, fd);
+    if (size > e->block_size) {
+        return move_blocks(e, 1, fd, buffer, size, offset);
+    }
+
+    // Copy the chars into a slot and write them behind.
+    async_slot* slot = take_slot(e, 1, 1);
+    if (slot == NULL || reserve_slot(slot, size) == -1) {
+        return move_chars(1, fd, buffer, size, offset);
+    }
+    memcpy(slot->buffer, buffer, size);
+    slot->kind = SLOT_WRITE_BEHIND;
+    slot->fd = fd;
+    slot->offset = offset;
+    slot->size = size;
+    slot->iov.iov_base = slot->buffer;
+    submit_slot(e, slot);
+    return size;
+}
+
+// Function for finishing the reads and writes of a file that are in flight, before it is closed.
+// Returns -1 if a write failed.
+int async_finish(int fd) {
+    async_engine* e = engine;
+    if (e == NULL) {
+        return 0;
+    }
+    drop_read_ahead(e, fd);
+    int result = finish_writes(e, fd);
+    for (int i = 0; i < e->depth; ++i) {
+        async_slot* slot = e->slots + i;
+        if (slot->kind == SLOT_READ_AHEAD && slot->fd == fd && slot->state == SLOT_IN_FLIGHT) {
+            wait_slot(e, slot);
+            slot->state = SLOT_FREE;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,48 @@
+#ifndef H_ASYNC
+#define H_ASYNC
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// The default number of blocks each thread moves at the same time, and the default size of a block.
+#define ASYNC_DEFAULT_QUEUE_DEPTH 4
+#define ASYNC_DEFAULT_BLOCK_SIZE (1 << 20)
+
+// The most blocks each thread moves at the same time.
+#define ASYNC_MAX_QUEUE_DEPTH 64
+
+// Ways of moving blocks without waiting for them.
+//   ASYNC_URING   blocks are submitted to an io_uring.
+//   ASYNC_THREAD  blocks are moved in order by an I/O thread, for kernels without io_uring or where it is not allowed.
+enum async_backend { ASYNC_URING, ASYNC_THREAD };
+
+// Function for selecting the number of blocks each thread moves at the same time and the size of a block. Reads
+// and writes of up to a block are read ahead and written behind, and larger ones are split into blocks that are
+// moved at the same time.
+void set_async_options(int queue_depth, size_t block_size);
+
+// Function for retrieving the backend the calling thread moves blocks with.
+int get_async_backend();
+
+// Function for retrieving the name of a backend.
+char* async_backend_name(int backend);
+
+// Function for reading a range of a file, from blocks read ahead when the file is read in order. Writes to the
+// file that are still in flight are finished first. Returns the number of chars read, which is less than size
+// at the end of the file.
+ssize_t async_read_range(int fd, char* buffer, size_t size, off_t offset);
+
+// Function for writing chars to a range of a file, finishing the writes to the file that are still in flight
+// first. Returns the number of chars written.
+ssize_t async_write_range(int fd, char* buffer, size_t size, off_t offset);
+
+// Function for writing chars at the position of a file and moving the position past them. Up to a block of
+// chars is copied and written behind, so the buffer can be reused at once. Returns the number of chars written,
+// or -1 for an error of an earlier write to the file.
+ssize_t async_write_chars(int fd, char* buffer, size_t size);
+
+// Function for finishing the reads and writes of a file that are in flight, before it is closed.
+// Returns -1 if a write failed.
+int async_finish(int fd);
+
+#endif
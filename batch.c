@@ -0,0 +1,425 @@
+#include <ctype.h>
+#include <glob.h>
+#include <limits.h>
+#include <pthread.h>
+#include "batch.h"
+#include "parallel.h"
+
+// The most worker threads run_batch starts.
+#define MAX_WORKERS 64
+
+struct batch_run;
+
+// A worker of a batch run. The worker takes jobs from the front of its own range and, once the range is
+// empty, steals the back half of the range of another worker.
+typedef struct batch_worker {
+    struct batch_run* run;
+    int index;
+    pthread_t thread;
+
+    // jobs [next, end) that are left to the worker, guarded by lock
+    pthread_mutex_t lock;
+    int next;
+    int end;
+
+    // block buffer reused for every file the worker streams
+    char* block;
+
+    // results
+    int num_files;
+    int num_failed;
+    size_t chars_processed;
+} batch_worker;
+
+// A struct holding the state shared by the workers of a batch run.
+typedef struct batch_run {
+    batch* batch;
+    batch_worker* workers;
+    int num_workers;
+    size_t block_size;
+    pthread_mutex_t report_lock;
+} batch_run;
+
+// A function for copying a string, returns NULL on error.
+static char* copy_string(char* string, size_t length) {
+    char* copy = malloc(length + 1);
+    if (copy != NULL) {
+        memcpy(copy, string, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+// A function for adding a job to a batch from a list of words: the input file, the output file and the
+// operations. The words are copied. Returns -1 if there is an error.
+static int add_job(batch* batch, char** words, size_t* lengths, int num_words) {
+
+    // Grow the job list if it is full, return -1 on error.
+    if (batch->num_jobs == batch->job_capacity) {
+        int capacity = batch->job_capacity > 0 ? batch->job_capacity * 2 : 16;
+        batch_job* jobs = realloc(batch->jobs, capacity * sizeof(batch_job));
+        if (jobs == NULL) {
+            print_message("Error allocating memory for batch.\n\n");
+            return -1;
+        }
+        batch->jobs = jobs;
+        batch->job_capacity = capacity;
+    }
+
+    // Copy the words, return -1 on error.
+    batch_job* job = batch->jobs + batch->num_jobs;
+    char** copies = calloc(num_words, sizeof(char*));
+    if (copies == NULL) {
+        print_message("Error allocating memory for batch.\n\n");
+        return -1;
+    }
+    for (int i = 0; i < num_words; ++i) {
+        copies[i] = copy_string(words[i], lengths[i]);
+        if (copies[i] == NULL) {
+            print_message("Error allocating memory for batch.\n\n");
+            while (i > 0) {
+                free(copies[--i]);
+            }
+            free(copies);
+            return -1;
+        }
+    }
+    job->source_file_name = copies[0];
+    job->destination_file_name = copies[1];
+    job->num_args = num_words - 2;
+    job->args = copies + 2;
+    job->words = copies;
+    ++batch->num_jobs;
+    return 0;
+}
+
+// A function for reading a batch from a manifest with a line of "input output [operations]" for each file.
+// Words are separated by spaces, and empty lines and lines starting with '#' are skipped.
+// Returns NULL if there is an error.
+batch* read_manifest(char* file_name) {
+
+    // Read the manifest, return NULL on error.
+    char* contents;
+    size_t size = read_file(file_name, &contents);
+    if (size == (size_t)-1) {
+        return NULL;
+    }
+
+    // Allocate memory for the batch and the words of a line, return NULL on error.
+    batch* new = calloc(1, sizeof(batch));
+    char** words = malloc((size / 2 + 2) * sizeof(char*));
+    size_t* lengths = malloc((size / 2 + 2) * sizeof(size_t));
+    if (new == NULL || words == NULL || lengths == NULL) {
+        print_message("Error allocating memory for batch.\n\n");
+        free(new);
+        free(words);
+        free(lengths);
+        free_file(contents);
+        return NULL;
+    }
+
+    // Split each line into words and add a job for it.
+    size_t position = 0;
+    int line = 0;
+    while (position < size) {
+        ++line;
+        int num_words = 0;
+        while (position < size && contents[position] != '\n') {
+            if (isspace((unsigned char)contents[position])) {
+                ++position;
+                continue;
+            }
+            size_t start = position;
+            while (position < size && !isspace((unsigned char)contents[position])) {
+                ++position;
+            }
+            words[num_words] = contents + start;
+            lengths[num_words++] = position - start;
+        }
+        ++position;
+
+        if (num_words == 0 || words[0][0] == '#') {
+            continue;
+        } else if (num_words < 2) {
+            print_message("Line %i of %s needs an input and an output file name.\n\n", line, file_name);
+            continue;
+        } else if (add_job(new, words, lengths, num_words) == -1) {
+            free_batch(new);
+            new = NULL;
+            break;
+        }
+
+        // Skip lines with options that apply to the whole batch, which the batch's options set for every file.
+        batch_job* job = new->jobs + new->num_jobs - 1;
+        char* run_option = find_run_option(job->num_args, job->args);
+        if (run_option != NULL) {
+            print_message("Line %i of %s gives %.*s, which applies to the whole batch and cannot be given in a line.\n\n",
+                          line, file_name, is_profile_option(run_option) ? 9 : 2, run_option);
+            for (int i = 0; i < job->num_args + 2; ++i) {
+                free(job->words[i]);
+            }
+            free(job->words);
+            --new->num_jobs;
+        }
+    }
+
+    free(words);
+    free(lengths);
+    free_file(contents);
+    return new;
+}
+
+// A function for creating a batch of every file matching a pattern, written to a directory with the same
+// operations. Returns NULL if there is an error.
+batch* glob_batch(char* pattern, char* directory, int num_args, char** args) {
+
+    // Find the files matching the pattern, return NULL on error.
+    glob_t matches;
+    if (glob(pattern, 0, NULL, &matches)) {
+        print_message("No files match %s.\n\n", pattern);
+        return NULL;
+    }
+
+    // Allocate memory for the batch and the words of a job, return NULL on error.
+    batch* new = calloc(1, sizeof(batch));
+    char** words = malloc((num_args + 2) * sizeof(char*));
+    size_t* lengths = malloc((num_args + 2) * sizeof(size_t));
+    char* destination = malloc(strlen(directory) + PATH_MAX + 2);
+    if (new == NULL || words == NULL || lengths == NULL || destination == NULL) {
+        print_message("Error allocating memory for batch.\n\n");
+        free(new);
+        new = NULL;
+    }
+
+    // Write each file to the directory under its own name.
+    for (size_t i = 0; new != NULL && i < matches.gl_pathc; ++i) {
+        char* source = matches.gl_pathv[i];
+        char* name = strrchr(source, '/') != NULL ? strrchr(source, '/') + 1 : source;
+        snprintf(destination, strlen(directory) + PATH_MAX + 2, "%s/%s", directory, name);
+        words[0] = source;
+        words[1] = destination;
+        for (int j = 0; j < num_args; ++j) {
+            words[j + 2] = args[j];
+        }
+        for (int j = 0; j < num_args + 2; ++j) {
+            lengths[j] = strlen(words[j]);
+        }
+        if (add_job(new, words, lengths, num_args + 2) == -1) {
+            free_batch(new);
+            new = NULL;
+        }
+    }
+
+    free(words);
+    free(lengths);
+    free(destination);
+    globfree(&matches);
+    return new;
+}
+
+// A function for freeing a batch.
+void free_batch(batch* batch) {
+    for (int i = 0; i < batch->num_jobs; ++i) {
+        batch_job* job = batch->jobs + i;
+        for (int j = 0; j < job->num_args + 2; ++j) {
+            free(job->words[j]);
+        }
+        free(job->words);
+    }
+    free(batch->jobs);
+    free(batch);
+}
+
+// A function for taking the next job of a worker, stealing half of another worker's jobs when the worker
+// has none left. Returns -1 when every job has been taken.
+static int take_job(batch_worker* worker) {
+    pthread_mutex_lock(&worker->lock);
+    if (worker->next < worker->end) {
+        int job = worker->next++;
+        pthread_mutex_unlock(&worker->lock);
+        return job;
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    batch_run* run = worker->run;
+    for (int i = 1; i < run->num_workers; ++i) {
+        batch_worker* victim = run->workers + (worker->index + i) % run->num_workers;
+        pthread_mutex_lock(&victim->lock);
+        int remaining = victim->end - victim->next;
+        if (remaining > 0) {
+            int taken = (remaining + 1) / 2;
+            victim->end -= taken;
+            int first = victim->end;
+            pthread_mutex_unlock(&victim->lock);
+
+            pthread_mutex_lock(&worker->lock);
+            worker->next = first + 1;
+            worker->end = first + taken;
+            pthread_mutex_unlock(&worker->lock);
+            return first;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return -1;
+}
+
+// A function for processing jobs on a worker thread until every job has been taken. The worker's messages
+// are kept, and the first error of a file is reported with the file's name.
+static void* run_worker(void* worker_pointer) {
+    batch_worker* worker = worker_pointer;
+    batch_run* run = worker->run;
+    char error[MESSAGE_SIZE];
+
+    set_quiet_messages(1);
+    for (int index = take_job(worker); index != -1; index = take_job(worker)) {
+        batch_job* job = run->batch->jobs + index;
+        struct stat st;
+        if (!stat(job->source_file_name, &st)) {
+            worker->chars_processed += st.st_size;
+        }
+
+        error[0] = '\0';
+        set_quiet_messages(1);
+        ++worker->num_files;
+        if (process_file(job->source_file_name, job->destination_file_name, job->num_args, job->args, run->block_size,
+                         worker->block, NULL, error) == -1) {
+            ++worker->num_failed;
+
+            // Drop the blank lines that end most messages.
+            size_t length = strlen(error);
+            while (length > 0 && isspace((unsigned char)error[length - 1])) {
+                error[--length] = '\0';
+            }
+            pthread_mutex_lock(&run->report_lock);
+            printf("Error processing %s: %s\n", job->source_file_name, length > 0 ? error : "unknown error");
+            pthread_mutex_unlock(&run->report_lock);
+        }
+    }
+    return NULL;
+}
+
+// A function for processing the files of a batch on a pool of worker threads, streaming each file in blocks
+// of block_size chars. The jobs are split into a contiguous range for each worker, and workers that finish
+// early steal from the others. Returns the number of files that could not be processed, or -1 on error.
+int run_batch(batch* batch, int num_workers, size_t block_size) {
+    num_workers = num_workers < batch->num_jobs ? num_workers : batch->num_jobs;
+    num_workers = num_workers < MAX_WORKERS ? num_workers : MAX_WORKERS;
+    num_workers = num_workers > 0 ? num_workers : 1;
+
+    // Allocate the workers and their block buffers, return -1 on error.
+    batch_run run = { batch, calloc(num_workers, sizeof(batch_worker)), num_workers, block_size, PTHREAD_MUTEX_INITIALIZER };
+    if (run.workers == NULL) {
+        print_message("Error allocating memory for workers.\n\n");
+        return -1;
+    }
+    for (int i = 0; i < num_workers; ++i) {
+        batch_worker* worker = run.workers + i;
+        worker->run = &run;
+        worker->index = i;
+        worker->next = (int)((long long)batch->num_jobs * i / num_workers);
+        worker->end = (int)((long long)batch->num_jobs * (i + 1) / num_workers);
+        worker->block = malloc(block_size * sizeof(char));
+        if (worker->block == NULL) {
+            print_message("Error allocating memory for block buffers.\n\n");
+            while (i > 0) {
+                --i;
+                free(run.workers[i].block);
+                pthread_mutex_destroy(&run.workers[i].lock);
+            }
+            free(run.workers);
+            return -1;
+        }
+        pthread_mutex_init(&worker->lock, NULL);
+    }
+
+    // Workers already process files in parallel, so the kernels run on a single thread each.
+    int num_threads = get_num_threads();
+    if (num_workers > 1) {
+        set_num_threads(1);
+    }
+
+    // Run the workers, using the calling thread as the first one.
+    double start = current_seconds();
+    for (int i = 1; i < num_workers; ++i) {
+        if (pthread_create(&run.workers[i].thread, NULL, run_worker, run.workers + i)) {
+            run.workers[i].thread = pthread_self();
+        }
+    }
+    run_worker(run.workers);
+    set_quiet_messages(0);
+    for (int i = 1; i < num_workers; ++i) {
+        if (!pthread_equal(run.workers[i].thread, pthread_self())) {
+            pthread_join(run.workers[i].thread, NULL);
+        }
+    }
+    double seconds = current_seconds() - start;
+    set_num_threads(num_threads);
+
+    // Display the batch summary.
+    int num_files = 0, num_failed = 0;
+    size_t chars_processed = 0;
+    for (int i = 0; i < num_workers; ++i) {
+        num_files += run.workers[i].num_files;
+        num_failed += run.workers[i].num_failed;
+        chars_processed += run.workers[i].chars_processed;
+        free(run.workers[i].block);
+        pthread_mutex_destroy(&run.workers[i].lock);
+    }
+    pthread_mutex_destroy(&run.report_lock);
+    free(run.workers);
+
+    printf("\nBatch stats:\n");
+    printf("Files:              %i (%i failed)\n", num_files, num_failed);
+    printf("Workers:            %i\n", num_workers);
+    printf("Input size:         %zu bytes\n", chars_processed);
+    printf("Time:               %.6f s\n", seconds);
+    printf("Files per second:   %.1f\n", seconds > 0 ? num_files / seconds : 0);
+    printf("Throughput:         %.1f MB/s\n\n", seconds > 0 ? chars_processed / seconds / 1e6 : 0);
+    return num_failed;
+}
+
+// A function for running batch mode from the command line:
+//   wave --batch manifest [-j workers] [-s block_size_in_kilobytes] [-i stdio|mmap|async]
+//   wave --batch-glob pattern directory [-j workers] [-s block_size_in_kilobytes] [-i stdio|mmap|async] [operations]
+// Returns the exit status of the process.
+int batch_main(int argc, char** argv) {
+    int glob_mode = !strcmp(*(argv + 1), "--batch-glob");
+    int first_arg = glob_mode ? 4 : 3;
+    if (argc < first_arg) {
+        printf(glob_mode ? "Must provide a pattern and an output directory\n" : "Must provide a manifest file name\n");
+        return 1;
+    }
+
+    // Take the number of workers out of the arguments, leaving the run options and the operations.
+    int num_workers = get_num_threads();
+    int num_args = 0;
+    char** args = malloc((argc - first_arg + 1) * sizeof(char*));
+    if (args == NULL) {
+        printf("Error allocating memory for arguments.\n\n");
+        return 1;
+    }
+    for (int i = first_arg; i < argc; ++i) {
+        if (!strcmp(*(argv + i), "-j") && i + 1 < argc) {
+            num_workers = atoi(*(argv + ++i));
+            if (num_workers <= 0) {
+                printf("Invalid number of workers. Using %i.\n\n", get_num_threads());
+                num_workers = get_num_threads();
+            }
+        } else {
+            args[num_args++] = *(argv + i);
+        }
+    }
+
+    // Batches always stream, so each worker only holds one block of a file at a time.
+    size_t block_size = parse_run_options(num_args, args);
+    block_size = block_size > 0 ? block_size : STREAM_DEFAULT_BLOCK_SIZE;
+
+    batch* batch = glob_mode ? glob_batch(*(argv + 2), *(argv + 3), num_args, args) : read_manifest(*(argv + 2));
+    free(args);
+    if (batch == NULL) {
+        return 1;
+    }
+    int num_failed = run_batch(batch, num_workers, block_size);
+    free_batch(batch);
+    return num_failed != 0;
+}
@@ -0,0 +1,40 @@
+#ifndef H_BATCH
+#define H_BATCH
+
+#include "process.h"
+
+// A file processed by a batch and the chain of operations performed on it.
+typedef struct batch_job {
+    char* source_file_name;
+    char* destination_file_name;
+    int num_args;
+    char** args;
+
+    // the file names followed by the operations, which the job owns
+    char** words;
+} batch_job;
+
+// A struct holding the files processed by a batch.
+typedef struct batch {
+    batch_job* jobs;
+    int num_jobs;
+    int job_capacity;
+} batch;
+
+// A function for reading a batch from a manifest with a line of "input output [operations]" for each file.
+batch* read_manifest(char* file_name);
+
+// A function for creating a batch of every file matching a pattern, written to a directory with the same operations.
+batch* glob_batch(char* pattern, char* directory, int num_args, char** args);
+
+// A function for freeing a batch.
+void free_batch(batch* batch);
+
+// A function for processing the files of a batch on a pool of worker threads, streaming each file in blocks
+// of block_size chars. Returns the number of files that could not be processed.
+int run_batch(batch* batch, int num_workers, size_t block_size);
+
+// A function for running batch mode from the command line.
+int batch_main(int argc, char** argv);
+
+#endif
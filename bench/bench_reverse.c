@@ -0,0 +1,102 @@
+// Benchmark comparing reverse_frames with the original per-frame reverse_audio loop.
+//
+// Build from the repository root:
+//   gcc -O2 -I. -o bench_reverse bench/bench_reverse.c reverse.c parallel.c -lpthread
+//
+// Usage: bench_reverse [buffer_size_in_megabytes] [repetitions]
+//        bench_reverse --check
+//
+// --check reverses each frame width once on a buffer large enough to be split between threads, without timing
+// it, and only reports the widths whose output differs. make test runs it. The exit status is 1 if an output
+// differs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parallel.h"
+#include "reverse.h"
+
+// The original implementation of reverse_audio, kept as the reference.
+static void reverse_reference(char* source, int num_samples, int sample_size) {
+    char* temp_sample = malloc(sample_size * sizeof(char));
+    for (int i = 0; i < num_samples / 2; ++i) {
+        memcpy(temp_sample, source + i * sample_size, sample_size);
+        memcpy(source + i * sample_size, source + (num_samples - i - 1) * sample_size, sample_size);
+        memcpy(source + (num_samples - i - 1) * sample_size, temp_sample, sample_size);
+    }
+    free(temp_sample);
+}
+
+int main(int argc, char** argv) {
+    int check = argc > 1 && !strcmp(argv[1], "--check");
+    size_t buffer_size = check ? 16 << 20 : (argc > 1 ? strtoul(argv[1], NULL, 10) : 64) << 20;
+    int repetitions = check ? 1 : argc > 2 ? atoi(argv[2]) : 3;
+    if (buffer_size == 0 || repetitions <= 0) {
+        printf("Usage: bench_reverse [buffer_size_in_megabytes] [repetitions]\n");
+        printf("       bench_reverse --check\n");
+        return 1;
+    }
+
+    // Fill the buffers with a pattern that differs in every char of a frame.
+    char* original = malloc(buffer_size);
+    char* reference = malloc(buffer_size);
+    char* reversed = malloc(buffer_size);
+    if (original == NULL || reference == NULL || reversed == NULL) {
+        printf("Error allocating memory for buffers.\n");
+        return 1;
+    }
+    srand(1);
+    for (size_t i = 0; i < buffer_size; ++i) {
+        original[i] = rand();
+    }
+
+    // Frame widths of 2, 4, 6 and 8 chars and 16, 24 and 32-bit samples with 1 to 8 channels.
+    int frame_sizes[] = { 2, 3, 4, 6, 8, 9, 10, 12, 14, 15, 16, 18, 20, 21, 24, 28, 32 };
+    int num_frame_sizes = sizeof(frame_sizes) / sizeof(frame_sizes[0]);
+
+    if (!check) {
+        printf("buffer %zu MB, %d threads, best of %d\n\n", buffer_size >> 20, get_num_threads(), repetitions);
+        printf("frame  reference GB/s  kernel GB/s  speedup  output\n");
+    }
+    int failures = 0;
+    for (int f = 0; f < num_frame_sizes; ++f) {
+        int frame_size = frame_sizes[f];
+
+        // Use an odd number of frames so the middle frame and the partial blocks are exercised.
+        size_t num_frames = buffer_size / frame_size;
+        num_frames -= num_frames % 2 == 0;
+
+        double reference_seconds = 1e30, kernel_seconds = 1e30;
+        for (int r = 0; r < repetitions; ++r) {
+            memcpy(reference, original, buffer_size);
+            double start = current_seconds();
+            reverse_reference(reference, num_frames, frame_size);
+            double elapsed = current_seconds() - start;
+            reference_seconds = elapsed < reference_seconds ? elapsed : reference_seconds;
+
+            memcpy(reversed, original, buffer_size);
+            start = current_seconds();
+            reverse_frames(reversed, num_frames, frame_size);
+            elapsed = current_seconds() - start;
+            kernel_seconds = elapsed < kernel_seconds ? elapsed : kernel_seconds;
+        }
+
+        int identical = !memcmp(reference, reversed, buffer_size);
+        failures += !identical;
+        double bytes = (double)num_frames * frame_size;
+        if (check && !identical) {
+            printf("bench_reverse: frame size %d is DIFFERENT\n", frame_size);
+        } else if (!check) {
+            printf("%5d  %14.2f  %11.2f  %6.1fx  %s\n", frame_size, bytes / reference_seconds / 1e9,
+                   bytes / kernel_seconds / 1e9, reference_seconds / kernel_seconds, identical ? "identical" : "DIFFERENT");
+        }
+    }
+    if (check) {
+        printf("bench_reverse: %d of %d frame sizes identical\n", num_frame_sizes - failures, num_frame_sizes);
+    }
+
+    free(original);
+    free(reference);
+    free(reversed);
+    return failures != 0;
+}
@@ -0,0 +1,215 @@
+// Benchmark comparing decode_frames and encode_frames with per-sample reference loops for each sample encoding.
+//
+// Build from the repository root:
+//   gcc -O2 -I. -o bench_sample bench/bench_sample.c sample.c -lm -lpthread
+//
+// Usage: bench_sample [buffer_size_in_megabytes] [repetitions]
+//        bench_sample --check
+//
+// --check decodes and encodes each encoding and channel count once on a small buffer, without timing them, and
+// only reports the ones whose output differs. make test runs it. The exit status is 1 if an output differs.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sample.h"
+
+// Function for converting a float sample to an integer of a given range, as the original encode_frames did.
+static int32_t quantize_reference(float sample, float scale, int32_t minimum, int32_t maximum) {
+    float scaled = sample * scale;
+    if (scaled >= (float)maximum) {
+        return maximum;
+    }
+    if (scaled <= (float)minimum) {
+        return minimum;
+    }
+    return (int32_t)lrintf(scaled);
+}
+
+// The original per-channel decode_frames loops, with float samples added, kept as the reference.
+static void decode_reference(unsigned char* source, float* destination, size_t num_frames, int num_channels,
+                             int encoding, size_t stride) {
+    int sample_size = encoding_size(encoding);
+    size_t frame_size = (size_t)sample_size * num_channels;
+    for (int c = 0; c < num_channels; ++c) {
+        for (size_t i = 0; i < num_frames; ++i) {
+            unsigned char* in = source + i * frame_size + c * sample_size;
+            float* out = destination + c * stride + i;
+            int16_t s16;
+            int32_t s32;
+            double f64;
+            switch (encoding) {
+                case SAMPLE_U8:
+                    *out = (in[0] - 128) * (1.0f / 128);
+                    break;
+                case SAMPLE_S16:
+                    memcpy(&s16, in, 2);
+                    *out = s16 * (1.0f / 32768);
+                    break;
+                case SAMPLE_S24:
+                    s32 = (int32_t)((uint32_t)in[0] << 8 | (uint32_t)in[1] << 16 | (uint32_t)in[2] << 24) >> 8;
+                    *out = s32 * (1.0f / 8388608);
+                    break;
+                case SAMPLE_S32:
+                    memcpy(&s32, in, 4);
+                    *out = s32 * (1.0f / 2147483648.0f);
+                    break;
+                case SAMPLE_F32:
+                    memcpy(out, in, 4);
+                    break;
+                default:
+                    memcpy(&f64, in, 8);
+                    *out = (float)f64;
+                    break;
+            }
+        }
+    }
+}
+
+// The original per-channel encode_frames loops, with float samples added, kept as the reference.
+static void encode_reference(float* source, unsigned char* destination, size_t num_frames, int num_channels,
+                             int encoding, size_t stride) {
+    int sample_size = encoding_size(encoding);
+    size_t frame_size = (size_t)sample_size * num_channels;
+    for (int c = 0; c < num_channels; ++c) {
+        for (size_t i = 0; i < num_frames; ++i) {
+            float in = source[c * stride + i];
+            unsigned char* out = destination + i * frame_size + c * sample_size;
+            int16_t s16;
+            int32_t s32;
+            double scaled;
+            switch (encoding) {
+                case SAMPLE_U8:
+                    out[0] = quantize_reference(in, 128, -128, 127) + 128;
+                    break;
+                case SAMPLE_S16:
+                    s16 = quantize_reference(in, 32768, -32768, 32767);
+                    memcpy(out, &s16, 2);
+                    break;
+                case SAMPLE_S24:
+                    s32 = quantize_reference(in, 8388608, -8388608, 8388607);
+                    out[0] = s32;
+                    out[1] = s32 >> 8;
+                    out[2] = s32 >> 16;
+                    break;
+                case SAMPLE_S32:
+                    scaled = in * 2147483648.0;
+                    s32 = scaled >= 2147483647.0 ? INT32_MAX : scaled <= -2147483648.0 ? INT32_MIN : (int32_t)lrint(scaled);
+                    memcpy(out, &s32, 4);
+                    break;
+                case SAMPLE_F32:
+                    memcpy(out, &in, 4);
+                    break;
+                default:
+                    scaled = in;
+                    memcpy(out, &scaled, 8);
+                    break;
+            }
+        }
+    }
+}
+
+// Function for reading a monotonic clock in seconds.
+static double current_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** argv) {
+    int check = argc > 1 && !strcmp(argv[1], "--check");
+    size_t buffer_size = check ? 1 << 20 : (argc > 1 ? strtoul(argv[1], NULL, 10) : 16) << 20;
+    int repetitions = check ? 1 : argc > 2 ? atoi(argv[2]) : 3;
+    if (buffer_size == 0 || repetitions <= 0) {
+        printf("Usage: bench_sample [buffer_size_in_megabytes] [repetitions]\n");
+        printf("       bench_sample --check\n");
+        return 1;
+    }
+
+    // The planar float buffers hold a sample for each char of the frames, which covers every encoding.
+    unsigned char* frames = malloc(buffer_size);
+    unsigned char* reference_frames = malloc(buffer_size);
+    unsigned char* kernel_frames = malloc(buffer_size);
+    float* samples = malloc(buffer_size * sizeof(float));
+    float* reference_samples = malloc(buffer_size * sizeof(float));
+    float* kernel_samples = malloc(buffer_size * sizeof(float));
+    if (frames == NULL || reference_frames == NULL || kernel_frames == NULL || samples == NULL ||
+        reference_samples == NULL || kernel_samples == NULL) {
+        printf("Error allocating memory for buffers.\n");
+        return 1;
+    }
+
+    // Float samples slightly past full scale exercise clipping, and every 64th sample is an exact edge value.
+    static const float edges[] = { 1.0f, -1.0f, 0.5f / 32768, -0.5f / 32768, 1.5f / 32768, 0.0f, 0.999999f, -1.000001f };
+    srand(1);
+    for (size_t i = 0; i < buffer_size; ++i) {
+        samples[i] = i % 64 == 0 ? edges[(i / 64) % 8] : (rand() / (float)RAND_MAX) * 2.4f - 1.2f;
+    }
+
+    if (!check) {
+        printf("buffer %zu MB, best of %d, GB/s of encoded samples\n\n", buffer_size >> 20, repetitions);
+        printf("encoding       channels  decode ref  decode kernel  encode ref  encode kernel  output\n");
+    }
+    int channel_counts[] = { 1, 2, 6 };
+    int failures = 0, num_checked = 0;
+    for (int encoding = SAMPLE_U8; encoding <= SAMPLE_F64; ++encoding) {
+        for (int k = 0; k < 3; ++k) {
+            int num_channels = channel_counts[k];
+            int sample_size = encoding_size(encoding);
+
+            // Use an odd number of frames so the samples left over by the vector kernels are exercised.
+            size_t num_frames = buffer_size / ((size_t)sample_size * num_channels);
+            num_frames -= num_frames % 2 == 0;
+            size_t frames_size = num_frames * sample_size * num_channels;
+
+            // Encoded frames come from the float samples, so float frames hold values past full scale.
+            encode_reference(samples, frames, num_frames, num_channels, encoding, num_frames);
+
+            double times[4] = { 1e30, 1e30, 1e30, 1e30 };
+            for (int r = 0; r < repetitions; ++r) {
+                double start = current_seconds();
+                decode_reference(frames, reference_samples, num_frames, num_channels, encoding, num_frames);
+                double split = current_seconds();
+                decode_frames((char*)frames, kernel_samples, num_frames, num_channels, encoding, num_frames);
+                double end = current_seconds();
+                times[0] = split - start < times[0] ? split - start : times[0];
+                times[1] = end - split < times[1] ? end - split : times[1];
+
+                start = current_seconds();
+                encode_reference(samples, reference_frames, num_frames, num_channels, encoding, num_frames);
+                split = current_seconds();
+                encode_frames(samples, (char*)kernel_frames, num_frames, num_channels, encoding, num_frames);
+                end = current_seconds();
+                times[2] = split - start < times[2] ? split - start : times[2];
+                times[3] = end - split < times[3] ? end - split : times[3];
+            }
+
+            size_t num_samples = num_frames * num_channels;
+            int identical = !memcmp(reference_samples, kernel_samples, num_samples * sizeof(float)) &&
+                            !memcmp(reference_frames, kernel_frames, frames_size);
+            failures += !identical;
+            ++num_checked;
+            if (check && !identical) {
+                printf("bench_sample: %s with %d channels is DIFFERENT\n", encoding_name(encoding), num_channels);
+            } else if (!check) {
+                printf("%-13s  %8d  %10.2f  %13.2f  %10.2f  %13.2f  %s\n", encoding_name(encoding), num_channels,
+                       frames_size / times[0] / 1e9, frames_size / times[1] / 1e9, frames_size / times[2] / 1e9,
+                       frames_size / times[3] / 1e9, identical ? "identical" : "DIFFERENT");
+            }
+        }
+    }
+    if (check) {
+        printf("bench_sample: %d of %d encodings and channel counts identical\n", num_checked - failures, num_checked);
+    }
+
+    free(frames);
+    free(reference_frames);
+    free(kernel_frames);
+    free(samples);
+    free(reference_samples);
+    free(kernel_samples);
+    return failures != 0;
+}
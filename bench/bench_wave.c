@@ -0,0 +1,695 @@
+// Benchmark timing the wav file operations of libwave on a corpus of generated wav files. Files are made for
+// each combination of sample format, channel count, duration and layout: plain, with metadata chunks before and
+// after the audio, or with embedded files. Each operation is timed over several repetitions and reported with
+// its median and 99th percentile time, throughput and peak memory as CSV or JSON lines. Files of 4 GB or more
+// are written as RF64 files.
+//
+// Build from the repository root:
+//   make bench
+//
+// Usage: bench_wave [-d corpus_directory] [-n repetitions] [-b formats] [-c channel_counts] [-t durations]
+//                   [-l layouts] [-o operations] [-i stdio|mmap] [--format=csv|json] [--check]
+//
+// Lists are comma-separated, such as -b 16,24,32f -c 1,2,6 -t 1,60,20000 -l plain,metadata,embedded or
+// -o load,reverse,stream_copy. Generated files are kept in the corpus directory and reused by later runs, and
+// files too large to hold in memory can be timed with the stream operations alone. The exit status is 1 if an
+// operation failed.
+//
+// --check performs each of a few chains of operations on each corpus file in memory and streamed in small
+// blocks, and compares the files written, walks their chunks and counts their frames instead of timing
+// operations. It also reverses each corpus file twice and compares the result with the file. make test runs it.
+// The exit status is 1 if a check fails.
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "libwave.h"
+#include "parallel.h"
+
+// The sample rate of the generated files.
+#define SAMPLE_RATE 48000
+
+// The number of frames generated at a time.
+#define GENERATE_FRAMES 65536
+
+// The sizes of the metadata chunks before and after the audio data, and of the embedded files.
+#define INFO_SIZE 1000
+#define TRAILER_SIZE 2048
+#define EMBEDDED_SIZE (1 << 20)
+
+// The most items in a comma-separated list.
+#define MAX_LIST 16
+
+// The block size of the files streamed by --check, small enough that blocks end inside frames.
+#define CHECK_BLOCK_SIZE 4000
+
+// Layouts of the generated files.
+enum layout { LAYOUT_PLAIN, LAYOUT_METADATA, LAYOUT_EMBEDDED };
+static char* layout_names[] = { "plain", "metadata", "embedded" };
+
+// Operations that are timed, with the chars each one processes: the audio data or the whole file.
+enum bench_operation {
+    BENCH_LOAD, BENCH_PARSE, BENCH_REVERSE, BENCH_STRETCH_NEAREST, BENCH_STRETCH_LINEAR, BENCH_STRETCH_WSOLA,
+    BENCH_CONVERT, BENCH_RESAMPLE, BENCH_ANALYZE, BENCH_REMOVE_METADATA, BENCH_EMBED, BENCH_WRITE, BENCH_STREAM_COPY,
+    BENCH_STREAM_STRETCH, BENCH_STREAM_TRIM, NUM_BENCH_OPERATIONS
+};
+static char* operation_names[] = {
+    "load", "parse", "reverse", "stretch_nearest", "stretch_linear", "stretch_wsola", "convert", "resample", "analyze",
+    "remove_metadata", "embed", "write", "stream_copy", "stream_stretch",
+    "stream_trim"
+};
+static int operation_uses_file[] = { 1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1 };
+
+// A chain of operations that --check performs on each corpus file in memory and streamed, with the number of
+// frames of the file written: a multiple of the frames of the corpus file and a number of seconds of audio.
+typedef struct chain_check {
+    char* chain;
+    double frames_multiple;
+    double seconds;
+} chain_check;
+static chain_check check_chains[] = {
+    { "-t -1", 1, 0 }, { "-t 2", 2, 0 }, { "--interp=linear -t 0.75", 0.75, 0 }, { "--stretch=wsola -t 1.25", 1.25, 0 },
+    { "-b 32f -c 1", 1, 0 }, { "-f 44100", 44100.0 / SAMPLE_RATE, 0 }, { "--trim 0.25:0.75", 0, 0.5 },
+    { "--trim 0:0.5000292", 0, 0.5000292 }, { "--trim 0:0.5000292 -b 24 -c 1", 0, 0.5000292 },
+    { "--analyze -m", 1, 0 }, { "-t -1 -t 0.7 --checksum", 0.7, 0 }
+};
+
+// A generated wav file and the parameters it was made from.
+typedef struct corpus_file {
+    char name[512];
+    int encoding;
+    int num_channels;
+    double seconds;
+    int layout;
+    off_t file_size;
+    off_t data_size;
+} corpus_file;
+
+// Settings of a benchmark run.
+typedef struct bench_settings {
+    char* directory;
+    int repetitions;
+    int json;
+    char embedded_name[512];
+    char output_name[512];
+    char streamed_name[512];
+    int check;
+} bench_settings;
+
+// Function for resetting the peak resident memory of the process, where the kernel supports it.
+static void reset_peak_memory() {
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (file != NULL) {
+        fputs("5", file);
+        fclose(file);
+    }
+}
+
+// Function for reading the peak resident memory of the process in kilobytes since it was last reset, or since
+// the process started where the kernel cannot reset it.
+static long peak_memory() {
+    FILE* file = fopen("/proc/self/status", "r");
+    char line[256];
+    long kilobytes = -1;
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+        if (!strncmp(line, "VmHWM:", 6)) {
+            kilobytes = strtol(line + 6, NULL, 10);
+            break;
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (kilobytes == -1) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        kilobytes = usage.ru_maxrss;
+    }
+    return kilobytes;
+}
+
+// Function for comparing two times for sorting.
+static int compare_times(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Function for splitting a comma-separated list in place.
+// Returns the number of items.
+static int split_list(char* list, char** items) {
+    int num_items = 0;
+    for (char* item = strtok(list, ","); item != NULL && num_items < MAX_LIST; item = strtok(NULL, ",")) {
+        items[num_items++] = item;
+    }
+    return num_items;
+}
+
+// Function for writing chars to a generated file.
+// Returns -1 if there is an error.
+static int write_all(FILE* file, const void* chars, size_t size) {
+    return fwrite(chars, 1, size, file) == size ? 0 : -1;
+}
+
+// Function for writing a 32-bit little-endian number to a generated file.
+// Returns -1 if there is an error.
+static int write_u32(FILE* file, uint32_t value) {
+    return write_all(file, &value, 4);
+}
+
+// Function for writing a file of chars that compress a little, to embed in the generated files.
+// Returns -1 if there is an error.
+static int write_embedded_file(char* name) {
+    FILE* file = fopen(name, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+    srand(1);
+    int result = 0;
+    for (int i = 0; i < EMBEDDED_SIZE && result == 0; ++i) {
+        result = fputc(i % 3 == 0 ? rand() : 'a' + i % 26, file) == EOF ? -1 : 0;
+    }
+    return fclose(file) == 0 ? result : -1;
+}
+
+// Function for writing a generated wav file of tones, one for each channel, with a little noise. Files with
+// metadata have a "LIST" chunk before the audio data and an "id3 " chunk after it.
+// Returns -1 if there is an error.
+static int generate_wav_file(corpus_file* corpus, char* name, int metadata) {
+    int sample_size = encoding_size(corpus->encoding);
+    int num_channels = corpus->num_channels;
+    uint64_t num_frames = (uint64_t)(corpus->seconds * SAMPLE_RATE);
+    uint64_t data_size = num_frames * sample_size * num_channels;
+    uint64_t chunk_size = 4 + 24 + 8 + data_size + data_size % 2 + (metadata ? 8 + 4 + 8 + INFO_SIZE + 8 + TRAILER_SIZE : 0);
+    int rf64 = chunk_size + 36 >= 0xFFFFFFFFu || data_size >= 0xFFFFFFFFu;
+    chunk_size += rf64 ? 36 : 0;
+
+    FILE* file = fopen(name, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    // Write the RIFF header, any "ds64" chunk and the "fmt " chunk.
+    int is_float = corpus->encoding == SAMPLE_F32 || corpus->encoding == SAMPLE_F64;
+    int result = write_all(file, rf64 ? "RF64" : "RIFF", 4) | write_u32(file, rf64 ? 0xFFFFFFFFu : chunk_size) |
+                 write_all(file, "WAVE", 4);
+    if (rf64) {
+        uint32_t table_length = 0;
+        result |= write_all(file, "ds64", 4) | write_u32(file, 28) | write_all(file, &chunk_size, 8) |
+                  write_all(file, &data_size, 8) | write_all(file, &num_frames, 8) | write_all(file, &table_length, 4);
+    }
+    short format[] = { is_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM, num_channels };
+    short alignment[] = { sample_size * num_channels, sample_size * 8 };
+    result |= write_all(file, "fmt ", 4) | write_u32(file, 16) | write_all(file, format, 4) | write_u32(file, SAMPLE_RATE) |
+              write_u32(file, SAMPLE_RATE * sample_size * num_channels) | write_all(file, alignment, 4);
+
+    // Write the "LIST" chunk of a file with metadata.
+    if (metadata) {
+        char comment[INFO_SIZE];
+        memset(comment, 'm', INFO_SIZE);
+        result |= write_all(file, "LIST", 4) | write_u32(file, 4 + 8 + INFO_SIZE) | write_all(file, "INFOICMT", 8) |
+                  write_u32(file, INFO_SIZE) | write_all(file, comment, INFO_SIZE);
+    }
+
+    // Generate and write the audio data a block of frames at a time.
+    result |= write_all(file, "data", 4) | write_u32(file, rf64 ? 0xFFFFFFFFu : data_size);
+    float* samples = malloc((size_t)GENERATE_FRAMES * num_channels * sizeof(float));
+    char* frames = malloc((size_t)GENERATE_FRAMES * num_channels * sample_size);
+    result |= samples == NULL || frames == NULL ? -1 : 0;
+    srand(2);
+    for (uint64_t first = 0; first < num_frames && result == 0; first += GENERATE_FRAMES) {
+        size_t count = num_frames - first < GENERATE_FRAMES ? num_frames - first : GENERATE_FRAMES;
+        for (int c = 0; c < num_channels; ++c) {
+            double step = 2 * M_PI * 220 * (c + 1) / SAMPLE_RATE;
+            for (size_t i = 0; i < count; ++i) {
+                float noise = (rand() / (float)RAND_MAX - 0.5f) * 0.01f;
+                samples[c * count + i] = 0.5f * (float)sin(step * (double)((first + i) % (SAMPLE_RATE * 10))) + noise;
+            }
+        }
+        encode_frames(samples, frames, count, num_channels, corpus->encoding, count);
+        result = write_all(file, frames, count * num_channels * sample_size);
+    }
+    free(samples);
+    free(frames);
+    if (data_size % 2) {
+        result |= write_all(file, "", 1);
+    }
+
+    // Write the "id3 " chunk of a file with metadata.
+    if (metadata) {
+        char trailer[TRAILER_SIZE] = { 0 };
+        result |= write_all(file, "id3 ", 4) | write_u32(file, TRAILER_SIZE) | write_all(file, trailer, TRAILER_SIZE);
+    }
+    return fclose(file) == 0 && result == 0 ? 0 : -1;
+}
+
+// Function for making a corpus file unless a file of its name exists, and reading its sizes. Files with
+// embedded files are made by streaming a plain file and embedding a compressed and an uncompressed file.
+// Returns -1 if there is an error.
+static int make_corpus_file(corpus_file* corpus, bench_settings* settings) {
+    static char* format_tags[] = { "", "u8", "s16", "s24", "s32", "f32", "f64" };
+    snprintf(corpus->name, sizeof(corpus->name), "%s/%s_%ich_%gs_%s.wav", settings->directory,
+             format_tags[corpus->encoding], corpus->num_channels, corpus->seconds, layout_names[corpus->layout]);
+
+    struct stat status;
+    if (stat(corpus->name, &status) == -1) {
+        fprintf(stderr, "Generating %s\n", corpus->name);
+        int result;
+        if (corpus->layout != LAYOUT_EMBEDDED) {
+            result = generate_wav_file(corpus, corpus->name, corpus->layout == LAYOUT_METADATA);
+        } else {
+            char plain_name[600];
+            snprintf(plain_name, sizeof(plain_name), "%s.plain", corpus->name);
+            stream_file* stream = NULL;
+            result = generate_wav_file(corpus, plain_name, 0);
+            if (result == 0) {
+                stream = stream_open(plain_name, STREAM_DEFAULT_BLOCK_SIZE);
+            }
+            result = stream != NULL && stream_push_back_file(stream, settings->embedded_name, COMPRESSION_NONE) == 0 &&
+                     stream_push_back_file(stream, settings->embedded_name, COMPRESSION_LZ_CHECKSUMS) == 0 &&
+                     stream_write(stream, corpus->name) == 0 ? 0 : -1;
+            if (stream != NULL) {
+                stream_close(stream);
+            }
+            remove(plain_name);
+        }
+        if (result == -1 || stat(corpus->name, &status) == -1) {
+            fprintf(stderr, "Error generating %s\n", corpus->name);
+            return -1;
+        }
+    }
+    corpus->file_size = status.st_size;
+    return 0;
+}
+
+// Function for performing an operation once on a corpus file, timing only the operation itself.
+// Returns the time in seconds, or -1 if there is an error.
+static double time_operation(int operation, corpus_file* corpus, bench_settings* settings, wave_context* context) {
+    char* name = corpus->name;
+    double start;
+    int result = 0;
+
+    // Operations on a file held in memory start from a freshly loaded file.
+    if (operation != BENCH_LOAD && operation != BENCH_PARSE && operation < BENCH_STREAM_COPY &&
+            load_wave_file(context, name) == -1) {
+        return -1;
+    }
+    wav_file* wav = context->wav;
+
+    if (operation == BENCH_LOAD) {
+        start = current_seconds();
+        result = load_wave_file(context, name);
+    } else if (operation == BENCH_PARSE) {
+        size_t size;
+        char* contents = read_wav_file(name, &size);
+        if (contents == NULL) {
+            return -1;
+        }
+        start = current_seconds();
+        wav_file* parsed = parse(contents);
+        double end = current_seconds();
+        if (parsed != NULL) {
+            free_wav(parsed);
+        }
+        free_file(contents);
+        return parsed != NULL ? end - start : -1;
+    } else if (operation == BENCH_REVERSE) {
+        start = current_seconds();
+        reverse_audio(wav->data_pointer, wav->num_all_channel_samples, wav->all_channel_sample_size_in_bytes);
+    } else if (operation == BENCH_STRETCH_NEAREST) {
+        start = current_seconds();
+        result = stretch_audio(context, 2, INTERPOLATION_NEAREST, STRETCH_RESAMPLE);
+    } else if (operation == BENCH_STRETCH_LINEAR) {
+        start = current_seconds();
+        result = stretch_audio(context, 0.75, INTERPOLATION_LINEAR, STRETCH_RESAMPLE);
+    } else if (operation == BENCH_STRETCH_WSOLA) {
+        start = current_seconds();
+        result = stretch_audio(context, 1.25, INTERPOLATION_NEAREST, STRETCH_WSOLA);
+    } else if (operation == BENCH_CONVERT) {
+        int encoding = wav->encoding == SAMPLE_S16 ? SAMPLE_S24 : SAMPLE_S16;
+        start = current_seconds();
+        result = convert_audio(context, encoding, NULL, DITHER_NONE);
+    } else if (operation == BENCH_RESAMPLE) {
+        start = current_seconds();
+        result = resample_audio(context, 44100);
+    } else if (operation == BENCH_ANALYZE) {
+        start = current_seconds();
+        result = analyze_audio(context, NULL);
+    } else if (operation == BENCH_REMOVE_METADATA) {
+        start = current_seconds();
+        result = remove_metadata(context);
+    } else if (operation == BENCH_EMBED) {
+        start = current_seconds();
+        result = push_back_file(context, settings->embedded_name, COMPRESSION_NONE);
+    } else if (operation == BENCH_WRITE) {
+        start = current_seconds();
+        result = write_wave_file(context, settings->output_name);
+    } else {
+        start = current_seconds();
+        stream_file* stream = stream_open(name, STREAM_DEFAULT_BLOCK_SIZE);
+        if (stream == NULL) {
+            return -1;
+        }
+        if (operation == BENCH_STREAM_STRETCH) {
+            result = stream_stretch_audio(stream, 2, INTERPOLATION_NEAREST, STRETCH_RESAMPLE);
+        } else if (operation == BENCH_STREAM_TRIM) {
+            size_t num_frames = stream->wav.num_all_channel_samples;
+            result = stream_trim_audio(stream, num_frames / 2, num_frames / 10);
+        }
+        result = result == 0 ? stream_write(stream, settings->output_name) : -1;
+        stream_close(stream);
+    }
+    double end = current_seconds();
+    return result == 0 ? end - start : -1;
+}
+
+// Function for determining whether two files hold the same chars.
+// Returns 1 if they do.
+static int same_files(char* name, char* other_name) {
+    FILE* file = fopen(name, "rb");
+    FILE* other = fopen(other_name, "rb");
+    int same = file != NULL && other != NULL;
+    char chars[65536], other_chars[65536];
+    while (same) {
+        size_t count = fread(chars, 1, sizeof(chars), file);
+        same = fread(other_chars, 1, sizeof(other_chars), other) == count && !memcmp(chars, other_chars, count);
+        if (count < sizeof(chars)) {
+            break;
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (other != NULL) {
+        fclose(other);
+    }
+    return same;
+}
+
+// Function for walking the chunks of a written wav file, checking that the RIFF size is the file size less the
+// RIFF header, that every chunk starts at an even position after the pad byte of an odd-sized chunk before it,
+// and that every directory entry is the position of a "file" or "zfil" chunk after the end of the data chunk.
+// RF64 files are not walked.
+// Returns NULL if the chunks are laid out correctly, or a description of the first fault.
+static char* check_chunks(char* name) {
+    FILE* file = fopen(name, "rb");
+    long size = file != NULL && fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    char* chars = size >= 12 ? malloc(size) : NULL;
+    int read = chars != NULL && fseek(file, 0, SEEK_SET) == 0 && fread(chars, 1, size, file) == (size_t)size;
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (!read || memcmp(chars, "RIFF", 4)) {
+        free(chars);
+        return read || size < 0 ? NULL : "the file cannot be read";
+    }
+
+    // Walk the chunks, recording the end of the data chunk and the directory chunk.
+    char* fault = NULL;
+    uint32_t riff_size, chunk_size;
+    memcpy(&riff_size, chars + 4, 4);
+    long data_end = -1, directory_position = -1, position = 12;
+    if (riff_size != (uint64_t)size - 8) {
+        fault = "the RIFF size is not the file size less 8";
+    }
+    for (; position + 8 <= size && fault == NULL; position += 8 + chunk_size + chunk_size % 2) {
+        memcpy(&chunk_size, chars + position + 4, 4);
+        if (position % 2 != 0) {
+            fault = "a chunk starts at an odd position";
+        } else if (!memcmp(chars + position, "data", 4)) {
+            data_end = position + 8 + chunk_size + chunk_size % 2;
+        } else if (!memcmp(chars + position, "fdir", 4)) {
+            directory_position = position;
+        }
+    }
+    if (fault == NULL && position != size) {
+        fault = "the chunks do not end at the end of the file";
+    }
+
+    // Find the chunk of each directory entry.
+    file_directory* directory = NULL;
+    if (fault == NULL && directory_position != -1) {
+        memcpy(&chunk_size, chars + directory_position + 4, 4);
+        directory = parse_directory(chars + directory_position + 8, chunk_size);
+        fault = directory == NULL ? "the directory cannot be parsed" : NULL;
+    }
+    for (int i = 0; directory != NULL && i < directory->num_entries && fault == NULL; ++i) {
+        long entry_position = data_end + directory->entries[i].offset;
+        if (entry_position < 0 || entry_position + 8 > size || !is_embedded_chunk(chars + entry_position)) {
+            fault = "a directory entry is not the position of an embedded file";
+        }
+    }
+    if (directory != NULL) {
+        free_directory(directory);
+    }
+    free(chars);
+    return fault;
+}
+
+// Function for counting the frames of a wav file.
+// Returns -1 if there is an error.
+static off_t count_frames(char* name) {
+    wav_summary* summary = inspect_wave_file(name);
+    if (summary == NULL) {
+        return -1;
+    }
+    off_t num_frames = summary->wav.block_alignment > 0 ? summary->wav.data_size / summary->wav.block_alignment : -1;
+    free_summary(summary);
+    return num_frames;
+}
+
+// Function for performing a chain of operations on a corpus file in memory and streamed, and comparing the files
+// written, reporting chains whose files differ, are laid out incorrectly or have a frame count more than a frame
+// from the chain's.
+// Returns -1 if the files differ or there is an error.
+static int check_chain(chain_check* check, corpus_file* corpus, bench_settings* settings) {
+    char* chain = check->chain;
+    char chain_copy[256];
+    char* args[MAX_LIST];
+    int num_args = 0;
+    snprintf(chain_copy, sizeof(chain_copy), "%s", chain);
+    for (char* arg = strtok(chain_copy, " "); arg != NULL && num_args < MAX_LIST; arg = strtok(NULL, " ")) {
+        args[num_args++] = arg;
+    }
+
+    char* fault;
+    int result = process_file(corpus->name, settings->output_name, num_args, args, 0, NULL, NULL, NULL);
+    if (result == 0) {
+        result = process_file(corpus->name, settings->streamed_name, num_args, args, CHECK_BLOCK_SIZE, NULL, NULL, NULL);
+    }
+    if (result == -1) {
+        printf("bench_wave: %s [%s] failed: %s", corpus->name, chain, get_last_message());
+    } else if (!same_files(settings->output_name, settings->streamed_name)) {
+        printf("bench_wave: %s [%s] is DIFFERENT in memory and streamed\n", corpus->name, chain);
+        result = -1;
+    } else if ((fault = check_chunks(settings->output_name)) != NULL) {
+        printf("bench_wave: %s [%s] is malformed: %s\n", corpus->name, chain, fault);
+        result = -1;
+    } else {
+        double num_frames = check->frames_multiple * (double)(off_t)(corpus->seconds * SAMPLE_RATE) +
+                            check->seconds * SAMPLE_RATE;
+        off_t written_frames = count_frames(settings->output_name);
+        if (fabs(written_frames - num_frames) > 1) {
+            printf("bench_wave: %s [%s] has %lld frames instead of %.0f\n", corpus->name, chain,
+                   (long long)written_frames, num_frames);
+            result = -1;
+        }
+    }
+    fflush(stdout);
+    return result;
+}
+
+// Function for reversing a corpus file in memory and reversing the file written again streamed, and comparing
+// the file written last with the corpus file, reporting a round trip that does not give the corpus file back.
+// Returns -1 if the files differ or there is an error.
+static int check_round_trip(corpus_file* corpus, bench_settings* settings) {
+    char* args[] = { "-t", "-1" };
+    int result = process_file(corpus->name, settings->output_name, 2, args, 0, NULL, NULL, NULL);
+    if (result == 0) {
+        result = process_file(settings->output_name, settings->streamed_name, 2, args, CHECK_BLOCK_SIZE, NULL, NULL, NULL);
+    }
+    if (result == -1) {
+        printf("bench_wave: %s [reversed twice] failed: %s", corpus->name, get_last_message());
+    } else if (!same_files(corpus->name, settings->streamed_name)) {
+        printf("bench_wave: %s [reversed twice] is DIFFERENT from the corpus file\n", corpus->name);
+        result = -1;
+    }
+    fflush(stdout);
+    return result;
+}
+
+// Function for timing an operation on a corpus file and printing the result as a CSV line or a JSON object.
+// Returns -1 if the operation failed.
+static int bench_operation(int operation, corpus_file* corpus, bench_settings* settings, wave_context* context) {
+    double* times = malloc(settings->repetitions * sizeof(double));
+    if (times == NULL) {
+        fprintf(stderr, "Error allocating memory for times.\n");
+        return -1;
+    }
+
+    // Time the operation, keeping the peak memory of the repetitions.
+    reset_peak_memory();
+    int failed = 0;
+    for (int r = 0; r < settings->repetitions && !failed; ++r) {
+        times[r] = time_operation(operation, corpus, settings, context);
+        failed = times[r] < 0;
+    }
+    long peak_kilobytes = peak_memory();
+
+    // Report the median and 99th percentile times, and the throughput at the median time.
+    double median = 0, p99 = 0, throughput = 0;
+    if (!failed) {
+        qsort(times, settings->repetitions, sizeof(double), compare_times);
+        median = times[settings->repetitions / 2];
+        p99 = times[(int)ceil(0.99 * settings->repetitions) - 1];
+        off_t size = operation_uses_file[operation] ? corpus->file_size : corpus->data_size;
+        throughput = median > 0 ? size / median / 1e6 : 0;
+    }
+    char* format = settings->json
+        ? "{\"file\": \"%s\", \"format\": \"%s\", \"channels\": %i, \"seconds\": %g, \"layout\": \"%s\", "
+          "\"file_bytes\": %lld, \"operation\": \"%s\", \"threads\": %i, \"repetitions\": %i, \"median_ms\": %.3f, "
+          "\"p99_ms\": %.3f, \"mb_per_s\": %.1f, \"peak_rss_kb\": %ld, \"status\": \"%s\"}\n"
+        : "%s,%s,%i,%g,%s,%lld,%s,%i,%i,%.3f,%.3f,%.1f,%ld,%s\n";
+    printf(format, corpus->name, encoding_name(corpus->encoding), corpus->num_channels,
+           corpus->seconds, layout_names[corpus->layout], (long long)corpus->file_size,
+           operation_names[operation], get_num_threads(), settings->repetitions, median * 1e3, p99 * 1e3, throughput,
+           peak_kilobytes, failed ? "error" : "ok");
+    fflush(stdout);
+    free(times);
+    return failed ? -1 : 0;
+}
+
+int main(int argc, char** argv) {
+    bench_settings settings = { "bench_corpus", 5, 0, "", "", "", 0 };
+    char formats[256] = "16,24", channel_counts[256] = "1,2", durations[256] = "1,10", layouts[256] = "plain,metadata,embedded";
+    char operations[512] = "";
+    int timed[NUM_BENCH_OPERATIONS];
+
+    // Read the options.
+    for (int i = 1; i < argc; ++i) {
+        char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(argv[i], "--format=json") || !strcmp(argv[i], "--format=csv")) {
+            settings.json = !strcmp(argv[i], "--format=json");
+            continue;
+        } else if (!strcmp(argv[i], "--check")) {
+            settings.check = 1;
+            continue;
+        } else if (value == NULL) {
+            printf("Usage: bench_wave [-d corpus_directory] [-n repetitions] [-b formats] [-c channel_counts]\n");
+            printf("                  [-t durations] [-l layouts] [-o operations] [-i stdio|mmap] [--format=csv|json]\n");
+            printf("                  [--check]\n");
+            return 1;
+        } else if (!strcmp(argv[i], "-d")) {
+            settings.directory = value;
+        } else if (!strcmp(argv[i], "-n")) {
+            settings.repetitions = atoi(value) > 0 ? atoi(value) : 1;
+        } else if (!strcmp(argv[i], "-b")) {
+            snprintf(formats, sizeof(formats), "%s", value);
+        } else if (!strcmp(argv[i], "-c")) {
+            snprintf(channel_counts, sizeof(channel_counts), "%s", value);
+        } else if (!strcmp(argv[i], "-t")) {
+            snprintf(durations, sizeof(durations), "%s", value);
+        } else if (!strcmp(argv[i], "-l")) {
+            snprintf(layouts, sizeof(layouts), "%s", value);
+        } else if (!strcmp(argv[i], "-o")) {
+            snprintf(operations, sizeof(operations), "%s", value);
+        } else if (!strcmp(argv[i], "-i")) {
+            set_file_mode(!strcmp(value, "mmap") ? FILE_MODE_MMAP : FILE_MODE_STDIO);
+        }
+        ++i;
+    }
+
+    // Make the corpus directory and the file to embed, and keep the library's messages to itself.
+    if (mkdir(settings.directory, 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "Error creating %s\n", settings.directory);
+        return 1;
+    }
+    snprintf(settings.embedded_name, sizeof(settings.embedded_name), "%s/embedded.bin", settings.directory);
+    snprintf(settings.output_name, sizeof(settings.output_name), "%s/output.wav", settings.directory);
+    snprintf(settings.streamed_name, sizeof(settings.streamed_name), "%s/streamed.wav", settings.directory);
+    if (write_embedded_file(settings.embedded_name) == -1) {
+        fprintf(stderr, "Error creating %s\n", settings.embedded_name);
+        return 1;
+    }
+    set_quiet_messages(1);
+
+    char* format_items[MAX_LIST];
+    char* channel_items[MAX_LIST];
+    char* duration_items[MAX_LIST];
+    char* layout_items[MAX_LIST];
+    int num_formats = split_list(formats, format_items);
+    int num_channel_counts = split_list(channel_counts, channel_items);
+    int num_durations = split_list(durations, duration_items);
+    int num_layouts = split_list(layouts, layout_items);
+
+    // Time every operation unless a list of operations is given.
+    char* operation_items[MAX_LIST];
+    int num_operations = split_list(operations, operation_items);
+    for (int operation = 0; operation < NUM_BENCH_OPERATIONS; ++operation) {
+        timed[operation] = num_operations == 0;
+        for (int o = 0; o < num_operations; ++o) {
+            timed[operation] |= !strcmp(operation_items[o], operation_names[operation]);
+        }
+    }
+
+    if (!settings.json && !settings.check) {
+        printf("file,format,channels,seconds,layout,file_bytes,operation,threads,repetitions,median_ms,p99_ms,"
+               "mb_per_s,peak_rss_kb,status\n");
+    }
+    wave_context* context = new_wave_context();
+    int failures = context == NULL;
+    int num_chains = sizeof(check_chains) / sizeof(check_chains[0]), num_checked = 0;
+    for (int f = 0; f < num_formats && context != NULL; ++f) {
+        for (int c = 0; c < num_channel_counts; ++c) {
+            for (int d = 0; d < num_durations; ++d) {
+                for (int l = 0; l < num_layouts; ++l) {
+
+                    // Make the corpus file, skipping unknown parameters.
+                    corpus_file corpus = { "", parse_encoding(format_items[f]), atoi(channel_items[c]),
+                                                strtod(duration_items[d], NULL), -1, 0, 0 };
+                    for (int layout = LAYOUT_PLAIN; layout <= LAYOUT_EMBEDDED; ++layout) {
+                        corpus.layout = !strcmp(layout_items[l], layout_names[layout]) ? layout : corpus.layout;
+                    }
+                    if (corpus.encoding == SAMPLE_UNSUPPORTED || corpus.num_channels < 1 ||
+                            corpus.seconds <= 0 || corpus.layout == -1) {
+                        fprintf(stderr, "Skipping %s %s %s %s\n", format_items[f], channel_items[c], duration_items[d],
+                                layout_items[l]);
+                        continue;
+                    }
+                    if (make_corpus_file(&corpus, &settings) == -1) {
+                        ++failures;
+                        continue;
+                    }
+                    corpus.data_size = (off_t)(corpus.seconds * SAMPLE_RATE) *
+                                            encoding_size(corpus.encoding) * corpus.num_channels;
+
+                    for (int chain = 0; chain < num_chains && settings.check; ++chain) {
+                        failures += check_chain(check_chains + chain, &corpus, &settings) == -1;
+                        ++num_checked;
+                    }
+                    if (settings.check) {
+                        failures += check_round_trip(&corpus, &settings) == -1;
+                        ++num_checked;
+                    }
+                    for (int operation = 0; operation < NUM_BENCH_OPERATIONS && !settings.check; ++operation) {
+                        if (timed[operation]) {
+                            failures += bench_operation(operation, &corpus, &settings, context) == -1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if (context != NULL) {
+        free_wave_context(context);
+    }
+    if (settings.check) {
+        printf("bench_wave: %d of %d checks passed\n", num_checked - failures, num_checked);
+    }
+    remove(settings.output_name);
+    remove(settings.streamed_name);
+    return failures != 0;
+}
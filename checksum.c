@@ -0,0 +1,273 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checksum.h"
+#include "message.h"
+#include "parallel.h"
+
+// The chars of a checksum chunk's payload before its ranges, holding the block size, and the chars of a range
+// before its checksums, holding its chunk id, position and size.
+#define CHECKSUM_HEADER_SIZE 4
+#define RANGE_HEADER_SIZE 20
+
+// The fewest blocks each thread checksums, so small ranges are checksummed on the calling thread.
+#define MIN_BLOCKS_PER_THREAD 4
+
+// Table of the CRC-32C of each byte value, filled on first use.
+static uint32_t crc_table[256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+static int hardware_crc = 0;
+
+// The blocks of a range checksummed by parallel_for.
+typedef struct checksum_task {
+    checksum_range* range;
+    size_t block_size;
+    char* chars;
+} checksum_task;
+
+// A function for filling the CRC-32C table and detecting the CRC-32C instruction of the processor.
+static void fill_crc_table() {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+        }
+        crc_table[i] = crc;
+    }
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+    hardware_crc = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// A function for calculating the CRC-32C of a buffer with the SSE 4.2 instruction, 8 chars at a time.
+__attribute__((target("sse4.2")))
+static uint32_t hardware_crc32c(uint32_t crc, char* buffer, size_t size) {
+    uint64_t crc64 = crc;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t chars;
+        memcpy(&chars, buffer + i, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, chars);
+    }
+    crc = (uint32_t)crc64;
+    for (; i < size; ++i) {
+        crc = __builtin_ia32_crc32qi(crc, (unsigned char)buffer[i]);
+    }
+    return crc;
+}
+#endif
+
+// A function for calculating the CRC-32C of a buffer, continuing from a previous checksum. Pass 0 to start.
+// Processors with SSE 4.2 calculate it with their CRC-32C instruction, and others a byte at a time from a table.
+uint32_t crc32c(uint32_t checksum, char* buffer, size_t size) {
+    pthread_once(&crc_table_once, fill_crc_table);
+    uint32_t crc = ~checksum;
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (hardware_crc) {
+        return ~hardware_crc32c(crc, buffer, size);
+    }
+#endif
+    for (size_t i = 0; i < size; ++i) {
+        crc = crc_table[(crc ^ (unsigned char)buffer[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// A function for calculating the number of blocks of a range.
+size_t checksum_block_count(off_t size, size_t block_size) {
+    return (size + block_size - 1) / block_size;
+}
+
+// A function for calculating the payload size of a checksum chunk with a number of ranges and blocks.
+size_t checksum_payload_size(int num_ranges, size_t num_blocks) {
+    return CHECKSUM_HEADER_SIZE + num_ranges * RANGE_HEADER_SIZE + num_blocks * 4 + CHECKSUM_TRAILER_SIZE;
+}
+
+// A function for creating an empty list of checksums of blocks of block_size chars.
+// Returns NULL if there is an error.
+checksum_list* new_checksum_list(size_t block_size) {
+    checksum_list* list = calloc(1, sizeof(checksum_list));
+    if (list == NULL) {
+        print_message("Error allocating memory for checksums.\n\n");
+        return NULL;
+    }
+    list->block_size = block_size;
+    return list;
+}
+
+// A function for freeing a list of checksums.
+void free_checksum_list(checksum_list* list) {
+    for (int i = 0; i < list->num_ranges; ++i) {
+        free(list->ranges[i].checksums);
+    }
+    free(list->ranges);
+    free(list);
+}
+
+// A function for adding a range to a list of checksums, with room for the checksums of its blocks.
+// Returns the range, or NULL if there is an error.
+checksum_range* add_checksum_range(checksum_list* list, char* id, off_t position, off_t size) {
+    if (list->num_ranges == list->capacity) {
+        int capacity = list->capacity > 0 ? list->capacity * 2 : 8;
+        checksum_range* ranges = realloc(list->ranges, capacity * sizeof(checksum_range));
+        if (ranges == NULL) {
+            print_message("Error allocating memory for checksums.\n\n");
+            return NULL;
+        }
+        list->ranges = ranges;
+        list->capacity = capacity;
+    }
+    checksum_range* range = list->ranges + list->num_ranges;
+    size_t num_blocks = checksum_block_count(size, list->block_size);
+    range->checksums = calloc(num_blocks > 0 ? num_blocks : 1, sizeof(uint32_t));
+    if (range->checksums == NULL) {
+        print_message("Error allocating memory for checksums.\n\n");
+        return NULL;
+    }
+    memcpy(range->id, id, 4);
+    range->position = position;
+    range->size = size;
+    ++list->num_ranges;
+    return range;
+}
+
+// A function for finding the range of a list at a position.
+// Returns NULL if there is none.
+checksum_range* find_checksum_range(checksum_list* list, off_t position) {
+    for (int i = 0; i < list->num_ranges; ++i) {
+        if (list->ranges[i].position == position) {
+            return list->ranges + i;
+        }
+    }
+    return NULL;
+}
+
+// A function for checksumming blocks [first, last) of a range.
+static void checksum_task_blocks(void* argument, size_t first, size_t last) {
+    checksum_task* task = argument;
+    for (size_t i = first; i < last; ++i) {
+        off_t start = (off_t)i * task->block_size;
+        size_t length = task->range->size - start < (off_t)task->block_size ? (size_t)(task->range->size - start) : task->block_size;
+        task->range->checksums[i] = crc32c(0, task->chars + start, length);
+    }
+}
+
+// A function for calculating the checksums of the blocks of a range from its chars, with the blocks split
+// between threads.
+void checksum_chars(checksum_range* range, size_t block_size, char* chars) {
+    checksum_task task = { range, block_size, chars };
+    parallel_for(checksum_block_count(range->size, block_size), MIN_BLOCKS_PER_THREAD, checksum_task_blocks, &task);
+}
+
+// A function for checking the checksums of a range against the expected ones, both calculated in blocks of
+// block_size chars, and reporting the first block that differs. Ranges of different sizes differ at their first
+// block.
+// Returns -1 if they differ.
+int check_checksums(checksum_range* expected, checksum_range* actual, size_t block_size) {
+    size_t num_blocks = checksum_block_count(expected->size, block_size);
+    size_t block = 0;
+    while (expected->size == actual->size && block < num_blocks && expected->checksums[block] == actual->checksums[block]) {
+        ++block;
+    }
+    if (expected->size != actual->size || block < num_blocks) {
+        print_message("Checksum mismatch in block %zu of the \"%.4s\" chunk.\n\n", block, expected->id);
+        return -1;
+    }
+    return 0;
+}
+
+// A function for calculating the payload size of a checksum chunk.
+size_t checksum_list_size(checksum_list* list) {
+    size_t num_blocks = 0;
+    for (int i = 0; i < list->num_ranges; ++i) {
+        num_blocks += checksum_block_count(list->ranges[i].size, list->block_size);
+    }
+    return checksum_payload_size(list->num_ranges, num_blocks);
+}
+
+// A function for writing the payload of a checksum chunk: the block size, then the chunk id, position, size and
+// block checksums of each range, then the number of ranges and the payload size.
+void write_checksum_list(checksum_list* list, char* destination) {
+    size_t size = checksum_list_size(list);
+    *(uint32_t*)destination = list->block_size;
+    size_t position = CHECKSUM_HEADER_SIZE;
+    for (int i = 0; i < list->num_ranges; ++i) {
+        checksum_range* range = list->ranges + i;
+        size_t num_blocks = checksum_block_count(range->size, list->block_size);
+        memcpy(destination + position, range->id, 4);
+        *(int64_t*)(destination + position + 4) = range->position;
+        *(int64_t*)(destination + position + 12) = range->size;
+        memcpy(destination + position + RANGE_HEADER_SIZE, range->checksums, num_blocks * 4);
+        position += RANGE_HEADER_SIZE + num_blocks * 4;
+    }
+    *(uint32_t*)(destination + position) = list->num_ranges;
+    *(uint32_t*)(destination + position + 4) = size;
+}
+
+// A function for parsing the payload of a checksum chunk.
+// Returns NULL if the payload is damaged or there is an error.
+checksum_list* parse_checksum_list(char* payload, size_t size) {
+    if (size < CHECKSUM_HEADER_SIZE + CHECKSUM_TRAILER_SIZE || *(uint32_t*)payload == 0 ||
+            *(uint32_t*)(payload + size - 4) != size) {
+        return NULL;
+    }
+    checksum_list* list = new_checksum_list(*(uint32_t*)payload);
+    if (list == NULL) {
+        return NULL;
+    }
+
+    // Read each range, return NULL if one does not fit before the trailer.
+    uint32_t num_ranges = *(uint32_t*)(payload + size - CHECKSUM_TRAILER_SIZE);
+    size_t end = size - CHECKSUM_TRAILER_SIZE;
+    size_t position = CHECKSUM_HEADER_SIZE;
+    for (uint32_t i = 0; i < num_ranges; ++i) {
+        int64_t range_position = position + RANGE_HEADER_SIZE <= end ? *(int64_t*)(payload + position + 4) : -1;
+        int64_t range_size = position + RANGE_HEADER_SIZE <= end ? *(int64_t*)(payload + position + 12) : -1;
+        size_t num_blocks = range_size >= 0 ? checksum_block_count(range_size, list->block_size) : 0;
+        checksum_range* range = NULL;
+        if (range_position >= 0 && range_size >= 0 && num_blocks <= (end - position - RANGE_HEADER_SIZE) / 4) {
+            range = add_checksum_range(list, payload + position, range_position, range_size);
+        }
+        if (range == NULL) {
+            free_checksum_list(list);
+            return NULL;
+        }
+        memcpy(range->checksums, payload + position + RANGE_HEADER_SIZE, num_blocks * 4);
+        position += RANGE_HEADER_SIZE + num_blocks * 4;
+    }
+    if (position != end) {
+        free_checksum_list(list);
+        return NULL;
+    }
+    return list;
+}
+
+// A function for starting to calculate the checksums of a range from its chars in order.
+void start_checksum_feed(checksum_feed* feed, checksum_range* range, size_t block_size) {
+    feed->range = range;
+    feed->block_size = block_size;
+    feed->position = 0;
+    feed->checksum = 0;
+}
+
+// A function for adding the next chars of a range to its checksums. Chars past the end of the range are left out.
+void feed_checksum(checksum_feed* feed, char* chars, size_t size) {
+    while (size > 0 && feed->position < feed->range->size) {
+        size_t offset = feed->position % feed->block_size;
+        size_t length = feed->block_size - offset;
+        length = length < size ? length : size;
+        length = (off_t)length < feed->range->size - feed->position ? length : (size_t)(feed->range->size - feed->position);
+        feed->checksum = crc32c(feed->checksum, chars, length);
+        feed->position += length;
+        chars += length;
+        size -= length;
+
+        // Record the checksum of a block once it is complete.
+        if (offset + length == feed->block_size || feed->position == feed->range->size) {
+            feed->range->checksums[(feed->position - 1) / feed->block_size] = feed->checksum;
+            feed->checksum = 0;
+        }
+    }
+}
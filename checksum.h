@@ -0,0 +1,87 @@
+#ifndef H_CHECKSUM
+#define H_CHECKSUM
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// The id of the chunk holding the checksums of the audio data and the embedded files of a wav file. It is always
+// the last chunk, after any directory chunk, so it can be dropped and written again without moving other chunks.
+#define CHECKSUM_CHUNK_ID "csum"
+
+// The payload of a checksum chunk ends with the number of ranges and the payload size, so the chunk can be found
+// from the end of the file.
+#define CHECKSUM_TRAILER_SIZE 8
+
+// The number of chars of a range with a checksum of their own, so blocks are checksummed in parallel and a
+// damaged block can be located.
+#define CHECKSUM_BLOCK_SIZE (1 << 20)
+
+// A range of a wav file checksummed in blocks: the payload of the data chunk or of an embedded file chunk.
+typedef struct checksum_range {
+    char id[4]; // id of the chunk holding the range
+    off_t position; // position of the payload in the file
+    off_t size;
+    uint32_t* checksums; // CRC-32C of each block, the last of which may be shorter
+} checksum_range;
+
+// The checksums of a wav file, held in its checksum chunk.
+typedef struct checksum_list {
+    size_t block_size;
+    checksum_range* ranges;
+    int num_ranges;
+    int capacity;
+} checksum_list;
+
+// A checksum of a range calculated from its chars in order, as they are read or written.
+typedef struct checksum_feed {
+    checksum_range* range;
+    size_t block_size;
+    off_t position; // chars of the range fed so far
+    uint32_t checksum; // checksum of the chars fed of the current block
+} checksum_feed;
+
+// A function for calculating the CRC-32C of a buffer, continuing from a previous checksum.
+uint32_t crc32c(uint32_t checksum, char* buffer, size_t size);
+
+// A function for calculating the number of blocks of a range.
+size_t checksum_block_count(off_t size, size_t block_size);
+
+// A function for calculating the payload size of a checksum chunk with a number of ranges and blocks.
+size_t checksum_payload_size(int num_ranges, size_t num_blocks);
+
+// A function for creating an empty list of checksums of blocks of block_size chars.
+checksum_list* new_checksum_list(size_t block_size);
+
+// A function for freeing a list of checksums.
+void free_checksum_list(checksum_list* list);
+
+// A function for adding a range to a list of checksums, with room for the checksums of its blocks.
+checksum_range* add_checksum_range(checksum_list* list, char* id, off_t position, off_t size);
+
+// A function for finding the range of a list at a position. Returns NULL if there is none.
+checksum_range* find_checksum_range(checksum_list* list, off_t position);
+
+// A function for calculating the checksums of the blocks of a range from its chars, in parallel.
+void checksum_chars(checksum_range* range, size_t block_size, char* chars);
+
+// A function for checking the checksums of a range against the expected ones and reporting the first block that
+// differs.
+int check_checksums(checksum_range* expected, checksum_range* actual, size_t block_size);
+
+// A function for calculating the payload size of a checksum chunk.
+size_t checksum_list_size(checksum_list* list);
+
+// A function for writing the payload of a checksum chunk.
+void write_checksum_list(checksum_list* list, char* destination);
+
+// A function for parsing the payload of a checksum chunk.
+checksum_list* parse_checksum_list(char* payload, size_t size);
+
+// A function for starting to calculate the checksums of a range from its chars in order.
+void start_checksum_feed(checksum_feed* feed, checksum_range* range, size_t block_size);
+
+// A function for adding the next chars of a range to its checksums.
+void feed_checksum(checksum_feed* feed, char* chars, size_t size);
+
+#endif
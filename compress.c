@@ -0,0 +1,430 @@
+#include <string.h>
+#include "compress.h"
+#include "parallel.h"
+
+// The shortest match encoded, the farthest back a match can start and the size of the match finder's table.
+#define MIN_MATCH 4
+#define MAX_DISTANCE 65535
+#define HASH_BITS 14
+
+// A group of blocks compressed or decompressed at the same time, one block per item of parallel_for.
+typedef struct block_group {
+    int compression;
+    char* input;
+    char* output;
+    size_t* input_sizes; // chars of each block in input
+    size_t* output_sizes; // chars of each block written to output, or 0 if the block is invalid
+    uint32_t* checksums;
+    size_t slot_size; // chars between the blocks of input and output
+    size_t* input_offsets;
+} block_group;
+
+// Function for reading a range of a file as a payload.
+int read_file_payload(void* range, char* destination, size_t size, size_t offset) {
+    file_range* file = range;
+    return read_file_range(file->fd, destination, size, file->offset + offset) == (ssize_t)size ? 0 : -1;
+}
+
+// Function for writing a range of a file as a payload.
+int write_file_payload(void* range, char* source, size_t size, size_t offset) {
+    file_range* file = range;
+    return write_file_range(file->fd, source, size, file->offset + offset) == (ssize_t)size ? 0 : -1;
+}
+
+// Function for reading a buffer in memory as a payload.
+int read_memory_payload(void* buffer, char* destination, size_t size, size_t offset) {
+    memcpy(destination, (char*)buffer + offset, size);
+    return 0;
+}
+
+// Function for writing a buffer in memory as a payload.
+int write_memory_payload(void* buffer, char* source, size_t size, size_t offset) {
+    memcpy((char*)buffer + offset, source, size);
+    return 0;
+}
+
+// A function for converting a compression name to a compression.
+// Returns -1 for unknown names.
+int parse_compression(char* name) {
+    if (!strcmp(name, "none")) {
+        return COMPRESSION_NONE;
+    } else if (!strcmp(name, "lz")) {
+        return COMPRESSION_LZ;
+    } else if (!strcmp(name, "lzcrc")) {
+        return COMPRESSION_LZ_CHECKSUMS;
+    }
+    return -1;
+}
+
+// A function for retrieving the name of a compression.
+char* compression_name(int compression) {
+    static char* names[] = { "none", "lz", "lzcrc" };
+    return names[compression];
+}
+
+// A function for calculating the size of the table of a compressed payload.
+static size_t table_size(size_t num_blocks, int compression) {
+    return num_blocks * (compression == COMPRESSION_LZ_CHECKSUMS ? 8 : 4);
+}
+
+// A function for calculating the largest compressed payload of size chars. Blocks are never stored larger
+// than they are.
+size_t compressed_bound(size_t size) {
+    size_t num_blocks = (size + COMPRESSED_BLOCK_SIZE - 1) / COMPRESSED_BLOCK_SIZE;
+    return COMPRESSED_HEADER_SIZE + table_size(num_blocks, COMPRESSION_LZ_CHECKSUMS) + size;
+}
+
+// A function for writing a length that does not fit in a token as a run of 255s and a remainder.
+// Returns the new output position, or -1 if the output is full.
+static int write_length(unsigned char* output, int position, int capacity, int length) {
+    while (length >= 255) {
+        if (position >= capacity) {
+            return -1;
+        }
+        output[position++] = 255;
+        length -= 255;
+    }
+    if (position >= capacity) {
+        return -1;
+    }
+    output[position++] = length;
+    return position;
+}
+
+// A function for writing a sequence of literals followed by a match, or by nothing when match_length is 0.
+// Returns the new output position, or -1 if the output is full.
+static int write_sequence(unsigned char* output, int position, int capacity, unsigned char* literals, int num_literals,
+                          int distance, int match_length) {
+    if (position >= capacity) {
+        return -1;
+    }
+    int extra_match = match_length > 0 ? match_length - MIN_MATCH : 0;
+    output[position++] = (num_literals < 15 ? num_literals : 15) << 4 | (extra_match < 15 ? extra_match : 15);
+    if (num_literals >= 15 && (position = write_length(output, position, capacity, num_literals - 15)) == -1) {
+        return -1;
+    }
+    if (position + num_literals > capacity) {
+        return -1;
+    }
+    memcpy(output + position, literals, num_literals);
+    position += num_literals;
+    if (match_length > 0) {
+        if (position + 2 > capacity) {
+            return -1;
+        }
+        output[position++] = distance & 0xFF;
+        output[position++] = distance >> 8;
+        if (extra_match >= 15 && (position = write_length(output, position, capacity, extra_match - 15)) == -1) {
+            return -1;
+        }
+    }
+    return position;
+}
+
+// A function for compressing a block with a greedy LZ77 match finder. Each sequence is a token holding the
+// number of literals and the match length, the literals, and the distance back to the match.
+// Returns the compressed size, or -1 if the block does not fit in capacity.
+static int compress_block(unsigned char* input, int size, unsigned char* output, int capacity) {
+    int table[1 << HASH_BITS];
+    memset(table, 0xFF, sizeof(table));
+
+    int position = 0;
+    int anchor = 0;
+    int output_position = 0;
+    while (position + MIN_MATCH <= size) {
+        uint32_t sequence;
+        memcpy(&sequence, input + position, 4);
+        int hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        int candidate = table[hash];
+        table[hash] = position;
+
+        // Extend a match with the last position of the same hash.
+        uint32_t candidate_sequence;
+        if (candidate >= 0 && position - candidate <= MAX_DISTANCE &&
+                (memcpy(&candidate_sequence, input + candidate, 4), candidate_sequence == sequence)) {
+            int length = MIN_MATCH;
+            while (position + length < size && input[candidate + length] == input[position + length]) {
+                ++length;
+            }
+            output_position = write_sequence(output, output_position, capacity, input + anchor, position - anchor,
+                                             position - candidate, length);
+            if (output_position == -1) {
+                return -1;
+            }
+            position += length;
+            anchor = position;
+        } else {
+            ++position;
+        }
+    }
+
+    // The block ends with its remaining literals.
+    return write_sequence(output, output_position, capacity, input + anchor, size - anchor, 0, 0);
+}
+
+// A function for reading a length continued as a run of 255s and a remainder.
+// Returns the new input position, or -1 if the input ends.
+static int read_length(unsigned char* input, int position, int size, size_t* length) {
+    unsigned char next;
+    do {
+        if (position >= size) {
+            return -1;
+        }
+        next = input[position++];
+        *length += next;
+    } while (next == 255);
+    return position;
+}
+
+// A function for decompressing a block into exactly output_size chars.
+// Returns -1 if the block is invalid.
+static int decompress_block(unsigned char* input, int size, unsigned char* output, size_t output_size) {
+    int position = 0;
+    size_t output_position = 0;
+    while (position < size) {
+
+        // Copy the literals.
+        int token = input[position++];
+        size_t num_literals = token >> 4;
+        if (num_literals == 15 && (position = read_length(input, position, size, &num_literals)) == -1) {
+            return -1;
+        }
+        if (num_literals > (size_t)(size - position) || num_literals > output_size - output_position) {
+            return -1;
+        }
+        memcpy(output + output_position, input + position, num_literals);
+        position += num_literals;
+        output_position += num_literals;
+        if (position == size) {
+            break;
+        }
+
+        // Copy the match one char at a time, since it can overlap the chars it produces.
+        if (position + 2 > size) {
+            return -1;
+        }
+        size_t distance = input[position] | input[position + 1] << 8;
+        position += 2;
+        size_t match_length = (token & 15) + MIN_MATCH;
+        if ((token & 15) == 15 && (position = read_length(input, position, size, &match_length)) == -1) {
+            return -1;
+        }
+        if (distance == 0 || distance > output_position || match_length > output_size - output_position) {
+            return -1;
+        }
+        for (size_t i = 0; i < match_length; ++i) {
+            output[output_position + i] = output[output_position - distance + i];
+        }
+        output_position += match_length;
+    }
+    return output_position == output_size ? 0 : -1;
+}
+
+// A function for compressing a range of the blocks of a group. Blocks that do not get smaller are stored as is.
+static void compress_range(void* argument, size_t first, size_t last) {
+    block_group* group = argument;
+    for (size_t i = first; i < last; ++i) {
+        char* input = group->input + i * group->slot_size;
+        char* output = group->output + i * group->slot_size;
+        int size = compress_block((unsigned char*)input, group->input_sizes[i], (unsigned char*)output, group->input_sizes[i] - 1);
+        if (size == -1) {
+            memcpy(output, input, group->input_sizes[i]);
+            size = group->input_sizes[i];
+        }
+        group->output_sizes[i] = size;
+        if (group->compression == COMPRESSION_LZ_CHECKSUMS) {
+            group->checksums[i] = crc32c(0, input, group->input_sizes[i]);
+        }
+    }
+}
+
+// A function for decompressing a range of the blocks of a group. A block stored with the size of its output
+// was stored as is.
+static void decompress_range(void* argument, size_t first, size_t last) {
+    block_group* group = argument;
+    for (size_t i = first; i < last; ++i) {
+        char* input = group->input + group->input_offsets[i];
+        char* output = group->output + i * group->slot_size;
+        size_t size = group->output_sizes[i];
+        if (group->input_sizes[i] == size) {
+            memcpy(output, input, size);
+        } else if (decompress_block((unsigned char*)input, group->input_sizes[i], (unsigned char*)output, size) == -1) {
+            group->output_sizes[i] = 0;
+            continue;
+        }
+        if (group->compression == COMPRESSION_LZ_CHECKSUMS && crc32c(0, output, size) != group->checksums[i]) {
+            group->output_sizes[i] = 0;
+        }
+    }
+}
+
+// A function for allocating the buffers of a group of num_blocks blocks.
+// Returns -1 if there is an error.
+static int new_block_group(block_group* group, int compression, size_t num_blocks, size_t slot_size) {
+    group->compression = compression;
+    group->slot_size = slot_size;
+    group->input = malloc(num_blocks * slot_size * sizeof(char));
+    group->output = malloc(num_blocks * slot_size * sizeof(char));
+    group->input_sizes = malloc(num_blocks * sizeof(size_t));
+    group->output_sizes = malloc(num_blocks * sizeof(size_t));
+    group->input_offsets = malloc(num_blocks * sizeof(size_t));
+    group->checksums = malloc(num_blocks * sizeof(uint32_t));
+    if (group->input == NULL || group->output == NULL || group->input_sizes == NULL || group->output_sizes == NULL ||
+            group->input_offsets == NULL || group->checksums == NULL) {
+        print_message("Error allocating memory for compression.\n\n");
+        return -1;
+    }
+    return 0;
+}
+
+// A function for freeing the buffers of a group.
+static void free_block_group(block_group* group) {
+    free(group->input);
+    free(group->output);
+    free(group->input_sizes);
+    free(group->output_sizes);
+    free(group->input_offsets);
+    free(group->checksums);
+}
+
+// A function for compressing size chars of a file into a payload. The file is read a group of blocks at a
+// time, one block for each worker thread, and the blocks of a group are compressed in parallel. The table
+// is written after the blocks, once their sizes are known.
+// Returns the size of the payload or -1 if there is an error.
+ssize_t compress_payload(int fd_in, size_t size, int compression, payload_writer writer, void* argument, uint32_t* checksum) {
+
+    // Allocate the table and the buffers of a group, return -1 on error.
+    size_t num_blocks = (size + COMPRESSED_BLOCK_SIZE - 1) / COMPRESSED_BLOCK_SIZE;
+    size_t group_blocks = num_blocks < (size_t)get_num_threads() ? num_blocks : (size_t)get_num_threads();
+    block_group group = { 0 };
+    char* table = malloc((COMPRESSED_HEADER_SIZE + table_size(num_blocks, compression)) * sizeof(char));
+    if (table == NULL || new_block_group(&group, compression, group_blocks > 0 ? group_blocks : 1, COMPRESSED_BLOCK_SIZE) == -1) {
+        if (table == NULL) {
+            print_message("Error allocating memory for compression.\n\n");
+        }
+        free(table);
+        free_block_group(&group);
+        return -1;
+    }
+    *(int*)table = COMPRESSED_BLOCK_SIZE;
+    *(int*)(table + 4) = size;
+    *(int*)(table + 8) = compression == COMPRESSION_LZ_CHECKSUMS;
+
+    // Compress each group and write its blocks after the table.
+    size_t position = COMPRESSED_HEADER_SIZE + table_size(num_blocks, compression);
+    int entry_size = compression == COMPRESSION_LZ_CHECKSUMS ? 8 : 4;
+    *checksum = 0;
+    ssize_t result = 0;
+    for (size_t first = 0; first < num_blocks && result == 0; first += group_blocks) {
+        size_t count = num_blocks - first < group_blocks ? num_blocks - first : group_blocks;
+        for (size_t i = 0; i < count && result == 0; ++i) {
+            size_t offset = (first + i) * COMPRESSED_BLOCK_SIZE;
+            group.input_sizes[i] = size - offset < COMPRESSED_BLOCK_SIZE ? size - offset : COMPRESSED_BLOCK_SIZE;
+            if (read_file_range(fd_in, group.input + i * COMPRESSED_BLOCK_SIZE, group.input_sizes[i], offset) !=
+                    (ssize_t)group.input_sizes[i]) {
+                print_message("Error reading file.\n\n");
+                result = -1;
+            } else {
+                *checksum = crc32c(*checksum, group.input + i * COMPRESSED_BLOCK_SIZE, group.input_sizes[i]);
+            }
+        }
+        if (result == -1) {
+            break;
+        }
+        parallel_for(count, 1, compress_range, &group);
+        for (size_t i = 0; i < count && result == 0; ++i) {
+            char* entry = table + COMPRESSED_HEADER_SIZE + (first + i) * entry_size;
+            *(int*)entry = group.output_sizes[i];
+            if (compression == COMPRESSION_LZ_CHECKSUMS) {
+                *(uint32_t*)(entry + 4) = group.checksums[i];
+            }
+            result = writer(argument, group.output + i * COMPRESSED_BLOCK_SIZE, group.output_sizes[i], position);
+            position += group.output_sizes[i];
+        }
+    }
+    if (result == 0) {
+        result = writer(argument, table, COMPRESSED_HEADER_SIZE + table_size(num_blocks, compression), 0);
+    }
+    free(table);
+    free_block_group(&group);
+    return result == -1 ? -1 : (ssize_t)position;
+}
+
+// A function for decompressing a payload of size chars to the end of a file. A group of blocks is read at a
+// time, one block for each worker thread, and the blocks of a group are decompressed in parallel and written
+// in order, so only one group is held in memory.
+// Returns the number of chars written or -1 if there is an error.
+ssize_t decompress_payload(payload_reader reader, void* argument, size_t size, int fd_out, uint32_t* checksum) {
+
+    // Read and check the header, return -1 on error.
+    char header[COMPRESSED_HEADER_SIZE];
+    if (size < COMPRESSED_HEADER_SIZE || reader(argument, header, COMPRESSED_HEADER_SIZE, 0) == -1) {
+        print_message("Error - Compressed file corrupted.\n\n");
+        return -1;
+    }
+    int block_size = *(int*)header;
+    int output_size = *(int*)(header + 4);
+    int compression = *(int*)(header + 8) ? COMPRESSION_LZ_CHECKSUMS : COMPRESSION_LZ;
+    size_t num_blocks = block_size > 0 ? ((size_t)output_size + block_size - 1) / block_size : 0;
+    if (block_size <= 0 || block_size > MAX_COMPRESSED_BLOCK_SIZE || output_size < 0 ||
+            COMPRESSED_HEADER_SIZE + table_size(num_blocks, compression) > size) {
+        print_message("Error - Compressed file corrupted.\n\n");
+        return -1;
+    }
+
+    // Read the table and allocate the buffers of a group, return -1 on error.
+    size_t group_blocks = num_blocks < (size_t)get_num_threads() ? num_blocks : (size_t)get_num_threads();
+    block_group group = { 0 };
+    char* table = malloc(table_size(num_blocks, compression) + 1);
+    if (table == NULL || new_block_group(&group, compression, group_blocks > 0 ? group_blocks : 1, block_size) == -1 ||
+            reader(argument, table, table_size(num_blocks, compression), COMPRESSED_HEADER_SIZE) == -1) {
+        if (table == NULL) {
+            print_message("Error allocating memory for compression.\n\n");
+        }
+        free(table);
+        free_block_group(&group);
+        return -1;
+    }
+
+    // Read, decompress and write each group.
+    int entry_size = compression == COMPRESSION_LZ_CHECKSUMS ? 8 : 4;
+    size_t position = COMPRESSED_HEADER_SIZE + table_size(num_blocks, compression);
+    *checksum = 0;
+    ssize_t result = 0;
+    for (size_t first = 0; first < num_blocks && result == 0; first += group_blocks) {
+        size_t count = num_blocks - first < group_blocks ? num_blocks - first : group_blocks;
+        size_t input_size = 0;
+        for (size_t i = 0; i < count; ++i) {
+            char* entry = table + (first + i) * entry_size;
+            group.input_sizes[i] = *(unsigned int*)entry;
+            group.input_offsets[i] = input_size;
+            group.output_sizes[i] = output_size - (first + i) * block_size < (size_t)block_size ?
+                                    output_size - (first + i) * block_size : (size_t)block_size;
+            group.checksums[i] = compression == COMPRESSION_LZ_CHECKSUMS ? *(uint32_t*)(entry + 4) : 0;
+            if (group.input_sizes[i] > group.output_sizes[i]) {
+                result = -1;
+            }
+            input_size += group.input_sizes[i];
+        }
+        if (result == -1 || position + input_size > size || reader(argument, group.input, input_size, position) == -1) {
+            print_message("Error - Compressed file corrupted.\n\n");
+            result = -1;
+            break;
+        }
+        position += input_size;
+        parallel_for(count, 1, decompress_range, &group);
+        for (size_t i = 0; i < count && result == 0; ++i) {
+            if (group.output_sizes[i] == 0) {
+                print_message("Error - Compressed file corrupted.\n\n");
+                result = -1;
+            } else if (write_chars(fd_out, group.output + i * block_size, group.output_sizes[i]) == -1) {
+                result = -1;
+            } else {
+                *checksum = crc32c(*checksum, group.output + i * block_size, group.output_sizes[i]);
+            }
+        }
+    }
+    free(table);
+    free_block_group(&group);
+    return result == -1 ? -1 : output_size;
+}
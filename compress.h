@@ -0,0 +1,57 @@
+#ifndef H_COMPRESS
+#define H_COMPRESS
+
+#include "checksum.h"
+#include "file.h"
+
+// Ways of storing an embedded file.
+//   COMPRESSION_NONE           the file is stored as is in a "file" chunk.
+//   COMPRESSION_LZ             the file is split into blocks compressed independently in a "zfil" chunk.
+//   COMPRESSION_LZ_CHECKSUMS   as COMPRESSION_LZ, with a CRC-32C of each block checked when it is decompressed.
+enum compression { COMPRESSION_NONE, COMPRESSION_LZ, COMPRESSION_LZ_CHECKSUMS };
+
+// The number of chars of an embedded file compressed into each block, and the largest block accepted when
+// decompressing.
+#define COMPRESSED_BLOCK_SIZE (1 << 18)
+#define MAX_COMPRESSED_BLOCK_SIZE (1 << 24)
+
+// The size of the header of a compressed payload, which is followed by a table with the stored size and
+// optionally the checksum of each block, then the blocks. Blocks that do not compress are stored as is.
+#define COMPRESSED_HEADER_SIZE 12
+
+// A function for reading size chars at an offset of a payload into destination.
+// Returns -1 if there is an error.
+typedef int (*payload_reader)(void* argument, char* destination, size_t size, size_t offset);
+
+// A function for writing size chars from source at an offset of a payload.
+// Returns -1 if there is an error.
+typedef int (*payload_writer)(void* argument, char* source, size_t size, size_t offset);
+
+// A payload stored in a range of a file, starting at offset.
+typedef struct file_range {
+    int fd;
+    off_t offset;
+} file_range;
+
+// Payload readers and writers for a file_range and for a buffer in memory.
+int read_file_payload(void* range, char* destination, size_t size, size_t offset);
+int write_file_payload(void* range, char* source, size_t size, size_t offset);
+int read_memory_payload(void* buffer, char* destination, size_t size, size_t offset);
+int write_memory_payload(void* buffer, char* source, size_t size, size_t offset);
+
+// A function for converting a compression name to a compression. Returns -1 for unknown names.
+int parse_compression(char* name);
+
+// A function for retrieving the name of a compression.
+char* compression_name(int compression);
+
+// A function for calculating the largest compressed payload of size chars.
+size_t compressed_bound(size_t size);
+
+// A function for compressing size chars of a file into a payload, storing the CRC-32C of the file in checksum.
+ssize_t compress_payload(int fd_in, size_t size, int compression, payload_writer writer, void* argument, uint32_t* checksum);
+
+// A function for decompressing a payload to the end of a file, storing the CRC-32C of the output in checksum.
+ssize_t decompress_payload(payload_reader reader, void* argument, size_t size, int fd_out, uint32_t* checksum);
+
+#endif
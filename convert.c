@@ -0,0 +1,301 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "convert.h"
+#include "message.h"
+#include "parallel.h"
+#include "sample.h"
+
+// The number of frames converted at a time by convert_frames.
+#define CONVERT_BLOCK_FRAMES 4096
+
+// The fewest blocks converted by each worker thread.
+#define MIN_BLOCKS_PER_THREAD 16
+
+// The most channels a wav file can have.
+#define MAX_CHANNELS 65535
+
+// Arguments for converting a range of blocks on a worker thread.
+typedef struct convert_task {
+    converter* converter;
+    char* source;
+    char* destination;
+    size_t num_frames;
+    int failed;
+} convert_task;
+
+// A function for converting a dither name to a dither. Returns -1 for unknown names.
+int parse_dither(char* name) {
+    if (!strcmp(name, "none")) {
+        return DITHER_NONE;
+    } else if (!strcmp(name, "tpdf")) {
+        return DITHER_TPDF;
+    }
+    return -1;
+}
+
+// A function for allocating a channel mix with room for num_terms terms.
+// Returns NULL if there is an error.
+static channel_mix* allocate_channel_mix(int num_channels, int num_terms) {
+    channel_mix* mix = calloc(1, sizeof(channel_mix));
+    mix_term* terms = malloc(num_terms * sizeof(mix_term));
+    if (mix == NULL || terms == NULL) {
+        print_message("Error allocating memory for channel mix.\n\n");
+        free(mix);
+        free(terms);
+        return NULL;
+    }
+    mix->num_channels = num_channels;
+    mix->terms = terms;
+    return mix;
+}
+
+// A function for adding a term to a channel mix.
+static void add_term(channel_mix* mix, int output, int input, float weight) {
+    mix->terms[mix->num_terms++] = (mix_term){ output, input, weight };
+}
+
+// A function for creating a mix of source_channels channels down or up to num_channels channels. A mono
+// source is copied to every channel, and other sources keep their channels and leave the new ones silent.
+// A 5.1 source is mixed down to stereo with the centre and surround channels at -3 dB and without the LFE
+// channel, and other sources are mixed down by averaging channel c into channel c % num_channels.
+// Returns NULL if there is an error.
+channel_mix* new_channel_mix(int source_channels, int num_channels) {
+    if (num_channels < 1 || num_channels > MAX_CHANNELS) {
+        print_message("Invalid number of channels.\n\n");
+        return NULL;
+    }
+    channel_mix* mix = allocate_channel_mix(num_channels, source_channels + num_channels);
+    if (mix == NULL) {
+        return NULL;
+    }
+
+    if (source_channels == 1) {
+        for (int c = 0; c < num_channels; ++c) {
+            add_term(mix, c, 0, 1);
+        }
+    } else if (num_channels >= source_channels) {
+        for (int c = 0; c < source_channels; ++c) {
+            add_term(mix, c, c, 1);
+        }
+    } else if (source_channels == 6 && num_channels == 2) {
+        // The weights of each output channel add up to 1, so full-scale channels do not clip.
+        float side = (float)M_SQRT1_2 / (1 + 2 * (float)M_SQRT1_2), front = 1 / (1 + 2 * (float)M_SQRT1_2);
+        add_term(mix, 0, 0, front);
+        add_term(mix, 1, 1, front);
+        add_term(mix, 0, 2, side);
+        add_term(mix, 1, 2, side);
+        add_term(mix, 0, 4, side);
+        add_term(mix, 1, 5, side);
+    } else {
+        for (int c = 0; c < source_channels; ++c) {
+            int output = c % num_channels;
+            int num_inputs = source_channels / num_channels + (output < source_channels % num_channels);
+            add_term(mix, output, c, 1.0f / num_inputs);
+        }
+    }
+    return mix;
+}
+
+// A function for creating a mix that keeps the channels in a comma-separated list of channel numbers,
+// starting at 1, in the order of the list. Channels may be repeated.
+// Returns NULL if there is an error.
+channel_mix* parse_channel_selection(char* list, int source_channels) {
+    int num_channels = 1;
+    for (char* c = list; *c != '\0'; ++c) {
+        num_channels += *c == ',';
+    }
+    if (num_channels > MAX_CHANNELS) {
+        print_message("%s is an invalid channel list.\n\n", list);
+        return NULL;
+    }
+    channel_mix* mix = allocate_channel_mix(num_channels, num_channels);
+    if (mix == NULL) {
+        return NULL;
+    }
+
+    // Read each channel number, return NULL on error.
+    char* position = list;
+    for (int c = 0; c < num_channels; ++c) {
+        char* end;
+        long channel = strtol(position, &end, 10);
+        if (end == position || channel < 1 || channel > source_channels || (*end != ',' && *end != '\0')) {
+            print_message("%s is an invalid channel list.\n\n", list);
+            free_channel_mix(mix);
+            return NULL;
+        }
+        add_term(mix, c, channel - 1, 1);
+        position = end + 1;
+    }
+    return mix;
+}
+
+// A function for freeing a channel mix.
+void free_channel_mix(channel_mix* mix) {
+    free(mix->terms);
+    free(mix);
+}
+
+// A function for creating a converter from frames of one sample encoding and number of channels to frames
+// of an encoding mixed with a channel mix, or with the same channels when mix is NULL. Samples whose
+// encoding is kept and whose channels are only selected are copied as chars, which also works for sample
+// formats that cannot be converted to float. Dither is only added when samples lose resolution: when they
+// are converted from float or to a narrower integer, or when channels are mixed.
+// Returns NULL if there is an error.
+converter* new_converter(int source_encoding, int source_sample_size, int source_channels, int encoding,
+                         channel_mix* mix, int dither) {
+
+    // Allocate memory for the converter and a copy of the mix, return NULL on error.
+    converter* new = calloc(1, sizeof(converter));
+    if (new == NULL) {
+        print_message("Error allocating memory for converter.\n\n");
+        return NULL;
+    }
+    new->source_encoding = source_encoding;
+    new->source_sample_size = source_sample_size;
+    new->source_channels = source_channels;
+    new->encoding = encoding;
+    new->sample_size = encoding == source_encoding ? source_sample_size : encoding_size(encoding);
+    new->num_channels = mix != NULL ? mix->num_channels : source_channels;
+    new->frame_size = new->sample_size * new->num_channels;
+    if (mix != NULL) {
+        new->mix = *mix;
+        new->mix.terms = malloc(mix->num_terms * sizeof(mix_term));
+        if (new->mix.terms == NULL) {
+            print_message("Error allocating memory for converter.\n\n");
+            free(new);
+            return NULL;
+        }
+        memcpy(new->mix.terms, mix->terms, mix->num_terms * sizeof(mix_term));
+    }
+
+    // A mix only selects channels when each output channel takes at most one source channel as it is.
+    int* inputs = malloc(new->num_channels * sizeof(int));
+    if (inputs == NULL) {
+        print_message("Error allocating memory for converter.\n\n");
+        free_converter(new);
+        return NULL;
+    }
+    int selection = 1;
+    for (int c = 0; c < new->num_channels; ++c) {
+        inputs[c] = mix != NULL ? -1 : c;
+    }
+    for (int i = 0; i < new->mix.num_terms; ++i) {
+        mix_term* term = new->mix.terms + i;
+        selection = selection && term->weight == 1 && inputs[term->output] == -1;
+        inputs[term->output] = term->input;
+    }
+
+    if (selection && encoding == source_encoding) {
+        new->copy = 1;
+        new->copy_inputs = inputs;
+        if (encoding != SAMPLE_UNSUPPORTED) {
+            float silence = 0;
+            encode_frames(&silence, new->silence, 1, 1, encoding, 1);
+        }
+        return new;
+    }
+    free(inputs);
+
+    // Return NULL if the samples cannot be converted to float.
+    if (source_encoding == SAMPLE_UNSUPPORTED) {
+        print_message("Converting samples is not supported for this sample format.\n\n");
+        free_converter(new);
+        return NULL;
+    }
+    if (dither == DITHER_TPDF && !is_float_encoding(encoding) &&
+        (is_float_encoding(source_encoding) || new->sample_size < source_sample_size || !selection)) {
+        new->dither_amplitude = ldexpf(1, 1 - 8 * new->sample_size);
+    }
+    return new;
+}
+
+// A function for freeing a converter.
+void free_converter(converter* converter) {
+    free(converter->mix.terms);
+    free(converter->copy_inputs);
+    free(converter);
+}
+
+// A function for calculating the number of floats of scratch memory used by convert_block.
+size_t converter_scratch_size(converter* converter, size_t count) {
+    return converter->copy ? 0 : (size_t)(converter->source_channels + converter->num_channels) * count;
+}
+
+// A function for converting frames [first, first + count) from source into destination. The dither of a
+// frame depends on its position, so it does not depend on how the frames are split into blocks.
+void convert_block(converter* converter, char* source, size_t first, size_t count, char* destination, float* scratch) {
+    int num_channels = converter->num_channels;
+    if (converter->copy) {
+        int sample_size = converter->sample_size;
+        size_t source_frame_size = (size_t)converter->source_channels * sample_size;
+        for (size_t i = 0; i < count; ++i) {
+            char* in = source + i * source_frame_size;
+            char* out = destination + i * converter->frame_size;
+            for (int c = 0; c < num_channels; ++c) {
+                int input = converter->copy_inputs[c];
+                memcpy(out + c * sample_size, input != -1 ? in + input * sample_size : converter->silence, sample_size);
+            }
+        }
+        return;
+    }
+
+    // Decode the source frames into planar samples and mix them into the output channels.
+    float* input = scratch;
+    float* output = input;
+    decode_frames(source, input, count, converter->source_channels, converter->source_encoding, count);
+    if (converter->mix.terms != NULL) {
+        output = input + (size_t)converter->source_channels * count;
+        memset(output, 0, num_channels * count * sizeof(float));
+        for (int i = 0; i < converter->mix.num_terms; ++i) {
+            mix_term* term = converter->mix.terms + i;
+            mix_samples(input + term->input * count, output + term->output * count, term->weight, count);
+        }
+    }
+
+    // Each channel's dither starts at a different key, so channels get independent dither.
+    if (converter->dither_amplitude > 0) {
+        for (int c = 0; c < num_channels; ++c) {
+            dither_samples(output + c * count, count, 2 * (uint32_t)first + (uint32_t)c * 0x9E3779B9u,
+                           converter->dither_amplitude);
+        }
+    }
+    encode_frames(output, destination, count, num_channels, converter->encoding, count);
+}
+
+// A function for converting a range of blocks on a worker thread.
+static void convert_range(void* argument, size_t first_block, size_t last_block) {
+    convert_task* task = argument;
+    converter* converter = task->converter;
+
+    // Allocate scratch memory for one block unless the samples are copied, return on error.
+    size_t scratch_size = converter_scratch_size(converter, CONVERT_BLOCK_FRAMES);
+    float* scratch = scratch_size > 0 ? malloc(scratch_size * sizeof(float)) : NULL;
+    if (scratch_size > 0 && scratch == NULL) {
+        task->failed = 1;
+        return;
+    }
+
+    size_t source_frame_size = (size_t)converter->source_channels * converter->source_sample_size;
+    for (size_t block = first_block; block < last_block; ++block) {
+        size_t first = block * CONVERT_BLOCK_FRAMES;
+        size_t count = task->num_frames - first < CONVERT_BLOCK_FRAMES ? task->num_frames - first : CONVERT_BLOCK_FRAMES;
+        convert_block(converter, task->source + first * source_frame_size, first, count,
+                      task->destination + first * converter->frame_size, scratch);
+    }
+    free(scratch);
+}
+
+// A function for converting a whole buffer of frames, splitting the frames across worker threads.
+// Returns -1 if there is an error.
+int convert_frames(converter* converter, char* source, char* destination, size_t num_frames) {
+    convert_task task = { converter, source, destination, num_frames, 0 };
+    size_t num_blocks = (num_frames + CONVERT_BLOCK_FRAMES - 1) / CONVERT_BLOCK_FRAMES;
+    parallel_for(num_blocks, MIN_BLOCKS_PER_THREAD, convert_range, &task);
+    if (task.failed) {
+        print_message("Error allocating memory for converting samples.\n\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef H_CONVERT
+#define H_CONVERT
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Ways of rounding samples when a conversion reduces their resolution.
+enum dither { DITHER_NONE, DITHER_TPDF };
+
+// A term of a channel mix: output channel output gets input channel input multiplied by weight.
+typedef struct mix_term {
+    int output;
+    int input;
+    float weight;
+} mix_term;
+
+// A struct describing how the channels of frames are mixed into the channels of new frames. Output
+// channels without a term are silent.
+typedef struct channel_mix {
+    int num_channels;
+    mix_term* terms;
+    int num_terms;
+} channel_mix;
+
+// A struct describing how frames are converted to another sample encoding and channel layout.
+typedef struct converter {
+    int source_encoding;
+    int source_sample_size;
+    int source_channels;
+    int encoding;
+    int sample_size;
+    int num_channels;
+    int frame_size;
+
+    // channel mix, whose terms are NULL when the channels are kept
+    channel_mix mix;
+
+    // samples are copied as chars from the source channel of each output channel, or from silence
+    int copy;
+    int* copy_inputs;
+    char silence[8];
+
+    // amplitude of the triangular dither added before rounding, or 0
+    float dither_amplitude;
+} converter;
+
+// A function for converting a dither name to a dither. Returns -1 for unknown names.
+int parse_dither(char* name);
+
+// A function for creating a mix of source_channels channels down or up to num_channels channels.
+channel_mix* new_channel_mix(int source_channels, int num_channels);
+
+// A function for creating a mix that keeps the channels in a comma-separated list of channel numbers,
+// starting at 1, in the order of the list.
+channel_mix* parse_channel_selection(char* list, int source_channels);
+
+// A function for freeing a channel mix.
+void free_channel_mix(channel_mix* mix);
+
+// A function for creating a converter from frames of one sample encoding and number of channels to frames
+// of an encoding mixed with a channel mix, or with the same channels when mix is NULL.
+converter* new_converter(int source_encoding, int source_sample_size, int source_channels, int encoding,
+                         channel_mix* mix, int dither);
+
+// A function for freeing a converter.
+void free_converter(converter* converter);
+
+// A function for calculating the number of floats of scratch memory used by convert_block.
+size_t converter_scratch_size(converter* converter, size_t count);
+
+// A function for converting frames [first, first + count) from source into destination.
+void convert_block(converter* converter, char* source, size_t first, size_t count, char* destination, float* scratch);
+
+// A function for converting a whole buffer of frames, splitting the frames across worker threads.
+// Returns -1 if there is an error.
+int convert_frames(converter* converter, char* source, char* destination, size_t num_frames);
+
+#endif
@@ -0,0 +1,260 @@
+#include <string.h>
+#include "directory.h"
+
+// The size of an entry before its name, which is padded to a multiple of 4 chars.
+#define ENTRY_HEADER_SIZE 16
+
+// A function for calculating the size of an entry in a directory chunk.
+static int entry_size(directory_entry* entry) {
+    return ENTRY_HEADER_SIZE + ((int)strlen(entry->name) + 3) / 4 * 4;
+}
+
+// A function for creating an empty directory.
+// Returns NULL if there is an error.
+file_directory* new_directory() {
+    file_directory* directory = calloc(1, sizeof(file_directory));
+    if (directory == NULL) {
+        print_message("Error allocating memory for directory.\n\n");
+    }
+    return directory;
+}
+
+// A function for freeing a directory.
+void free_directory(file_directory* directory) {
+    free(directory->entries);
+    free(directory);
+}
+
+// A function for adding an entry to the end of a directory.
+// Returns -1 if there is an error.
+static int append_entry(file_directory* directory, directory_entry* entry) {
+    if (directory->num_entries == directory->capacity) {
+        int capacity = directory->capacity > 0 ? directory->capacity * 2 : 16;
+        directory_entry* entries = realloc(directory->entries, capacity * sizeof(directory_entry));
+        if (entries == NULL) {
+            print_message("Error allocating memory for directory.\n\n");
+            return -1;
+        }
+        directory->entries = entries;
+        directory->capacity = capacity;
+    }
+    directory->entries[directory->num_entries++] = *entry;
+    return 0;
+}
+
+// A function for parsing the payload of a directory chunk. Names that could point outside the current
+// directory are rejected, since entries are extracted to files with their names.
+// Returns NULL if the payload is not a valid directory.
+file_directory* parse_directory(char* payload, int size) {
+    file_directory* directory = new_directory();
+    if (directory == NULL) {
+        return NULL;
+    }
+
+    // Read each entry, return NULL if one does not fit before the trailer.
+    int num_entries = size >= DIRECTORY_TRAILER_SIZE ? *(int*)(payload + size - DIRECTORY_TRAILER_SIZE) : -1;
+    int position = 0;
+    for (int i = 0; i < num_entries; ++i) {
+        directory_entry entry;
+        int name_length = position + ENTRY_HEADER_SIZE <= size - DIRECTORY_TRAILER_SIZE ? *(int*)(payload + position + 12) : -1;
+        if (name_length <= 0 || name_length > DIRECTORY_NAME_SIZE ||
+                position + ENTRY_HEADER_SIZE + name_length > size - DIRECTORY_TRAILER_SIZE) {
+            num_entries = -1;
+            break;
+        }
+        entry.offset = *(int*)(payload + position);
+        entry.size = *(int*)(payload + position + 4);
+        entry.checksum = *(uint32_t*)(payload + position + 8);
+        memcpy(entry.name, payload + position + ENTRY_HEADER_SIZE, name_length);
+        entry.name[name_length] = 0;
+        if (strlen(entry.name) != (size_t)name_length || strchr(entry.name, '/') || !strcmp(entry.name, ".") ||
+                !strcmp(entry.name, "..") || append_entry(directory, &entry) == -1) {
+            num_entries = -1;
+            break;
+        }
+        position += entry_size(&entry);
+    }
+    if (num_entries == -1 || position != size - DIRECTORY_TRAILER_SIZE) {
+        print_message("Error - Embedded file directory corrupted.\n\n");
+        free_directory(directory);
+        return NULL;
+    }
+    return directory;
+}
+
+// A function for calculating the payload size of a directory chunk.
+int directory_size(file_directory* directory) {
+    int size = DIRECTORY_TRAILER_SIZE;
+    for (int i = 0; i < directory->num_entries; ++i) {
+        size += entry_size(directory->entries + i);
+    }
+    return size;
+}
+
+// A function for writing the payload of a directory chunk.
+void write_directory(file_directory* directory, char* destination) {
+    int position = 0;
+    for (int i = 0; i < directory->num_entries; ++i) {
+        directory_entry* entry = directory->entries + i;
+        int length = entry_size(entry);
+        memset(destination + position, 0, length);
+        *(int*)(destination + position) = entry->offset;
+        *(int*)(destination + position + 4) = entry->size;
+        *(uint32_t*)(destination + position + 8) = entry->checksum;
+        *(int*)(destination + position + 12) = strlen(entry->name);
+        memcpy(destination + position + ENTRY_HEADER_SIZE, entry->name, strlen(entry->name));
+        position += length;
+    }
+    *(int*)(destination + position) = directory->num_entries;
+    *(int*)(destination + position + 4) = position + DIRECTORY_TRAILER_SIZE;
+}
+
+// A function for recording an embedded file under the name of the file it was read from, without its path.
+// Returns -1 if there is an error.
+int add_entry(file_directory* directory, char* file_name, int offset, int size, uint32_t checksum) {
+    char* name = strrchr(file_name, '/') != NULL ? strrchr(file_name, '/') + 1 : file_name;
+    if (strlen(name) == 0 || strlen(name) > DIRECTORY_NAME_SIZE || !strcmp(name, ".") || !strcmp(name, "..")) {
+        print_message("%s is not a valid embedded file name.\n\n", file_name);
+        return -1;
+    }
+    directory_entry entry = { .offset = offset, .size = size, .checksum = checksum };
+    strcpy(entry.name, name);
+    return append_entry(directory, &entry);
+}
+
+// A function for removing an entry from a directory.
+void remove_entry(file_directory* directory, int index) {
+    memmove(directory->entries + index, directory->entries + index + 1,
+            (directory->num_entries - index - 1) * sizeof(directory_entry));
+    --directory->num_entries;
+}
+
+// A function for moving the entries of chunks after an offset by a number of chars.
+void shift_entries(file_directory* directory, int offset, int distance) {
+    for (int i = 0; i < directory->num_entries; ++i) {
+        if (directory->entries[i].offset > offset) {
+            directory->entries[i].offset += distance;
+        }
+    }
+}
+
+// A function for finding the oldest entry with a name.
+// Returns -1 if there is none.
+int find_entry(file_directory* directory, char* name) {
+    for (int i = 0; i < directory->num_entries; ++i) {
+        if (!strcmp(directory->entries[i].name, name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// A function for finding the entry of the chunk at an offset.
+// Returns -1 if there is none.
+int find_entry_at(file_directory* directory, int offset) {
+    for (int i = 0; i < directory->num_entries; ++i) {
+        if (directory->entries[i].offset == offset) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// A function for printing the entries of a directory to the user.
+void print_directory(file_directory* directory) {
+    print_message("Embedded files:     %i\n", directory->num_entries);
+    for (int i = 0; i < directory->num_entries; ++i) {
+        directory_entry* entry = directory->entries + i;
+        print_message("  %-40s %10i bytes  crc32c %08x\n", entry->name, entry->size, entry->checksum);
+    }
+    print_message("\n");
+}
+
+// A function for copying a payload between files through a buffer, or only reading it when fd_out is -1,
+// and calculating its checksum.
+// Returns the number of chars copied or -1 if there is an error.
+ssize_t copy_payload(int fd_in, off_t offset, int fd_out, off_t out_offset, size_t size, char* buffer, size_t buffer_size,
+                     uint32_t* checksum) {
+    size_t chars_copied = 0;
+    *checksum = 0;
+    while (chars_copied < size) {
+        size_t length = size - chars_copied < buffer_size ? size - chars_copied : buffer_size;
+        ssize_t chars_read = read_file_range(fd_in, buffer, length, offset + chars_copied);
+        if (chars_read <= 0) {
+            return chars_read == -1 ? -1 : (ssize_t)chars_copied;
+        }
+        *checksum = crc32c(*checksum, buffer, chars_read);
+        if (fd_out != -1 && write_file_range(fd_out, buffer, chars_read, out_offset + chars_copied) == -1) {
+            return -1;
+        }
+        chars_copied += chars_read;
+    }
+    return chars_copied;
+}
+
+// A function for creating the temporary file an embedded file is extracted to, named after the embedded file.
+// Returns a file descriptor or -1 if there is an error.
+static int create_extracted_file(directory_entry* entry, char* temporary_name) {
+    sprintf(temporary_name, "%s.XXXXXX", entry->name);
+    int fd = mkstemp(temporary_name);
+    if (fd == -1) {
+        print_message("Error writing file. Unable to open %s.\n\n", temporary_name);
+    } else {
+        fchmod(fd, 0644);
+    }
+    return fd;
+}
+
+// A function for closing the temporary file an embedded file was extracted to and renaming it after the
+// embedded file if all of it was extracted and its checksum matches the directory.
+// Returns -1 if there is an error.
+static int finish_extracted_file(directory_entry* entry, char* temporary_name, int fd, int complete, uint32_t checksum) {
+    complete = close_file(fd) == 0 && complete;
+    if (!complete || checksum != entry->checksum || rename(temporary_name, entry->name)) {
+        if (complete && checksum != entry->checksum) {
+            print_message("Error - Checksum of embedded file %s does not match.\n\n", entry->name);
+        } else if (complete) {
+            print_message("Error writing file %s.\n\n", entry->name);
+        }
+        unlink(temporary_name);
+        return -1;
+    }
+    return 0;
+}
+
+// A function for extracting an embedded file to a file with its name, reading its payload from a range of
+// a file. The payload is written to a temporary file that only replaces the named file if its checksum
+// matches the directory.
+// Returns -1 if there is an error.
+int extract_entry(directory_entry* entry, int fd, off_t offset, char* buffer, size_t buffer_size) {
+    char temporary_name[DIRECTORY_NAME_SIZE + 8];
+    int fd_out = create_extracted_file(entry, temporary_name);
+    if (fd_out == -1) {
+        return -1;
+    }
+    uint32_t checksum;
+    ssize_t chars_copied = copy_payload(fd, offset, fd_out, 0, entry->size, buffer, buffer_size, &checksum);
+    if (chars_copied != -1 && chars_copied != entry->size) {
+        print_message("Error - Embedded file %s is truncated.\n\n", entry->name);
+    }
+    return finish_extracted_file(entry, temporary_name, fd_out, chars_copied == entry->size, checksum);
+}
+
+// A function for extracting a compressed embedded file to a file with its name, decompressing it one group
+// of blocks at a time. The output replaces the named file only if its checksum matches the directory.
+// Returns -1 if there is an error.
+int extract_compressed_entry(directory_entry* entry, payload_reader reader, void* argument) {
+    char temporary_name[DIRECTORY_NAME_SIZE + 8];
+    int fd_out = create_extracted_file(entry, temporary_name);
+    if (fd_out == -1) {
+        return -1;
+    }
+    uint32_t checksum;
+    ssize_t chars_written = decompress_payload(reader, argument, entry->size, fd_out, &checksum);
+    return finish_extracted_file(entry, temporary_name, fd_out, chars_written != -1, checksum);
+}
+
+// A function for determining whether a chunk holds an embedded file, either as is or compressed.
+int is_embedded_chunk(char* id) {
+    return !memcmp(id, "file", 4) || !memcmp(id, "zfil", 4);
+}
@@ -0,0 +1,74 @@
+#ifndef H_DIRECTORY
+#define H_DIRECTORY
+
+#include "compress.h"
+
+// The payload of a directory chunk ends with the number of entries and the payload size, so the chunk can be
+// found from the end of the file. The directory chunk is always the last chunk of a file.
+#define DIRECTORY_TRAILER_SIZE 8
+
+// The longest name recorded for an embedded file.
+#define DIRECTORY_NAME_SIZE 255
+
+// An embedded file recorded in a directory chunk.
+typedef struct directory_entry {
+    int offset; // position of the "file" or "zfil" chunk header after the end of the data chunk and its pad byte
+    int size; // size of the chunk's payload, which is compressed in a "zfil" chunk
+    uint32_t checksum; // CRC-32C of the embedded file
+    char name[DIRECTORY_NAME_SIZE + 1];
+} directory_entry;
+
+// A struct holding the entries of a directory chunk in the order of their chunks.
+typedef struct file_directory {
+    directory_entry* entries;
+    int num_entries;
+    int capacity;
+} file_directory;
+
+// A function for creating an empty directory.
+file_directory* new_directory();
+
+// A function for freeing a directory.
+void free_directory(file_directory* directory);
+
+// A function for parsing the payload of a directory chunk.
+file_directory* parse_directory(char* payload, int size);
+
+// A function for calculating the payload size of a directory chunk.
+int directory_size(file_directory* directory);
+
+// A function for writing the payload of a directory chunk.
+void write_directory(file_directory* directory, char* destination);
+
+// A function for recording an embedded file under the name of the file it was read from.
+int add_entry(file_directory* directory, char* file_name, int offset, int size, uint32_t checksum);
+
+// A function for removing an entry from a directory.
+void remove_entry(file_directory* directory, int index);
+
+// A function for moving the entries of chunks after an offset by a number of chars.
+void shift_entries(file_directory* directory, int offset, int distance);
+
+// A function for finding the oldest entry with a name. Returns -1 if there is none.
+int find_entry(file_directory* directory, char* name);
+
+// A function for finding the entry of the chunk at an offset. Returns -1 if there is none.
+int find_entry_at(file_directory* directory, int offset);
+
+// A function for printing the entries of a directory to the user.
+void print_directory(file_directory* directory);
+
+// A function for copying a payload between files, or only reading it when fd_out is -1, and calculating its checksum.
+ssize_t copy_payload(int fd_in, off_t offset, int fd_out, off_t out_offset, size_t size, char* buffer, size_t buffer_size,
+                     uint32_t* checksum);
+
+// A function for extracting an embedded file to a file with its name, reading its payload from a file.
+int extract_entry(directory_entry* entry, int fd, off_t offset, char* buffer, size_t buffer_size);
+
+// A function for extracting a compressed embedded file to a file with its name.
+int extract_compressed_entry(directory_entry* entry, payload_reader reader, void* argument);
+
+// A function for determining whether a chunk holds an embedded file, either as is or compressed.
+int is_embedded_chunk(char* id);
+
+#endif
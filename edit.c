@@ -0,0 +1,743 @@
+#include <limits.h>
+#include "edit.h"
+
+// A function for reading the header of the chunk at a position of a wav file edited in place.
+// Returns the position of the following chunk, or -1 if no complete chunk starts at the position.
+static off_t read_chunk(edit_file* edit, off_t position, char* header) {
+    if (edit->size - position < 8 || read_file_range(edit->fd, header, 8, position) != 8) {
+        return -1;
+    }
+    off_t size = chunk_header_size(&edit->wav, header);
+    if (size < 0 || size > edit->size - position - 8) {
+        return -1;
+    }
+    off_t payload_end = position + 8 + size;
+    char following[4];
+    ssize_t following_length = payload_end < edit->size ? read_file_range(edit->fd, following, 4, payload_end) : 0;
+    return payload_end + chunk_padding(size, following, following_length > 0 ? following_length : 0);
+}
+
+// A function for moving chars to an earlier position of a wav file edited in place.
+// Returns -1 if there is an error.
+static int move_chars(edit_file* edit, off_t from, off_t to, off_t size) {
+    off_t moved = 0;
+    while (moved < size) {
+        size_t length = size - moved < (off_t)edit->buffer_size ? (size_t)(size - moved) : edit->buffer_size;
+        if (read_file_range(edit->fd, edit->buffer, length, from + moved) != (ssize_t)length ||
+                write_file_range(edit->fd, edit->buffer, length, to + moved) != (ssize_t)length) {
+            return -1;
+        }
+        moved += length;
+    }
+    return 0;
+}
+
+// A function for adding the checksums of a range of a wav file edited in place to a list. The checksums of a range
+// that has not changed since they were read from the file are kept, and others are calculated by reading it.
+// Returns -1 if there is an error.
+static int add_edit_range(edit_file* edit, checksum_list* list, char* id, off_t position, off_t size) {
+    checksum_range* kept = find_checksum_range(edit->checksums, position);
+    checksum_range* range = add_checksum_range(list, id, position, size);
+    if (range == NULL) {
+        return -1;
+    }
+    if (kept != NULL && kept->size == size && !memcmp(kept->id, id, 4)) {
+        memcpy(range->checksums, kept->checksums, checksum_block_count(size, list->block_size) * sizeof(uint32_t));
+        return 0;
+    }
+    checksum_feed feed;
+    start_checksum_feed(&feed, range, list->block_size);
+    for (off_t done = 0; done < size; done += edit->buffer_size) {
+        size_t length = size - done < (off_t)edit->buffer_size ? (size_t)(size - done) : edit->buffer_size;
+        if (read_file_range(edit->fd, edit->buffer, length, position + done) != (ssize_t)length) {
+            return -1;
+        }
+        feed_checksum(&feed, edit->buffer, length);
+    }
+    return 0;
+}
+
+// A function for bringing the checksums of a wav file edited in place up to date with its audio data and the
+// embedded files before size, and writing its checksum chunk at size.
+// Returns the number of chars of the checksum chunk, or -1 if there is an error.
+static off_t write_checksums(edit_file* edit, off_t size) {
+    checksum_list* list = new_checksum_list(edit->checksums->block_size);
+    if (list == NULL) {
+        return -1;
+    }
+    int result = add_edit_range(edit, list, "data", edit->data_position + 8, edit->wav.data_size);
+    char header[8];
+    off_t position = edit->data_end;
+    off_t next;
+    while (result == 0 && position < size && (next = read_chunk(edit, position, header)) != -1) {
+        if (is_embedded_chunk(header)) {
+            result = add_edit_range(edit, list, header, position + 8, *(uint32_t*)(header + 4));
+        }
+        position = next;
+    }
+
+    // Write the checksum chunk, return -1 on error.
+    size_t payload_size = checksum_list_size(list);
+    char* chunk = result == 0 ? malloc((payload_size + 8) * sizeof(char)) : NULL;
+    if (chunk == NULL) {
+        if (result == 0) {
+            print_message("Error allocating memory for checksums.\n\n");
+        }
+        free_checksum_list(list);
+        return -1;
+    }
+    memcpy(chunk, CHECKSUM_CHUNK_ID, 4);
+    *(uint32_t*)(chunk + 4) = payload_size;
+    write_checksum_list(list, chunk + 8);
+    result = write_file_range(edit->fd, chunk, payload_size + 8, size) == (ssize_t)(payload_size + 8) ? 0 : -1;
+    free(chunk);
+    free_checksum_list(edit->checksums);
+    edit->checksums = list;
+    return result == 0 ? (off_t)payload_size + 8 : -1;
+}
+
+// A function for changing the size of a wav file edited in place and patching its RIFF chunk size, which an
+// RF64 file holds in its "ds64" chunk. A file with checksums has its checksum chunk written after size.
+// Returns -1 if there is an error.
+static int resize_file(edit_file* edit, off_t size) {
+    off_t checksum_length = edit->checksums != NULL ? write_checksums(edit, size) : 0;
+    if (checksum_length == -1 || ftruncate(edit->fd, size + checksum_length)) {
+        print_message("Error writing file.\n\n");
+        return -1;
+    }
+    char header[44];
+    edit->wav.chunk_size = size + checksum_length - 8;
+    write_riff_header(&edit->wav, header);
+    write_ds64_sizes(&edit->wav, header + 20);
+    if (write_file_range(edit->fd, header, 12, 0) != 12 ||
+            (edit->wav.rf64 && write_file_range(edit->fd, header + 20, 24, 20) != 24)) {
+        return -1;
+    }
+    edit->size = size;
+    return 0;
+}
+
+// A function for turning a wav file edited in place into an RF64 file, so it can grow past the 32-bit sizes of
+// a RIFF header. Inserting a "ds64" chunk would move the whole file, so it takes the place of a "JUNK" chunk
+// reserved after the RIFF header, as recorders write. The RIFF header is written when the file is resized.
+// Returns -1 if there is an error.
+static int convert_to_rf64(edit_file* edit) {
+    char chunk[8 + DS64_SIZE];
+    if (read_chunk(edit, 12, chunk) == -1 || memcmp(chunk, "JUNK", 4) || *(uint32_t*)(chunk + 4) < DS64_SIZE) {
+        print_message("The file needs RF64 sizes, but has no \"JUNK\" chunk after its RIFF header to hold them. "
+                      "Stream the file instead.\n\n");
+        return -1;
+    }
+    edit->wav.rf64 = 1;
+    memcpy(chunk, "ds64", 4);
+    write_ds64_sizes(&edit->wav, chunk + 8);
+    *(int*)(chunk + 8 + DS64_SIZE - 4) = 0;
+    uint32_t marker = RF64_SIZE_MARKER;
+    if (write_file_range(edit->fd, chunk, sizeof(chunk), 12) != sizeof(chunk) ||
+            write_file_range(edit->fd, (char*)&marker, 4, edit->data_position + 4) != 4) {
+        return -1;
+    }
+    return 0;
+}
+
+// A function for taking the checksums from the checksum chunk at the end of a wav file edited in place, which is
+// found from the number of ranges and the payload size its last chars hold, and leaving the chunk out of the size
+// of the file. A damaged checksum chunk is dropped.
+// Returns -1 if there is an error.
+static int take_checksums(edit_file* edit) {
+    uint32_t trailer[2];
+    char header[8];
+    if (edit->size - edit->data_end < 8 + CHECKSUM_TRAILER_SIZE ||
+            read_file_range(edit->fd, (char*)trailer, CHECKSUM_TRAILER_SIZE, edit->size - CHECKSUM_TRAILER_SIZE) != CHECKSUM_TRAILER_SIZE) {
+        return 0;
+    }
+    off_t size = trailer[1];
+    if (size < CHECKSUM_TRAILER_SIZE || size % 2 || size > edit->size - edit->data_end - 8 ||
+            read_file_range(edit->fd, header, 8, edit->size - size - 8) != 8 || memcmp(header, CHECKSUM_CHUNK_ID, 4) ||
+            *(uint32_t*)(header + 4) != size) {
+        return 0;
+    }
+
+    // Read the payload of the checksum chunk, return -1 on error.
+    char* payload = malloc(size * sizeof(char));
+    if (payload == NULL) {
+        print_message("Error allocating memory for checksums.\n\n");
+        return -1;
+    }
+    if (read_file_range(edit->fd, payload, size, edit->size - size) == size) {
+        edit->checksums = parse_checksum_list(payload, size);
+    }
+    free(payload);
+    edit->size -= size + 8;
+    return 0;
+}
+
+// A function for opening a wav file to edit in place. Only the RIFF header and the chunk headers are read.
+// Returns NULL if there is an error.
+edit_file* edit_open(char* file_name, size_t buffer_size) {
+
+    // Allocate memory for the file and its buffer, return NULL on error.
+    edit_file* edit = calloc(1, sizeof(edit_file));
+    char* buffer = malloc(buffer_size * sizeof(char));
+    if (edit == NULL || buffer == NULL) {
+        print_message("Error allocating memory for edited file.\n\n");
+        free(edit);
+        free(buffer);
+        return NULL;
+    }
+    edit->buffer = buffer;
+    edit->buffer_size = buffer_size;
+
+    // Open the file for reading and writing, return NULL on error.
+    struct stat st;
+    if (stat(file_name, &st)) {
+        print_message("The file %s does not exist.\n\n", file_name);
+        edit->fd = -1;
+        edit_close(edit);
+        return NULL;
+    }
+    edit->size = st.st_size;
+    edit->fd = open(file_name, O_RDWR);
+    if (edit->fd == -1) {
+        print_message("The file %s cannot be opened for editing.\n\n", file_name);
+        edit_close(edit);
+        return NULL;
+    }
+
+    // Return NULL if the file is not a valid wav file
+    char header[44] = { 0 };
+    if (edit->size < 44 || read_file_range(edit->fd, header, 44, 0) != 44) {
+        print_message("Error - Not a WAVE file.\n");
+        edit_close(edit);
+        return NULL;
+    }
+    if (parse_riff_header(header, &edit->wav) == -1) {
+        edit_close(edit);
+        return NULL;
+    }
+
+    // Return NULL if the RIFF chunk size is incorrect
+    if (edit->size != edit->wav.chunk_size + 8) {
+        print_message("File Corrupted. Incorrect chunk size.\n");
+        edit_close(edit);
+        return NULL;
+    }
+
+    // Walk the chunk headers up to the end of the "data" chunk, return NULL on error.
+    off_t position = 12;
+    int found_format = 0;
+    for (;;) {
+        memset(header, 0, 8);
+        off_t next = read_chunk(edit, position, header);
+        if (next == -1) {
+            if (found_format && !memcmp(header, "data", 4)) {
+                print_message("File Corrupted. Incorrect data size.\n");
+            } else {
+                print_message(found_format ? "Error - No \"data\" section." : "Error - No \"fmt \" section.");
+            }
+            edit_close(edit);
+            return NULL;
+        }
+        if (!found_format && !memcmp(header, "fmt ", 4)) {
+            char format[FORMAT_READ_SIZE];
+            off_t length = next - position < FORMAT_READ_SIZE ? next - position : FORMAT_READ_SIZE;
+            length = read_file_range(edit->fd, format, length, position);
+            parse_format(&edit->wav, format, length < 0 ? 0 : length);
+            found_format = 1;
+        }
+        edit->data_position = position;
+        edit->audio_end = position + 8 + chunk_header_size(&edit->wav, header);
+        position = next;
+        if (found_format && !memcmp(header, "data", 4)) {
+            break;
+        }
+    }
+    edit->data_end = position;
+
+    // Keep the audio data size and frame count for the "ds64" chunk of an RF64 file.
+    edit->wav.data_size = edit->audio_end - edit->data_position - 8;
+    edit->wav.all_channel_sample_size_in_bytes = edit->wav.num_channels * edit->wav.bits_per_sample / 8;
+    if (edit->wav.all_channel_sample_size_in_bytes > 0) {
+        edit->wav.num_all_channel_samples = edit->wav.data_size / edit->wav.all_channel_sample_size_in_bytes;
+    }
+
+    // Take the checksums from the end of the file, return NULL on error.
+    if (take_checksums(edit) == -1) {
+        edit_close(edit);
+        return NULL;
+    }
+    return edit;
+}
+
+// A function for closing a wav file edited in place.
+void edit_close(edit_file* edit) {
+    if (edit->fd != -1) {
+        close_file(edit->fd);
+    }
+    if (edit->checksums != NULL) {
+        free_checksum_list(edit->checksums);
+    }
+    free(edit->buffer);
+    free(edit);
+}
+
+// A function for reading the directory of the embedded files of a wav file edited in place. The last chars
+// of a directory chunk hold its payload size, so only the directory is read. Returns an empty directory if
+// the file has none, or NULL if there is an error.
+static file_directory* read_directory(edit_file* edit) {
+
+    // Locate the directory chunk from the end of the file.
+    int size = 0;
+    char header[8];
+    if (edit->size - edit->data_end < 8 + DIRECTORY_TRAILER_SIZE || read_file_range(edit->fd, (char*)&size, 4, edit->size - 4) != 4 ||
+            size < DIRECTORY_TRAILER_SIZE || size % 2 || size > edit->size - edit->data_end - 8 ||
+            read_file_range(edit->fd, header, 8, edit->size - size - 8) != 8 || memcmp(header, "fdir", 4) ||
+            *(int*)(header + 4) != size) {
+        return new_directory();
+    }
+
+    // Read the payload of the directory chunk, return NULL on error.
+    char* payload = malloc(size * sizeof(char));
+    if (payload == NULL) {
+        print_message("Error allocating memory for directory.\n\n");
+        return NULL;
+    }
+    file_directory* directory = NULL;
+    if (read_file_range(edit->fd, payload, size, edit->size - size) == size) {
+        directory = parse_directory(payload, size);
+    }
+    free(payload);
+    return directory;
+}
+
+// A function for reading the directory of the embedded files of a wav file edited in place and leaving its
+// chunk out of the file, so an operation can change the chunks before it. store_directory writes it back.
+// Returns NULL if there is an error.
+static file_directory* take_directory(edit_file* edit) {
+    file_directory* directory = read_directory(edit);
+    if (directory != NULL && directory->num_entries > 0) {
+        edit->size -= directory_size(directory) + 8;
+    }
+    return directory;
+}
+
+// A function for writing the directory of the embedded files after the last chunk of a wav file edited in
+// place, then truncating the file after it and patching the RIFF chunk size, and freeing the directory.
+// The chunk is left out when there are no entries.
+// Returns -1 if there is an error.
+static int store_directory(edit_file* edit, file_directory* directory) {
+    off_t size = edit->size;
+    int result = 0;
+    if (directory->num_entries > 0) {
+        int payload_size = directory_size(directory);
+        char* chunk = malloc((payload_size + 8) * sizeof(char));
+        if (chunk == NULL) {
+            print_message("Error allocating memory for directory.\n\n");
+            result = -1;
+        } else {
+            memcpy(chunk, "fdir", 4);
+            *(int*)(chunk + 4) = payload_size;
+            write_directory(directory, chunk + 8);
+            result = write_file_range(edit->fd, chunk, payload_size + 8, size) == payload_size + 8 ? 0 : -1;
+            size += payload_size + 8;
+            free(chunk);
+        }
+    }
+    free_directory(directory);
+    return result == -1 ? -1 : resize_file(edit, size);
+}
+
+// A function for appending an embedded file, compressed or as is, to the end of a wav file in place and
+// recording it in the directory, which is written after it. The RIFF chunk size is patched after both are
+// written.
+// Returns -1 if there is an error.
+int edit_push_back_file(edit_file* edit, char* embedded_filename, int compression) {
+
+    // Take the directory from the end of the file, return -1 on error.
+    file_directory* directory = take_directory(edit);
+    if (directory == NULL) {
+        return -1;
+    }
+
+    // Open the embedded file, return -1 on error.
+    off_t size;
+    int fd = open_file(embedded_filename, &size);
+    if (fd == -1) {
+        store_directory(edit, directory);
+        return -1;
+    }
+
+    // Return -1 if the chunk and the directory could not be recorded at offsets from the end of the data chunk,
+    // or if the file would need RF64 sizes and cannot be converted.
+    off_t bound = compression != COMPRESSION_NONE ? (off_t)compressed_bound(size) : size;
+    off_t growth = 8 + bound + 1 + directory_size(directory) + DIRECTORY_NAME_SIZE + 24;
+    if (edit->size - edit->data_end + growth > INT_MAX) {
+        print_message("The file %s is too large to embed.\n\n", embedded_filename);
+        close_file(fd);
+        store_directory(edit, directory);
+        return -1;
+    }
+    if (edit->checksums != NULL) {
+        growth += 8 + checksum_list_size(edit->checksums) + checksum_payload_size(1, checksum_block_count(bound, CHECKSUM_BLOCK_SIZE));
+    }
+    if (!edit->wav.rf64 && edit->size + growth - 8 >= RF64_SIZE_MARKER && convert_to_rf64(edit) == -1) {
+        close_file(fd);
+        store_directory(edit, directory);
+        return -1;
+    }
+
+    // Write the embedded file, compressed or as is, after the last chunk.
+    uint32_t checksum;
+    ssize_t chunk_size;
+    if (compression != COMPRESSION_NONE) {
+        file_range range = { edit->fd, edit->size + 8 };
+        chunk_size = compress_payload(fd, size, compression, write_file_payload, &range, &checksum);
+    } else {
+        chunk_size = copy_payload(fd, 0, edit->fd, edit->size + 8, size, edit->buffer, edit->buffer_size, &checksum);
+        chunk_size = chunk_size == size ? chunk_size : -1;
+    }
+
+    // Write the chunk header before the payload and any pad byte after it, then record the file in the
+    // directory. Odd-sized chunks are followed by a pad byte.
+    char header[8];
+    memcpy(header, compression != COMPRESSION_NONE ? "zfil" : "file", 4);
+    *(int*)(header + 4) = chunk_size;
+    int padding = chunk_size % 2;
+    char pad = 0;
+    int result = -1;
+    if (chunk_size != -1 && write_file_range(edit->fd, header, 8, edit->size) == 8 &&
+            (!padding || write_file_range(edit->fd, &pad, 1, edit->size + 8 + chunk_size) == 1) &&
+            add_entry(directory, embedded_filename, edit->size - edit->data_end, chunk_size, checksum) == 0) {
+        edit->size += 8 + chunk_size + padding;
+        result = 0;
+    }
+    close_file(fd);
+    return store_directory(edit, directory) == -1 ? -1 : result;
+}
+
+// A function for forgetting the checksums of the chunk at a position of a wav file edited in place, once the chunk
+// is removed, so they are not taken for those of a chunk moved there.
+static void forget_checksums(edit_file* edit, off_t position) {
+    checksum_range* range = edit->checksums != NULL ? find_checksum_range(edit->checksums, position + 8) : NULL;
+    if (range != NULL) {
+        range->position = -1;
+    }
+}
+
+// A function for removing the embedded file chunk with a header between position and next from a wav file
+// edited in place and from its directory, after extracting it to extracted_file_name unless it is NULL. The
+// chunk is kept if the embedded file cannot be extracted.
+// Returns -1 if there is an error.
+static int remove_file_chunk(edit_file* edit, file_directory* directory, off_t position, off_t next, char* header,
+                             char* extracted_file_name, int mode) {
+
+    // Write the extracted file to disk, decompressing it if it was compressed, return -1 on error.
+    if (extracted_file_name != NULL) {
+        int fd = create_file(extracted_file_name);
+        if (fd == -1) {
+            return -1;
+        }
+        int size = *(int*)(header + 4);
+        int result;
+        if (!memcmp(header, "zfil", 4)) {
+            file_range range = { edit->fd, position + 8 };
+            uint32_t checksum;
+            result = decompress_payload(read_file_payload, &range, size, fd, &checksum) != -1 ? 0 : -1;
+        } else {
+            result = copy_file_chars(edit->fd, position + 8, fd, size, edit->buffer, edit->buffer_size) == size ? 0 : -1;
+        }
+        result = close_file(fd) == -1 ? -1 : result;
+        if (result == -1) {
+            return -1;
+        }
+    }
+
+    // Remove the chunk from the directory.
+    int offset = position - edit->data_end;
+    int entry_index = find_entry_at(directory, offset);
+    if (entry_index != -1) {
+        remove_entry(directory, entry_index);
+    }
+
+    // Rename the chunk, or move the chunks that follow it over it, along with their checksums.
+    forget_checksums(edit, position);
+    if (mode == REMOVE_JUNK) {
+        return write_file_range(edit->fd, "JUNK", 4, position) == 4 ? 0 : -1;
+    }
+    if (move_chars(edit, next, position, edit->size - next) == -1) {
+        return -1;
+    }
+    shift_entries(directory, offset, -(int)(next - position));
+    for (int i = 0; edit->checksums != NULL && i < edit->checksums->num_ranges; ++i) {
+        if (edit->checksums->ranges[i].position > next) {
+            edit->checksums->ranges[i].position -= next - position;
+        }
+    }
+    edit->size -= next - position;
+    return 0;
+}
+
+// A function for extracting the oldest embedded file from a wav file and removing it in place, either by
+// moving the chunks that follow it or by renaming its chunk to "JUNK".
+// Returns -1 if there is an error.
+int edit_pop_front_file(edit_file* edit, char* extracted_file_name, int mode) {
+
+    // Take the directory from the end of the file, return -1 on error.
+    file_directory* directory = take_directory(edit);
+    if (directory == NULL) {
+        return -1;
+    }
+
+    // Locate the first embedded file after the audio data, return -1 if none exist.
+    char header[8];
+    off_t position = edit->data_end;
+    off_t next;
+    while ((next = read_chunk(edit, position, header)) != -1 && !is_embedded_chunk(header)) {
+        position = next;
+    }
+    int result = -1;
+    if (next == -1) {
+        print_message("There are no embedded files.\n\n");
+    } else {
+        result = remove_file_chunk(edit, directory, position, next, header, extracted_file_name, mode);
+    }
+    return store_directory(edit, directory) == -1 ? -1 : result;
+}
+
+// A function for finding the chunk of the oldest entry with a name in the directory of a wav file edited in
+// place, storing its header, its position and the position of the following chunk.
+// Returns the index of the entry, or -1 if it cannot be found.
+static int find_named_chunk(edit_file* edit, file_directory* directory, char* name, char* header, off_t* position,
+                            off_t* next) {
+    int entry_index = find_entry(directory, name);
+    if (entry_index == -1) {
+        print_message("There is no embedded file named %s.\n\n", name);
+        return -1;
+    }
+    *position = edit->data_end + directory->entries[entry_index].offset;
+    *next = *position >= edit->data_end ? read_chunk(edit, *position, header) : -1;
+    if (*next == -1 || !is_embedded_chunk(header) || *(int*)(header + 4) != directory->entries[entry_index].size) {
+        print_message("Error - Embedded file directory does not match the file.\n\n");
+        return -1;
+    }
+    return entry_index;
+}
+
+// A function for listing the embedded files recorded in the directory of a wav file. Only the directory is read.
+// Returns -1 if there is an error.
+int edit_list_files(edit_file* edit) {
+    file_directory* directory = read_directory(edit);
+    if (directory == NULL) {
+        return -1;
+    }
+    print_directory(directory);
+    free_directory(directory);
+    return 0;
+}
+
+// A function for extracting the oldest embedded file with a name to a file with that name. Only the directory
+// and the embedded file are read.
+// Returns -1 if there is an error.
+int edit_extract_file(edit_file* edit, char* name) {
+    file_directory* directory = read_directory(edit);
+    if (directory == NULL) {
+        return -1;
+    }
+    char header[8];
+    off_t position, next;
+    int entry_index = find_named_chunk(edit, directory, name, header, &position, &next);
+    int result = -1;
+    if (entry_index != -1 && !memcmp(header, "zfil", 4)) {
+        file_range range = { edit->fd, position + 8 };
+        result = extract_compressed_entry(directory->entries + entry_index, read_file_payload, &range);
+    } else if (entry_index != -1) {
+        result = extract_entry(directory->entries + entry_index, edit->fd, position + 8, edit->buffer, edit->buffer_size);
+    }
+    free_directory(directory);
+    return result;
+}
+
+// A function for deleting the oldest embedded file with a name from a wav file in place, either by moving the
+// chunks that follow it or by renaming its chunk to "JUNK".
+// Returns -1 if there is an error.
+int edit_delete_file(edit_file* edit, char* name, int mode) {
+    file_directory* directory = take_directory(edit);
+    if (directory == NULL) {
+        return -1;
+    }
+    char header[8];
+    off_t position, next;
+    int result = -1;
+    if (find_named_chunk(edit, directory, name, header, &position, &next) != -1) {
+        result = remove_file_chunk(edit, directory, position, next, header, NULL, mode);
+    }
+    return store_directory(edit, directory) == -1 ? -1 : result;
+}
+
+// A function for removing the "JUNK" chunks that follow the audio data of a wav file in place. Each
+// remaining chunk is moved down over the "JUNK" chunks before it, so the audio data is never moved.
+// Returns -1 if there is an error.
+int edit_compact(edit_file* edit) {
+
+    // Take the directory from the end of the file, return -1 on error.
+    file_directory* directory = take_directory(edit);
+    if (directory == NULL) {
+        return -1;
+    }
+
+    char header[8];
+    off_t position = edit->data_end;
+    off_t destination = edit->data_end;
+    while (position < edit->size) {
+
+        // Chars that do not form a complete chunk are kept as they are.
+        off_t next = read_chunk(edit, position, header);
+        if (next == -1) {
+            next = edit->size;
+        } else if (!memcmp(header, "JUNK", 4)) {
+            position = next;
+            continue;
+        }
+
+        // Move the chunk and its directory entry.
+        if (destination != position) {
+            if (move_chars(edit, position, destination, next - position) == -1) {
+                free_directory(directory);
+                return -1;
+            }
+            int entry_index = find_entry_at(directory, position - edit->data_end);
+            if (entry_index != -1) {
+                directory->entries[entry_index].offset = destination - edit->data_end;
+            }
+            checksum_range* range = edit->checksums != NULL ? find_checksum_range(edit->checksums, position + 8) : NULL;
+            forget_checksums(edit, destination);
+            if (range != NULL) {
+                range->position = destination + 8;
+            }
+        }
+        destination += next - position;
+        position = next;
+    }
+
+    // Truncate the file after the last chunk kept.
+    if (destination == edit->size) {
+        print_message("There are no JUNK chunks after the audio data.\n\n");
+    } else {
+        print_message("Removing %lld bytes of JUNK chunks.\n\n", (long long)(edit->size - destination));
+    }
+    edit->size = destination;
+    return store_directory(edit, directory);
+}
+
+// A function for adding the checksums of the audio data and the embedded files to a wav file in place, in a
+// checksum chunk after its last chunk. Each is read once, and a file with checksums keeps them.
+// Returns -1 if there is an error.
+int edit_add_checksums(edit_file* edit) {
+    if (edit->checksums != NULL) {
+        print_message("The file already has checksums.\n\n");
+        return 0;
+    }
+    print_message("Adding checksums to the file.\n\n");
+    edit->checksums = new_checksum_list(CHECKSUM_BLOCK_SIZE);
+    return edit->checksums != NULL ? resize_file(edit, edit->size) : -1;
+}
+
+// A function for running in-place edit mode from the command line.
+// Returns 1 if any operation fails.
+int edit_main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("Must provide a file name\n");
+        return 1;
+    }
+
+    // Look for the file mode and the size of the buffer chars are moved through, then open the file.
+    size_t block_size = parse_run_options(argc - 3, argv + 3);
+    edit_file* edit = edit_open(*(argv + 2), block_size > 0 ? block_size : STREAM_DEFAULT_BLOCK_SIZE);
+    if (edit == NULL) {
+        return 1;
+    }
+
+    // Read options and perform associated operations in order.
+    int mode = REMOVE_SHIFT;
+    int compression = COMPRESSION_NONE;
+    int num_errors = 0;
+    for (int i = 3; i < argc; ++i) {
+        int result = 0;
+        char* arg = *(argv + i);
+        char* value = i + 1 < argc ? *(argv + i + 1) : NULL;
+
+        // The profile option was handled before opening the file, and the other options are recorded in the profile.
+        if (is_profile_option(arg)) {
+            continue;
+        }
+        profile_span span;
+        profile_begin(&span, "operation", arg, NULL);
+
+        // Print error for an operation missing its value
+        if (value == NULL && (!strncmp(arg, "-e", 2) || !strncmp(arg, "-r", 2) || !strncmp(arg, "-x", 2) ||
+                              !strncmp(arg, "-d", 2) || is_run_option(arg))) {
+            print_message("%s is missing a value.\n\n", arg);
+            result = -1;
+        // Embed hidden file option
+        } else if (!strncmp(arg, "-e", 2)) {
+            print_message("Embedding %s into wav file.\n\n", value);
+            result = edit_push_back_file(edit, value, compression);
+            ++i;
+        // Remove hidden file option
+        } else if (!strncmp(arg, "-r", 2)) {
+            print_message("Extracting %s from wav file\n\n", value);
+            result = edit_pop_front_file(edit, value, mode);
+            ++i;
+        // List embedded files option
+        } else if (!strncmp(arg, "-l", 2)) {
+            result = edit_list_files(edit);
+        // Extract embedded file by name option
+        } else if (!strncmp(arg, "-x", 2)) {
+            print_message("Extracting %s from wav file\n\n", value);
+            result = edit_extract_file(edit, value);
+            ++i;
+        // Delete embedded file by name option
+        } else if (!strncmp(arg, "-d", 2)) {
+            print_message("Deleting %s from wav file\n\n", value);
+            result = edit_delete_file(edit, value, mode);
+            ++i;
+        // Remove mode option
+        } else if (!strncmp(arg, "--remove=", 9)) {
+            if (!strcmp(arg + 9, "shift") || !strcmp(arg + 9, "junk")) {
+                mode = !strcmp(arg + 9, "junk") ? REMOVE_JUNK : REMOVE_SHIFT;
+            } else {
+                print_message("%s is an invalid remove mode.\n\n", arg + 9);
+                result = -1;
+            }
+        // Compression option
+        } else if (!strncmp(arg, "--compress=", 11)) {
+            int new_compression = parse_compression(arg + 11);
+            if (new_compression == -1) {
+                print_message("%s is an invalid compression.\n\n", arg + 11);
+                result = -1;
+            } else {
+                compression = new_compression;
+            }
+        // Compact option
+        } else if (!strcmp(arg, "--compact")) {
+            result = edit_compact(edit);
+        // Checksum option
+        } else if (!strcmp(arg, "--checksum")) {
+            result = edit_add_checksums(edit);
+        // Streaming and file mode options, handled before opening the file
+        } else if (is_run_option(arg)) {
+            ++i;
+        // Print error for invalid option
+        } else {
+            print_message("%s is an invalid option.\n\n", arg);
+            result = -1;
+        }
+        profile_end(&span);
+        num_errors += result == -1;
+    }
+    edit_close(edit);
+
+    // Display the chars moved between the disk and memory.
+    print_file_stats();
+    return num_errors != 0;
+}
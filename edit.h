@@ -0,0 +1,61 @@
+#ifndef H_EDIT
+#define H_EDIT
+
+#include "process.h"
+
+// Ways of removing an embedded file from a wav file edited in place.
+//   REMOVE_SHIFT  the chunks that follow the embedded file are moved over it and the file is truncated.
+//   REMOVE_JUNK   the embedded file's chunk is renamed to "JUNK", leaving the rest of the file untouched.
+enum remove_mode { REMOVE_SHIFT, REMOVE_JUNK };
+
+// A wav file edited in place on disk. Only the chunks after the audio data are read or moved, so
+// operations cost I/O in proportion to the embedded files rather than the recording.
+typedef struct edit_file {
+    int fd;
+    off_t size;
+    wav_file wav; // header information, with the sizes of an RF64 file
+    off_t data_position; // position of the data chunk header
+    off_t audio_end; // position following the audio data
+    off_t data_end; // position following the data chunk and its pad byte, which directory entries are relative to
+
+    // checksums from the checksum chunk after the last chunk, which is written again whenever the file changes, or
+    // NULL. The size of the file leaves the checksum chunk out.
+    checksum_list* checksums;
+
+    // buffer for moving chars within the file
+    char* buffer;
+    size_t buffer_size;
+} edit_file;
+
+// A function for opening a wav file to edit in place, moving chars through a buffer of buffer_size chars.
+edit_file* edit_open(char* file_name, size_t buffer_size);
+
+// A function for closing a wav file edited in place.
+void edit_close(edit_file* edit);
+
+// A function for appending an embedded file, compressed or as is, to the end of a wav file in place and
+// recording it in the directory.
+int edit_push_back_file(edit_file* edit, char* embedded_filename, int compression);
+
+// A function for extracting the oldest embedded file from a wav file and removing it in place.
+int edit_pop_front_file(edit_file* edit, char* extracted_file_name, int mode);
+
+// A function for listing the embedded files recorded in the directory of a wav file.
+int edit_list_files(edit_file* edit);
+
+// A function for extracting the oldest embedded file with a name to a file with that name.
+int edit_extract_file(edit_file* edit, char* name);
+
+// A function for deleting the oldest embedded file with a name from a wav file in place.
+int edit_delete_file(edit_file* edit, char* name, int mode);
+
+// A function for removing the "JUNK" chunks that follow the audio data of a wav file in place.
+int edit_compact(edit_file* edit);
+
+// A function for adding the checksums of the audio data and the embedded files to a wav file in place.
+int edit_add_checksums(edit_file* edit);
+
+// A function for running in-place edit mode from the command line.
+int edit_main(int argc, char** argv);
+
+#endif
@@ -1,4 +1,99 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include "file.h"
+#include "parallel.h"
+
+// A mapped file returned by read_file.
+typedef struct file_mapping {
+    char* buffer;
+    size_t size;
+    dev_t device;
+    ino_t inode;
+    struct file_mapping* next;
+} file_mapping;
+
+// A file created by create_file in place of a mapped file. It is written under a temporary name in the same
+// directory and renamed over the mapped file when it is closed, so the mapping keeps the contents it was read from.
+typedef struct file_replacement {
+    int fd;
+    char* file_name;
+    char* temporary_name;
+    struct file_replacement* next;
+} file_replacement;
+
+static int file_mode = FILE_MODE_STDIO;
+static file_stats stats;
+static file_mapping* mappings = NULL;
+static file_replacement* replacements = NULL;
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Function for adding chars moved since start to one of the counters. Batch workers move files
+// at the same time, so the counters are locked. The chars are counted for the profile too, with the
+// chars copied in the kernel counted as both read and written.
+static void add_stats(size_t* counter, size_t chars, double start) {
+    double seconds = current_seconds() - start;
+    profile_io(counter != &stats.chars_written ? chars : 0,
+               counter == &stats.chars_written || counter == &stats.chars_copied_in_kernel ? chars : 0);
+    pthread_mutex_lock(&stats_lock);
+    *counter += chars;
+    stats.seconds += seconds;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+// Function for selecting how files are read and copied.
+void set_file_mode(int mode) {
+    file_mode = mode;
+}
+
+// Function for retrieving the current file mode.
+int get_file_mode() {
+    return file_mode;
+}
+
+// Function for retrieving the counters of the chars moved by the file functions.
+file_stats* get_file_stats() {
+    return &stats;
+}
+
+// Function for mapping a file into memory. The mapping is private, so the buffer can be
+// modified without changing the file.
+// Returns NULL if the file cannot be mapped.
+static char* map_file(FILE* stream, struct stat* st) {
+    size_t size = st->st_size;
+    if (size == 0) {
+        return NULL;
+    }
+
+    // Allocate memory for the mapping record, return NULL on error.
+    file_mapping* mapping = malloc(sizeof(file_mapping));
+    if (mapping == NULL) {
+        return NULL;
+    }
+
+    // Map the file, return NULL on error.
+    char* buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(stream), 0);
+    if (buffer == MAP_FAILED) {
+        free(mapping);
+        return NULL;
+    }
+    madvise(buffer, size, MADV_SEQUENTIAL);
+
+    // Record the mapping so free_file can unmap it.
+    mapping->buffer = buffer;
+    mapping->size = size;
+    mapping->device = st->st_dev;
+    mapping->inode = st->st_ino;
+    pthread_mutex_lock(&mappings_lock);
+    mapping->next = mappings;
+    mappings = mapping;
+    pthread_mutex_unlock(&mappings_lock);
+    return buffer;
+}
 
 // Function for reading a file.
 // Returns the number of chars read from the file or -1 if there is an error.
@@ -7,52 +102,407 @@ size_t read_file(char* filename, char** buffer) {
     // Retrieve file information, return -1 on error
     struct stat st;
     if (stat(filename, &st)) {
-        printf("The file %s does not exist.\n\n", filename);
-        return -1;
-    }
-
-    // Allocate memory for the new file, return -1 on error.
-    size_t size = st.st_size;
-    *buffer = malloc(size * sizeof(char));
-    if (*buffer == NULL) {
-        printf("Error allocating memory for file %s.\n\n", filename);
+        print_message("The file %s does not exist.\n\n", filename);
         return -1;
     }
 
     // Open the file stream, return -1 on error
     FILE* stream = fopen(filename, "r");
     if (stream == NULL) {
-        printf("The file %s cannot be read.\n\n", filename);
+        print_message("The file %s cannot be read.\n\n", filename);
+        return -1;
+    }
+
+    // Map the file when mapping is enabled, falling back to reading it if it cannot be mapped.
+    profile_span span;
+    profile_begin(&span, "io", "read_file", filename);
+    double start = current_seconds();
+    size_t size = st.st_size;
+    if (file_mode == FILE_MODE_MMAP) {
+        *buffer = map_file(stream, &st);
+        if (*buffer != NULL) {
+            fclose(stream);
+            add_stats(&stats.chars_mapped, size, start);
+            profile_end(&span);
+            return size;
+        }
+    }
+
+    // Allocate memory for the new file, return -1 on error.
+    *buffer = malloc(size * sizeof(char));
+    if (*buffer == NULL) {
+        print_message("Error allocating memory for file %s.\n\n", filename);
+        fclose(stream);
+        profile_end(&span);
         return -1;
     }
+    profile_allocation(size);
 
     // Read the file, print an error message if unsuccessful.
-    size_t chars_read = fread(*buffer, sizeof(char), size, stream);
+    size_t chars_read;
+    if (file_mode == FILE_MODE_ASYNC) {
+        ssize_t result = async_read_range(fileno(stream), *buffer, size, 0);
+        chars_read = result > 0 ? result : 0;
+    } else {
+        chars_read = fread(*buffer, sizeof(char), size, stream);
+    }
     if (size != chars_read) {
-        printf("Warning, file size is %zu, but %zu bytes were read.\n\n", size, chars_read);
+        print_message("Warning, file size is %zu, but %zu bytes were read.\n\n", size, chars_read);
     }
 
     fclose(stream);
+    add_stats(&stats.chars_read, chars_read, start);
+    profile_end(&span);
     return chars_read;
 }
 
+// Function for freeing a buffer returned by read_file.
+void free_file(char* buffer) {
+
+    // Unmap the buffer if it is a mapped file.
+    pthread_mutex_lock(&mappings_lock);
+    for (file_mapping** mapping = &mappings; *mapping != NULL; mapping = &(*mapping)->next) {
+        if ((*mapping)->buffer == buffer) {
+            file_mapping* found = *mapping;
+            *mapping = found->next;
+            pthread_mutex_unlock(&mappings_lock);
+            munmap(found->buffer, found->size);
+            free(found);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&mappings_lock);
+
+    free(buffer);
+}
+
 // Function for writing to a file.
 // Returns the number of chars written to the file or -1 if there is an error.
 size_t write_file(char* filename, char* buffer, size_t size) {
 
-    // Open the file stream, return -1 on error
-    FILE* stream = fopen(filename, "w");
-    if (stream == NULL) {
-        printf("Error writing file. Unable to open file stream.\n\n");
+    // Create the file, return -1 on error
+    int fd = create_file(filename);
+    if (fd == -1) {
+        return -1;
+    }
+
+    // Write to the file, return -1 if it cannot all be written.
+    profile_span span;
+    profile_begin(&span, "io", "write_file", filename);
+    if (write_chars(fd, buffer, size) != (ssize_t)size) {
+        discard_file(fd);
+        profile_end(&span);
         return -1;
     }
+    int result = close_file(fd);
+    profile_end(&span);
+    return result != -1 ? size : (size_t)-1;
+}
 
-    // Write to the file, print an error message if unsuccessful.
-    size_t chars_written = fwrite(buffer, sizeof(char), size, stream);
-    if (size != chars_written) {
-        printf("Warning, file size is %zu, but %zu bytes were written.\n\n", size, chars_written);
+// Function for opening a file for positioned reads.
+// Returns a file descriptor or -1 if there is an error. The file size is stored in size.
+int open_file(char* filename, off_t* size) {
+
+    // Retrieve file information, return -1 on error
+    struct stat st;
+    if (stat(filename, &st)) {
+        print_message("The file %s does not exist.\n\n", filename);
+        return -1;
     }
 
-    fclose(stream);
+    // Open the file, return -1 on error
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        print_message("The file %s cannot be read.\n\n", filename);
+        return -1;
+    }
+
+    *size = st.st_size;
+    return fd;
+}
+
+// Function for creating an unnamed temporary file in TMPDIR or /tmp, which is deleted when it is closed.
+// Returns a file descriptor or -1 if there is an error.
+int create_temporary_file() {
+    char name[PATH_MAX];
+    snprintf(name, sizeof(name), "%s/wave.XXXXXX", getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp");
+    int fd = mkstemp(name);
+    if (fd == -1) {
+        print_message("Error writing file. Unable to open %s.\n\n", name);
+        return -1;
+    }
+    unlink(name);
+    return fd;
+}
+
+// Function for checking whether a file is mapped by read_file. The file information is stored in st.
+static int is_mapped_file(char* filename, struct stat* st) {
+    if (stat(filename, st)) {
+        return 0;
+    }
+    int mapped = 0;
+    pthread_mutex_lock(&mappings_lock);
+    for (file_mapping* mapping = mappings; mapping != NULL && !mapped; mapping = mapping->next) {
+        mapped = mapping->device == st->st_dev && mapping->inode == st->st_ino;
+    }
+    pthread_mutex_unlock(&mappings_lock);
+    return mapped;
+}
+
+// Function for creating a file in place of a mapped file, under a temporary name in the same directory with the
+// permissions of the mapped file.
+// Returns a file descriptor or -1 if there is an error.
+static int create_replacement(char* filename, struct stat* st) {
+
+    // Allocate memory for the replacement record and both names, return -1 on error.
+    size_t length = strlen(filename);
+    file_replacement* replacement = malloc(sizeof(file_replacement) + 2 * length + 9);
+    if (replacement == NULL) {
+        print_message("Error allocating memory for file name.\n\n");
+        return -1;
+    }
+    replacement->file_name = (char*)(replacement + 1);
+    replacement->temporary_name = replacement->file_name + length + 1;
+    strcpy(replacement->file_name, filename);
+    sprintf(replacement->temporary_name, "%s.XXXXXX", filename);
+
+    // Create the temporary file, return -1 on error.
+    int fd = mkstemp(replacement->temporary_name);
+    if (fd == -1) {
+        print_message("Error writing file. Unable to open %s.\n\n", replacement->temporary_name);
+        free(replacement);
+        return -1;
+    }
+    fchmod(fd, st->st_mode & 07777);
+
+    // Record the replacement so close_file can rename it.
+    replacement->fd = fd;
+    pthread_mutex_lock(&mappings_lock);
+    replacement->next = replacements;
+    replacements = replacement;
+    pthread_mutex_unlock(&mappings_lock);
+    return fd;
+}
+
+// Function for removing the replacement record of a file descriptor from the list of replacements.
+// Returns the record or NULL if the file descriptor does not replace a mapped file.
+static file_replacement* take_replacement(int fd) {
+    file_replacement* found = NULL;
+    pthread_mutex_lock(&mappings_lock);
+    for (file_replacement** replacement = &replacements; *replacement != NULL; replacement = &(*replacement)->next) {
+        if ((*replacement)->fd == fd) {
+            found = *replacement;
+            *replacement = found->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mappings_lock);
+    return found;
+}
+
+// Function for creating a file for sequential writes. A file that is mapped by read_file is not truncated while
+// it is still read from, but written under a temporary name that close_file renames over it.
+// Returns a file descriptor or -1 if there is an error.
+int create_file(char* filename) {
+    struct stat st;
+    if (is_mapped_file(filename, &st)) {
+        return create_replacement(filename, &st);
+    }
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        print_message("Error writing file. Unable to open %s.\n\n", filename);
+    }
+    return fd;
+}
+
+// Function for closing a file, finishing the writes to it that are still in flight. A file written in place of a
+// mapped file is renamed over it.
+// Returns -1 if a write failed.
+int close_file(int fd) {
+    int result = file_mode == FILE_MODE_ASYNC ? async_finish(fd) : 0;
+    if (result == -1) {
+        print_message("Error writing file.\n\n");
+    }
+    file_replacement* replacement = take_replacement(fd);
+    close(fd);
+    if (replacement != NULL) {
+        if (result != -1 && rename(replacement->temporary_name, replacement->file_name)) {
+            print_message("Error writing file. Unable to replace %s.\n\n", replacement->file_name);
+            result = -1;
+        }
+        if (result == -1) {
+            unlink(replacement->temporary_name);
+        }
+        free(replacement);
+    }
+    return result;
+}
+
+// Function for closing a file whose writes failed. A file written in place of a mapped file is removed, so the
+// mapped file is kept as it was.
+void discard_file(int fd) {
+    if (file_mode == FILE_MODE_ASYNC) {
+        async_finish(fd);
+    }
+    file_replacement* replacement = take_replacement(fd);
+    close(fd);
+    if (replacement != NULL) {
+        unlink(replacement->temporary_name);
+        free(replacement);
+    }
+}
+
+// Function for reading a range of a file.
+// Returns the number of chars read, which is less than size at the end of the file, or -1 on error.
+ssize_t read_file_range(int fd, char* buffer, size_t size, off_t offset) {
+    profile_span span;
+    profile_begin(&span, "io", "read_file_range", NULL);
+    double start = current_seconds();
+    ssize_t chars_read = 0;
+    if (file_mode == FILE_MODE_ASYNC) {
+        chars_read = async_read_range(fd, buffer, size, offset);
+    }
+    while (file_mode != FILE_MODE_ASYNC && (size_t)chars_read < size) {
+        ssize_t result = pread(fd, buffer + chars_read, size - chars_read, offset + chars_read);
+        if (result <= 0) {
+            chars_read = result == -1 ? -1 : chars_read;
+            break;
+        }
+        chars_read += result;
+    }
+    if (chars_read == -1) {
+        print_message("Error reading file.\n\n");
+        profile_end(&span);
+        return -1;
+    }
+    add_stats(&stats.chars_read, chars_read, start);
+    profile_end(&span);
+    return chars_read;
+}
+
+// Function for writing chars to a range of a file.
+// Returns the number of chars written or -1 if there is an error.
+ssize_t write_file_range(int fd, char* buffer, size_t size, off_t offset) {
+    profile_span span;
+    profile_begin(&span, "io", "write_file_range", NULL);
+    double start = current_seconds();
+    ssize_t chars_written = 0;
+    if (file_mode == FILE_MODE_ASYNC) {
+        chars_written = async_write_range(fd, buffer, size, offset);
+    }
+    while (file_mode != FILE_MODE_ASYNC && (size_t)chars_written < size) {
+        ssize_t result = pwrite(fd, buffer + chars_written, size - chars_written, offset + chars_written);
+        if (result == -1) {
+            chars_written = -1;
+            break;
+        }
+        chars_written += result;
+    }
+    if (chars_written == -1) {
+        print_message("Error writing file.\n\n");
+        profile_end(&span);
+        return -1;
+    }
+    add_stats(&stats.chars_written, chars_written, start);
+    profile_end(&span);
+    return chars_written;
+}
+
+// Function for writing chars to a file. In async mode the chars may still be in flight when it returns, and
+// close_file finishes them.
+// Returns the number of chars written or -1 if there is an error.
+ssize_t write_chars(int fd, char* buffer, size_t size) {
+    profile_span span;
+    profile_begin(&span, "io", "write_chars", NULL);
+    double start = current_seconds();
+    ssize_t chars_written = 0;
+    if (file_mode == FILE_MODE_ASYNC) {
+        chars_written = async_write_chars(fd, buffer, size);
+    }
+    while (file_mode != FILE_MODE_ASYNC && (size_t)chars_written < size) {
+        ssize_t result = write(fd, buffer + chars_written, size - chars_written);
+        if (result == -1) {
+            chars_written = -1;
+            break;
+        }
+        chars_written += result;
+    }
+    if (chars_written == -1) {
+        print_message("Error writing file.\n\n");
+        profile_end(&span);
+        return -1;
+    }
+    add_stats(&stats.chars_written, chars_written, start);
+    profile_end(&span);
     return chars_written;
-}
\ No newline at end of file
+}
+
+// Function for copying a range of one file to the end of another inside the kernel, first with
+// copy_file_range and then with sendfile.
+// Returns the number of chars copied, which is less than size if the kernel cannot copy the range.
+static size_t copy_in_kernel(int fd_in, off_t offset, int fd_out, size_t size) {
+    double start = current_seconds();
+    size_t chars_copied = 0;
+    int use_sendfile = 0;
+    while (chars_copied < size) {
+        off_t position = offset + chars_copied;
+        ssize_t result;
+        if (!use_sendfile) {
+            result = copy_file_range(fd_in, &position, fd_out, NULL, size - chars_copied, 0);
+            if (result == -1 && chars_copied == 0) {
+                use_sendfile = 1;
+                continue;
+            }
+        } else {
+            result = sendfile(fd_out, fd_in, &position, size - chars_copied);
+        }
+        if (result <= 0) {
+            break;
+        }
+        chars_copied += result;
+    }
+    add_stats(&stats.chars_copied_in_kernel, chars_copied, start);
+    return chars_copied;
+}
+
+// Function for copying a range of one file to the end of another, inside the kernel when the
+// file mode allows it and through a bounce buffer otherwise.
+// Returns the number of chars copied or -1 if there is an error.
+ssize_t copy_file_chars(int fd_in, off_t offset, int fd_out, size_t size, char* buffer, size_t buffer_size) {
+    profile_span span;
+    profile_begin(&span, "io", "copy_file_chars", NULL);
+    size_t chars_copied = 0;
+    if (file_mode == FILE_MODE_MMAP) {
+        chars_copied = copy_in_kernel(fd_in, offset, fd_out, size);
+    }
+    while (chars_copied < size) {
+        size_t length = size - chars_copied < buffer_size ? size - chars_copied : buffer_size;
+        ssize_t chars_read = read_file_range(fd_in, buffer, length, offset + chars_copied);
+        if (chars_read <= 0) {
+            print_message("Warning, %zu bytes were expected, but %zu bytes were copied.\n\n", size, chars_copied);
+            profile_end(&span);
+            return chars_read == -1 ? -1 : (ssize_t)chars_copied;
+        }
+        if (write_chars(fd_out, buffer, chars_read) == -1) {
+            profile_end(&span);
+            return -1;
+        }
+        chars_copied += chars_read;
+    }
+    profile_end(&span);
+    return chars_copied;
+}
+
+// Function for printing the counters of the chars moved by the file functions.
+void print_file_stats() {
+    if (file_mode == FILE_MODE_ASYNC) {
+        print_message("I/O stats (async, %s):\n", async_backend_name(get_async_backend()));
+    } else {
+        print_message("I/O stats (%s):\n", file_mode == FILE_MODE_MMAP ? "mmap" : "stdio");
+    }
+    print_message("Read:               %zu bytes\n", stats.chars_read);
+    print_message("Mapped:             %zu bytes\n", stats.chars_mapped);
+    print_message("Written:            %zu bytes\n", stats.chars_written);
+    print_message("Copied in kernel:   %zu bytes\n", stats.chars_copied_in_kernel);
+    print_message("I/O time:           %.6f s\n\n", stats.seconds);
+}
@@ -4,11 +4,78 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "async.h"
+#include "message.h"
+#include "profile.h"
+
+// Ways of moving file contents between the disk and memory.
+//   FILE_MODE_STDIO  files are read into heap buffers and ranges are copied through a buffer.
+//   FILE_MODE_MMAP   files are mapped into memory and ranges are copied inside the kernel.
+//   FILE_MODE_ASYNC  files read in order are read ahead and written behind, with io_uring or an I/O thread, so
+//                    the disk is busy while blocks are processed.
+enum file_mode { FILE_MODE_STDIO, FILE_MODE_MMAP, FILE_MODE_ASYNC };
+
+// Counters for the chars moved by the file functions.
+typedef struct file_stats {
+    size_t chars_read;
+    size_t chars_mapped;
+    size_t chars_written;
+    size_t chars_copied_in_kernel;
+    double seconds;
+} file_stats;
+
+// Function for selecting how files are read and copied.
+void set_file_mode(int mode);
+
+// Function for retrieving the current file mode.
+int get_file_mode();
+
+// Function for retrieving the counters of the chars moved by the file functions.
+file_stats* get_file_stats();
+
+// Function for printing the counters of the chars moved by the file functions.
+void print_file_stats();
 
 // Function for reading a file. Returns the number of chars read from the file.
 size_t read_file(char* filename, char** buffer);
 
+// Function for freeing a buffer returned by read_file.
+void free_file(char* buffer);
+
 // Function for writing to a file. Returns the number of chars written to the file.
 size_t write_file(char* filename, char* buffer, size_t size);
 
+// Function for opening a file for positioned reads. Returns a file descriptor and stores
+// the size of the file in size.
+int open_file(char* filename, off_t* size);
+
+// Function for creating a file for sequential writes. A file mapped by read_file is replaced when the new file is
+// closed, rather than truncated. Returns a file descriptor.
+int create_file(char* filename);
+
+// Function for creating an unnamed temporary file, which is deleted when it is closed. Returns a file descriptor.
+int create_temporary_file();
+
+// Function for closing a file, finishing the writes to it that are still in flight. Returns -1 if a write failed.
+int close_file(int fd);
+
+// Function for closing a file whose writes failed, without replacing a mapped file with it.
+void discard_file(int fd);
+
+// Function for reading a range of a file. Returns the number of chars read from the file.
+ssize_t read_file_range(int fd, char* buffer, size_t size, off_t offset);
+
+// Function for writing chars to a range of a file. Returns the number of chars written to the file.
+ssize_t write_file_range(int fd, char* buffer, size_t size, off_t offset);
+
+// Function for writing chars to a file. Returns the number of chars written to the file.
+ssize_t write_chars(int fd, char* buffer, size_t size);
+
+// Function for copying a range of one file to the end of another, inside the kernel when the
+// file mode allows it and through a bounce buffer otherwise. Returns the number of chars copied.
+ssize_t copy_file_chars(int fd_in, off_t offset, int fd_out, size_t size, char* buffer, size_t buffer_size);
+
 #endif
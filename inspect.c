@@ -0,0 +1,668 @@
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <strings.h>
+#include "inspect.h"
+#include "parallel.h"
+
+// The most worker threads inspect_files starts.
+#define MAX_INSPECTORS 64
+
+// The number of checksum blocks read at once for each thread while verifying a file, so the blocks read are
+// checksummed in parallel.
+#define VERIFY_BLOCKS_PER_THREAD 4
+
+// A function for writing a line of JSON about a file to a stream.
+// Returns -1 if the file could not be described.
+typedef int (*file_describer)(FILE* destination, char* file_name);
+
+// A struct for reading the chunk headers of a file through a buffer holding the last chars read.
+typedef struct header_reader {
+    int fd;
+    off_t size;
+    char buffer[INSPECT_READ_SIZE];
+    off_t position;
+    size_t length;
+} header_reader;
+
+// A struct holding the state shared by the workers of inspect_files. Each file's line is kept until the lines
+// of the files before it have been written.
+typedef struct inspect_run {
+    file_describer describe;
+    char** file_names;
+    int num_files;
+    int next_file;
+    char** lines;
+    int next_line;
+    int num_failed;
+    char empty_line[1]; // the line of a file whose description could not be allocated
+    FILE* destination;
+    pthread_mutex_t lock;
+} inspect_run;
+
+// A list of file names to inspect, which owns the names.
+typedef struct name_list {
+    char** names;
+    int num_names;
+    int capacity;
+} name_list;
+
+// A function for reading chars of a file, from the buffer when it holds them and otherwise by refilling the
+// buffer from the position. Ranges larger than the buffer are read directly.
+// Returns the number of chars read, which is less than size at the end of the file, or -1 if there is an error.
+static ssize_t read_chars(header_reader* reader, char* destination, size_t size, off_t position) {
+    if (size > INSPECT_READ_SIZE) {
+        return read_file_range(reader->fd, destination, size, position);
+    }
+    if (position < reader->position || position + (off_t)size > reader->position + (off_t)reader->length) {
+        off_t remaining = reader->size - position;
+        size_t length = remaining < INSPECT_READ_SIZE ? (remaining > 0 ? remaining : 0) : INSPECT_READ_SIZE;
+        ssize_t chars_read = length > 0 ? read_file_range(reader->fd, reader->buffer, length, position) : 0;
+        if (chars_read == -1) {
+            return -1;
+        }
+        reader->position = position;
+        reader->length = chars_read;
+    }
+    size_t available = reader->position + reader->length - position;
+    size = size < available ? size : available;
+    memcpy(destination, reader->buffer + (position - reader->position), size);
+    return size;
+}
+
+// A function for indexing every chunk of a wav file and reading its "fmt " chunk, as parse does for a file in
+// memory. A chunk that runs past the end of the file ends the walk.
+// Returns -1 if there is an error.
+static int index_file_chunks(header_reader* reader, wav_file* wav) {
+    char header[44];
+    if (reader->size < 44 || read_chars(reader, header, 44, 0) != 44) {
+        print_message("Error - Not a WAVE file.\n");
+        return -1;
+    }
+    if (parse_riff_header(header, wav) == -1) {
+        return -1;
+    }
+
+    // Return -1 if the RIFF chunk size is incorrect
+    if (reader->size != wav->chunk_size + 8) {
+        print_message("File Corrupted. Incorrect chunk size.\n");
+        return -1;
+    }
+    wav->file_size = reader->size;
+
+    off_t position = 12;
+    int found_format = 0;
+    while (position <= wav->file_size - 8) {
+        if (read_chars(reader, header, 8, position) != 8) {
+            return -1;
+        }
+        off_t size = chunk_header_size(wav, header);
+        if (add_wav_chunk(wav, header, position, size) == -1) {
+            return -1;
+        }
+        if (size < 0 || size > wav->file_size - position - 8) {
+            break;
+        }
+
+        // Read the first "fmt " chunk into the wav_file
+        if (!found_format && !memcmp(header, "fmt ", 4)) {
+            char format[FORMAT_READ_SIZE];
+            ssize_t length = read_chars(reader, format, size < FORMAT_READ_SIZE - 8 ? 8 + size : FORMAT_READ_SIZE, position);
+            parse_format(wav, format, length < 0 ? 0 : length);
+            wav->format_position = position;
+            found_format = 1;
+        }
+
+        // The chars after the payload decide whether it has a pad byte, and are read with the next header.
+        off_t payload_end = position + 8 + size;
+        char following[4];
+        ssize_t following_length = read_chars(reader, following, 4, payload_end);
+        position = payload_end + chunk_padding(size, following, following_length > 0 ? following_length : 0);
+    }
+    return 0;
+}
+
+// A function for locating the audio data of an indexed wav file and calculating its metrics.
+// Returns -1 if there is an error.
+static int locate_audio(wav_file* wav) {
+
+    // Return -1 if there is no "fmt " or "data" chunk
+    int data_index = find_chunk(wav, "data", 0);
+    if (find_chunk(wav, "fmt ", 0) == -1) {
+        print_message("Error - No \"fmt \" section.");
+        return -1;
+    }
+    if (data_index == -1) {
+        print_message("Error - No \"data\" section.");
+        return -1;
+    }
+    memcpy(wav->data_id, wav->chunks[data_index].id, 4);
+    wav->data_size = wav->chunks[data_index].size;
+    wav->data_position = wav->chunks[data_index].position;
+
+    // Return -1 if the audio data does not fit in the file or the sample size is invalid
+    if (wav->data_size < 0 || wav->data_size > wav->file_size - wav->data_position - 8) {
+        print_message("File Corrupted. Incorrect data size.\n");
+        return -1;
+    }
+    wav->all_channel_sample_size_in_bytes = wav->num_channels * wav->bits_per_sample / 8;
+    if (wav->all_channel_sample_size_in_bytes <= 0) {
+        print_message("Error - Invalid sample size.\n");
+        return -1;
+    }
+
+    // The data chunk ends after the pad byte of odd-sized audio data, if the file has one.
+    off_t next_position = data_index + 1 < wav->num_chunks ? wav->chunks[data_index + 1].position : wav->file_size;
+    wav->audio_data_position = wav->data_position + 8;
+    wav->data_end_position = wav->audio_data_position + wav->data_size;
+    wav->data_end_position += wav->data_size % 2 != 0 && next_position > wav->data_end_position;
+    wav->bytes_after_data = wav->file_size - wav->data_end_position;
+    wav->num_all_channel_samples = wav->data_size / wav->all_channel_sample_size_in_bytes;
+    return 0;
+}
+
+// A function for reading the directory of the embedded files of an indexed wav file from its last chunk, or the
+// chunk before a checksum chunk at the end.
+// Returns an empty directory if the file has none, or NULL if there is an error.
+static file_directory* read_file_directory(header_reader* reader, wav_file* wav) {
+    wav_chunk* chunk = wav->chunks + wav->num_chunks - 1;
+    if (!memcmp(chunk->id, CHECKSUM_CHUNK_ID, 4) && wav->num_chunks > 1) {
+        --chunk;
+    }
+    if (memcmp(chunk->id, "fdir", 4) || chunk->size > wav->file_size - chunk->position - 8) {
+        return new_directory();
+    }
+
+    // Read the payload of the directory chunk, return NULL on error.
+    char* payload = malloc(chunk->size * sizeof(char));
+    if (payload == NULL) {
+        print_message("Error allocating memory for directory.\n\n");
+        return NULL;
+    }
+    file_directory* directory = NULL;
+    if (read_chars(reader, payload, chunk->size, chunk->position + 8) == chunk->size) {
+        directory = parse_directory(payload, chunk->size);
+    }
+    free(payload);
+    return directory;
+}
+
+// A function for describing a wav file from its RIFF header and chunk headers, read with positioned reads through
+// a buffer of INSPECT_READ_SIZE chars, so a file costs a read for the chunks before the audio data and one for
+// each chunk after it. Only the directory chunk is read after the audio data.
+// Returns NULL if there is an error.
+wav_summary* inspect_wave_file(char* file_name) {
+
+    // Allocate memory for the summary and the reader, return NULL on error.
+    wav_summary* summary = calloc(1, sizeof(wav_summary));
+    header_reader* reader = malloc(sizeof(header_reader));
+    if (summary == NULL || reader == NULL) {
+        print_message("Error allocating memory for wav summary.\n\n");
+        free(summary);
+        free(reader);
+        return NULL;
+    }
+    reader->position = 0;
+    reader->length = 0;
+
+    // Open the file, return NULL on error.
+    reader->fd = open_file(file_name, &reader->size);
+    if (reader->fd == -1) {
+        free(reader);
+        free(summary);
+        return NULL;
+    }
+
+    // Index the chunks and read the directory, return NULL on error.
+    int result = index_file_chunks(reader, &summary->wav);
+    if (result == 0) {
+        result = locate_audio(&summary->wav);
+    }
+    if (result == 0) {
+        summary->directory = read_file_directory(reader, &summary->wav);
+        result = summary->directory == NULL ? -1 : 0;
+    }
+    close_file(reader->fd);
+    free(reader);
+    if (result == -1) {
+        free_summary(summary);
+        return NULL;
+    }
+    return summary;
+}
+
+// A function for freeing the description of a wav file.
+void free_summary(wav_summary* summary) {
+    if (summary->directory != NULL) {
+        free_directory(summary->directory);
+    }
+    free(summary->wav.chunks);
+    free(summary);
+}
+
+// A function for writing chars as a JSON string.
+void write_json_chars(FILE* destination, const char* chars, size_t length) {
+    fputc('"', destination);
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = chars[i];
+        if (c == '"' || c == '\\') {
+            fprintf(destination, "\\%c", c);
+        } else if (c < 0x20 || c > 0x7e) {
+            fprintf(destination, "\\u%04x", c);
+        } else {
+            fputc(c, destination);
+        }
+    }
+    fputc('"', destination);
+}
+
+// A function for naming the role of a chunk in a wav file.
+static char* chunk_kind(char* id) {
+    if (!memcmp(id, "ds64", 4)) {
+        return "sizes";
+    } else if (!memcmp(id, "fmt ", 4)) {
+        return "format";
+    } else if (!memcmp(id, "data", 4)) {
+        return "audio";
+    } else if (is_embedded_chunk(id)) {
+        return "embedded";
+    } else if (!memcmp(id, "fdir", 4)) {
+        return "directory";
+    } else if (!memcmp(id, CHECKSUM_CHUNK_ID, 4)) {
+        return "checksums";
+    }
+    return "metadata";
+}
+
+// A function for writing the description of a wav file as a line of JSON, with every chunk in file order and
+// the embedded files recorded in its directory.
+void write_summary_json(FILE* destination, wav_summary* summary, char* file_name) {
+    wav_file* wav = &summary->wav;
+    fprintf(destination, "{\"file\": ");
+    write_json_chars(destination, file_name, strlen(file_name));
+    fprintf(destination, ", \"container\": ");
+    write_json_chars(destination, wav->chunk_id, 4);
+    fprintf(destination, ", \"file_size\": %lld, \"format_tag\": %i, \"sample_format\": \"%s\", \"channels\": %i, "
+            "\"sample_rate\": %i, \"byte_rate\": %i, \"block_align\": %i, \"bits_per_sample\": %i, \"frames\": %zu, "
+            "\"duration\": %.6f, \"data_offset\": %lld, \"data_size\": %lld, \"chunks\": [",
+            (long long)wav->file_size, (unsigned short)wav->format_type,
+            wav->encoding == SAMPLE_UNSUPPORTED ? "other" : encoding_name(wav->encoding), wav->num_channels,
+            wav->sample_rate, wav->byte_rate, wav->block_alignment, wav->bits_per_sample, wav->num_all_channel_samples,
+            wav->sample_rate > 0 ? (double)wav->num_all_channel_samples / wav->sample_rate : 0.0,
+            (long long)wav->audio_data_position, (long long)wav->data_size);
+
+    for (int i = 0; i < wav->num_chunks; ++i) {
+        wav_chunk* chunk = wav->chunks + i;
+        fprintf(destination, "%s{\"id\": ", i > 0 ? ", " : "");
+        write_json_chars(destination, chunk->id, 4);
+        fprintf(destination, ", \"kind\": \"%s\", \"offset\": %lld, \"size\": %lld}", chunk_kind(chunk->id),
+                (long long)chunk->position, (long long)chunk->size);
+    }
+
+    // Directory entries are relative to the end of the data chunk.
+    fprintf(destination, "], \"embedded\": [");
+    for (int i = 0; i < summary->directory->num_entries; ++i) {
+        directory_entry* entry = summary->directory->entries + i;
+        int index = find_chunk(wav, "zfil", wav->data_end_position + entry->offset);
+        int compressed = index != -1 && wav->chunks[index].position == wav->data_end_position + entry->offset;
+        fprintf(destination, "%s{\"name\": ", i > 0 ? ", " : "");
+        write_json_chars(destination, entry->name, strlen(entry->name));
+        fprintf(destination, ", \"offset\": %lld, \"size\": %i, \"compressed\": %s, \"crc32c\": \"%08x\"}",
+                (long long)(wav->data_end_position + entry->offset), entry->size, compressed ? "true" : "false",
+                entry->checksum);
+    }
+    fprintf(destination, "]}\n");
+}
+
+// A function for writing the error of a file that could not be described as a line of JSON, without the blank
+// lines that end most messages.
+static void write_error_json(FILE* destination, char* file_name, char* error) {
+    size_t length = strlen(error);
+    while (length > 0 && isspace((unsigned char)error[length - 1])) {
+        --length;
+    }
+    fprintf(destination, "{\"file\": ");
+    write_json_chars(destination, file_name, strlen(file_name));
+    fprintf(destination, ", \"error\": ");
+    write_json_chars(destination, length > 0 ? error : "unknown error", length > 0 ? length : strlen("unknown error"));
+    fprintf(destination, "}\n");
+}
+
+// A function for describing a wav file from its chunk headers as a line of JSON.
+// Returns -1 if there is an error.
+static int describe_summary(FILE* destination, char* file_name) {
+    wav_summary* summary = inspect_wave_file(file_name);
+    if (summary == NULL) {
+        return -1;
+    }
+    write_summary_json(destination, summary, file_name);
+    free_summary(summary);
+    return 0;
+}
+
+// A function for reading the checksums of an indexed wav file from the checksum chunk at its end.
+// Returns NULL if the file has none or there is an error.
+static checksum_list* read_file_checksums(header_reader* reader, wav_file* wav) {
+    wav_chunk* chunk = wav->chunks + wav->num_chunks - 1;
+    if (memcmp(chunk->id, CHECKSUM_CHUNK_ID, 4) || chunk->position < wav->data_end_position ||
+            chunk->size > wav->file_size - chunk->position - 8) {
+        print_message("The file has no checksums.\n\n");
+        return NULL;
+    }
+
+    // Read the payload of the checksum chunk, return NULL on error.
+    char* payload = malloc(chunk->size > 0 ? chunk->size : 1);
+    if (payload == NULL) {
+        print_message("Error allocating memory for checksums.\n\n");
+        return NULL;
+    }
+    checksum_list* list = NULL;
+    if (read_chars(reader, payload, chunk->size, chunk->position + 8) == chunk->size) {
+        list = parse_checksum_list(payload, chunk->size);
+    }
+    if (list == NULL) {
+        print_message("Error - The checksum chunk is damaged.\n\n");
+    }
+    free(payload);
+    return list;
+}
+
+// A function for checking a range of a file against its checksums, reading it through a buffer of a whole number
+// of blocks whose blocks are checksummed in parallel.
+// Returns -1 if there is an error or a block has changed.
+static int verify_range(header_reader* reader, checksum_range* expected, size_t block_size, char* buffer,
+                        size_t buffer_size) {
+    if (expected->position < 0 || expected->size > reader->size - expected->position) {
+        print_message("Error - Checksum range of the \"%.4s\" chunk is outside the file.\n\n", expected->id);
+        return -1;
+    }
+    checksum_list* actual = new_checksum_list(block_size);
+    checksum_range* range = actual != NULL ? add_checksum_range(actual, expected->id, expected->position, expected->size) : NULL;
+    int result = range != NULL ? 0 : -1;
+    for (off_t done = 0; done < expected->size && result == 0; done += buffer_size) {
+        size_t length = expected->size - done < (off_t)buffer_size ? (size_t)(expected->size - done) : buffer_size;
+        checksum_range piece = { { 0 }, expected->position + done, length, range->checksums + done / block_size };
+        if (read_file_range(reader->fd, buffer, length, piece.position) != (ssize_t)length) {
+            print_message("The file cannot be read to check its checksums.\n\n");
+            result = -1;
+        } else {
+            checksum_chars(&piece, block_size, buffer);
+        }
+    }
+    if (result == 0) {
+        result = check_checksums(expected, range, block_size);
+    }
+    if (actual != NULL) {
+        free_checksum_list(actual);
+    }
+    return result;
+}
+
+// A function for checking the audio data and the embedded files of a wav file against its checksum chunk, and
+// writing the result as a line of JSON. Only the chunk headers, the checksum chunk and the checksummed ranges are
+// read.
+// Returns -1 if there is an error or a block has changed.
+static int describe_verification(FILE* destination, char* file_name) {
+    wav_file wav = { .chunks = NULL };
+    header_reader* reader = malloc(sizeof(header_reader));
+    if (reader == NULL) {
+        print_message("Error allocating memory for wav summary.\n\n");
+        return -1;
+    }
+    reader->position = 0;
+    reader->length = 0;
+    reader->fd = open_file(file_name, &reader->size);
+    if (reader->fd == -1) {
+        free(reader);
+        return -1;
+    }
+
+    // Index the chunks and read the checksums, then check each range, return -1 on error.
+    checksum_list* list = index_file_chunks(reader, &wav) == 0 && locate_audio(&wav) == 0 ?
+                          read_file_checksums(reader, &wav) : NULL;
+    int result = list != NULL ? 0 : -1;
+    off_t verified = 0;
+    char* buffer = NULL;
+    size_t buffer_size = 0;
+    if (list != NULL) {
+        buffer_size = list->block_size * VERIFY_BLOCKS_PER_THREAD * get_num_threads();
+        buffer = malloc(buffer_size);
+        if (buffer == NULL) {
+            print_message("Error allocating memory for checksums.\n\n");
+            result = -1;
+        }
+    }
+    for (int i = 0; result == 0 && i < list->num_ranges; ++i) {
+        result = verify_range(reader, list->ranges + i, list->block_size, buffer, buffer_size);
+        verified += list->ranges[i].size;
+    }
+    if (result == 0) {
+        fprintf(destination, "{\"file\": ");
+        write_json_chars(destination, file_name, strlen(file_name));
+        fprintf(destination, ", \"verified\": true, \"ranges\": %i, \"bytes\": %lld}\n", list->num_ranges,
+                (long long)verified);
+    }
+    free(buffer);
+    if (list != NULL) {
+        free_checksum_list(list);
+    }
+    free(wav.chunks);
+    close_file(reader->fd);
+    free(reader);
+    return result;
+}
+
+// A function for describing a file as a line of JSON, or the error that kept it from being described.
+// Returns the line, or NULL if there is an error allocating it.
+static char* describe_file(char* file_name, file_describer describe, int* failed) {
+    char* line = NULL;
+    size_t length = 0;
+    FILE* stream = open_memstream(&line, &length);
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    // A file that fails is described by its error alone.
+    set_quiet_messages(1);
+    if (describe(stream, file_name) == -1) {
+        write_error_json(stream, file_name, get_last_message());
+        *failed = 1;
+    }
+    if (fclose(stream)) {
+        free(line);
+        return NULL;
+    }
+    return line;
+}
+
+// A function for describing files on a worker thread until every file has been taken. The worker writes the
+// lines that are ready in order after each file.
+static void* run_inspector(void* run_pointer) {
+    inspect_run* run = run_pointer;
+    for (;;) {
+        pthread_mutex_lock(&run->lock);
+        int index = run->next_file < run->num_files ? run->next_file++ : -1;
+        pthread_mutex_unlock(&run->lock);
+        if (index == -1) {
+            break;
+        }
+
+        int failed = 0;
+        char* line = describe_file(run->file_names[index], run->describe, &failed);
+
+        pthread_mutex_lock(&run->lock);
+        run->num_failed += failed || line == NULL;
+        run->lines[index] = line != NULL ? line : run->empty_line;
+        while (run->next_line < run->num_files && run->lines[run->next_line] != NULL) {
+            char* ready = run->lines[run->next_line++];
+            if (ready != run->empty_line) {
+                fputs(ready, run->destination);
+                free(ready);
+            }
+        }
+        pthread_mutex_unlock(&run->lock);
+    }
+    set_quiet_messages(0);
+    return NULL;
+}
+
+// A function for describing files on a pool of worker threads and writing each as a line of JSON, in the order
+// the files are given. Workers take the files one at a time.
+// Returns the number of files that could not be described, or -1 on error.
+static int describe_files(char** file_names, int num_files, int num_workers, FILE* destination, file_describer describe) {
+
+    // Allocate the lines, return -1 on error.
+    inspect_run run = { describe, file_names, num_files, 0, calloc(num_files > 0 ? num_files : 1, sizeof(char*)), 0, 0,
+                        { 0 }, destination, PTHREAD_MUTEX_INITIALIZER };
+    if (run.lines == NULL) {
+        print_message("Error allocating memory for stats.\n\n");
+        return -1;
+    }
+
+    // Run the workers, using the calling thread as the first one.
+    pthread_t threads[MAX_INSPECTORS];
+    int started[MAX_INSPECTORS] = { 0 };
+    for (int i = 1; i < num_workers; ++i) {
+        started[i] = !pthread_create(threads + i, NULL, run_inspector, &run);
+    }
+    run_inspector(&run);
+    for (int i = 1; i < num_workers; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    pthread_mutex_destroy(&run.lock);
+    free(run.lines);
+    return run.num_failed;
+}
+
+// A function for limiting the number of workers describing files to the number of files and MAX_INSPECTORS.
+static int limit_workers(int num_workers, int num_files) {
+    num_workers = num_workers < num_files ? num_workers : num_files;
+    num_workers = num_workers < MAX_INSPECTORS ? num_workers : MAX_INSPECTORS;
+    return num_workers > 0 ? num_workers : 1;
+}
+
+// A function for describing files on a pool of worker threads and writing each as a line of JSON, in the order
+// the files are given. Files cost a few reads each, so workers take them one at a time.
+// Returns the number of files that could not be described, or -1 on error.
+int inspect_files(char** file_names, int num_files, int num_workers, FILE* destination) {
+    return describe_files(file_names, num_files, limit_workers(num_workers, num_files), destination, describe_summary);
+}
+
+// A function for checking files against their checksum chunks on a pool of worker threads and writing the result
+// of each as a line of JSON, in the order the files are given. The blocks of a file are checked in parallel when
+// there is a single worker, and on the worker's thread otherwise.
+// Returns the number of files that could not be checked or have changed, or -1 on error.
+int verify_files(char** file_names, int num_files, int num_workers, FILE* destination) {
+    num_workers = limit_workers(num_workers, num_files);
+    int num_threads = get_num_threads();
+    if (num_workers > 1) {
+        set_num_threads(1);
+    }
+    int result = describe_files(file_names, num_files, num_workers, destination, describe_verification);
+    set_num_threads(num_threads);
+    return result;
+}
+
+// A function for adding a copy of a file name to a list.
+// Returns -1 if there is an error.
+static int add_name(name_list* list, char* name) {
+    if (list->num_names == list->capacity) {
+        int capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+        char** names = realloc(list->names, capacity * sizeof(char*));
+        if (names == NULL) {
+            printf("Error allocating memory for file names.\n\n");
+            return -1;
+        }
+        list->names = names;
+        list->capacity = capacity;
+    }
+    list->names[list->num_names] = strdup(name);
+    if (list->names[list->num_names] == NULL) {
+        printf("Error allocating memory for file names.\n\n");
+        return -1;
+    }
+    ++list->num_names;
+    return 0;
+}
+
+// A function for comparing two file names for qsort.
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// A function for adding the wav files of a directory to a list, in order of their names.
+// Returns -1 if there is an error.
+static int add_directory_files(name_list* list, char* directory) {
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        printf("The directory %s cannot be read.\n\n", directory);
+        return -1;
+    }
+
+    int first = list->num_names;
+    int result = 0;
+    size_t directory_length = strlen(directory);
+    char* path = malloc(directory_length + 2 + 256);
+    struct dirent* entry;
+    while (result == 0 && path != NULL && (entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length <= 4 || strcasecmp(entry->d_name + length - 4, ".wav") || length > 255) {
+            continue;
+        }
+        snprintf(path, directory_length + 2 + 256, "%s%s%s", directory,
+                 directory_length > 0 && directory[directory_length - 1] == '/' ? "" : "/", entry->d_name);
+        result = add_name(list, path);
+    }
+    if (path == NULL) {
+        printf("Error allocating memory for file names.\n\n");
+        result = -1;
+    }
+    free(path);
+    closedir(dir);
+    qsort(list->names + first, list->num_names - first, sizeof(char*), compare_names);
+    return result;
+}
+
+// A function for running stats or verify mode from the command line:
+//   wave --stats file_or_directory... [-j workers]
+//   wave --verify file_or_directory... [-j workers]
+// Each file, and each wav file of each directory, is described or checked against its checksums and written to
+// stdout as a line of JSON.
+// Returns the exit status of the process.
+int inspect_main(int argc, char** argv) {
+    int num_workers = get_num_threads();
+    name_list list = { NULL, 0, 0 };
+    int result = 0;
+    for (int i = 2; i < argc && result == 0; ++i) {
+        struct stat st;
+        if (!strcmp(*(argv + i), "-j") && i + 1 < argc) {
+            num_workers = atoi(*(argv + ++i));
+            if (num_workers <= 0) {
+                printf("Invalid number of workers. Using %i.\n\n", get_num_threads());
+                num_workers = get_num_threads();
+            }
+        } else if (!stat(*(argv + i), &st) && S_ISDIR(st.st_mode)) {
+            result = add_directory_files(&list, *(argv + i));
+        } else {
+            result = add_name(&list, *(argv + i));
+        }
+    }
+
+    int num_failed = 0;
+    if (result == 0 && list.num_names == 0) {
+        printf("Must provide a file or directory name\n");
+        result = -1;
+    } else if (result == 0) {
+        num_failed = !strcmp(*(argv + 1), "--verify") ? verify_files(list.names, list.num_names, num_workers, stdout) :
+                     inspect_files(list.names, list.num_names, num_workers, stdout);
+    }
+
+    for (int i = 0; i < list.num_names; ++i) {
+        free(list.names[i]);
+    }
+    free(list.names);
+    return result != 0 || num_failed != 0;
+}
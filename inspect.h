@@ -0,0 +1,42 @@
+#ifndef H_INSPECT
+#define H_INSPECT
+
+#include "wav.h"
+
+// The number of chars read at once while walking the chunk headers of a file. The first read holds the RIFF
+// header and the chunks before the audio data of most files, and each later read holds a chunk header and the
+// chars before it that decide whether the previous chunk has a pad byte.
+#define INSPECT_READ_SIZE 4096
+
+// A wav file described from its chunk headers, without reading its audio data.
+typedef struct wav_summary {
+    wav_file wav; // header information and the index of every chunk
+    file_directory* directory; // embedded files recorded in the directory chunk, empty if there is none
+} wav_summary;
+
+// A function for describing a wav file from its RIFF header and chunk headers, read with positioned reads.
+// Only the directory chunk is read after the audio data.
+wav_summary* inspect_wave_file(char* file_name);
+
+// A function for freeing the description of a wav file.
+void free_summary(wav_summary* summary);
+
+// A function for writing chars as a JSON string.
+void write_json_chars(FILE* destination, const char* chars, size_t length);
+
+// A function for writing the description of a wav file as a line of JSON.
+void write_summary_json(FILE* destination, wav_summary* summary, char* file_name);
+
+// A function for describing files on a pool of worker threads and writing each as a line of JSON, in the order
+// the files are given. Returns the number of files that could not be described.
+int inspect_files(char** file_names, int num_files, int num_workers, FILE* destination);
+
+// A function for checking files against their checksum chunks on a pool of worker threads and writing the result
+// of each as a line of JSON, in the order the files are given. Returns the number of files that could not be
+// checked or have changed.
+int verify_files(char** file_names, int num_files, int num_workers, FILE* destination);
+
+// A function for running stats or verify mode from the command line.
+int inspect_main(int argc, char** argv);
+
+#endif
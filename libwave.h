@@ -0,0 +1,22 @@
+#ifndef H_LIBWAVE
+#define H_LIBWAVE
+
+// The public interface of libwave. A program embedding the library processes files in memory with a
+// wave_context, which it can reuse across files to avoid allocating:
+//
+//   wave_context* context = new_wave_context();
+//   load_wave_file(context, "in.wav");
+//   stretch_audio(context, 2.0, INTERPOLATION_LINEAR, STRETCH_RESAMPLE);
+//   write_wave_file(context, "out.wav");
+//   free_wave_context(context);
+//
+// Large files can be streamed through a stream_file instead, many files processed with run_batch,
+// embedded files added to or removed from a file on disk in place with an edit_file, and files described
+// from their chunk headers alone with inspect_wave_file or checked against their checksums with verify_files.
+// run_server serves chains of operations sent over a Unix domain socket.
+#include "batch.h"
+#include "edit.h"
+#include "inspect.h"
+#include "server.h"
+
+#endif
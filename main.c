@@ -1,18 +1,96 @@
-#include "wav.h"
+#include "batch.h"
+#include "edit.h"
+#include "inspect.h"
+#include "server.h"
 
 int main(int argc, char** argv) {
 
+    // Process many files in one run when a batch is given.
+    if (argc > 1 && (!strcmp(*(argv + 1), "--batch") || !strcmp(*(argv + 1), "--batch-glob"))) {
+        exit(batch_main(argc, argv));
+    }
+
+    // Edit a file on disk without rewriting its audio data when asked to.
+    if (argc > 1 && !strcmp(*(argv + 1), "--edit")) {
+        exit(edit_main(argc, argv));
+    }
+
+    // Describe files from their chunk headers alone, or check them against their checksums, when asked to.
+    if (argc > 1 && (!strcmp(*(argv + 1), "--stats") || !strcmp(*(argv + 1), "--verify"))) {
+        exit(inspect_main(argc, argv));
+    }
+
+    // Serve requests on a Unix domain socket when asked to.
+    if (argc > 1 && !strcmp(*(argv + 1), "--serve")) {
+        exit(server_main(argc, argv));
+    }
+
     // Display options to user.
-    printf("OPTIONS: [-t time_multiplier]  [-e embedded_file_name]  [-r removed_file_name]\n");
-    printf("         [-o output_file_name]  [-m]\n\n");
+    printf("OPTIONS: [-t time_multiplier]  [-e embedded_file_name]  [-r removed_file_name]  [-l]\n");
+    printf("         [-x embedded_name]  [-d embedded_name]  [-o output_file_name]  [-m]\n");
+    printf("         [-s block_size_in_kilobytes]  [-i stdio|mmap|async]  [-q queue_depth]\n");
+    printf("         [-b 8|16|24|32|32f|64f]  [-c channels]  [-k channel_list]  [-f sample_rate]\n");
+    printf("         [--interp=nearest|linear|cubic|sinc]  [--stretch=resample|wsola]  [--compress=none|lz|lzcrc]\n");
+    printf("         [--dither=none|tpdf]  [--analyze[=sidecar_file_name]]  [--checksum]  [--verify]  [--explain]\n");
+    printf("         [--trim start:end]  [--concat wav_file_name]  [--split seconds]  [--profile=profile_file_name]\n\n");
     printf("          -t        Stretch audio by a given factor.\n");
     printf("          -e        Embed a given file into the wav file.\n");
     printf("          -r        Remove the oldest embedded file from the wav file.\n");
+    printf("          -l        List the embedded files by name.\n");
+    printf("          -x        Extract the embedded file with a given name to a file of that name.\n");
+    printf("          -d        Delete the embedded file with a given name from the wav file.\n");
     printf("          -o        Output the current wav file.\n");
-    printf("          -m        remove all metadata from the file\n\n");
+    printf("          -m        remove all metadata from the file\n");
+    printf("          -b        Convert the samples to 8, 16, 24 or 32-bit PCM or 32 or 64-bit float.\n");
+    printf("          -c        Mix the channels down or up to a given number of channels.\n");
+    printf("          -k        Keep the channels in a comma-separated list of channel numbers starting at 1.\n");
+    printf("          -f        Convert the audio to a given sample rate.\n");
+    printf("          -s        Stream the file in blocks of a given size instead of reading it into memory.\n");
+    printf("          -i        Read and copy files through stdio buffers, with mmap and in-kernel copies, or with\n");
+    printf("                    reads ahead and writes behind through io_uring or an I/O thread.\n");
+    printf("          -q        Keep up to a given number of blocks in flight at once with -i async.\n");
+    printf("          --interp  Interpolate between frames in the following stretches.\n");
+    printf("          --stretch Resample or keep the pitch in the following stretches.\n");
+    printf("          --compress Compress the following embedded files in blocks, with a checksum per block for lzcrc.\n");
+    printf("          --dither  Add triangular dither when the following conversions lower the sample resolution.\n");
+    printf("          --trim    Keep the audio between two times in seconds, rounded to frames. Either may be left out\n");
+    printf("                    for the start or the end. A streamed file only has the frames kept read.\n");
+    printf("          --concat  Append the audio of a wav file with the same format. Streamed files are copied as ranges.\n");
+    printf("          --split   Write the output file in numbered pieces of a given number of seconds, as in out-001.wav.\n");
+    printf("          --analyze Report the peak, RMS, DC offset and clipped samples of each channel and the silences of\n");
+    printf("                    the audio, and write them as JSON to a sidecar file when one is named. A streamed file is\n");
+    printf("                    analyzed while it is read to be written.\n");
+    printf("          --checksum Write the output files with a \"csum\" chunk holding CRC-32C checksums of each 1 MB block\n");
+    printf("                    of the audio data and the embedded files. Files that have one keep it up to date.\n");
+    printf("          --verify  Check the input file against its checksums before writing, or while streaming it.\n");
+    printf("          --explain Print the plan of the operations, with adjacent operations fused, instead of performing it.\n");
+    printf("          --profile Record the time, bytes moved, allocations and peak memory of each operation and I/O call\n");
+    printf("                    as JSON lines, or as Chrome trace events for a .json file. WAVE_PROFILE also names the file.\n\n");
+    printf("BATCH:   --batch manifest_file  [-j workers]  [-s block_size_in_kilobytes]  [-i stdio|mmap|async]\n");
+    printf("         --batch-glob pattern output_directory  [-j workers]  [options]\n\n");
+    printf("          A manifest has a line of \"input output [options]\" for each file. The batch's -s and -i\n");
+    printf("          options apply to every file, and a line that gives -s, -i, -q or --profile is skipped.\n\n");
+    printf("EDIT:    --edit wav_file  [-e embedded_file_name]  [-r removed_file_name]  [-l]  [-x embedded_name]\n");
+    printf("         [-d embedded_name]  [--remove=shift|junk]  [--compact]  [-s block_size_in_kilobytes]\n");
+    printf("         [--compress=none|lz|lzcrc]  [--checksum]  [-i stdio|mmap|async]\n\n");
+    printf("          Embed and remove files in place. --remove=junk renames removed chunks to \"JUNK\"\n");
+    printf("          instead of moving the chunks that follow, and --compact removes the \"JUNK\" chunks.\n");
+    printf("          --checksum adds checksums, which edits keep up to date, without rewriting the audio data.\n\n");
+    printf("STATS:   --stats wav_file_or_directory...  [-j workers]\n\n");
+    printf("          Describe each file, and the wav files in each directory, as a line of JSON read from the\n");
+    printf("          chunk headers alone, with the chunks and the embedded files and their sizes.\n\n");
+    printf("VERIFY:  --verify wav_file_or_directory...  [-j workers]\n\n");
+    printf("          Check each file against its checksums, reading its blocks in parallel, and write the result\n");
+    printf("          as a line of JSON. Files without checksums or with a changed block fail.\n\n");
+    printf("SERVE:   --serve socket_path  [-j workers]  [--queue=connections]  [-s block_size_in_kilobytes]\n");
+    printf("         [-i stdio|mmap|async]\n\n");
+    printf("          Listen on a Unix domain socket for lines of \"input output [options]\", which workers perform\n");
+    printf("          with buffers they reuse, answering each with a line of JSON holding the result and its timing.\n");
+    printf("          The server's -s and -i options apply to every request, and a request that gives -s, -i, -q or\n");
+    printf("          --profile fails.\n");
+    printf("          Connections wait in a queue, and clients wait to connect while it is full. SIGINT or SIGTERM\n");
+    printf("          stops the server once the queued connections are served.\n\n");
 
-    char* file; // The current output file
-    wav_file* wav; // The current parsed output file
     char* source_file_name;
     char* destination_file_name;
 
@@ -25,82 +103,12 @@ int main(int argc, char** argv) {
         destination_file_name = *(argv + 2);
     }
 
-    // Read the input file, exit on error.
-    file = read_wav_file(source_file_name);
-    if (file == NULL) {
-        exit(0);
-    }
-
-    // Parse the input file, exit on error.
-    wav = parse(file);
-    if (wav == NULL) {
-        exit(0);
-    }
-
-    // Display input file stats.
-    printf("\nInput file stats:\n");
-    print_stats(wav, source_file_name);
-
-    // If no options are provided, reverse the audio.
-    if (argc == 3) {
-        printf("No options provided. Reversing audio by default.\n\n");
-        reverse_audio(wav->data_pointer, wav->num_all_channel_samples, wav->all_channel_sample_size_in_bytes);
-    } else {
-        int current_arg = 3;
-        // Read options and perform associated operations in order.
-        while (current_arg < argc) {
-            // Stretch audio option
-            if (!strncmp(*(argv + current_arg), "-t", 2)) {
-                double time_multiplier = strtod(*(argv + current_arg + 1), NULL);
-                if (time_multiplier == 0 || fabs(time_multiplier) == HUGE_VAL) {
-                    printf("Invalid time multiplier.\n\n");
-                } else if (time_multiplier == 1.0) {
-                    printf("Time multiplier is 1. Doing nothing.\n\n");
-                } else if (time_multiplier == -1.0) {
-                    printf("Reversing audio.\n\n");
-                    reverse_audio(wav->data_pointer, wav->num_all_channel_samples, wav->all_channel_sample_size_in_bytes);
-                } else {
-                    printf("Stretching audio by a factor of %f.\n\n", time_multiplier);
-                    stretch_audio(&file, &wav, time_multiplier);
-                }
-                current_arg += 2;
-            // Embed hidden file option
-            } else if (!strncmp(*(argv + current_arg), "-e", 2)) {
-                char* embedded_file_name = *(argv + current_arg + 1);
-                printf("Embedding %s into wav file.\n\n", embedded_file_name);
-                push_back_file(&file, &wav, embedded_file_name);
-                current_arg += 2;
-            // Remove hidden file option
-            } else if (!strncmp(*(argv + current_arg), "-r", 2)) {
-                char* embedded_file_name = *(argv + current_arg + 1);
-                printf("Extracting %s from wav file\n\n", embedded_file_name);
-                pop_front_file(&file, &wav, embedded_file_name);
-                current_arg += 2;
-            // Output current file option
-            } else if (!strncmp(*(argv + current_arg), "-o", 2)) {
-                char* out_file_name = *(argv + current_arg + 1);
-                printf("Writing current wav file to %s\n\n", out_file_name);
-                write_file(out_file_name, file, wav->file_size);
-                current_arg += 2;
-            // Remove metadata option
-            } else if (!strncmp(*(argv + current_arg), "-m", 2)) {
-                remove_metadata(&file, &wav);
-                ++current_arg;
-            // Print error for invalid option
-            } else {
-                printf("%s is an invalid option.\n\n", *(argv + current_arg));
-                ++current_arg;
-            }
-        }
-    }
-
-    // Display output file stats
-    printf("Output file stats:\n");
-    print_stats(wav, destination_file_name);
+    // Look for the streaming and file mode options, which apply to the whole run, then perform the operations.
+    size_t block_size = parse_run_options(argc - 3, argv + 3);
+    int result = process_file(source_file_name, destination_file_name, argc - 3, argv + 3, block_size, NULL, NULL, NULL);
 
-    // Write the output file to disk, free memory, and exit.
-    write_file(destination_file_name, file, wav->file_size);
-    free(wav);
-    free(file);
-    exit(0);
+    // Display the chars moved between the disk and memory, and exit with status 1 if the operations failed, as a
+    // batch with a failed file does.
+    print_file_stats();
+    exit(result == -1 ? 1 : 0);
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include "message.h"
+
+// Each thread is quiet or not on its own, so batch workers can keep the messages of the file they
+// are processing while the main thread prints.
+static __thread int quiet_messages = 0;
+static __thread char last_message[MESSAGE_SIZE];
+
+// Function for printing a message to the user. On a quiet thread the message is kept instead.
+void print_message(const char* format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    if (quiet_messages) {
+        vsnprintf(last_message, MESSAGE_SIZE, format, arguments);
+    } else {
+        vprintf(format, arguments);
+    }
+    va_end(arguments);
+}
+
+// Function for making the calling thread quiet, so its messages are kept instead of printed.
+void set_quiet_messages(int quiet) {
+    quiet_messages = quiet;
+    last_message[0] = '\0';
+}
+
+// Function for retrieving the last message kept by the calling thread.
+char* get_last_message() {
+    return last_message;
+}
@@ -0,0 +1,16 @@
+#ifndef H_MESSAGE
+#define H_MESSAGE
+
+// The longest message kept for a quiet thread.
+#define MESSAGE_SIZE 256
+
+// Function for printing a message to the user. On a quiet thread the message is kept instead.
+void print_message(const char* format, ...);
+
+// Function for making the calling thread quiet, so its messages are kept instead of printed.
+void set_quiet_messages(int quiet);
+
+// Function for retrieving the last message kept by the calling thread.
+char* get_last_message();
+
+#endif
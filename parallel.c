@@ -0,0 +1,100 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "parallel.h"
+
+// The most threads parallel_for starts for a single task.
+#define MAX_THREADS 64
+
+// A range of items run by one thread of parallel_for.
+typedef struct parallel_range {
+    parallel_task task;
+    void* argument;
+    size_t first;
+    size_t last;
+} parallel_range;
+
+// The number of worker threads that was set, or 0 for the default, which is found once. Threads read the number
+// while another thread may set it, so both are atomic.
+static int num_threads = 0;
+static int default_threads = 1;
+static pthread_once_t default_threads_once = PTHREAD_ONCE_INIT;
+
+// Function for finding the default number of worker threads. The WAVE_THREADS environment variable
+// overrides the number of online processors.
+static void find_default_threads() {
+    char* threads = getenv("WAVE_THREADS");
+    int found = threads != NULL ? atoi(threads) : 0;
+    if (found <= 0) {
+        found = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    default_threads = found > 0 ? found : 1;
+}
+
+// Function for setting the number of worker threads. Zero selects the default.
+void set_num_threads(int threads) {
+    __atomic_store_n(&num_threads, threads, __ATOMIC_RELAXED);
+}
+
+// Function for retrieving the number of worker threads.
+int get_num_threads() {
+    int threads = __atomic_load_n(&num_threads, __ATOMIC_RELAXED);
+    if (threads <= 0) {
+        pthread_once(&default_threads_once, find_default_threads);
+        threads = default_threads;
+    }
+    return threads < MAX_THREADS ? threads : MAX_THREADS;
+}
+
+// Function for reading a monotonic clock in seconds, which the timings of operations, files and requests share.
+double current_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Function for running a range of a task on a thread.
+static void* run_range(void* range_pointer) {
+    parallel_range* range = range_pointer;
+    range->task(range->argument, range->first, range->last);
+    return NULL;
+}
+
+// Function for splitting count items into contiguous ranges and running a task over each range on its
+// own thread. Ranges are never smaller than min_per_thread items, so small inputs run on the calling thread.
+void parallel_for(size_t count, size_t min_per_thread, parallel_task task, void* argument) {
+    if (count == 0) {
+        return;
+    }
+
+    // Choose the number of ranges.
+    size_t threads = get_num_threads();
+    if (min_per_thread > 0 && count / min_per_thread < threads) {
+        threads = count / min_per_thread > 0 ? count / min_per_thread : 1;
+    }
+    if (threads == 1) {
+        task(argument, 0, count);
+        return;
+    }
+
+    // Start a thread for every range but the last, which runs on the calling thread. Ranges whose
+    // thread cannot be started also run on the calling thread.
+    parallel_range ranges[MAX_THREADS];
+    pthread_t thread_ids[MAX_THREADS];
+    int started[MAX_THREADS];
+    for (size_t i = 0; i < threads; ++i) {
+        ranges[i] = (parallel_range){ task, argument, count * i / threads, count * (i + 1) / threads };
+        started[i] = i + 1 < threads && !pthread_create(thread_ids + i, NULL, run_range, ranges + i);
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        if (!started[i]) {
+            run_range(ranges + i);
+        }
+    }
+    for (size_t i = 0; i + 1 < threads; ++i) {
+        if (started[i]) {
+            pthread_join(thread_ids[i], NULL);
+        }
+    }
+}
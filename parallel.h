@@ -0,0 +1,23 @@
+#ifndef H_PARALLEL
+#define H_PARALLEL
+
+#include <stddef.h>
+
+// A task run over a range [first, last) of items by parallel_for.
+typedef void (*parallel_task)(void* argument, size_t first, size_t last);
+
+// Function for setting the number of worker threads. Zero selects the default: the WAVE_THREADS environment
+// variable, or the number of online processors.
+void set_num_threads(int num_threads);
+
+// Function for retrieving the number of worker threads.
+int get_num_threads();
+
+// Function for reading a monotonic clock in seconds.
+double current_seconds();
+
+// Function for splitting count items into contiguous ranges and running a task over each range on its
+// own thread. Ranges are never smaller than min_per_thread items, so small inputs run on the calling thread.
+void parallel_for(size_t count, size_t min_per_thread, parallel_task task, void* argument);
+
+#endif
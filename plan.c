@@ -0,0 +1,538 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compress.h"
+#include "convert.h"
+#include "message.h"
+#include "plan.h"
+#include "resample.h"
+#include "sample.h"
+#include "wsola.h"
+
+// Function for determining whether an argument is an option that applies to the whole run and is followed by a value.
+int is_run_option(char* arg) {
+    return !strcmp(arg, "-s") || !strcmp(arg, "-i") || !strcmp(arg, "-q");
+}
+
+// Function for determining whether an argument is a setting that applies to the following operations.
+int is_setting(char* arg) {
+    return !strncmp(arg, "--interp=", 9) || !strncmp(arg, "--stretch=", 10) ||
+           !strncmp(arg, "--compress=", 11) || !strncmp(arg, "--dither=", 9);
+}
+
+// Function for determining whether an argument is the profile option, which applies to the whole run.
+int is_profile_option(char* arg) {
+    return !strncmp(arg, "--profile=", 10);
+}
+
+// Function for finding an option that applies to the whole run in the options of one file, where the options of
+// the run are set for every file.
+// Returns the option, or NULL if there is none.
+char* find_run_option(int num_args, char** args) {
+    for (int i = 0; i < num_args; ++i) {
+        if (is_run_option(args[i]) || is_profile_option(args[i])) {
+            return args[i];
+        }
+    }
+    return NULL;
+}
+
+// Function for retrieving the name of a kind of operation.
+char* operation_name(int type) {
+    static char* names[] = {
+        "error", "stretch", "embed", "pop", "list", "extract", "delete", "write", "remove_metadata", "convert", "resample",
+        "analyze", "trim", "concat"
+    };
+    return names[type];
+}
+
+// Function for determining whether an argument is an option that is followed by a value.
+int takes_value(char* arg) {
+    return !strncmp(arg, "-t", 2) || !strncmp(arg, "-e", 2) || !strncmp(arg, "-r", 2) || !strncmp(arg, "-x", 2) ||
+           !strncmp(arg, "-d", 2) || !strncmp(arg, "-o", 2) || !strncmp(arg, "-b", 2) || !strncmp(arg, "-c", 2) ||
+           !strncmp(arg, "-k", 2) || !strncmp(arg, "-f", 2) || !strcmp(arg, "--trim") || !strcmp(arg, "--concat") ||
+           !strcmp(arg, "--split") || is_run_option(arg);
+}
+
+// Function for formatting the message of an option that cannot be performed, with one value in it.
+// Returns NULL if there is an error.
+static char* new_error(const char* format, char* value) {
+    char* error = malloc(MESSAGE_SIZE);
+    if (error == NULL) {
+        print_message("Error allocating memory for plan.\n\n");
+        return NULL;
+    }
+    snprintf(error, MESSAGE_SIZE, format, value);
+    return error;
+}
+
+// Function for reading a range of seconds of the form start:end, where either end may be left out for the start
+// or the end of the audio, which is given as -1.
+// Returns -1 if the range is invalid.
+static int parse_trim_range(char* value, double* start, double* end) {
+    char* separator = strchr(value, ':');
+    if (separator == NULL) {
+        return -1;
+    }
+    char* number_end;
+    *start = separator == value ? 0 : strtod(value, &number_end);
+    if ((separator != value && number_end != separator) || !(*start >= 0) || *start == HUGE_VAL) {
+        return -1;
+    }
+    *end = separator[1] == '\0' ? -1 : strtod(separator + 1, &number_end);
+    if (separator[1] != '\0' && (*number_end != '\0' || !(*end > *start) || *end == HUGE_VAL)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Function for determining whether an operation leaves the chunks other than "fmt " and "data" as they are,
+// so removing the metadata can be moved past it.
+static int keeps_metadata(int type) {
+    return type == OPERATION_STRETCH || type == OPERATION_CONVERT || type == OPERATION_RESAMPLE ||
+           type == OPERATION_REMOVE_METADATA || type == OPERATION_ANALYZE || type == OPERATION_TRIM || type == OPERATION_CONCAT ||
+           type == OPERATION_ERROR;
+}
+
+// Function for moving the options of one operation to the end of the options of another.
+static void move_options(operation* destination, operation* source) {
+    memcpy(destination->options + destination->num_options, source->options, source->num_options * sizeof(int));
+    destination->num_options += source->num_options;
+    free(source->options);
+    source->options = NULL;
+}
+
+// Function for replacing the metadata removals that are only followed by operations that keep the metadata with
+// one removal at the end of a plan, which the writer performs while writing the output file instead of copying
+// the file without its metadata.
+static void defer_metadata_removal(operation_plan* plan) {
+
+    // Find the operations at the end of the plan that keep the metadata.
+    int first = plan->num_operations;
+    while (first > 0 && keeps_metadata(plan->operations[first - 1].type)) {
+        --first;
+    }
+
+    // Gather the removals among them into the first one and move it to the end.
+    operation removal = { .type = OPERATION_ERROR };
+    int num_operations = first;
+    for (int i = first; i < plan->num_operations; ++i) {
+        operation* current = plan->operations + i;
+        if (current->type != OPERATION_REMOVE_METADATA) {
+            plan->operations[num_operations++] = *current;
+        } else if (removal.type != OPERATION_REMOVE_METADATA) {
+            removal = *current;
+        } else {
+            move_options(&removal, current);
+        }
+    }
+    if (removal.type == OPERATION_REMOVE_METADATA) {
+        removal.on_write = 1;
+        plan->operations[num_operations++] = removal;
+    }
+    plan->num_operations = num_operations;
+}
+
+// Function for fusing an operation into the operation before it when they can be performed as one: stretches
+// by composing their factors, where reversing is a stretch by -1 that the stretch before it can take on, embeds with the
+// same compression, appended files, a channel mix followed by a sample conversion, repeated metadata removals, and
+// repeated analyses with at most one sidecar file between them. Trims are not composed, as rounding each to frames
+// can differ by a frame from rounding their sum. A stretch by a negative factor reverses the stretched audio, so a
+// stretch that reverses is not fused with a stretch after it other than a reverse, which would move its reversal
+// past that stretch.
+// Returns 1 if the operations were fused.
+static int fuse_operation(operation* previous, operation* current) {
+    if (previous->type != current->type) {
+        return 0;
+    } else if (current->type == OPERATION_STRETCH) {
+        double time_multiplier = previous->time_multiplier * current->time_multiplier;
+        int previous_reverses = fabs(previous->time_multiplier) == 1, current_reverses = fabs(current->time_multiplier) == 1;
+        if (time_multiplier == 0 || fabs(time_multiplier) == HUGE_VAL ||
+                (previous->time_multiplier < 0 && !current_reverses) ||
+                (!previous_reverses && !current_reverses && (previous->interpolation != current->interpolation ||
+                                                             previous->stretch_method != current->stretch_method))) {
+            return 0;
+        }
+        if (previous_reverses) {
+            previous->interpolation = current->interpolation;
+            previous->stretch_method = current->stretch_method;
+        }
+        previous->time_multiplier = time_multiplier;
+    } else if (current->type == OPERATION_EMBED) {
+        if (previous->compression != current->compression) {
+            return 0;
+        }
+    } else if (current->type == OPERATION_CONVERT) {
+        if (previous->encoding != SAMPLE_UNSUPPORTED || current->mix_option != 0 || previous->dither != current->dither) {
+            return 0;
+        }
+        previous->encoding = current->encoding;
+    } else if (current->type == OPERATION_ANALYZE) {
+        if (previous->value != NULL && current->value != NULL && strcmp(previous->value, current->value)) {
+            return 0;
+        }
+        previous->value = previous->value != NULL ? previous->value : current->value;
+    } else if (current->type != OPERATION_REMOVE_METADATA && current->type != OPERATION_CONCAT) {
+        return 0;
+    }
+    move_options(previous, current);
+    return 1;
+}
+
+// Function for fusing each operation of a plan into the operation before it when they can be performed as one.
+static void fuse_operations(operation_plan* plan) {
+    int num_operations = 0;
+    for (int i = 0; i < plan->num_operations; ++i) {
+        operation* current = plan->operations + i;
+        if (num_operations == 0 || !fuse_operation(plan->operations + num_operations - 1, current)) {
+            plan->operations[num_operations++] = *current;
+        }
+    }
+    plan->num_operations = num_operations;
+}
+
+// Function for naming a numbered piece of a split output file in a buffer of size chars, by inserting the number
+// before the file name's extension, as in out-001.wav for out.wav.
+// Returns the buffer.
+char* split_file_name(char* file_name, int piece, char* destination, size_t size) {
+    char* base_name = strrchr(file_name, '/') != NULL ? strrchr(file_name, '/') + 1 : file_name;
+    char* extension = strrchr(base_name, '.') != NULL && strrchr(base_name, '.') != base_name ? strrchr(base_name, '.') :
+                      base_name + strlen(base_name);
+    snprintf(destination, size, "%.*s-%03i%s", (int)(extension - file_name), file_name, piece, extension);
+    return destination;
+}
+
+// Function for reading a chain of options into a plan with an operation for each option, and fusing the
+// operations that can be performed together. Options that cannot be performed become errors, which are reported
+// in order with the other operations. If no option is an operation, the plan reverses the audio by default.
+// Returns NULL if there is an error.
+operation_plan* new_plan(int num_args, char** args) {
+
+    // Allocate memory for the plan, with room for an operation for each argument, return NULL on error.
+    operation_plan* plan = calloc(1, sizeof(operation_plan));
+    operation* operations = calloc(num_args + 1, sizeof(operation));
+    if (plan == NULL || operations == NULL) {
+        print_message("Error allocating memory for plan.\n\n");
+        free(plan);
+        free(operations);
+        return NULL;
+    }
+    plan->args = args;
+    plan->num_args = num_args;
+    plan->operations = operations;
+
+    int interpolation = INTERPOLATION_NEAREST; // The interpolation used when stretching
+    int stretch_method = STRETCH_RESAMPLE; // The way audio is stretched
+    int compression = COMPRESSION_NONE; // The way embedded files are compressed
+    int dither = DITHER_NONE; // The way samples are rounded when converting them
+    int num_operation_args = 0;
+
+    // Read options into operations in order.
+    for (int current_arg = 0; current_arg < num_args; ++current_arg) {
+        char* arg = *(args + current_arg);
+        char* value = current_arg + 1 < num_args ? *(args + current_arg + 1) : NULL;
+        operation new = { .type = OPERATION_ERROR, .value = value, .encoding = SAMPLE_UNSUPPORTED };
+        int position = current_arg;
+
+        // Error for an option missing its value
+        if (value == NULL && takes_value(arg)) {
+            new.error = new_error("%s is missing a value.\n\n", arg);
+        // Stretch audio option
+        } else if (!strncmp(arg, "-t", 2)) {
+            new.time_multiplier = strtod(value, NULL);
+            if (new.time_multiplier == 0 || fabs(new.time_multiplier) == HUGE_VAL) {
+                new.error = new_error("Invalid time multiplier.\n\n", NULL);
+            } else {
+                new.type = OPERATION_STRETCH;
+                new.interpolation = interpolation;
+                new.stretch_method = stretch_method;
+            }
+        // Embed hidden file option
+        } else if (!strncmp(arg, "-e", 2)) {
+            new.type = OPERATION_EMBED;
+            new.compression = compression;
+        // Remove hidden file, list, extract, delete and output options
+        } else if (!strncmp(arg, "-r", 2)) {
+            new.type = OPERATION_POP;
+        } else if (!strncmp(arg, "-l", 2)) {
+            new.type = OPERATION_LIST;
+        } else if (!strncmp(arg, "-x", 2)) {
+            new.type = OPERATION_EXTRACT;
+        } else if (!strncmp(arg, "-d", 2)) {
+            new.type = OPERATION_DELETE;
+        } else if (!strncmp(arg, "-o", 2)) {
+            new.type = OPERATION_WRITE;
+        // Remove metadata option
+        } else if (!strncmp(arg, "-m", 2)) {
+            new.type = OPERATION_REMOVE_METADATA;
+        // Convert sample format option
+        } else if (!strncmp(arg, "-b", 2)) {
+            new.encoding = parse_encoding(value);
+            if (new.encoding == SAMPLE_UNSUPPORTED) {
+                new.error = new_error("%s is an invalid sample format.\n\n", value);
+            } else {
+                new.type = OPERATION_CONVERT;
+                new.dither = dither;
+            }
+        // Mix channels and keep channels options
+        } else if (!strncmp(arg, "-c", 2) || !strncmp(arg, "-k", 2)) {
+            new.type = OPERATION_CONVERT;
+            new.mix_option = arg[1];
+            new.mix_value = value;
+            new.dither = dither;
+        // Convert sample rate option
+        } else if (!strncmp(arg, "-f", 2)) {
+            new.type = OPERATION_RESAMPLE;
+        // Trim audio option
+        } else if (!strcmp(arg, "--trim")) {
+            if (parse_trim_range(value, &new.trim_start, &new.trim_end) == -1) {
+                new.error = new_error("%s is an invalid trim range.\n\n", value);
+            } else {
+                new.type = OPERATION_TRIM;
+            }
+        // Concatenate audio option
+        } else if (!strcmp(arg, "--concat")) {
+            new.type = OPERATION_CONCAT;
+        // Split option, which writes the output file in pieces
+        } else if (!strcmp(arg, "--split") && strtod(value, NULL) > 0 && strtod(value, NULL) != HUGE_VAL) {
+            plan->split_seconds = strtod(value, NULL);
+            ++current_arg;
+            continue;
+        } else if (!strcmp(arg, "--split")) {
+            new.error = new_error("%s is an invalid split length.\n\n", value);
+        // Analyze audio option, with an optional sidecar file
+        } else if (!strcmp(arg, "--analyze") || !strncmp(arg, "--analyze=", 10)) {
+            new.value = arg[9] == '=' ? arg + 10 : NULL;
+            if (new.value != NULL && *new.value == '\0') {
+                new.error = new_error("%s is missing a file name.\n\n", arg);
+            } else {
+                new.type = OPERATION_ANALYZE;
+            }
+        // Interpolation option
+        } else if (!strncmp(arg, "--interp=", 9)) {
+            int new_interpolation = parse_interpolation(arg + 9);
+            if (new_interpolation == -1) {
+                new.error = new_error("%s is an invalid interpolation.\n\n", arg + 9);
+            } else {
+                interpolation = new_interpolation;
+                continue;
+            }
+        // Stretch method option
+        } else if (!strncmp(arg, "--stretch=", 10)) {
+            int new_stretch_method = parse_stretch_method(arg + 10);
+            if (new_stretch_method == -1) {
+                new.error = new_error("%s is an invalid stretch method.\n\n", arg + 10);
+            } else {
+                stretch_method = new_stretch_method;
+                continue;
+            }
+        // Compression option
+        } else if (!strncmp(arg, "--compress=", 11)) {
+            int new_compression = parse_compression(arg + 11);
+            if (new_compression == -1) {
+                new.error = new_error("%s is an invalid compression.\n\n", arg + 11);
+            } else {
+                compression = new_compression;
+                continue;
+            }
+        // Dither option
+        } else if (!strncmp(arg, "--dither=", 9)) {
+            int new_dither = parse_dither(arg + 9);
+            if (new_dither == -1) {
+                new.error = new_error("%s is an invalid dither.\n\n", arg + 9);
+            } else {
+                dither = new_dither;
+                continue;
+            }
+        // Explain option, which prints the plan instead of performing it
+        } else if (!strcmp(arg, "--explain")) {
+            plan->explain = 1;
+            continue;
+        // Checksum option, which writes the output files with a checksum chunk
+        } else if (!strcmp(arg, "--checksum")) {
+            plan->checksum = 1;
+            continue;
+        // Verify option, which checks the input file against its checksum chunk
+        } else if (!strcmp(arg, "--verify")) {
+            plan->verify = 1;
+            continue;
+        // Profile option, handled before reading the input file
+        } else if (is_profile_option(arg)) {
+            continue;
+        // Streaming and file mode options, handled before reading the input file
+        } else if (is_run_option(arg)) {
+            ++current_arg;
+            continue;
+        // Invalid option
+        } else {
+            new.error = new_error("%s is an invalid option.\n\n", arg);
+        }
+
+        // Settings are not operations, so an invalid one does not stop the audio from being reversed by default.
+        if (!is_setting(arg)) {
+            ++num_operation_args;
+        }
+        if (value != NULL && takes_value(arg)) {
+            ++current_arg;
+        }
+
+        // Add the operation with room for the options of any operations fused into it, return NULL on error.
+        new.options = malloc(num_args * sizeof(int));
+        if (new.options == NULL || (new.type == OPERATION_ERROR && new.error == NULL)) {
+            if (new.options == NULL) {
+                print_message("Error allocating memory for plan.\n\n");
+            }
+            free(new.options);
+            free(new.error);
+            free_plan(plan);
+            return NULL;
+        }
+        new.options[new.num_options++] = position;
+        plan->operations[plan->num_operations++] = new;
+    }
+
+    // If no options are operations, reverse the audio by default. A file that is only checksummed, verified or split
+    // is copied.
+    if (num_operation_args == 0 && !plan->checksum && !plan->verify && plan->split_seconds == 0) {
+        for (int i = 0; i < plan->num_operations; ++i) {
+            free(plan->operations[i].options);
+            free(plan->operations[i].error);
+        }
+        plan->num_operations = 0;
+        plan->reverse_by_default = 1;
+    }
+
+    defer_metadata_removal(plan);
+    fuse_operations(plan);
+    return plan;
+}
+
+// Function for describing an operation of a plan in a buffer of MESSAGE_SIZE chars.
+static void describe_operation(operation* current, char* description) {
+    double time_multiplier = current->time_multiplier;
+    char* mix = current->mix_option == 'c' ? "mix the channels into" : "keep channels";
+    char* mix_end = current->mix_option == 'c' ? " channels" : "";
+    char* dither = current->dither == DITHER_TPDF ? " with tpdf dither" : "";
+    int length;
+    switch (current->type) {
+        case OPERATION_STRETCH:
+            if (time_multiplier == 1) {
+                snprintf(description, MESSAGE_SIZE, "do nothing, the time multiplier is 1");
+            } else if (time_multiplier == -1) {
+                snprintf(description, MESSAGE_SIZE, "reverse the audio");
+            } else {
+                snprintf(description, MESSAGE_SIZE, "stretch by a factor of %f with %s%s%s", time_multiplier,
+                         current->stretch_method == STRETCH_WSOLA ? "wsola" : interpolation_name(current->interpolation),
+                         current->stretch_method == STRETCH_WSOLA ? "" : " interpolation",
+                         time_multiplier < 0 ? " and reverse it" : "");
+            }
+            break;
+        case OPERATION_EMBED:
+            snprintf(description, MESSAGE_SIZE, "embed %i file%s in one pass with compression %s", current->num_options,
+                     current->num_options > 1 ? "s" : "", compression_name(current->compression));
+            break;
+        case OPERATION_POP:
+            snprintf(description, MESSAGE_SIZE, "remove the oldest embedded file into %s", current->value);
+            break;
+        case OPERATION_LIST:
+            snprintf(description, MESSAGE_SIZE, "list the embedded files");
+            break;
+        case OPERATION_EXTRACT:
+            snprintf(description, MESSAGE_SIZE, "extract %s", current->value);
+            break;
+        case OPERATION_DELETE:
+            snprintf(description, MESSAGE_SIZE, "delete %s", current->value);
+            break;
+        case OPERATION_WRITE:
+            snprintf(description, MESSAGE_SIZE, "write the current file to %s", current->value);
+            break;
+        case OPERATION_REMOVE_METADATA:
+            snprintf(description, MESSAGE_SIZE, "remove the metadata%s",
+                     current->on_write ? " while writing the output file" : "");
+            break;
+        case OPERATION_CONVERT:
+            if (current->mix_option == 0) {
+                snprintf(description, MESSAGE_SIZE, "convert the samples to %s%s", encoding_name(current->encoding), dither);
+            } else if (current->encoding == SAMPLE_UNSUPPORTED) {
+                snprintf(description, MESSAGE_SIZE, "%s %s%s%s", mix, current->mix_value, mix_end, dither);
+            } else {
+                snprintf(description, MESSAGE_SIZE, "%s %s%s and convert the samples to %s in one pass%s", mix,
+                         current->mix_value, mix_end, encoding_name(current->encoding), dither);
+            }
+            break;
+        case OPERATION_RESAMPLE:
+            snprintf(description, MESSAGE_SIZE, "convert the audio to %s Hz", current->value);
+            break;
+        case OPERATION_TRIM:
+            if (current->trim_end < 0) {
+                snprintf(description, MESSAGE_SIZE, "keep the audio from %g seconds to the end", current->trim_start);
+            } else {
+                snprintf(description, MESSAGE_SIZE, "keep the audio from %g to %g seconds", current->trim_start,
+                         current->trim_end);
+            }
+            break;
+        case OPERATION_CONCAT:
+            snprintf(description, MESSAGE_SIZE, "append the audio of %i file%s in one pass", current->num_options,
+                     current->num_options > 1 ? "s" : "");
+            break;
+        case OPERATION_ANALYZE:
+            snprintf(description, MESSAGE_SIZE, "analyze the peak, RMS, DC offset, clipping and silences of the audio%s%s",
+                     current->value != NULL ? " into " : "", current->value != NULL ? current->value : "");
+            break;
+        default:
+            length = strlen(current->error);
+            while (length > 0 && current->error[length - 1] == '\n') {
+                --length;
+            }
+            snprintf(description, MESSAGE_SIZE, "error: %.*s", length, current->error);
+            break;
+    }
+}
+
+// Function for printing the operations of a plan and the options each was made from.
+void print_plan(operation_plan* plan, char* destination_file_name) {
+    char options[MESSAGE_SIZE];
+    char description[MESSAGE_SIZE];
+    print_message("\nOperation plan:\n\n");
+    if (plan->verify) {
+        print_message("  %-32s check the input file against its checksums\n", "--verify");
+    }
+    if (plan->reverse_by_default) {
+        print_message("  %-32s reverse the audio\n", "(no options)");
+    }
+    for (int i = 0; i < plan->num_operations; ++i) {
+        operation* current = plan->operations + i;
+
+        // List the options with their values.
+        int length = 0;
+        for (int j = 0; j < current->num_options && length < MESSAGE_SIZE; ++j) {
+            int position = current->options[j];
+            char* arg = *(plan->args + position);
+            int has_value = position + 1 < plan->num_args && takes_value(arg);
+            length += snprintf(options + length, MESSAGE_SIZE - length, "%s%s%s%s", j > 0 ? " " : "", arg,
+                               has_value ? " " : "", has_value ? *(plan->args + position + 1) : "");
+        }
+        describe_operation(current, description);
+        print_message("  %-32s %s\n", options, description);
+    }
+    if (plan->split_seconds > 0) {
+        snprintf(options, MESSAGE_SIZE, "--split %g", plan->split_seconds);
+        print_message("  %-32s write the output file in pieces of %g seconds numbered from 1, as in %s%s\n\n", options,
+                      plan->split_seconds, split_file_name(destination_file_name, 1, description, MESSAGE_SIZE),
+                      plan->checksum ? " with checksums" : "");
+    } else {
+        print_message("  %-32s write the output file to %s%s\n\n", "", destination_file_name,
+                      plan->checksum ? " with checksums" : "");
+    }
+}
+
+// Function for freeing a plan.
+void free_plan(operation_plan* plan) {
+    for (int i = 0; i < plan->num_operations; ++i) {
+        free(plan->operations[i].options);
+        free(plan->operations[i].error);
+    }
+    free(plan->operations);
+    free(plan);
+}
@@ -0,0 +1,97 @@
+#ifndef H_PLAN
+#define H_PLAN
+
+#include <stddef.h>
+
+// Kinds of operation in a plan.
+enum operation_type {
+    OPERATION_ERROR, OPERATION_STRETCH, OPERATION_EMBED, OPERATION_POP, OPERATION_LIST, OPERATION_EXTRACT,
+    OPERATION_DELETE, OPERATION_WRITE, OPERATION_REMOVE_METADATA, OPERATION_CONVERT, OPERATION_RESAMPLE,
+    OPERATION_ANALYZE, OPERATION_TRIM, OPERATION_CONCAT
+};
+
+// An operation of a plan, made from one option or from several options fused into one, with the settings that
+// applied where its options appeared.
+typedef struct operation {
+    int type;
+
+    // positions of the options the operation was made from in the plan's arguments
+    int* options;
+    int num_options;
+
+    // value of the first option, or the sidecar file of an analysis, and the message of an option that cannot be
+    // performed
+    char* value;
+    char* error;
+
+    // stretch, by a factor of -1 to only reverse the audio or 1 to do nothing
+    double time_multiplier;
+    int interpolation;
+    int stretch_method;
+
+    // embedded files, named by the values of the options
+    int compression;
+
+    // trim, keeping the audio from trim_start to trim_end seconds, where a trim_end of -1 is the end of the audio
+    double trim_start;
+    double trim_end;
+
+    // conversion, mixing the channels with the -c or -k option in mix_option, or with none when it is 0,
+    // and then converting the samples to encoding unless it is SAMPLE_UNSUPPORTED
+    char mix_option;
+    char* mix_value;
+    int encoding;
+    int dither;
+
+    // metadata removal, left to the writer
+    int on_write;
+} operation;
+
+// A plan of the operations performed on a wav file for a chain of options.
+typedef struct operation_plan {
+    char** args;
+    int num_args;
+    operation* operations;
+    int num_operations;
+    int reverse_by_default; // no operation was given, so the audio is reversed
+    int explain; // the plan is printed instead of performed
+    int checksum; // the output files are written with a checksum chunk
+    int verify; // the input file is checked against its checksum chunk
+    double split_seconds; // the output file is written in numbered pieces of this length, or whole when it is 0
+} operation_plan;
+
+// Function for determining whether an argument is an option that applies to the whole run and is followed by a value.
+int is_run_option(char* arg);
+
+// Function for determining whether an argument is an option that is followed by a value.
+int takes_value(char* arg);
+
+// Function for determining whether an argument is a setting that applies to the following operations.
+int is_setting(char* arg);
+
+// Function for determining whether an argument is the profile option, which applies to the whole run.
+int is_profile_option(char* arg);
+
+// Function for finding an option that applies to the whole run in the options of one file, where the options of
+// the run are set for every file.
+// Returns the option, or NULL if there is none.
+char* find_run_option(int num_args, char** args);
+
+// Function for retrieving the name of a kind of operation.
+char* operation_name(int type);
+
+// Function for naming a numbered piece of a split output file, as in out-001.wav for out.wav.
+char* split_file_name(char* file_name, int piece, char* destination, size_t size);
+
+// Function for reading a chain of options into a plan with an operation for each option, and fusing the
+// operations that can be performed together.
+// Returns NULL if there is an error.
+operation_plan* new_plan(int num_args, char** args);
+
+// Function for printing the operations of a plan and the options each was made from.
+void print_plan(operation_plan* plan, char* destination_file_name);
+
+// Function for freeing a plan.
+void free_plan(operation_plan* plan);
+
+#endif
@@ -0,0 +1,392 @@
+#include <limits.h>
+#include "process.h"
+
+// Function for reading the options that apply to a whole run: the streaming block size, the file mode, the number
+// of blocks in flight in async mode and the file a profile is recorded to. Async mode moves blocks of the
+// streaming block size. The values of other options are skipped, so a file named like an option is not read as one.
+// Returns the block size in chars, or 0 to read files into memory.
+size_t parse_run_options(int num_args, char** args) {
+    size_t block_size = 0;
+    int queue_depth = ASYNC_DEFAULT_QUEUE_DEPTH;
+    for (int i = 0; i < num_args; ++i) {
+        if (is_profile_option(*(args + i))) {
+            start_profile(*(args + i) + 10);
+            continue;
+        } else if (!takes_value(*(args + i)) || i == num_args - 1) {
+            continue;
+        } else if (!strcmp(*(args + i), "-i")) {
+            if (!strcmp(*(args + i + 1), "mmap")) {
+                set_file_mode(FILE_MODE_MMAP);
+            } else if (!strcmp(*(args + i + 1), "async")) {
+                set_file_mode(FILE_MODE_ASYNC);
+            } else if (strcmp(*(args + i + 1), "stdio")) {
+                print_message("%s is an invalid file mode. Using stdio.\n\n", *(args + i + 1));
+            }
+        } else if (!strcmp(*(args + i), "-q")) {
+            queue_depth = atoi(*(args + i + 1));
+            if (queue_depth <= 0 || queue_depth > ASYNC_MAX_QUEUE_DEPTH) {
+                print_message("Invalid queue depth. Using %i blocks.\n\n", ASYNC_DEFAULT_QUEUE_DEPTH);
+                queue_depth = ASYNC_DEFAULT_QUEUE_DEPTH;
+            }
+        } else if (!strcmp(*(args + i), "-s")) {
+            block_size = strtoul(*(args + i + 1), NULL, 10) * 1024;
+            if (block_size == 0) {
+                print_message("Invalid block size. Using %i kilobytes.\n\n", STREAM_DEFAULT_BLOCK_SIZE / 1024);
+                block_size = STREAM_DEFAULT_BLOCK_SIZE;
+            }
+        }
+        ++i;
+    }
+    set_async_options(queue_depth, block_size > 0 ? block_size : ASYNC_DEFAULT_BLOCK_SIZE);
+    return block_size;
+}
+
+// Function for recording the first error of a file.
+static void record_error(char* error, int* num_errors) {
+    if (error != NULL && *num_errors == 0) {
+        snprintf(error, MESSAGE_SIZE, "%s", get_last_message());
+    }
+    ++*num_errors;
+}
+
+// Function for performing an operation of a plan on the current output file, which is held by context when
+// reading files into memory and by stream when streaming.
+// Returns -1 if there is an error.
+static int perform_operation(operation_plan* plan, operation* operation, wave_context* context, stream_file* stream,
+                             wav_file* wav) {
+    char* value = operation->value;
+    int result = 0;
+
+    // Error for an option that cannot be performed
+    if (operation->type == OPERATION_ERROR) {
+        print_message("%s", operation->error);
+        result = -1;
+    // Stretch audio operation
+    } else if (operation->type == OPERATION_STRETCH) {
+        double time_multiplier = operation->time_multiplier;
+        if (time_multiplier == 1.0) {
+            print_message("Time multiplier is 1. Doing nothing.\n\n");
+        } else if (time_multiplier == -1.0) {
+            print_message("Reversing audio.\n\n");
+            if (stream != NULL) {
+                result = stream_reverse_audio(stream);
+            } else {
+                reverse_audio(wav->data_pointer, wav->num_all_channel_samples, wav->all_channel_sample_size_in_bytes);
+            }
+        } else {
+            print_message("Stretching audio by a factor of %f.\n\n", time_multiplier);
+            if (stream != NULL) {
+                result = stream_stretch_audio(stream, time_multiplier, operation->interpolation, operation->stretch_method);
+            } else {
+                result = stretch_audio(context, time_multiplier, operation->interpolation, operation->stretch_method);
+            }
+        }
+    // Embed hidden files operation, which copies a file held in memory once for all the files
+    } else if (operation->type == OPERATION_EMBED) {
+        char** names = malloc(operation->num_options * sizeof(char*));
+        if (names == NULL) {
+            print_message("Error allocating memory for embedded files.\n\n");
+            return -1;
+        }
+        for (int i = 0; i < operation->num_options; ++i) {
+            names[i] = *(plan->args + operation->options[i] + 1);
+            print_message("Embedding %s into wav file.\n\n", names[i]);
+        }
+        if (stream != NULL) {
+            for (int i = 0; i < operation->num_options; ++i) {
+                if (stream_push_back_file(stream, names[i], operation->compression) == -1) {
+                    result = -1;
+                }
+            }
+        } else {
+            result = push_back_files(context, names, operation->num_options, operation->compression);
+        }
+        free(names);
+    // Remove hidden file operation
+    } else if (operation->type == OPERATION_POP) {
+        print_message("Extracting %s from wav file\n\n", value);
+        if (stream != NULL) {
+            result = stream_pop_front_file(stream, value);
+        } else {
+            result = pop_front_file(context, value);
+        }
+    // List embedded files operation
+    } else if (operation->type == OPERATION_LIST) {
+        if (stream != NULL) {
+            result = stream_list_files(stream);
+        } else {
+            result = list_files(context);
+        }
+    // Extract embedded file by name operation
+    } else if (operation->type == OPERATION_EXTRACT) {
+        print_message("Extracting %s from wav file\n\n", value);
+        if (stream != NULL) {
+            result = stream_extract_file(stream, value);
+        } else {
+            result = extract_file(context, value);
+        }
+    // Delete embedded file by name operation
+    } else if (operation->type == OPERATION_DELETE) {
+        print_message("Deleting %s from wav file\n\n", value);
+        if (stream != NULL) {
+            result = stream_delete_file(stream, value);
+        } else {
+            result = delete_file(context, value);
+        }
+    // Output current file operation
+    } else if (operation->type == OPERATION_WRITE) {
+        print_message("Writing current wav file to %s\n\n", value);
+        if (stream != NULL) {
+            result = stream_write(stream, value);
+        } else {
+            result = write_wave_file(context, value);
+        }
+    // Remove metadata operation. A streamed file is only copied when it is written, and a file held in memory
+    // is not copied when the writer leaves the metadata out.
+    } else if (operation->type == OPERATION_REMOVE_METADATA) {
+        if (stream != NULL) {
+            result = stream_remove_metadata(stream);
+        } else if (operation->on_write) {
+            result = remove_metadata_on_write(context);
+        } else {
+            result = remove_metadata(context);
+        }
+    // Mix channels, keep channels and convert sample format operation, in one pass over the audio
+    } else if (operation->type == OPERATION_CONVERT) {
+        channel_mix* mix = NULL;
+        if (operation->mix_option == 'c') {
+            print_message("Mixing %i channels into %s channels.\n\n", wav->num_channels, operation->mix_value);
+            mix = new_channel_mix(wav->num_channels, atoi(operation->mix_value));
+        } else if (operation->mix_option == 'k') {
+            print_message("Keeping channels %s.\n\n", operation->mix_value);
+            mix = parse_channel_selection(operation->mix_value, wav->num_channels);
+        }
+        if (operation->mix_option != 0 && mix == NULL) {
+            return -1;
+        }
+        int encoding = wav->encoding;
+        if (operation->encoding == wav->encoding) {
+            print_message("Samples are already %s. Doing nothing.\n\n", encoding_name(encoding));
+        } else if (operation->encoding != SAMPLE_UNSUPPORTED) {
+            print_message("Converting samples to %s.\n\n", encoding_name(operation->encoding));
+            encoding = operation->encoding;
+        }
+        if (mix != NULL || encoding != wav->encoding) {
+            if (stream != NULL) {
+                result = stream_convert_audio(stream, encoding, mix, operation->dither);
+            } else {
+                result = convert_audio(context, encoding, mix, operation->dither);
+            }
+        }
+        if (mix != NULL) {
+            free_channel_mix(mix);
+        }
+    // Convert sample rate operation
+    } else if (operation->type == OPERATION_RESAMPLE) {
+        int sample_rate = atoi(value);
+        if (sample_rate == wav->sample_rate) {
+            print_message("Sample rate is already %i Hz. Doing nothing.\n\n", sample_rate);
+        } else {
+            print_message("Converting audio to %i Hz.\n\n", sample_rate);
+            if (stream != NULL) {
+                result = stream_resample_audio(stream, sample_rate);
+            } else {
+                result = resample_audio(context, sample_rate);
+            }
+        }
+    // Trim audio operation
+    } else if (operation->type == OPERATION_TRIM) {
+        size_t first, count;
+        result = trim_range(wav, operation->trim_start, operation->trim_end, &first, &count);
+        if (result != -1) {
+            print_message("Keeping frames %zu to %zu of the audio.\n\n", first, first + count);
+            if (stream != NULL) {
+                result = stream_trim_audio(stream, first, count);
+            } else {
+                trim_audio(context, first, count);
+            }
+        }
+    // Concatenate audio operation, which copies a file held in memory once for all the files
+    } else if (operation->type == OPERATION_CONCAT) {
+        char** names = malloc(operation->num_options * sizeof(char*));
+        if (names == NULL) {
+            print_message("Error allocating memory for appended files.\n\n");
+            return -1;
+        }
+        for (int i = 0; i < operation->num_options; ++i) {
+            names[i] = *(plan->args + operation->options[i] + 1);
+            print_message("Appending the audio of %s.\n\n", names[i]);
+        }
+        if (stream != NULL) {
+            for (int i = 0; i < operation->num_options && result != -1; ++i) {
+                result = stream_concat_audio(stream, names[i]);
+            }
+        } else {
+            result = concat_audio(context, names, operation->num_options);
+        }
+        free(names);
+    // Analyze audio operation. A streamed file is analyzed while it is read to be written, and the analysis is
+    // reported then.
+    } else if (operation->type == OPERATION_ANALYZE) {
+        print_message("Analyzing audio.\n\n");
+        if (stream != NULL) {
+            result = stream_analyze_audio(stream, value);
+        } else {
+            result = analyze_audio(context, value);
+        }
+    }
+    return result;
+}
+
+// Function for writing the current output file, held by context when reading files into memory and by stream when
+// streaming, in numbered pieces of split_seconds seconds, or whole when split_seconds is 0.
+// Returns -1 if there is an error.
+static int write_output(wave_context* context, stream_file* stream, char* file_name, double split_seconds) {
+    if (split_seconds == 0) {
+        return stream != NULL ? stream_write(stream, file_name) : write_wave_file(context, file_name);
+    }
+    wav_file* wav = stream != NULL ? &stream->wav : context->wav;
+    size_t num_frames = wav->num_all_channel_samples;
+    double piece_frames = round(split_seconds * wav->sample_rate);
+    size_t frames_per_piece = piece_frames < 1 ? 1 : piece_frames < (double)num_frames ? (size_t)piece_frames : num_frames;
+    char piece_name[PATH_MAX];
+    int result = 0;
+    for (size_t first = 0, piece = 1; first < num_frames || piece == 1; first += frames_per_piece, ++piece) {
+        size_t count = num_frames - first < frames_per_piece ? num_frames - first : frames_per_piece;
+        split_file_name(file_name, piece, piece_name, sizeof(piece_name));
+        print_message("Writing frames %zu to %zu to %s\n\n", first, first + count, piece_name);
+        if ((stream != NULL ? stream_write_range(stream, piece_name, first, count) :
+                              write_wave_range(context, piece_name, first, count)) == -1) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+// Function for reading a wav file, performing a chain of operations on it in order and writing the result.
+// The chain is planned first, so adjacent operations that can be performed together take one pass over the
+// audio. Operations that fail are reported and the rest of the chain still runs. When streaming, block is a
+// buffer of block_size chars to reuse, or NULL, and when reading files into memory, shared is a context whose
+// buffers are reused, or NULL to use a context of the file's own.
+// Returns -1 if there is an error.
+int process_file(char* source_file_name, char* destination_file_name, int num_args, char** args, size_t block_size,
+                 char* block, wave_context* shared, char* error) {
+
+    wave_context* context = NULL; // The current output file when reading files into memory
+    wav_file* wav; // The current parsed output file
+    stream_file* stream = NULL; // The current output file when streaming
+    int num_errors = 0;
+
+    // Plan the operations, return -1 on error. Print the plan instead of performing it when asked to.
+    operation_plan* plan = new_plan(num_args, args);
+    if (plan == NULL) {
+        record_error(error, &num_errors);
+        return -1;
+    }
+    if (plan->explain) {
+        print_plan(plan, destination_file_name);
+        free_plan(plan);
+        return 0;
+    }
+
+    // Record the file in the profile, with its reading and writing as spans of their own.
+    profile_span file_span;
+    profile_span read_span;
+    profile_begin(&file_span, "file", "process_file", source_file_name);
+    profile_begin(&read_span, "file", block_size > 0 ? "stream_open" : "load_wave_file", source_file_name);
+
+    if (block_size > 0) {
+        // Open the input file for streaming, return -1 on error.
+        stream = stream_open(source_file_name, block_size);
+        profile_end(&read_span);
+        if (stream == NULL) {
+            record_error(error, &num_errors);
+            free_plan(plan);
+            profile_end(&file_span);
+            return -1;
+        }
+        stream->block = block;
+        wav = &stream->wav;
+    } else {
+        // Read and parse the input file, return -1 on error.
+        context = shared != NULL ? shared : new_wave_context();
+        int result = context != NULL ? load_wave_file(context, source_file_name) : -1;
+        profile_end(&read_span);
+        if (result == -1) {
+            record_error(error, &num_errors);
+            if (context != NULL && context != shared) {
+                free_wave_context(context);
+            }
+            free_plan(plan);
+            profile_end(&file_span);
+            return -1;
+        }
+        wav = context->wav;
+    }
+
+    // Check the input file against its checksums before it is changed, and ask for checksums in the output files.
+    // A streamed file is checked while it is read to write the output, which is not kept if the check fails.
+    // Return -1 if there are no checksums or the file held in memory has changed.
+    int checked = stream != NULL ? stream_use_checksums(stream, plan->checksum, plan->verify) :
+                  plan->verify ? verify_checksums(context) : 0;
+    if (checked == -1) {
+        record_error(error, &num_errors);
+        if (stream != NULL) {
+            stream_close(stream);
+        } else if (context != shared) {
+            free_wave_context(context);
+        }
+        free_plan(plan);
+        profile_end(&file_span);
+        return -1;
+    }
+    wav->write_checksums |= plan->checksum;
+
+    // Display input file stats.
+    print_message("\nInput file stats:\n");
+    print_stats(wav, source_file_name);
+
+    // If no options are provided, reverse the audio.
+    if (plan->reverse_by_default) {
+        print_message("No options provided. Reversing audio by default.\n\n");
+        if (stream != NULL) {
+            if (stream_reverse_audio(stream) == -1) {
+                record_error(error, &num_errors);
+            }
+        } else {
+            reverse_audio(wav->data_pointer, wav->num_all_channel_samples, wav->all_channel_sample_size_in_bytes);
+        }
+    }
+
+    // Perform the operations in order, recording each in the profile.
+    double split_seconds = plan->split_seconds;
+    for (int i = 0; i < plan->num_operations; ++i) {
+        operation* current = plan->operations + i;
+        profile_span operation_span;
+        profile_begin(&operation_span, "operation", operation_name(current->type), current->value);
+        if (perform_operation(plan, current, context, stream, wav) == -1) {
+            record_error(error, &num_errors);
+        }
+        profile_end(&operation_span);
+    }
+    free_plan(plan);
+
+    // Display output file stats
+    print_message("Output file stats:\n");
+    print_stats(wav, destination_file_name);
+
+    // Write the output file to disk and free memory.
+    profile_span write_span;
+    profile_begin(&write_span, "file", stream != NULL ? "stream_write" : "write_wave_file", destination_file_name);
+    if (write_output(context, stream, destination_file_name, split_seconds) == -1) {
+        record_error(error, &num_errors);
+    }
+    if (stream != NULL) {
+        stream_close(stream);
+    } else if (context != shared) {
+        free_wave_context(context);
+    }
+    profile_end(&write_span);
+    profile_end(&file_span);
+    return num_errors > 0 ? -1 : 0;
+}
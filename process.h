@@ -0,0 +1,18 @@
+#ifndef H_PROCESS
+#define H_PROCESS
+
+#include "plan.h"
+#include "stream.h"
+
+// Function for reading the options that apply to a whole run: the streaming block size and the file mode.
+// Returns the block size in chars, or 0 to read files into memory.
+size_t parse_run_options(int num_args, char** args);
+
+// Function for reading a wav file, performing a chain of operations on it in order and writing the result.
+// The chain is planned first, and only the plan is printed when it has the --explain option. When streaming,
+// block is a buffer of block_size chars to reuse, or NULL, and when reading files into memory, shared is a context
+// to reuse, or NULL. The text of the first error is copied into error when it is not NULL.
+int process_file(char* source_file_name, char* destination_file_name, int num_args, char** args, size_t block_size,
+                 char* block, wave_context* shared, char* error);
+
+#endif
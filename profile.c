@@ -0,0 +1,180 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "message.h"
+#include "parallel.h"
+#include "profile.h"
+
+// Ways of writing a profile.
+//   PROFILE_JSON_LINES  a JSON object for each span on its own line.
+//   PROFILE_TRACE       a JSON array of Chrome trace events, which chrome://tracing and Perfetto open.
+enum profile_format { PROFILE_JSON_LINES, PROFILE_TRACE };
+
+static pthread_once_t profile_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static char* requested_file_name = NULL;
+static char* profile_file_name = NULL;
+static FILE* profile_file = NULL;
+static int profile_format = PROFILE_JSON_LINES;
+static int enabled = 0;
+static int num_events = 0;
+static int num_threads = 0;
+static double profile_start = 0;
+
+// The counters of each thread, and the number its spans are recorded with, which is given on its first span.
+static __thread profile_counters thread_counters;
+static __thread int thread_number = 0;
+
+// Function for ending the profile when the process exits, closing the array of trace events.
+static void finish_profile() {
+    pthread_mutex_lock(&profile_lock);
+    if (profile_format == PROFILE_TRACE) {
+        fprintf(profile_file, "\n]\n");
+    }
+    fclose(profile_file);
+    profile_file = NULL;
+    enabled = 0;
+    pthread_mutex_unlock(&profile_lock);
+}
+
+// Function for opening the profile named by start_profile or by the WAVE_PROFILE environment variable, once for
+// the whole process.
+static void open_profile() {
+    char* file_name = requested_file_name != NULL ? requested_file_name : getenv("WAVE_PROFILE");
+    if (file_name == NULL || *file_name == '\0') {
+        return;
+    }
+
+    // Open the profile file, print an error message if unsuccessful.
+    profile_file = fopen(file_name, "w");
+    if (profile_file == NULL) {
+        print_message("Error writing profile. Unable to open %s.\n\n", file_name);
+        return;
+    }
+    size_t length = strlen(file_name);
+    profile_format = length >= 5 && !strcmp(file_name + length - 5, ".json") ? PROFILE_TRACE : PROFILE_JSON_LINES;
+    if (profile_format == PROFILE_TRACE) {
+        fprintf(profile_file, "[\n");
+    }
+    profile_file_name = file_name;
+    profile_start = current_seconds();
+    enabled = 1;
+    atexit(finish_profile);
+}
+
+// Function for recording a profile of the run to a file, as Chrome trace events when the name ends in ".json"
+// and as JSON lines otherwise.
+// Returns -1 if there is an error.
+int start_profile(char* file_name) {
+    requested_file_name = file_name;
+    pthread_once(&profile_once, open_profile);
+    if (enabled && profile_file_name != file_name) {
+        print_message("A profile is already being recorded to %s.\n\n", profile_file_name);
+    }
+    return enabled && profile_file_name == file_name ? 0 : -1;
+}
+
+// Function for beginning a span with a category, a name and an optional detail. When no profile is being recorded
+// the span is left inactive, so the cost is a check of a flag.
+void profile_begin(profile_span* span, const char* category, const char* name, const char* detail) {
+    pthread_once(&profile_once, open_profile);
+    span->active = enabled;
+    if (!enabled) {
+        return;
+    }
+    span->category = category;
+    span->name = name;
+    span->detail = detail;
+    span->counters = thread_counters;
+    span->start = current_seconds();
+}
+
+// Function for writing a string to the profile as a JSON string, or null when there is none.
+static void write_json_string(const char* string) {
+    if (string == NULL) {
+        fputs("null", profile_file);
+        return;
+    }
+    fputc('"', profile_file);
+    for (const char* c = string; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(profile_file, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(profile_file, "\\u%04x", (unsigned char)*c);
+        } else {
+            fputc(*c, profile_file);
+        }
+    }
+    fputc('"', profile_file);
+}
+
+// Function for ending a span and writing it to the profile, with the chars the thread moved and allocated during
+// the span and the peak memory of the process at its end.
+void profile_end(profile_span* span) {
+    if (!span->active) {
+        return;
+    }
+    double end = current_seconds();
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    size_t chars_read = thread_counters.chars_read - span->counters.chars_read;
+    size_t chars_written = thread_counters.chars_written - span->counters.chars_written;
+    size_t num_allocations = thread_counters.num_allocations - span->counters.num_allocations;
+    size_t chars_allocated = thread_counters.chars_allocated - span->counters.chars_allocated;
+    double start_us = (span->start - profile_start) * 1e6;
+    double duration_us = (end - span->start) * 1e6;
+
+    // Spans are written as they end, so batch workers take turns.
+    pthread_mutex_lock(&profile_lock);
+    if (profile_file == NULL) {
+        pthread_mutex_unlock(&profile_lock);
+        return;
+    }
+    if (thread_number == 0) {
+        thread_number = ++num_threads;
+    }
+    if (profile_format == PROFILE_TRACE) {
+        fprintf(profile_file, "%s{\"name\": ", num_events > 0 ? ",\n" : "");
+        write_json_string(span->name);
+        fprintf(profile_file, ", \"cat\": ");
+        write_json_string(span->category);
+        fprintf(profile_file, ", \"ph\": \"X\", \"pid\": %ld, \"tid\": %i, \"ts\": %.3f, \"dur\": %.3f, \"args\": {"
+                "\"detail\": ", (long)getpid(), thread_number, start_us, duration_us);
+        write_json_string(span->detail);
+        fprintf(profile_file, ", \"bytes_read\": %zu, \"bytes_written\": %zu, \"allocations\": %zu, "
+                "\"bytes_allocated\": %zu, \"peak_rss_kb\": %ld}}", chars_read, chars_written, num_allocations,
+                chars_allocated, usage.ru_maxrss);
+    } else {
+        fprintf(profile_file, "{\"category\": ");
+        write_json_string(span->category);
+        fprintf(profile_file, ", \"name\": ");
+        write_json_string(span->name);
+        fprintf(profile_file, ", \"detail\": ");
+        write_json_string(span->detail);
+        fprintf(profile_file, ", \"thread\": %i, \"start_us\": %.3f, \"duration_us\": %.3f, \"bytes_read\": %zu, "
+                "\"bytes_written\": %zu, \"allocations\": %zu, \"bytes_allocated\": %zu, \"peak_rss_kb\": %ld}\n",
+                thread_number, start_us, duration_us, chars_read, chars_written, num_allocations, chars_allocated,
+                usage.ru_maxrss);
+    }
+    ++num_events;
+    pthread_mutex_unlock(&profile_lock);
+}
+
+// Function for counting chars moved between the disk and memory by the calling thread.
+void profile_io(size_t chars_read, size_t chars_written) {
+    if (enabled) {
+        thread_counters.chars_read += chars_read;
+        thread_counters.chars_written += chars_written;
+    }
+}
+
+// Function for counting an allocation made by the calling thread.
+void profile_allocation(size_t size) {
+    if (enabled) {
+        ++thread_counters.num_allocations;
+        thread_counters.chars_allocated += size;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef H_PROFILE
+#define H_PROFILE
+
+#include <stddef.h>
+
+// Counters of the work done by a thread. A span records how much they grew between its beginning and its end, so
+// a span includes the work of the spans inside it.
+typedef struct profile_counters {
+    size_t chars_read;
+    size_t chars_written;
+    size_t num_allocations;
+    size_t chars_allocated;
+} profile_counters;
+
+// A span of time spent in an operation or an I/O call. It is only active while a profile is being recorded.
+typedef struct profile_span {
+    const char* category;
+    const char* name;
+    const char* detail;
+    double start;
+    profile_counters counters;
+    int active;
+} profile_span;
+
+// Function for recording a profile of the run to a file, as Chrome trace events when the name ends in ".json"
+// and as JSON lines otherwise. Without it, a profile is recorded when the WAVE_PROFILE environment variable names
+// a file. Returns -1 if there is an error.
+int start_profile(char* file_name);
+
+// Function for beginning a span with a category, a name and an optional detail, such as a file name, which must
+// last until the span ends.
+void profile_begin(profile_span* span, const char* category, const char* name, const char* detail);
+
+// Function for ending a span and recording it.
+void profile_end(profile_span* span);
+
+// Function for counting chars moved between the disk and memory by the calling thread.
+void profile_io(size_t chars_read, size_t chars_written);
+
+// Function for counting an allocation made by the calling thread.
+void profile_allocation(size_t size);
+
+#endif
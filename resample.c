@@ -0,0 +1,262 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "message.h"
+#include "parallel.h"
+#include "resample.h"
+#include "sample.h"
+
+// The number of output frames resampled at a time by resample_frames.
+#define RESAMPLE_BLOCK_FRAMES 4096
+
+// The fewest blocks resampled by each worker thread.
+#define MIN_BLOCKS_PER_THREAD 16
+
+// Arguments for resampling a range of blocks on a worker thread.
+typedef struct resample_task {
+    resampler* resampler;
+    char* source;
+    char* destination;
+    size_t num_frames;
+    int failed;
+} resample_task;
+
+// A function for converting an interpolation name to an interpolation. Returns -1 for unknown names.
+int parse_interpolation(char* name) {
+    if (!strcmp(name, "nearest")) {
+        return INTERPOLATION_NEAREST;
+    } else if (!strcmp(name, "linear")) {
+        return INTERPOLATION_LINEAR;
+    } else if (!strcmp(name, "cubic")) {
+        return INTERPOLATION_CUBIC;
+    } else if (!strcmp(name, "sinc")) {
+        return INTERPOLATION_SINC;
+    }
+    return -1;
+}
+
+// A function for retrieving the name of an interpolation.
+char* interpolation_name(int interpolation) {
+    static char* names[] = { "nearest", "linear", "cubic", "sinc" };
+    return names[interpolation];
+}
+
+// A function for filling a table of windowed sinc weights. When there are fewer output frames than
+// source frames, the cutoff frequency is lowered to the output's Nyquist frequency.
+static void build_sinc_table(float* table, double cutoff, int taps_before) {
+    double half_width = SINC_TAPS / 2;
+    for (int phase = 0; phase < SINC_PHASES; ++phase) {
+        double sum = 0;
+        for (int tap = 0; tap < SINC_TAPS; ++tap) {
+            double x = tap - taps_before - (double)phase / SINC_PHASES;
+            double sinc = x == 0 ? 1 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            double window = fabs(x) >= half_width ? 0 : 0.42 + 0.5 * cos(M_PI * x / half_width) + 0.08 * cos(2 * M_PI * x / half_width);
+            table[phase * SINC_TAPS + tap] = sinc * window;
+            sum += sinc * window;
+        }
+
+        // Normalize the weights so a constant signal keeps its level.
+        for (int tap = 0; tap < SINC_TAPS; ++tap) {
+            table[phase * SINC_TAPS + tap] /= sum;
+        }
+    }
+}
+
+// A function for creating a resampler producing time_multiplier output frames per source frame.
+// Returns NULL if there is an error.
+resampler* new_resampler(double time_multiplier, int interpolation, int num_channels, int encoding,
+                         size_t num_source_frames) {
+
+    // Allocate memory for the resampler, return NULL on error.
+    resampler* new = calloc(1, sizeof(resampler));
+    if (new == NULL) {
+        print_message("Error allocating memory for resampler.\n\n");
+        return NULL;
+    }
+
+    new->interpolation = interpolation;
+    new->step = (uint64_t)llround(4294967296.0 / time_multiplier);
+    new->num_channels = num_channels;
+    new->encoding = encoding;
+    new->frame_size = num_channels * encoding_size(encoding);
+    new->num_source_frames = num_source_frames;
+
+    switch (interpolation) {
+        case INTERPOLATION_LINEAR:
+            new->taps_after = 1;
+            break;
+        case INTERPOLATION_CUBIC:
+            new->taps_before = 1;
+            new->taps_after = 2;
+            break;
+        case INTERPOLATION_SINC:
+            new->taps_before = SINC_TAPS / 2 - 1;
+            new->taps_after = SINC_TAPS / 2;
+            new->sinc_table = malloc(SINC_TAPS * SINC_PHASES * sizeof(float));
+            if (new->sinc_table == NULL) {
+                print_message("Error allocating memory for resampler.\n\n");
+                free(new);
+                return NULL;
+            }
+            build_sinc_table(new->sinc_table, time_multiplier < 1 ? time_multiplier : 1, new->taps_before);
+            break;
+    }
+    return new;
+}
+
+// A function for freeing a resampler.
+void free_resampler(resampler* resampler) {
+    free(resampler->sinc_table);
+    free(resampler);
+}
+
+// A function for calculating the unclamped range of source frames used by output frames [first, first + count).
+static void tap_range(resampler* resampler, size_t first, size_t count, int64_t* low, int64_t* high) {
+    *low = (int64_t)((first * resampler->step) >> 32) - resampler->taps_before;
+    *high = (int64_t)(((first + count - 1) * resampler->step) >> 32) + resampler->taps_after;
+}
+
+// A function for calculating the range of source frames needed for output frames [first, first + count).
+// Returns the number of source frames and stores the first one in source_first.
+size_t resampler_source_range(resampler* resampler, size_t first, size_t count, size_t* source_first) {
+    int64_t low, high, last = (int64_t)resampler->num_source_frames - 1;
+    if (count == 0 || last < 0) {
+        *source_first = 0;
+        return 0;
+    }
+    tap_range(resampler, first, count, &low, &high);
+    low = low < 0 ? 0 : low > last ? last : low;
+    high = high > last ? last : high;
+    *source_first = low;
+    return high - low + 1;
+}
+
+// A function for calculating the number of floats of scratch memory used by resample_block.
+size_t resampler_scratch_size(resampler* resampler, size_t count) {
+    size_t width = (((count > 0 ? count - 1 : 0) * resampler->step) >> 32) + 2 + resampler->taps_before + resampler->taps_after;
+    return resampler->num_channels * (width + count) + 3 * count;
+}
+
+// A function for resampling output frames [first, first + count) from the source frames returned by
+// resampler_source_range, which start at frame source_first.
+void resample_block(resampler* resampler, char* source, size_t source_first, size_t source_count, size_t first,
+                    size_t count, char* destination, float* scratch) {
+    if (count == 0 || source_count == 0) {
+        memset(destination, 0, count * resampler->frame_size);
+        return;
+    }
+
+    // Decode the source frames into planar samples padded to the full tap range. Taps before the first
+    // source frame or after the last repeat the edge frames.
+    int64_t low, high;
+    tap_range(resampler, first, count, &low, &high);
+    size_t width = high - low + 1;
+    float* input = scratch;
+    float* output = input + resampler->num_channels * width;
+    float* fractions = output + resampler->num_channels * count;
+    int32_t* bases = (int32_t*)(fractions + count);
+    int32_t* phases = bases + count;
+
+    // Positions past the last source frame only use the last source frame.
+    int64_t start = (int64_t)source_first - low;
+    if (start < 0) {
+        source += (source_count - 1) * resampler->frame_size;
+        source_count = 1;
+        start = 0;
+    }
+    size_t offset = start;
+    decode_frames(source, input + offset, source_count, resampler->num_channels, resampler->encoding, width);
+    for (int c = 0; c < resampler->num_channels; ++c) {
+        float* x = input + c * width;
+        for (size_t j = 0; j < offset; ++j) {
+            x[j] = x[offset];
+        }
+        for (size_t j = offset + source_count; j < width; ++j) {
+            x[j] = x[offset + source_count - 1];
+        }
+    }
+
+    // Calculate the first tap and the fractional position of every output frame once for all channels.
+    uint64_t position = first * resampler->step;
+    for (size_t i = 0; i < count; ++i, position += resampler->step) {
+        bases[i] = (int64_t)(position >> 32) - resampler->taps_before - low;
+        fractions[i] = (uint32_t)position * (1.0f / 4294967296.0f);
+        phases[i] = (uint32_t)position / (4294967296ULL / SINC_PHASES);
+    }
+
+    // Interpolate each channel.
+    for (int c = 0; c < resampler->num_channels; ++c) {
+        float* x = input + c * width;
+        float* y = output + c * count;
+        switch (resampler->interpolation) {
+            case INTERPOLATION_LINEAR:
+                for (size_t i = 0; i < count; ++i) {
+                    float* p = x + bases[i];
+                    y[i] = p[0] + fractions[i] * (p[1] - p[0]);
+                }
+                break;
+            case INTERPOLATION_CUBIC:
+                for (size_t i = 0; i < count; ++i) {
+                    float* p = x + bases[i];
+                    float t = fractions[i];
+                    y[i] = p[1] + 0.5f * t * (p[2] - p[0] + t * (2 * p[0] - 5 * p[1] + 4 * p[2] - p[3] + t * (3 * (p[1] - p[2]) + p[3] - p[0])));
+                }
+                break;
+            case INTERPOLATION_SINC:
+                for (size_t i = 0; i < count; ++i) {
+                    float* p = x + bases[i];
+                    float* weights = resampler->sinc_table + phases[i] * SINC_TAPS;
+                    float sum = 0;
+                    for (int tap = 0; tap < SINC_TAPS; ++tap) {
+                        sum += weights[tap] * p[tap];
+                    }
+                    y[i] = sum;
+                }
+                break;
+            default:
+                for (size_t i = 0; i < count; ++i) {
+                    y[i] = x[bases[i]];
+                }
+                break;
+        }
+    }
+
+    encode_frames(output, destination, count, resampler->num_channels, resampler->encoding, count);
+}
+
+// A function for resampling a range of blocks on a worker thread.
+static void resample_range(void* argument, size_t first_block, size_t last_block) {
+    resample_task* task = argument;
+    resampler* resampler = task->resampler;
+
+    // Allocate scratch memory for one block, return on error.
+    float* scratch = malloc(resampler_scratch_size(resampler, RESAMPLE_BLOCK_FRAMES) * sizeof(float));
+    if (scratch == NULL) {
+        task->failed = 1;
+        return;
+    }
+
+    for (size_t block = first_block; block < last_block; ++block) {
+        size_t first = block * RESAMPLE_BLOCK_FRAMES;
+        size_t count = task->num_frames - first < RESAMPLE_BLOCK_FRAMES ? task->num_frames - first : RESAMPLE_BLOCK_FRAMES;
+        size_t source_first;
+        size_t source_count = resampler_source_range(resampler, first, count, &source_first);
+        resample_block(resampler, task->source + source_first * resampler->frame_size, source_first, source_count, first,
+                       count, task->destination + first * resampler->frame_size, scratch);
+    }
+    free(scratch);
+}
+
+// A function for resampling a whole buffer of source frames into num_frames output frames, splitting
+// the output across worker threads. Returns -1 if there is an error.
+int resample_frames(resampler* resampler, char* source, char* destination, size_t num_frames) {
+    resample_task task = { resampler, source, destination, num_frames, 0 };
+    size_t num_blocks = (num_frames + RESAMPLE_BLOCK_FRAMES - 1) / RESAMPLE_BLOCK_FRAMES;
+    parallel_for(num_blocks, MIN_BLOCKS_PER_THREAD, resample_range, &task);
+    if (task.failed) {
+        print_message("Error allocating memory for resampling.\n\n");
+        return -1;
+    }
+    return 0;
+}
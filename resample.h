@@ -0,0 +1,62 @@
+#ifndef H_RESAMPLE
+#define H_RESAMPLE
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Ways of calculating an output frame that falls between two source frames.
+enum interpolation { INTERPOLATION_NEAREST, INTERPOLATION_LINEAR, INTERPOLATION_CUBIC, INTERPOLATION_SINC };
+
+// The number of source frames weighted by the windowed sinc kernel, and the number of positions
+// between two source frames for which its weights are tabulated.
+#define SINC_TAPS 16
+#define SINC_PHASES 256
+
+// A struct describing how frames are resampled. Output frame i is taken from source position
+// i * step, where step is a 32.32 fixed-point number of source frames.
+typedef struct resampler {
+    int interpolation;
+    uint64_t step;
+    int num_channels;
+    int encoding;
+    int frame_size;
+    size_t num_source_frames;
+
+    // source frames used before and after each position
+    int taps_before;
+    int taps_after;
+
+    // windowed sinc weights, SINC_TAPS for each of SINC_PHASES positions
+    float* sinc_table;
+} resampler;
+
+// A function for converting an interpolation name to an interpolation. Returns -1 for unknown names.
+int parse_interpolation(char* name);
+
+// A function for retrieving the name of an interpolation.
+char* interpolation_name(int interpolation);
+
+// A function for creating a resampler producing time_multiplier output frames per source frame.
+resampler* new_resampler(double time_multiplier, int interpolation, int num_channels, int encoding,
+                         size_t num_source_frames);
+
+// A function for freeing a resampler.
+void free_resampler(resampler* resampler);
+
+// A function for calculating the range of source frames needed for output frames [first, first + count).
+// Returns the number of source frames and stores the first one in source_first.
+size_t resampler_source_range(resampler* resampler, size_t first, size_t count, size_t* source_first);
+
+// A function for calculating the number of floats of scratch memory used by resample_block.
+size_t resampler_scratch_size(resampler* resampler, size_t count);
+
+// A function for resampling output frames [first, first + count) from the source frames returned by
+// resampler_source_range, which start at frame source_first.
+void resample_block(resampler* resampler, char* source, size_t source_first, size_t source_count, size_t first,
+                    size_t count, char* destination, float* scratch);
+
+// A function for resampling a whole buffer of source frames into num_frames output frames, splitting
+// the output across worker threads. Returns -1 if there is an error.
+int resample_frames(resampler* resampler, char* source, char* destination, size_t num_frames);
+
+#endif
@@ -0,0 +1,235 @@
+#include <pthread.h>
+#include <string.h>
+#include "parallel.h"
+#include "reverse.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REVERSE_SIMD 1
+#endif
+
+// The widest frame with a specialized kernel.
+#define MAX_KERNEL_FRAME_SIZE 32
+
+// The number of frames swapped at a time by the vector kernels. A block of 16 frames is always
+// a whole number of 16-char vectors.
+#define BLOCK_FRAMES 16
+
+// The fewest chars reversed by each worker thread.
+#define MIN_CHARS_PER_THREAD (4 << 20)
+
+// A kernel swapping the frames at the front of a buffer with the mirrored frames at its back.
+// front points to the first frame of the front range, and back to the last frame of the back range.
+typedef void (*reverse_kernel)(char* front, char* back, size_t num_pairs);
+
+// Arguments for reversing a range of frame pairs on a worker thread.
+typedef struct reverse_task {
+    char* frames;
+    size_t num_frames;
+    int frame_size;
+    size_t num_blocks;
+    reverse_kernel kernel;
+} reverse_task;
+
+// Function for swapping frames of any width through a small temporary buffer.
+static void swap_frames(char* front, char* back, size_t num_pairs, int frame_size) {
+    char temp[256];
+    for (size_t i = 0; i < num_pairs; ++i) {
+        for (int offset = 0; offset < frame_size; offset += sizeof(temp)) {
+            int length = frame_size - offset < (int)sizeof(temp) ? frame_size - offset : (int)sizeof(temp);
+            memcpy(temp, front + offset, length);
+            memcpy(front + offset, back + offset, length);
+            memcpy(back + offset, temp, length);
+        }
+        front += frame_size;
+        back -= frame_size;
+    }
+}
+
+// Scalar kernels with a constant frame width, so each swap compiles to a few moves.
+#define DEFINE_SCALAR_KERNEL(N)                                                 \
+    static void reverse_scalar_##N(char* front, char* back, size_t num_pairs) { \
+        char temp[N];                                                           \
+        for (size_t i = 0; i < num_pairs; ++i) {                                \
+            memcpy(temp, front, N);                                             \
+            memcpy(front, back, N);                                             \
+            memcpy(back, temp, N);                                              \
+            front += N;                                                         \
+            back -= N;                                                          \
+        }                                                                       \
+    }
+
+DEFINE_SCALAR_KERNEL(1) DEFINE_SCALAR_KERNEL(2) DEFINE_SCALAR_KERNEL(3) DEFINE_SCALAR_KERNEL(4)
+DEFINE_SCALAR_KERNEL(5) DEFINE_SCALAR_KERNEL(6) DEFINE_SCALAR_KERNEL(7) DEFINE_SCALAR_KERNEL(8)
+DEFINE_SCALAR_KERNEL(9) DEFINE_SCALAR_KERNEL(10) DEFINE_SCALAR_KERNEL(11) DEFINE_SCALAR_KERNEL(12)
+DEFINE_SCALAR_KERNEL(13) DEFINE_SCALAR_KERNEL(14) DEFINE_SCALAR_KERNEL(15) DEFINE_SCALAR_KERNEL(16)
+DEFINE_SCALAR_KERNEL(17) DEFINE_SCALAR_KERNEL(18) DEFINE_SCALAR_KERNEL(19) DEFINE_SCALAR_KERNEL(20)
+DEFINE_SCALAR_KERNEL(21) DEFINE_SCALAR_KERNEL(22) DEFINE_SCALAR_KERNEL(23) DEFINE_SCALAR_KERNEL(24)
+DEFINE_SCALAR_KERNEL(25) DEFINE_SCALAR_KERNEL(26) DEFINE_SCALAR_KERNEL(27) DEFINE_SCALAR_KERNEL(28)
+DEFINE_SCALAR_KERNEL(29) DEFINE_SCALAR_KERNEL(30) DEFINE_SCALAR_KERNEL(31) DEFINE_SCALAR_KERNEL(32)
+
+static const reverse_kernel scalar_kernels[MAX_KERNEL_FRAME_SIZE + 1] = {
+    NULL, reverse_scalar_1, reverse_scalar_2, reverse_scalar_3, reverse_scalar_4, reverse_scalar_5,
+    reverse_scalar_6, reverse_scalar_7, reverse_scalar_8, reverse_scalar_9, reverse_scalar_10,
+    reverse_scalar_11, reverse_scalar_12, reverse_scalar_13, reverse_scalar_14, reverse_scalar_15,
+    reverse_scalar_16, reverse_scalar_17, reverse_scalar_18, reverse_scalar_19, reverse_scalar_20,
+    reverse_scalar_21, reverse_scalar_22, reverse_scalar_23, reverse_scalar_24, reverse_scalar_25,
+    reverse_scalar_26, reverse_scalar_27, reverse_scalar_28, reverse_scalar_29, reverse_scalar_30,
+    reverse_scalar_31, reverse_scalar_32
+};
+
+#ifdef REVERSE_SIMD
+
+// A plan for reversing the order of the frames in a block of 16 frames of a given width with byte
+// shuffles. Each output vector is the OR of up to four shuffled input vectors.
+typedef struct shuffle_plan {
+    int num_sources[MAX_KERNEL_FRAME_SIZE];
+    int sources[MAX_KERNEL_FRAME_SIZE][4];
+    unsigned char masks[MAX_KERNEL_FRAME_SIZE][4][16];
+} shuffle_plan;
+
+static shuffle_plan plans[MAX_KERNEL_FRAME_SIZE + 1];
+static pthread_once_t plans_once = PTHREAD_ONCE_INIT;
+static int has_ssse3 = 0;
+
+// Function for building the shuffle plans for every frame width.
+static void build_plans() {
+    has_ssse3 = __builtin_cpu_supports("ssse3");
+    for (int frame_size = 1; frame_size <= MAX_KERNEL_FRAME_SIZE; ++frame_size) {
+        shuffle_plan* plan = plans + frame_size;
+        memset(plan->masks, 0x80, sizeof(plan->masks));
+        for (int position = 0; position < BLOCK_FRAMES * frame_size; ++position) {
+
+            // The char at position in the output comes from the same offset of the mirrored frame.
+            int frame = position / frame_size;
+            int source = (BLOCK_FRAMES - 1 - frame) * frame_size + position % frame_size;
+            int vector = position / 16;
+
+            int k = 0;
+            while (k < plan->num_sources[vector] && plan->sources[vector][k] != source / 16) {
+                ++k;
+            }
+            if (k == plan->num_sources[vector]) {
+                plan->sources[vector][k] = source / 16;
+                ++plan->num_sources[vector];
+            }
+            plan->masks[vector][k][position % 16] = source % 16;
+        }
+    }
+}
+
+// Function for reversing the frames of one block into another with a shuffle plan.
+__attribute__((target("ssse3"))) static inline void shuffle_block(__m128i* input, char* output, shuffle_plan* plan,
+                                                                    int num_vectors) {
+    for (int j = 0; j < num_vectors; ++j) {
+        __m128i vector = _mm_setzero_si128();
+        for (int k = 0; k < plan->num_sources[j]; ++k) {
+            __m128i mask = _mm_loadu_si128((__m128i*)plan->masks[j][k]);
+            vector = _mm_or_si128(vector, _mm_shuffle_epi8(input[plan->sources[j][k]], mask));
+        }
+        _mm_storeu_si128((__m128i*)(output + 16 * j), vector);
+    }
+}
+
+// Vector kernels for frame widths that do not divide a vector. Each step swaps a block of 16 frames
+// at the front with the mirrored block at the back, and the remaining pairs are swapped by the
+// scalar kernel.
+#define DEFINE_BLOCK_KERNEL(N)                                                                     \
+    __attribute__((target("ssse3"))) static void reverse_block_##N(char* front, char* back,        \
+                                                                   size_t num_pairs) {             \
+        shuffle_plan* plan = plans + N;                                                            \
+        __m128i front_block[N], back_block[N];                                                     \
+        char* back_start = back - (BLOCK_FRAMES - 1) * N;                                          \
+        size_t i = 0;                                                                              \
+        for (; i + BLOCK_FRAMES <= num_pairs; i += BLOCK_FRAMES) {                                 \
+            for (int j = 0; j < N; ++j) {                                                          \
+                front_block[j] = _mm_loadu_si128((__m128i*)(front + 16 * j));                      \
+                back_block[j] = _mm_loadu_si128((__m128i*)(back_start + 16 * j));                  \
+            }                                                                                      \
+            shuffle_block(back_block, front, plan, N);                                             \
+            shuffle_block(front_block, back_start, plan, N);                                       \
+            front += BLOCK_FRAMES * N;                                                             \
+            back_start -= BLOCK_FRAMES * N;                                                        \
+        }                                                                                          \
+        reverse_scalar_##N(front, back_start + (BLOCK_FRAMES - 1) * N, num_pairs - i);             \
+    }
+
+// Vector kernels for frame widths that divide a vector. Each step swaps two vectors at the front
+// with the mirrored vectors at the back, reversing the frames inside each vector with one shuffle.
+#define DEFINE_SHUFFLE_KERNEL(N)                                                                   \
+    __attribute__((target("ssse3"))) static void reverse_shuffle_##N(char* front, char* back,      \
+                                                                     size_t num_pairs) {           \
+        __m128i mask = _mm_loadu_si128((__m128i*)plans[N].masks[BLOCK_FRAMES * N / 16 - 1][0]);    \
+        const size_t step = 32 / N;                                                                \
+        char* back_start = back - (step - 1) * N;                                                  \
+        size_t i = 0;                                                                              \
+        for (; i + step <= num_pairs; i += step) {                                                 \
+            __m128i front_0 = _mm_loadu_si128((__m128i*)front);                                    \
+            __m128i front_1 = _mm_loadu_si128((__m128i*)(front + 16));                             \
+            __m128i back_0 = _mm_loadu_si128((__m128i*)back_start);                                \
+            __m128i back_1 = _mm_loadu_si128((__m128i*)(back_start + 16));                         \
+            _mm_storeu_si128((__m128i*)front, _mm_shuffle_epi8(back_1, mask));                     \
+            _mm_storeu_si128((__m128i*)(front + 16), _mm_shuffle_epi8(back_0, mask));              \
+            _mm_storeu_si128((__m128i*)back_start, _mm_shuffle_epi8(front_1, mask));               \
+            _mm_storeu_si128((__m128i*)(back_start + 16), _mm_shuffle_epi8(front_0, mask));        \
+            front += 32;                                                                           \
+            back_start -= 32;                                                                      \
+        }                                                                                          \
+        reverse_scalar_##N(front, back_start + (step - 1) * N, num_pairs - i);                     \
+    }
+
+DEFINE_SHUFFLE_KERNEL(1) DEFINE_SHUFFLE_KERNEL(2) DEFINE_SHUFFLE_KERNEL(4) DEFINE_SHUFFLE_KERNEL(8)
+DEFINE_BLOCK_KERNEL(3)
+
+// Vector kernels by frame width. Wider frames are moved with whole-frame loads and stores by the
+// scalar kernels, which bench/bench_reverse.c measures as faster than shuffling them.
+static const reverse_kernel vector_kernels[MAX_KERNEL_FRAME_SIZE + 1] = {
+    NULL, reverse_shuffle_1, reverse_shuffle_2, reverse_block_3, reverse_shuffle_4, NULL, NULL, NULL, reverse_shuffle_8
+};
+
+#endif
+
+// Function for choosing the kernel for a frame width. Returns NULL for widths without a kernel.
+static reverse_kernel select_kernel(int frame_size) {
+    if (frame_size < 1 || frame_size > MAX_KERNEL_FRAME_SIZE) {
+        return NULL;
+    }
+#ifdef REVERSE_SIMD
+    pthread_once(&plans_once, build_plans);
+    if (has_ssse3 && vector_kernels[frame_size] != NULL) {
+        return vector_kernels[frame_size];
+    }
+#endif
+    return scalar_kernels[frame_size];
+}
+
+// Function for swapping a range of frame pairs on a worker thread.
+static void reverse_range(void* argument, size_t first, size_t last) {
+    reverse_task* task = argument;
+    char* front = task->frames + first * task->frame_size;
+    char* back = task->frames + (task->num_frames - 1 - first) * task->frame_size;
+    if (task->kernel != NULL) {
+        task->kernel(front, back, last - first);
+    } else {
+        swap_frames(front, back, last - first, task->frame_size);
+    }
+}
+
+// Function for swapping a range of blocks of frame pairs on a worker thread. The last range
+// also swaps the pairs that do not fill a block.
+static void reverse_blocks(void* argument, size_t first, size_t last) {
+    reverse_task* task = argument;
+    reverse_range(task, first * BLOCK_FRAMES, last >= task->num_blocks ? task->num_frames / 2 : last * BLOCK_FRAMES);
+}
+
+// Function for reversing the order of num_frames frames of frame_size chars in place.
+void reverse_frames(char* frames, size_t num_frames, int frame_size) {
+    if (num_frames < 2 || frame_size < 1) {
+        return;
+    }
+
+    // Frame pairs are split across threads in multiples of a block, so every thread can use whole vectors.
+    reverse_task task = { frames, num_frames, frame_size, num_frames / 2 / BLOCK_FRAMES, select_kernel(frame_size) };
+    size_t min_blocks = MIN_CHARS_PER_THREAD / frame_size / BLOCK_FRAMES;
+    parallel_for(task.num_blocks > 0 ? task.num_blocks : 1, min_blocks > 0 ? min_blocks : 1, reverse_blocks, &task);
+}
@@ -0,0 +1,10 @@
+#ifndef H_REVERSE
+#define H_REVERSE
+
+#include <stddef.h>
+
+// Function for reversing the order of num_frames frames of frame_size chars in place. Frame widths
+// of up to 32 chars use specialized kernels, and large buffers are split across worker threads.
+void reverse_frames(char* frames, size_t num_frames, int frame_size);
+
+#endif
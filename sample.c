@@ -0,0 +1,552 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "sample.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SAMPLE_SIMD 1
+#endif
+
+// The number of samples converted at a time when frames have more than one channel. The samples are converted
+// between a block of interleaved floats and the frames with contiguous kernels, and the block is spread across
+// the channels or gathered from them.
+#define BLOCK_SAMPLES 1024
+
+// Kernels converting contiguous samples of an encoding to float and back.
+typedef void (*decode_kernel)(unsigned char* source, float* destination, size_t num_samples);
+typedef void (*encode_kernel)(float* source, unsigned char* destination, size_t num_samples);
+
+// Function for determining the encoding of samples from their format tag and the width of their container.
+// Returns SAMPLE_UNSUPPORTED for samples that cannot be converted.
+int sample_encoding(int format_tag, int bits_per_sample) {
+    if (format_tag == WAVE_FORMAT_PCM) {
+        switch (bits_per_sample) {
+            case 8:
+                return SAMPLE_U8;
+            case 16:
+                return SAMPLE_S16;
+            case 24:
+                return SAMPLE_S24;
+            case 32:
+                return SAMPLE_S32;
+        }
+    } else if (format_tag == WAVE_FORMAT_IEEE_FLOAT) {
+        if (bits_per_sample == 32) {
+            return SAMPLE_F32;
+        }
+        if (bits_per_sample == 64) {
+            return SAMPLE_F64;
+        }
+    }
+    return SAMPLE_UNSUPPORTED;
+}
+
+// Function for retrieving the size in chars of a sample of an encoding.
+int encoding_size(int encoding) {
+    static const int sizes[] = { 0, 1, 2, 3, 4, 4, 8 };
+    return sizes[encoding];
+}
+
+// Function for retrieving a name of an encoding to show to the user.
+char* encoding_name(int encoding) {
+    static char* names[] = { "unsupported", "8-bit PCM", "16-bit PCM", "24-bit PCM", "32-bit PCM", "32-bit float",
+                             "64-bit float" };
+    return names[encoding];
+}
+
+// Function for converting the name of a sample format to convert to, such as 24 or 32f, to an encoding.
+// Returns SAMPLE_UNSUPPORTED for unknown names.
+int parse_encoding(char* name) {
+    static char* names[] = { "", "8", "16", "24", "32", "32f", "64f" };
+    for (int encoding = SAMPLE_U8; encoding <= SAMPLE_F64; ++encoding) {
+        if (!strcmp(name, names[encoding])) {
+            return encoding;
+        }
+    }
+    return SAMPLE_UNSUPPORTED;
+}
+
+// Function for determining whether an encoding holds float samples.
+int is_float_encoding(int encoding) {
+    return encoding == SAMPLE_F32 || encoding == SAMPLE_F64;
+}
+
+// Function for converting a float sample to an integer of a given range, rounding and clipping it.
+static inline int32_t quantize(float sample, float scale, int32_t minimum, int32_t maximum) {
+    float scaled = sample * scale;
+    if (scaled >= (float)maximum) {
+        return maximum;
+    }
+    if (scaled <= (float)minimum) {
+        return minimum;
+    }
+    return (int32_t)lrintf(scaled);
+}
+
+// Scalar kernels, which also convert the samples left over by the vector kernels.
+static void decode_u8(unsigned char* in, float* out, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        out[i] = (in[i] - 128) * (1.0f / 128);
+    }
+}
+
+static void decode_s16(unsigned char* in, float* out, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        int16_t sample;
+        memcpy(&sample, in + 2 * i, 2);
+        out[i] = sample * (1.0f / 32768);
+    }
+}
+
+static void decode_s24(unsigned char* in, float* out, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        unsigned char* bytes = in + 3 * i;
+        int32_t sample = (int32_t)((uint32_t)bytes[0] << 8 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 24) >> 8;
+        out[i] = sample * (1.0f / 8388608);
+    }
+}
+
+static void decode_s32(unsigned char* in, float* out, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        int32_t sample;
+        memcpy(&sample, in + 4 * i, 4);
+        out[i] = sample * (1.0f / 2147483648.0f);
+    }
+}
+
+static void decode_f32(unsigned char* in, float* out, size_t num_samples) {
+    memcpy(out, in, num_samples * sizeof(float));
+}
+
+static void decode_f64(unsigned char* in, float* out, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        double sample;
+        memcpy(&sample, in + 8 * i, 8);
+        out[i] = (float)sample;
+    }
+}
+
+static void encode_u8(float* in, unsigned char* out, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        out[i] = quantize(in[i], 128, -128, 127) + 128;
+    }
+}
+
+static void encode_s16(float* in, unsigned char* out, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        int16_t sample = quantize(in[i], 32768, -32768, 32767);
+        memcpy(out + 2 * i, &sample, 2);
+    }
+}
+
+static void encode_s24(float* in, unsigned char* out, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        int32_t sample = quantize(in[i], 8388608, -8388608, 8388607);
+        out[3 * i] = sample;
+        out[3 * i + 1] = sample >> 8;
+        out[3 * i + 2] = sample >> 16;
+    }
+}
+
+static void encode_s32(float* in, unsigned char* out, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        // Scaled samples at or above 2^31 do not fit in a float comparison with INT32_MAX, so clip in double.
+        double scaled = in[i] * 2147483648.0;
+        int32_t sample = scaled >= 2147483647.0 ? INT32_MAX : scaled <= -2147483648.0 ? INT32_MIN : (int32_t)lrint(scaled);
+        memcpy(out + 4 * i, &sample, 4);
+    }
+}
+
+static void encode_f32(float* in, unsigned char* out, size_t num_samples) {
+    memcpy(out, in, num_samples * sizeof(float));
+}
+
+static void encode_f64(float* in, unsigned char* out, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        double sample = in[i];
+        memcpy(out + 8 * i, &sample, 8);
+    }
+}
+
+// Function for scrambling the index of a dither value into a uniformly distributed 32-bit value.
+static inline uint32_t hash_index(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static void mix(float* source, float* destination, float weight, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        destination[i] += weight * source[i];
+    }
+}
+
+// Triangular dither is the difference of two uniform values in [0, 1), each made from the top 24 bits of a hash.
+static void dither(float* samples, size_t num_samples, uint32_t key, float amplitude) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        float first = (float)(hash_index(key + 2 * (uint32_t)i) >> 8) * (1.0f / 16777216);
+        float second = (float)(hash_index(key + 2 * (uint32_t)i + 1) >> 8) * (1.0f / 16777216);
+        samples[i] += (first - second) * amplitude;
+    }
+}
+
+// Samples are loud and clipped by their magnitude, so the most negative integer sample counts as clipped too.
+static void measure(float* samples, size_t num_samples, float clip_level, float threshold, sample_measure* stats,
+                    unsigned char* loud) {
+    float peak = stats->peak;
+    double sum = 0, sum_squares = 0;
+    size_t clips = 0;
+    for (size_t i = 0; i < num_samples; ++i) {
+        float magnitude = fabsf(samples[i]);
+        peak = magnitude > peak ? magnitude : peak;
+        sum += samples[i];
+        sum_squares += (double)samples[i] * samples[i];
+        clips += magnitude >= clip_level;
+        loud[i] |= magnitude > threshold;
+    }
+    stats->peak = peak;
+    stats->sum += sum;
+    stats->sum_squares += sum_squares;
+    stats->clips += clips;
+}
+
+static decode_kernel decoders[] = { NULL, decode_u8, decode_s16, decode_s24, decode_s32, decode_f32, decode_f64 };
+static encode_kernel encoders[] = { NULL, encode_u8, encode_s16, encode_s24, encode_s32, encode_f32, encode_f64 };
+static void (*mixer)(float* source, float* destination, float weight, size_t num_samples) = mix;
+static void (*ditherer)(float* samples, size_t num_samples, uint32_t key, float amplitude) = dither;
+static void (*measurer)(float* samples, size_t num_samples, float clip_level, float threshold, sample_measure* measure,
+                        unsigned char* loud) = measure;
+
+#ifdef SAMPLE_SIMD
+
+// Vector kernels converting 8 samples at a time with AVX2. Integer samples are widened to 32 bits and
+// converted with one multiply, and floats are rounded to integers in the default round-to-nearest mode,
+// like lrintf, so the kernels give the same samples as the scalar kernels.
+__attribute__((target("avx2"))) static void decode_u8_avx2(unsigned char* in, float* out, size_t num_samples) {
+    __m256i offset = _mm256_set1_epi32(128);
+    __m256 scale = _mm256_set1_ps(1.0f / 128);
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256i samples = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)(in + i))), offset);
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+    }
+    decode_u8(in + i, out + i, num_samples - i);
+}
+
+__attribute__((target("avx2"))) static void decode_s16_avx2(unsigned char* in, float* out, size_t num_samples) {
+    __m256 scale = _mm256_set1_ps(1.0f / 32768);
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i*)(in + 2 * i)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+    }
+    decode_s16(in + 2 * i, out + i, num_samples - i);
+}
+
+// 24-bit samples are moved into the top three chars of 32-bit lanes, which scales them by 2^8. Each 16-char
+// load holds four samples and reads four chars past them, so the last samples are left to the scalar kernel.
+__attribute__((target("avx2"))) static void decode_s24_avx2(unsigned char* in, float* out, size_t num_samples) {
+    __m128i mask = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 10 <= num_samples; i += 8) {
+        __m128i low = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(in + 3 * i)), mask);
+        __m128i high = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(in + 3 * i + 12)), mask);
+        __m256i samples = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+    }
+    decode_s24(in + 3 * i, out + i, num_samples - i);
+}
+
+__attribute__((target("avx2"))) static void decode_s32_avx2(unsigned char* in, float* out, size_t num_samples) {
+    __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256i samples = _mm256_loadu_si256((__m256i*)(in + 4 * i));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+    }
+    decode_s32(in + 4 * i, out + i, num_samples - i);
+}
+
+__attribute__((target("avx2"))) static void decode_f64_avx2(unsigned char* in, float* out, size_t num_samples) {
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        _mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_loadu_pd((double*)(in + 8 * i))));
+        _mm_storeu_ps(out + i + 4, _mm256_cvtpd_ps(_mm256_loadu_pd((double*)(in + 8 * i + 32))));
+    }
+    decode_f64(in + 8 * i, out + i, num_samples - i);
+}
+
+// Function for scaling 8 float samples and rounding them to integers clipped to a range.
+__attribute__((target("avx2"))) static inline __m256i quantize_avx2(float* in, __m256 scale, __m256 minimum,
+                                                                    __m256 maximum) {
+    __m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(in), scale);
+    return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(scaled, minimum), maximum));
+}
+
+__attribute__((target("avx2"))) static void encode_u8_avx2(float* in, unsigned char* out, size_t num_samples) {
+    __m256 scale = _mm256_set1_ps(128), minimum = _mm256_set1_ps(-128), maximum = _mm256_set1_ps(127);
+    __m256i offset = _mm256_set1_epi32(128);
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256i samples = _mm256_add_epi32(quantize_avx2(in + i, scale, minimum, maximum), offset);
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(samples), _mm256_extracti128_si256(samples, 1));
+        _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(words, words));
+    }
+    encode_u8(in + i, out + i, num_samples - i);
+}
+
+__attribute__((target("avx2"))) static void encode_s16_avx2(float* in, unsigned char* out, size_t num_samples) {
+    __m256 scale = _mm256_set1_ps(32768), minimum = _mm256_set1_ps(-32768), maximum = _mm256_set1_ps(32767);
+    size_t i = 0;
+    for (; i + 16 <= num_samples; i += 16) {
+        __m256i low = quantize_avx2(in + i, scale, minimum, maximum);
+        __m256i high = quantize_avx2(in + i + 8, scale, minimum, maximum);
+        __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high), 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + 2 * i), words);
+    }
+    encode_s16(in + i, out + 2 * i, num_samples - i);
+}
+
+// Each 16-char store holds four 24-bit samples followed by four chars that the next store overwrites, so the
+// last samples are left to the scalar kernel.
+__attribute__((target("avx2"))) static void encode_s24_avx2(float* in, unsigned char* out, size_t num_samples) {
+    __m256 scale = _mm256_set1_ps(8388608), minimum = _mm256_set1_ps(-8388608), maximum = _mm256_set1_ps(8388607);
+    __m256i mask = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 10 <= num_samples; i += 8) {
+        __m256i packed = _mm256_shuffle_epi8(quantize_avx2(in + i, scale, minimum, maximum), mask);
+        _mm_storeu_si128((__m128i*)(out + 3 * i), _mm256_castsi256_si128(packed));
+        _mm_storeu_si128((__m128i*)(out + 3 * i + 12), _mm256_extracti128_si256(packed, 1));
+    }
+    encode_s24(in + i, out + 3 * i, num_samples - i);
+}
+
+// Scaled samples at or above 2^31 overflow the conversion, which gives INT32_MIN, so they are replaced by
+// INT32_MAX. Samples below -2^31 convert to INT32_MIN as they should.
+__attribute__((target("avx2"))) static void encode_s32_avx2(float* in, unsigned char* out, size_t num_samples) {
+    __m256 scale = _mm256_set1_ps(2147483648.0f);
+    __m256i maximum = _mm256_set1_epi32(INT32_MAX);
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+        __m256i overflow = _mm256_castps_si256(_mm256_cmp_ps(scaled, scale, _CMP_GE_OQ));
+        __m256i samples = _mm256_blendv_epi8(_mm256_cvtps_epi32(scaled), maximum, overflow);
+        _mm256_storeu_si256((__m256i*)(out + 4 * i), samples);
+    }
+    encode_s32(in + i, out + 4 * i, num_samples - i);
+}
+
+__attribute__((target("avx2"))) static void encode_f64_avx2(float* in, unsigned char* out, size_t num_samples) {
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        _mm256_storeu_pd((double*)(out + 8 * i), _mm256_cvtps_pd(_mm_loadu_ps(in + i)));
+        _mm256_storeu_pd((double*)(out + 8 * i + 32), _mm256_cvtps_pd(_mm_loadu_ps(in + i + 4)));
+    }
+    encode_f64(in + i, out + 8 * i, num_samples - i);
+}
+
+__attribute__((target("avx2"))) static void mix_avx2(float* source, float* destination, float weight, size_t num_samples) {
+    __m256 weights = _mm256_set1_ps(weight);
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256 product = _mm256_mul_ps(weights, _mm256_loadu_ps(source + i));
+        _mm256_storeu_ps(destination + i, _mm256_add_ps(_mm256_loadu_ps(destination + i), product));
+    }
+    mix(source + i, destination + i, weight, num_samples - i);
+}
+
+// Function for scrambling 8 indices of dither values at a time.
+__attribute__((target("avx2"))) static inline __m256i hash_index_avx2(__m256i x) {
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7FEB352D));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x846CA68Bu));
+    return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+__attribute__((target("avx2"))) static void dither_avx2(float* samples, size_t num_samples, uint32_t key, float amplitude) {
+    __m256 scale = _mm256_set1_ps(1.0f / 16777216), amplitudes = _mm256_set1_ps(amplitude);
+    __m256i steps = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14), one = _mm256_set1_epi32(1);
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256i indices = _mm256_add_epi32(_mm256_set1_epi32((int)(key + 2 * (uint32_t)i)), steps);
+        __m256 first = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(hash_index_avx2(indices), 8)), scale);
+        __m256 second = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(hash_index_avx2(_mm256_add_epi32(indices, one)), 8)),
+                                      scale);
+        __m256 noise = _mm256_mul_ps(_mm256_sub_ps(first, second), amplitudes);
+        _mm256_storeu_ps(samples + i, _mm256_add_ps(_mm256_loadu_ps(samples + i), noise));
+    }
+    dither(samples + i, num_samples - i, key + 2 * (uint32_t)i, amplitude);
+}
+
+// Sums are taken in four double lanes of each half of 8 samples, so they may differ from the scalar kernel's in
+// their last bits. Loud samples are marked by packing the comparison masks down to one char per sample.
+__attribute__((target("avx2"))) static void measure_avx2(float* samples, size_t num_samples, float clip_level,
+                                                         float threshold, sample_measure* stats, unsigned char* loud) {
+    __m256 sign = _mm256_set1_ps(-0.0f), clip_levels = _mm256_set1_ps(clip_level), thresholds = _mm256_set1_ps(threshold);
+    __m256 peaks = _mm256_set1_ps(stats->peak);
+    __m256d sums = _mm256_setzero_pd(), squares = _mm256_setzero_pd();
+    __m128i ones = _mm_set1_epi8(1);
+    size_t clips = 0;
+    size_t i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256 values = _mm256_loadu_ps(samples + i);
+        __m256 magnitudes = _mm256_andnot_ps(sign, values);
+        peaks = _mm256_max_ps(peaks, magnitudes);
+        __m256d low = _mm256_cvtps_pd(_mm256_castps256_ps128(values));
+        __m256d high = _mm256_cvtps_pd(_mm256_extractf128_ps(values, 1));
+        sums = _mm256_add_pd(sums, _mm256_add_pd(low, high));
+        squares = _mm256_add_pd(squares, _mm256_add_pd(_mm256_mul_pd(low, low), _mm256_mul_pd(high, high)));
+        clips += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(magnitudes, clip_levels, _CMP_GE_OQ)));
+        __m256i above = _mm256_castps_si256(_mm256_cmp_ps(magnitudes, thresholds, _CMP_GT_OQ));
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(above), _mm256_extracti128_si256(above, 1));
+        __m128i marks = _mm_and_si128(_mm_packs_epi16(words, words), ones);
+        _mm_storel_epi64((__m128i*)(loud + i), _mm_or_si128(_mm_loadl_epi64((__m128i*)(loud + i)), marks));
+    }
+
+    // Gather the lanes, then measure the samples left over with the scalar kernel.
+    float peak_lanes[8];
+    double sum_lanes[4], square_lanes[4];
+    _mm256_storeu_ps(peak_lanes, peaks);
+    _mm256_storeu_pd(sum_lanes, sums);
+    _mm256_storeu_pd(square_lanes, squares);
+    for (int lane = 0; lane < 8; ++lane) {
+        stats->peak = peak_lanes[lane] > stats->peak ? peak_lanes[lane] : stats->peak;
+    }
+    stats->sum += sum_lanes[0] + sum_lanes[1] + sum_lanes[2] + sum_lanes[3];
+    stats->sum_squares += square_lanes[0] + square_lanes[1] + square_lanes[2] + square_lanes[3];
+    stats->clips += clips;
+    measure(samples + i, num_samples - i, clip_level, threshold, stats, loud + i);
+}
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+// Function for replacing the scalar kernels with the vector kernels when the processor supports them.
+static void select_kernels() {
+    if (__builtin_cpu_supports("avx2")) {
+        decoders[SAMPLE_U8] = decode_u8_avx2;
+        decoders[SAMPLE_S16] = decode_s16_avx2;
+        decoders[SAMPLE_S24] = decode_s24_avx2;
+        decoders[SAMPLE_S32] = decode_s32_avx2;
+        decoders[SAMPLE_F64] = decode_f64_avx2;
+        encoders[SAMPLE_U8] = encode_u8_avx2;
+        encoders[SAMPLE_S16] = encode_s16_avx2;
+        encoders[SAMPLE_S24] = encode_s24_avx2;
+        encoders[SAMPLE_S32] = encode_s32_avx2;
+        encoders[SAMPLE_F64] = encode_f64_avx2;
+        mixer = mix_avx2;
+        ditherer = dither_avx2;
+        measurer = measure_avx2;
+    }
+}
+
+#endif
+
+// Function for converting interleaved frames to planar float samples, in [-1, 1) for integer samples.
+void decode_frames(char* source, float* destination, size_t num_frames, int num_channels, int encoding,
+                   size_t stride) {
+#ifdef SAMPLE_SIMD
+    pthread_once(&kernels_once, select_kernels);
+#endif
+    decode_kernel kernel = decoders[encoding];
+    unsigned char* in = (unsigned char*)source;
+    int sample_size = encoding_size(encoding);
+    if (num_channels == 1) {
+        kernel(in, destination, num_frames);
+        return;
+    }
+
+    // Frames with more channels than a block holds are converted one sample at a time.
+    float block[BLOCK_SAMPLES];
+    size_t block_frames = BLOCK_SAMPLES / num_channels;
+    if (block_frames == 0) {
+        for (size_t i = 0; i < num_frames; ++i) {
+            for (int c = 0; c < num_channels; ++c) {
+                kernel(in + ((size_t)i * num_channels + c) * sample_size, destination + c * stride + i, 1);
+            }
+        }
+        return;
+    }
+    for (size_t first = 0; first < num_frames; first += block_frames) {
+        size_t count = num_frames - first < block_frames ? num_frames - first : block_frames;
+        kernel(in + first * num_channels * sample_size, block, count * num_channels);
+        for (int c = 0; c < num_channels; ++c) {
+            float* out = destination + c * stride + first;
+            for (size_t i = 0; i < count; ++i) {
+                out[i] = block[i * num_channels + c];
+            }
+        }
+    }
+}
+
+// Function for converting planar float samples to interleaved frames, rounding and clipping integer samples.
+void encode_frames(float* source, char* destination, size_t num_frames, int num_channels, int encoding,
+                   size_t stride) {
+#ifdef SAMPLE_SIMD
+    pthread_once(&kernels_once, select_kernels);
+#endif
+    encode_kernel kernel = encoders[encoding];
+    unsigned char* out = (unsigned char*)destination;
+    int sample_size = encoding_size(encoding);
+    if (num_channels == 1) {
+        kernel(source, out, num_frames);
+        return;
+    }
+
+    // Frames with more channels than a block holds are converted one sample at a time.
+    float block[BLOCK_SAMPLES];
+    size_t block_frames = BLOCK_SAMPLES / num_channels;
+    if (block_frames == 0) {
+        for (size_t i = 0; i < num_frames; ++i) {
+            for (int c = 0; c < num_channels; ++c) {
+                kernel(source + c * stride + i, out + ((size_t)i * num_channels + c) * sample_size, 1);
+            }
+        }
+        return;
+    }
+    for (size_t first = 0; first < num_frames; first += block_frames) {
+        size_t count = num_frames - first < block_frames ? num_frames - first : block_frames;
+        for (int c = 0; c < num_channels; ++c) {
+            float* in = source + c * stride + first;
+            for (size_t i = 0; i < count; ++i) {
+                block[i * num_channels + c] = in[i];
+            }
+        }
+        kernel(block, out + first * num_channels * sample_size, count * num_channels);
+    }
+}
+
+// Function for adding the samples of a channel, multiplied by a weight, to the samples of another channel.
+void mix_samples(float* source, float* destination, float weight, size_t num_samples) {
+#ifdef SAMPLE_SIMD
+    pthread_once(&kernels_once, select_kernels);
+#endif
+    mixer(source, destination, weight, num_samples);
+}
+
+// Function for adding triangular dither of up to amplitude to samples. The dither of sample i only depends
+// on key + 2 * i, so a channel gets the same dither however its samples are split into blocks.
+void dither_samples(float* samples, size_t num_samples, uint32_t key, float amplitude) {
+#ifdef SAMPLE_SIMD
+    pthread_once(&kernels_once, select_kernels);
+#endif
+    ditherer(samples, num_samples, key, amplitude);
+}
+
+// Function for adding float samples to the statistics of their channel, counting those whose magnitude reaches
+// clip_level, and marking in loud the samples whose magnitude is above threshold. Marks are only ever set, so the
+// channels of a block of frames can share one array of marks.
+void measure_samples(float* samples, size_t num_samples, float clip_level, float threshold, sample_measure* measure,
+                     unsigned char* loud) {
+#ifdef SAMPLE_SIMD
+    pthread_once(&kernels_once, select_kernels);
+#endif
+    measurer(samples, num_samples, clip_level, threshold, measure, loud);
+}
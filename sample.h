@@ -0,0 +1,62 @@
+#ifndef H_SAMPLE
+#define H_SAMPLE
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Format tags of a fmt chunk. A WAVE_FORMAT_EXTENSIBLE fmt chunk holds the format tag of its samples in the first
+// two chars of its sub-format GUID.
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+// Encodings of the samples of a wav file that can be converted to and from float. Integer samples are
+// identified by the width of their container, so 20-bit or 24-bit samples in 32-bit containers are SAMPLE_S32.
+enum sample_encoding { SAMPLE_UNSUPPORTED, SAMPLE_U8, SAMPLE_S16, SAMPLE_S24, SAMPLE_S32, SAMPLE_F32, SAMPLE_F64 };
+
+// Statistics of the samples of a channel, added to as its samples are measured a block at a time.
+typedef struct sample_measure {
+    float peak; // largest magnitude
+    double sum;
+    double sum_squares;
+    size_t clips; // samples whose magnitude reaches the clip level
+} sample_measure;
+
+// Function for determining the encoding of samples from their format tag and the width of their container.
+int sample_encoding(int format_tag, int bits_per_sample);
+
+// Function for retrieving the size in chars of a sample of an encoding.
+int encoding_size(int encoding);
+
+// Function for retrieving a name of an encoding to show to the user.
+char* encoding_name(int encoding);
+
+// Function for converting the name of a sample format to convert to, such as 24 or 32f, to an encoding.
+int parse_encoding(char* name);
+
+// Function for determining whether an encoding holds float samples.
+int is_float_encoding(int encoding);
+
+// Function for converting interleaved frames to planar float samples, in [-1, 1) for integer samples. The
+// samples of channel c are stored at destination + c * stride.
+void decode_frames(char* source, float* destination, size_t num_frames, int num_channels, int encoding,
+                   size_t stride);
+
+// Function for converting planar float samples to interleaved frames, rounding and clipping integer samples.
+// The samples of channel c are read from source + c * stride.
+void encode_frames(float* source, char* destination, size_t num_frames, int num_channels, int encoding,
+                   size_t stride);
+
+// Function for adding the samples of a channel, multiplied by a weight, to the samples of another channel.
+void mix_samples(float* source, float* destination, float weight, size_t num_samples);
+
+// Function for adding triangular dither of up to amplitude to samples. The dither of sample i only depends
+// on key + 2 * i, so a channel gets the same dither however its samples are split into blocks.
+void dither_samples(float* samples, size_t num_samples, uint32_t key, float amplitude);
+
+// Function for adding float samples to the statistics of their channel, counting those whose magnitude reaches
+// clip_level, and marking in loud the samples whose magnitude is above threshold.
+void measure_samples(float* samples, size_t num_samples, float clip_level, float threshold, sample_measure* measure,
+                     unsigned char* loud);
+
+#endif
@@ -0,0 +1,476 @@
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include "inspect.h"
+#include "parallel.h"
+#include "server.h"
+
+// The most worker threads run_server starts.
+#define MAX_SERVER_WORKERS 64
+
+// The number of milliseconds the server waits for a connection, or for room in the queue, before checking whether
+// it was interrupted.
+#define SERVER_POLL_MILLISECONDS 200
+
+// A connection accepted by the server, waiting in the queue for a worker.
+typedef struct server_connection {
+    int fd;
+    double accepted; // time the connection was accepted
+} server_connection;
+
+struct server_run;
+
+// A worker of a server, which serves the requests of one connection at a time with the buffers it reuses for
+// every request.
+typedef struct server_worker {
+    struct server_run* run;
+    pthread_t thread;
+    int started;
+
+    // buffers reused for every file the worker processes in memory or streams
+    wave_context* context;
+    char* block;
+
+    // chars read from the current connection, holding the current request line and any chars after it
+    char* request;
+    size_t request_length;
+    size_t line_length;
+
+    // words of the current request
+    char** words;
+    int word_capacity;
+
+    // results
+    int num_requests;
+    int num_failed;
+} server_worker;
+
+// A struct holding the state shared by the thread accepting connections and the workers of a server. Accepted
+// connections wait in a ring of queue_size connections, guarded by lock.
+typedef struct server_run {
+    size_t block_size;
+    server_connection* queue;
+    int queue_size;
+    int first;
+    int count;
+    int stopping; // no more connections are accepted, so workers stop once the queue is empty
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} server_run;
+
+// Set by the signal handler when the server is interrupted.
+static volatile sig_atomic_t interrupted = 0;
+
+// A function for recording that the server was interrupted.
+static void interrupt_server(int signal_number) {
+    (void)signal_number;
+    interrupted = 1;
+}
+
+// A function for waiting on a condition of a server run for at most SERVER_POLL_MILLISECONDS, so the waiting
+// thread can check whether the server was interrupted.
+static void wait_briefly(pthread_cond_t* condition, pthread_mutex_t* lock) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += SERVER_POLL_MILLISECONDS * 1000000L;
+    until.tv_sec += until.tv_nsec / 1000000000L;
+    until.tv_nsec %= 1000000000L;
+    pthread_cond_timedwait(condition, lock, &until);
+}
+
+// A function for sending chars to a connection, ignoring a client that has gone away.
+// Returns -1 if the chars could not all be sent.
+static int send_chars(int fd, char* chars, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, chars, length, MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR) {
+            continue;
+        } else if (sent <= 0) {
+            return -1;
+        }
+        chars += sent;
+        length -= sent;
+    }
+    return 0;
+}
+
+// A function for reading the next request line of a connection into the worker's request buffer, after dropping
+// the previous one. A last request without a newline is read when the client stops sending.
+// Returns the line without its newline, or NULL when the connection has no more requests or there is an error.
+static char* read_request(server_worker* worker, int fd) {
+    memmove(worker->request, worker->request + worker->line_length, worker->request_length - worker->line_length);
+    worker->request_length -= worker->line_length;
+    worker->line_length = 0;
+    for (;;) {
+        char* end = memchr(worker->request, '\n', worker->request_length);
+        if (end != NULL) {
+            *end = '\0';
+            worker->line_length = end - worker->request + 1;
+            return worker->request;
+        }
+        if (worker->request_length == SERVER_MAX_REQUEST_SIZE) {
+            char* error = "{\"ok\": false, \"error\": \"The request is too long.\"}\n";
+            send_chars(fd, error, strlen(error));
+            return NULL;
+        }
+        ssize_t chars_read = recv(fd, worker->request + worker->request_length,
+                                  SERVER_MAX_REQUEST_SIZE - worker->request_length, 0);
+        if (chars_read == -1 && errno == EINTR) {
+            continue;
+        } else if (chars_read == 0 && worker->request_length > 0) {
+            worker->request[worker->request_length] = '\0';
+            worker->line_length = worker->request_length;
+            return worker->request;
+        } else if (chars_read <= 0) {
+            return NULL;
+        }
+        worker->request_length += chars_read;
+    }
+}
+
+// A function for splitting a request line into words separated by spaces, in place.
+// Returns the number of words, or -1 if there is an error.
+static int split_request(server_worker* worker, char* line) {
+    int num_words = 0;
+    while (*line != '\0') {
+        if (isspace((unsigned char)*line)) {
+            *line++ = '\0';
+            continue;
+        }
+        if (num_words == worker->word_capacity) {
+            int capacity = worker->word_capacity > 0 ? worker->word_capacity * 2 : 16;
+            char** words = realloc(worker->words, capacity * sizeof(char*));
+            if (words == NULL) {
+                print_message("Error allocating memory for request.\n\n");
+                return -1;
+            }
+            worker->words = words;
+            worker->word_capacity = capacity;
+        }
+        worker->words[num_words++] = line;
+        while (*line != '\0' && !isspace((unsigned char)*line)) {
+            ++line;
+        }
+    }
+    return num_words;
+}
+
+// A function for performing a request line and answering it with a line of JSON holding the result, the first
+// error, the size of the input file and the seconds the request waited for a worker and took to process.
+// Returns -1 if the answer could not be sent.
+static int serve_request(server_worker* worker, int fd, char* line, double queued) {
+    server_run* run = worker->run;
+    char error[MESSAGE_SIZE];
+    error[0] = '\0';
+
+    // Perform the request with the worker's buffers, keeping its messages.
+    set_quiet_messages(1);
+    int num_words = split_request(worker, line);
+    if (num_words == 0) {
+        return 0;
+    }
+    double start = current_seconds();
+    struct stat st;
+    off_t input_size = num_words >= 2 && !stat(worker->words[0], &st) ? st.st_size : 0;
+    int result = -1;
+    char* run_option = num_words >= 2 ? find_run_option(num_words - 2, worker->words + 2) : NULL;
+    if (num_words == -1) {
+        snprintf(error, MESSAGE_SIZE, "%s", get_last_message());
+    } else if (num_words < 2) {
+        snprintf(error, MESSAGE_SIZE, "A request needs an input and an output file name.");
+    } else if (run_option != NULL) {
+        snprintf(error, MESSAGE_SIZE, "%.*s applies to the whole server and cannot be given in a request.",
+                 is_profile_option(run_option) ? 9 : 2, run_option);
+    } else {
+        result = process_file(worker->words[0], worker->words[1], num_words - 2, worker->words + 2, run->block_size,
+                              worker->block, worker->context, error);
+    }
+    double seconds = current_seconds() - start;
+    ++worker->num_requests;
+    worker->num_failed += result == -1;
+
+    // Answer with a line of JSON, without the blank lines that end most messages.
+    char* answer = NULL;
+    size_t answer_length = 0;
+    FILE* stream = open_memstream(&answer, &answer_length);
+    if (stream == NULL) {
+        return -1;
+    }
+    fprintf(stream, "{");
+    if (num_words >= 2) {
+        fprintf(stream, "\"input\": ");
+        write_json_chars(stream, worker->words[0], strlen(worker->words[0]));
+        fprintf(stream, ", \"output\": ");
+        write_json_chars(stream, worker->words[1], strlen(worker->words[1]));
+        fprintf(stream, ", ");
+    }
+    fprintf(stream, "\"ok\": %s", result != -1 ? "true" : "false");
+    if (result == -1) {
+        size_t length = strlen(error);
+        while (length > 0 && isspace((unsigned char)error[length - 1])) {
+            --length;
+        }
+        fprintf(stream, ", \"error\": ");
+        write_json_chars(stream, length > 0 ? error : "unknown error", length > 0 ? length : strlen("unknown error"));
+    }
+    fprintf(stream, ", \"input_size\": %lld, \"queued_seconds\": %.6f, \"seconds\": %.6f}\n", (long long)input_size,
+            queued, seconds);
+    int sent = fclose(stream) ? -1 : send_chars(fd, answer, answer_length);
+    free(answer);
+    return sent;
+}
+
+// A function for serving the requests of a connection in order until the client stops sending, goes away or is
+// idle for SERVER_IDLE_SECONDS. The first request reports the time the connection waited in the queue.
+static void serve_connection(server_worker* worker, server_connection* connection) {
+    struct timeval idle = { SERVER_IDLE_SECONDS, 0 };
+    setsockopt(connection->fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+    double queued = current_seconds() - connection->accepted;
+    worker->request_length = 0;
+    worker->line_length = 0;
+    for (char* line = read_request(worker, connection->fd); line != NULL; line = read_request(worker, connection->fd)) {
+        if (serve_request(worker, connection->fd, line, queued) == -1) {
+            break;
+        }
+        queued = 0;
+    }
+    close(connection->fd);
+}
+
+// A function for serving the connections of the queue on a worker thread until the server stops accepting
+// connections and the queue is empty.
+static void* run_server_worker(void* worker_pointer) {
+    server_worker* worker = worker_pointer;
+    server_run* run = worker->run;
+    for (;;) {
+        pthread_mutex_lock(&run->lock);
+        while (run->count == 0 && !run->stopping) {
+            pthread_cond_wait(&run->not_empty, &run->lock);
+        }
+        if (run->count == 0) {
+            pthread_mutex_unlock(&run->lock);
+            break;
+        }
+        server_connection connection = run->queue[run->first];
+        run->first = (run->first + 1) % run->queue_size;
+        --run->count;
+        pthread_cond_signal(&run->not_full);
+        pthread_mutex_unlock(&run->lock);
+
+        serve_connection(worker, &connection);
+    }
+    set_quiet_messages(0);
+    return NULL;
+}
+
+// A function for accepting connections into the queue until the server is interrupted. While the queue is full,
+// no connections are accepted, so clients wait in the socket's backlog.
+static void accept_connections(server_run* run, int listen_fd) {
+    struct pollfd listening = { listen_fd, POLLIN, 0 };
+    while (!interrupted) {
+        // Wait for room in the queue.
+        pthread_mutex_lock(&run->lock);
+        while (run->count == run->queue_size && !interrupted) {
+            wait_briefly(&run->not_full, &run->lock);
+        }
+        pthread_mutex_unlock(&run->lock);
+
+        // Wait for a connection and add it to the queue.
+        if (interrupted || poll(&listening, 1, SERVER_POLL_MILLISECONDS) <= 0) {
+            continue;
+        }
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd == -1) {
+            continue;
+        }
+        pthread_mutex_lock(&run->lock);
+        run->queue[(run->first + run->count++) % run->queue_size] = (server_connection){ fd, current_seconds() };
+        pthread_cond_signal(&run->not_empty);
+        pthread_mutex_unlock(&run->lock);
+    }
+}
+
+// A function for creating a Unix domain socket listening on a path, with a backlog of backlog connections. A
+// socket file left by a server that is no longer running is replaced.
+// Returns the socket or -1 if there is an error.
+static int listen_on(char* socket_path, int backlog) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        print_message("The socket path %s is too long.\n\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        print_message("Error creating a socket.\n\n");
+        return -1;
+    }
+
+    // Replace a socket file nothing is listening on, return -1 if another server is.
+    struct stat st;
+    if (!stat(socket_path, &st) && S_ISSOCK(st.st_mode)) {
+        if (!connect(fd, (struct sockaddr*)&address, sizeof(address))) {
+            print_message("A server is already listening on %s.\n\n", socket_path);
+            close(fd);
+            return -1;
+        }
+        unlink(socket_path);
+    }
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) || listen(fd, backlog)) {
+        print_message("Unable to listen on %s.\n\n", socket_path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// A function for serving requests on a Unix domain socket until the server is interrupted by SIGINT or SIGTERM.
+// Each request is a line of "input output [operations]", as in a batch manifest, and a connection can send several,
+// which are performed in order. Each is answered with a line of JSON holding the result, the first error and the
+// seconds the request waited for a worker and took to process. Connections wait for a worker in a queue of
+// queue_size connections, and workers reuse their context or block buffer for every file, streaming files in
+// blocks of block_size chars or reading them into memory when block_size is 0. The queued connections are served
+// before the server stops.
+// Returns the number of requests that failed, or -1 on error.
+int run_server(char* socket_path, int num_workers, int queue_size, size_t block_size) {
+    num_workers = num_workers < MAX_SERVER_WORKERS ? num_workers : MAX_SERVER_WORKERS;
+    num_workers = num_workers > 0 ? num_workers : 1;
+    queue_size = queue_size > 0 ? queue_size : SERVER_DEFAULT_QUEUE_SIZE;
+
+    // Allocate the queue and the workers' buffers, return -1 on error.
+    server_run run = { block_size, calloc(queue_size, sizeof(server_connection)), queue_size, 0, 0, 0,
+                       PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+    server_worker* workers = calloc(num_workers, sizeof(server_worker));
+    int result = run.queue != NULL && workers != NULL ? 0 : -1;
+    for (int i = 0; i < num_workers && result != -1; ++i) {
+        workers[i].run = &run;
+        workers[i].request = malloc(SERVER_MAX_REQUEST_SIZE + 1);
+        workers[i].context = block_size == 0 ? new_wave_context() : NULL;
+        workers[i].block = block_size > 0 ? malloc(block_size * sizeof(char)) : NULL;
+        if (workers[i].request == NULL || (block_size == 0 && workers[i].context == NULL) ||
+                (block_size > 0 && workers[i].block == NULL)) {
+            result = -1;
+        }
+    }
+    if (result == -1) {
+        print_message("Error allocating memory for workers.\n\n");
+    }
+    int listen_fd = result != -1 ? listen_on(socket_path, queue_size) : -1;
+
+    // Workers already process files in parallel, so the kernels run on a single thread each. The workers start
+    // with SIGINT and SIGTERM blocked, so the signals stop the thread accepting connections.
+    int num_threads = get_num_threads();
+    double start = current_seconds();
+    if (listen_fd != -1) {
+        if (num_workers > 1) {
+            set_num_threads(1);
+        }
+        sigset_t signals, previous;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, &previous);
+        for (int i = 0; i < num_workers; ++i) {
+            workers[i].started = !pthread_create(&workers[i].thread, NULL, run_server_worker, workers + i);
+        }
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+        struct sigaction action = { .sa_handler = interrupt_server };
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+
+        printf("Listening on %s with %i workers and a queue of %i connections.\n\n", socket_path, num_workers, queue_size);
+        fflush(stdout);
+        accept_connections(&run, listen_fd);
+        close(listen_fd);
+        unlink(socket_path);
+
+        // Let the workers serve the queued connections and stop.
+        pthread_mutex_lock(&run.lock);
+        run.stopping = 1;
+        pthread_cond_broadcast(&run.not_empty);
+        pthread_mutex_unlock(&run.lock);
+        for (int i = 0; i < num_workers; ++i) {
+            if (workers[i].started) {
+                pthread_join(workers[i].thread, NULL);
+            }
+        }
+        set_num_threads(num_threads);
+    }
+    double seconds = current_seconds() - start;
+
+    // Display the server summary and free the workers.
+    int num_requests = 0, num_failed = 0;
+    for (int i = 0; workers != NULL && i < num_workers; ++i) {
+        num_requests += workers[i].num_requests;
+        num_failed += workers[i].num_failed;
+        if (workers[i].context != NULL) {
+            free_wave_context(workers[i].context);
+        }
+        free(workers[i].block);
+        free(workers[i].request);
+        free(workers[i].words);
+    }
+    free(workers);
+    free(run.queue);
+    pthread_mutex_destroy(&run.lock);
+    pthread_cond_destroy(&run.not_empty);
+    pthread_cond_destroy(&run.not_full);
+    if (listen_fd == -1) {
+        return -1;
+    }
+
+    printf("\nServer stats:\n");
+    printf("Requests:           %i (%i failed)\n", num_requests, num_failed);
+    printf("Workers:            %i\n", num_workers);
+    printf("Time:               %.6f s\n", seconds);
+    printf("Rate:               %.1f requests/s\n\n", seconds > 0 ? num_requests / seconds : 0);
+    return num_failed;
+}
+
+// A function for running server mode from the command line:
+//   wave --serve socket_path [-j workers] [--queue=connections] [-s block_size_in_kilobytes] [-i stdio|mmap|async]
+// The run options apply to every request. Returns the exit status of the process.
+int server_main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("Must provide a socket path\n");
+        return 1;
+    }
+
+    // Take the number of workers and the queue size out of the arguments, leaving the run options.
+    int num_workers = get_num_threads();
+    int queue_size = SERVER_DEFAULT_QUEUE_SIZE;
+    int num_args = 0;
+    char** args = malloc((argc - 3 + 1) * sizeof(char*));
+    if (args == NULL) {
+        printf("Error allocating memory for arguments.\n\n");
+        return 1;
+    }
+    for (int i = 3; i < argc; ++i) {
+        if (!strcmp(*(argv + i), "-j") && i + 1 < argc) {
+            num_workers = atoi(*(argv + ++i));
+            if (num_workers <= 0) {
+                printf("Invalid number of workers. Using %i.\n\n", get_num_threads());
+                num_workers = get_num_threads();
+            }
+        } else if (!strncmp(*(argv + i), "--queue=", 8)) {
+            queue_size = atoi(*(argv + i) + 8);
+            if (queue_size <= 0) {
+                printf("Invalid queue size. Using %i connections.\n\n", SERVER_DEFAULT_QUEUE_SIZE);
+                queue_size = SERVER_DEFAULT_QUEUE_SIZE;
+            }
+        } else {
+            args[num_args++] = *(argv + i);
+        }
+    }
+
+    // Files are read into memory unless a block size is given, as small files are processed fastest in memory.
+    size_t block_size = parse_run_options(num_args, args);
+    free(args);
+    return run_server(*(argv + 2), num_workers, queue_size, block_size) != 0;
+}
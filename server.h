@@ -0,0 +1,26 @@
+#ifndef H_SERVER
+#define H_SERVER
+
+#include "process.h"
+
+// The number of accepted connections that wait for a worker by default. Once the queue is full, the server stops
+// accepting, so further clients wait in the socket's backlog, which is as long as the queue.
+#define SERVER_DEFAULT_QUEUE_SIZE 64
+
+// The longest request line a connection can send.
+#define SERVER_MAX_REQUEST_SIZE 65536
+
+// The number of seconds a worker waits for the next request of an idle connection before closing it.
+#define SERVER_IDLE_SECONDS 60
+
+// A function for serving requests on a Unix domain socket until the server is interrupted. Each request is a line
+// of "input output [operations]", as in a batch manifest, which is answered with a line of JSON holding the result
+// and the request's timing. Requests run on a pool of worker threads that reuse their buffers, streaming each file
+// in blocks of block_size chars, or reading it into memory when block_size is 0. A request that gives an option
+// that applies to the whole run, such as -s or --profile, fails.
+int run_server(char* socket_path, int num_workers, int queue_size, size_t block_size);
+
+// A function for running server mode from the command line.
+int server_main(int argc, char** argv);
+
+#endif
@@ -0,0 +1,1545 @@
+#include "stream.h"
+
+// A function for creating a stage of the streaming audio pipeline.
+// Returns NULL if there is an error.
+stream_stage* new_stage(int type, stream_stage* input, size_t num_frames, int frame_size, size_t block_size) {
+
+    // Allocate memory for the stage, return NULL on error.
+    stream_stage* stage = calloc(1, sizeof(stream_stage));
+    if (stage == NULL) {
+        print_message("Error allocating memory for stream stage.\n\n");
+        return NULL;
+    }
+
+    stage->type = type;
+    stage->input = input;
+    stage->num_frames = num_frames;
+    stage->frame_size = frame_size;
+    stage->fd = -1;
+
+    // Stretch, resample and convert stages gather frames from a block of their input, and an analyze stage reads
+    // the frames it did not analyze in order through its block. A resample stage's block always holds the source
+    // frames of at least one output frame, and a convert stage's block holds frames of its input's size.
+    if (type == STAGE_STRETCH || type == STAGE_RESAMPLE || type == STAGE_CONVERT || type == STAGE_ANALYZE) {
+        int input_frame_size = type == STAGE_CONVERT ? input->frame_size : frame_size;
+        stage->scratch_frames = block_size / input_frame_size > 0 ? block_size / input_frame_size : 1;
+        if (type == STAGE_RESAMPLE && stage->scratch_frames < SINC_TAPS + 2) {
+            stage->scratch_frames = SINC_TAPS + 2;
+        }
+        stage->scratch = malloc(stage->scratch_frames * input_frame_size * sizeof(char));
+        if (stage->scratch == NULL) {
+            print_message("Error allocating memory for stream stage.\n\n");
+            free(stage);
+            return NULL;
+        }
+        profile_allocation(stage->scratch_frames * input_frame_size);
+    }
+
+    return stage;
+}
+
+// A function for freeing a stage and all of the stages it reads from.
+void free_stages(stream_stage* stage) {
+    while (stage != NULL) {
+        stream_stage* input = stage->input;
+        free_stages(stage->appended);
+        if (stage->owns_fd) {
+            close_file(stage->fd);
+        }
+        if (stage->resampler != NULL) {
+            free_resampler(stage->resampler);
+        }
+        if (stage->wsola != NULL) {
+            free_wsola(stage->wsola);
+        }
+        if (stage->workspace != NULL) {
+            free_wsola_workspace(stage->workspace);
+        }
+        if (stage->converter != NULL) {
+            free_converter(stage->converter);
+        }
+        if (stage->analysis != NULL) {
+            free_audio_analysis(stage->analysis);
+        }
+        free(stage->analysis_file_name);
+        free(stage->samples);
+        free(stage->scratch);
+        free(stage);
+        stage = input;
+    }
+}
+
+// A function for calculating the input frame used for an output frame of a stretch stage.
+static size_t stretch_index(stream_stage* stage, size_t frame) {
+    return (size_t)((double)frame / stage->time_multiplier);
+}
+
+static int read_stage(stream_stage* stage, size_t first, size_t count, char* destination);
+
+// A function for adding chars read from a position of the source file to the checksums of a range of the source,
+// when they continue the chars added so far. Chars read out of order are checksummed after the file is written.
+static void feed_source(checksum_feed* feed, off_t position, char* chars, size_t size) {
+    off_t skip = feed != NULL ? feed->range->position + feed->position - position : -1;
+    if (skip >= 0 && skip < (off_t)size) {
+        feed_checksum(feed, chars + skip, size - skip);
+    }
+}
+
+// A function for reading chars of the source file from a position relative to the start of its audio data.
+static int read_source_chars(stream_stage* stage, off_t position, size_t size, char* destination) {
+    ssize_t chars_read = read_file_range(stage->fd, destination, size, stage->offset + position);
+    if (chars_read == -1) {
+        return -1;
+    }
+    feed_source(stage->feed, stage->offset + position, destination, chars_read);
+
+    // Chars past the end of the file are silent.
+    memset(destination + chars_read, 0, size - chars_read);
+    return 0;
+}
+
+// A function for reading frames from the source file.
+static int read_source(stream_stage* stage, size_t first, size_t count, char* destination) {
+    return read_source_chars(stage, (off_t)first * stage->frame_size, count * stage->frame_size, destination);
+}
+
+// A function for reading frames from a stretch stage. Blocks whose input frames do not
+// fit in the scratch buffer are split in half.
+static int read_stretch(stream_stage* stage, size_t first, size_t count, char* destination) {
+    int frame_size = stage->frame_size;
+    size_t low = stretch_index(stage, first);
+    size_t span = stretch_index(stage, first + count - 1) - low + 1;
+
+    if (span > stage->scratch_frames && count > 1) {
+        size_t half = count / 2;
+        if (read_stretch(stage, first, half, destination) == -1) {
+            return -1;
+        }
+        return read_stretch(stage, first + half, count - half, destination + half * frame_size);
+    }
+
+    if (read_stage(stage->input, low, span, stage->scratch) == -1) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(destination + i * frame_size, stage->scratch + (stretch_index(stage, first + i) - low) * frame_size, frame_size);
+    }
+    return 0;
+}
+
+// A function for growing the decoded sample buffer of a stage to hold num_samples samples.
+// Returns -1 if there is an error.
+static int reserve_samples(stream_stage* stage, size_t num_samples) {
+    if (num_samples > stage->sample_capacity) {
+        float* samples = realloc(stage->samples, num_samples * sizeof(float));
+        if (samples == NULL) {
+            print_message("Error allocating memory for stream stage.\n\n");
+            return -1;
+        }
+        stage->samples = samples;
+        stage->sample_capacity = num_samples;
+    }
+    return 0;
+}
+
+// A function for reading frames from a resample stage. Blocks whose source frames do not fit in the
+// scratch buffer are split in half.
+static int read_resample(stream_stage* stage, size_t first, size_t count, char* destination) {
+    size_t source_first;
+    size_t source_count = resampler_source_range(stage->resampler, first, count, &source_first);
+
+    if (source_count > stage->scratch_frames && count > 1) {
+        size_t half = count / 2;
+        if (read_resample(stage, first, half, destination) == -1) {
+            return -1;
+        }
+        return read_resample(stage, first + half, count - half, destination + half * stage->frame_size);
+    }
+
+    // Grow the decoded sample buffer for the block, return -1 on error.
+    if (reserve_samples(stage, resampler_scratch_size(stage->resampler, count)) == -1) {
+        return -1;
+    }
+
+    if (read_stage(stage->input, source_first, source_count, stage->scratch) == -1) {
+        return -1;
+    }
+    resample_block(stage->resampler, stage->scratch, source_first, source_count, first, count, destination, stage->samples);
+    return 0;
+}
+
+// A function for reading frames from a convert stage. Blocks whose input frames do not fit in the scratch
+// buffer are split.
+static int read_convert(stream_stage* stage, size_t first, size_t count, char* destination) {
+    if (reserve_samples(stage, converter_scratch_size(stage->converter, count < stage->scratch_frames ? count :
+                                                                                stage->scratch_frames)) == -1) {
+        return -1;
+    }
+    for (size_t done = 0; done < count; done += stage->scratch_frames) {
+        size_t part = count - done < stage->scratch_frames ? count - done : stage->scratch_frames;
+        if (read_stage(stage->input, first + done, part, stage->scratch) == -1) {
+            return -1;
+        }
+        convert_block(stage->converter, stage->scratch, first + done, part, destination + done * stage->frame_size,
+                      stage->samples);
+    }
+    return 0;
+}
+
+// A function for reading source frames for a pitch-preserving stretch stage from its input stage.
+static int read_wsola_input(void* argument, size_t first, size_t count, char* destination) {
+    return read_stage(argument, first, count, destination);
+}
+
+// A function for reading frames from a pitch-preserving stretch stage.
+static int read_wsola(stream_stage* stage, size_t first, size_t count, char* destination) {
+    return wsola_render(stage->wsola, stage->workspace, first, count, destination, read_wsola_input, stage->input);
+}
+
+// A function for reading frames from a reverse stage.
+static int read_reverse(stream_stage* stage, size_t first, size_t count, char* destination) {
+    if (read_stage(stage->input, stage->num_frames - first - count, count, destination) == -1) {
+        return -1;
+    }
+    reverse_audio(destination, count, stage->frame_size);
+    return 0;
+}
+
+// A function for reading frames from a trim stage.
+static int read_trim(stream_stage* stage, size_t first, size_t count, char* destination) {
+    return read_stage(stage->input, stage->first_frame + first, count, destination);
+}
+
+// A function for reading frames from a concatenation stage, from its input and then from the appended stage.
+static int read_concat(stream_stage* stage, size_t first, size_t count, char* destination) {
+    size_t input_frames = stage->input->num_frames;
+    size_t inside = first < input_frames ? (count < input_frames - first ? count : input_frames - first) : 0;
+    if (read_stage(stage->input, first, inside, destination) == -1) {
+        return -1;
+    }
+    return read_stage(stage->appended, first + inside - input_frames, count - inside, destination + inside * stage->frame_size);
+}
+
+// A function for reading frames from an analyze stage, analyzing those that continue the frames analyzed so far
+// at either end, so frames read forwards or backwards are analyzed once. Frames read out of order are analyzed
+// when the analysis is reported.
+static int read_analyze(stream_stage* stage, size_t first, size_t count, char* destination) {
+    if (read_stage(stage->input, first, count, destination) == -1) {
+        return -1;
+    }
+    audio_analysis* analysis = stage->analysis;
+    if (analysis == NULL) {
+        return 0;
+    }
+    size_t start = analysis->first_frame;
+    size_t end = analysis->num_frames > 0 ? start + analysis->num_frames : first;
+    if (first <= end && first + count > end &&
+            analyze_frames(analysis, destination + (end - first) * stage->frame_size, end, first + count - end) == -1) {
+        return -1;
+    }
+    if (first < start && first + count >= start && analyze_frames(analysis, destination, first, start - first) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+// A function for reading frames [first, first + count) of a stage's output into destination.
+static int read_stage(stream_stage* stage, size_t first, size_t count, char* destination) {
+    if (count == 0) {
+        return 0;
+    }
+
+    // Frames past the end of a stage are read from the chars that follow the source audio data, in frames of
+    // the stage's size.
+    if (stage->type != STAGE_SOURCE && first + count > stage->num_frames) {
+        size_t inside = first < stage->num_frames ? stage->num_frames - first : 0;
+        if (read_stage(stage, first, inside, destination) == -1) {
+            return -1;
+        }
+        stream_stage* source = stage;
+        while (source->input != NULL) {
+            source = source->input;
+        }
+        off_t position = (off_t)source->num_frames * source->frame_size + (off_t)(first + inside - stage->num_frames) * stage->frame_size;
+        return read_source_chars(source, position, (count - inside) * stage->frame_size,
+                                 destination + inside * stage->frame_size);
+    }
+
+    switch (stage->type) {
+        case STAGE_SOURCE:
+            return read_source(stage, first, count, destination);
+        case STAGE_STRETCH:
+            return read_stretch(stage, first, count, destination);
+        case STAGE_RESAMPLE:
+            return read_resample(stage, first, count, destination);
+        case STAGE_WSOLA:
+            return read_wsola(stage, first, count, destination);
+        case STAGE_CONVERT:
+            return read_convert(stage, first, count, destination);
+        case STAGE_ANALYZE:
+            return read_analyze(stage, first, count, destination);
+        case STAGE_TRIM:
+            return read_trim(stage, first, count, destination);
+        case STAGE_CONCAT:
+            return read_concat(stage, first, count, destination);
+        default:
+            return read_reverse(stage, first, count, destination);
+    }
+}
+
+// A function for calculating the number of chars of the checksum chunk written after a streamed wav file, which
+// holds the checksums of its audio data and, unless only the audio data is counted, of its embedded files.
+static off_t checksum_chunk_length(stream_file* stream, int with_chunks) {
+    if (!stream->wav.write_checksums) {
+        return 0;
+    }
+    int num_ranges = 1;
+    size_t num_blocks = checksum_block_count(stream->wav.data_size, CHECKSUM_BLOCK_SIZE);
+    for (int i = 0; i < stream->num_chunks && with_chunks; ++i) {
+        if (!stream->chunks[i].raw && is_embedded_chunk(stream->chunks[i].id)) {
+            ++num_ranges;
+            num_blocks += checksum_block_count(stream->chunks[i].size, CHECKSUM_BLOCK_SIZE);
+        }
+    }
+    return 8 + checksum_payload_size(num_ranges, num_blocks);
+}
+
+// A function for calculating the number of chars written between the RIFF header, or any "ds64" chunk, and the
+// data chunk of a streamed wav file.
+static off_t head_length(stream_file* stream) {
+    return stream->head_size + stream->format_written - stream->format_read;
+}
+
+// A function for recalculating the sizes and positions of a streamed wav file after an operation. A file
+// whose sizes do not fit in its headers gets a "ds64" chunk after its RIFF header, as does a source file
+// that had one.
+static void update_sizes(stream_file* stream) {
+    wav_file* wav = &stream->wav;
+
+    off_t chunks_size = 0;
+    for (int i = 0; i < stream->num_chunks; ++i) {
+        chunks_size += stream->chunks[i].length + stream->chunks[i].padding + (stream->chunks[i].raw ? 0 : 8);
+    }
+    off_t checksum_length = checksum_chunk_length(stream, 1);
+
+    wav->rf64 = 0;
+    wav->chunk_size = 4 + head_length(stream) + 8 + wav->data_size + wav->data_size % 2 + chunks_size + checksum_length;
+    wav->rf64 = stream->ds64_size > 0 || needs_rf64(wav);
+    off_t ds64_length = !wav->rf64 ? 0 : 8 + (stream->ds64_size > 0 ? stream->ds64_size : DS64_SIZE);
+
+    wav->data_position = 12 + ds64_length + head_length(stream);
+    wav->audio_data_position = wav->data_position + 8;
+    wav->data_end_position = wav->audio_data_position + wav->data_size + wav->data_size % 2;
+    wav->file_size = wav->data_end_position + chunks_size + checksum_length;
+    wav->chunk_size = wav->file_size - 8;
+    wav->bytes_after_data = chunks_size; // new chunks are added before the checksum chunk
+    wav->num_all_channel_samples = wav->data_size / wav->all_channel_sample_size_in_bytes;
+}
+
+// A function for appending a chunk to the end of a streamed wav file.
+// Returns -1 if there is an error.
+static int add_chunk(stream_file* stream, stream_chunk* chunk) {
+    if (stream->num_chunks == stream->chunk_capacity) {
+        int capacity = stream->chunk_capacity > 0 ? stream->chunk_capacity * 2 : 8;
+        stream_chunk* chunks = realloc(stream->chunks, capacity * sizeof(stream_chunk));
+        if (chunks == NULL) {
+            print_message("Error allocating memory for chunk list.\n\n");
+            return -1;
+        }
+        stream->chunks = chunks;
+        stream->chunk_capacity = capacity;
+    }
+    stream->chunks[stream->num_chunks++] = *chunk;
+    return 0;
+}
+
+// A function for removing a chunk from a streamed wav file.
+static void remove_chunk(stream_file* stream, int index) {
+    if (stream->chunks[index].owns_fd) {
+        close_file(stream->chunks[index].fd);
+    }
+    free(stream->chunks[index].data);
+    memmove(stream->chunks + index, stream->chunks + index + 1, (stream->num_chunks - index - 1) * sizeof(stream_chunk));
+    --stream->num_chunks;
+}
+
+// A function for determining whether a chunk of the source file is followed by a pad byte.
+static int source_padding(stream_file* stream, off_t payload_end, off_t size) {
+    char following[4];
+    ssize_t following_length = payload_end < stream->source_size ? read_file_range(stream->source_fd, following, 4, payload_end) : 0;
+    return chunk_padding(size, following, following_length > 0 ? following_length : 0);
+}
+
+// A function for indexing the chunks that follow the data chunk of the source file.
+// Chars that do not form a complete chunk are kept as a raw range.
+static int index_trailing_chunks(stream_file* stream, off_t position) {
+    while (position < stream->source_size) {
+        stream_chunk chunk = { .fd = stream->source_fd, .offset = position };
+        char header[8];
+
+        if (stream->source_size - position < 8 || read_file_range(stream->source_fd, header, 8, position) != 8 ||
+                *(uint32_t*)(header + 4) > stream->source_size - position - 8) {
+            chunk.raw = 1;
+            chunk.length = stream->source_size - position;
+        } else {
+            memcpy(chunk.id, header, 4);
+            chunk.size = *(uint32_t*)(header + 4);
+            chunk.offset = position + 8;
+            chunk.length = chunk.size + source_padding(stream, chunk.offset + chunk.size, chunk.size);
+        }
+
+        if (add_chunk(stream, &chunk) == -1) {
+            return -1;
+        }
+        position = chunk.offset + chunk.length;
+    }
+    return 0;
+}
+
+// A function for taking the checksums from the checksum chunk at the end of a streamed wav file and removing the
+// chunk, so operations can append chunks. The chunk is written again with the file. A damaged checksum chunk is
+// dropped.
+// Returns -1 if there is an error.
+static int take_checksums(stream_file* stream) {
+    stream_chunk* chunk = stream->num_chunks > 0 ? stream->chunks + stream->num_chunks - 1 : NULL;
+    if (chunk == NULL || chunk->raw || memcmp(chunk->id, CHECKSUM_CHUNK_ID, 4)) {
+        return 0;
+    }
+
+    // Read the payload of the checksum chunk, return -1 on error.
+    char* payload = malloc(chunk->size > 0 ? chunk->size : 1);
+    if (payload == NULL) {
+        print_message("Error allocating memory for checksums.\n\n");
+        return -1;
+    }
+    if (read_file_range(chunk->fd, payload, chunk->size, chunk->offset) == chunk->size) {
+        stream->checksums = parse_checksum_list(payload, chunk->size);
+    }
+    free(payload);
+    stream->wav.write_checksums = stream->checksums != NULL;
+    remove_chunk(stream, stream->num_chunks - 1);
+    return 0;
+}
+
+// A function for opening a wav file for streaming. Only the RIFF header and the chunk headers
+// are read. Returns NULL if there is an error.
+stream_file* stream_open(char* file_name, size_t block_size) {
+
+    // Allocate memory for the stream, return NULL on error.
+    stream_file* stream = calloc(1, sizeof(stream_file));
+    if (stream == NULL) {
+        print_message("Error allocating memory for stream.\n\n");
+        return NULL;
+    }
+    stream->block_size = block_size;
+
+    // Open the file, return NULL on error.
+    stream->source_fd = open_file(file_name, &stream->source_size);
+    if (stream->source_fd == -1) {
+        free(stream);
+        return NULL;
+    }
+
+    // Return NULL if the file is not a valid wav file
+    wav_file* wav = &stream->wav;
+    char header[44];
+    if (stream->source_size < 44 || read_file_range(stream->source_fd, header, 44, 0) != 44) {
+        print_message("Error - Not a WAVE file.\n");
+        stream_close(stream);
+        return NULL;
+    }
+    if (parse_riff_header(header, wav) == -1) {
+        stream_close(stream);
+        return NULL;
+    }
+
+    // Return NULL if the RIFF chunk size is incorrect
+    if (stream->source_size != wav->chunk_size + 8) {
+        print_message("File Corrupted. Incorrect chunk size.\n");
+        stream_close(stream);
+        return NULL;
+    }
+
+    // Walk the chunk headers up to the "data" chunk, copying the "fmt " chunk into the wav_file and finding the
+    // "fact" chunk. The "ds64" chunk of an RF64 file is written again with the new sizes, so it is not part of the
+    // copied chunks.
+    stream->ds64_size = wav->rf64 ? *(uint32_t*)(header + 16) : 0;
+    off_t position = 12 + (wav->rf64 ? 8 + (off_t)stream->ds64_size : 0);
+    stream->head_offset = position;
+    int found_format = 0, found_fact = 0;
+    for (;;) {
+        if (position + 8 > stream->source_size || read_file_range(stream->source_fd, header, 8, position) != 8) {
+            print_message(found_format ? "Error - No \"data\" section." : "Error - No \"fmt \" section.");
+            stream_close(stream);
+            return NULL;
+        }
+        off_t size = chunk_header_size(wav, header);
+        if (found_format && !memcmp(header, "data", 4)) {
+            memcpy(wav->data_id, header, 4);
+            wav->data_size = size;
+            break;
+        }
+        off_t payload_end = position + 8 + size;
+        off_t next = payload_end + source_padding(stream, payload_end, size);
+        if (!found_format && !memcmp(header, "fmt ", 4)) {
+            off_t length = size >= 0 && size < FORMAT_READ_SIZE - 8 ? 8 + size : FORMAT_READ_SIZE;
+            length = read_file_range(stream->source_fd, stream->format, length, position);
+            stream->format_read = length < 0 ? 0 : length;
+            stream->format_written = stream->format_read;
+            parse_format(wav, stream->format, stream->format_read);
+            stream->format_offset = position;
+            stream->format_length = next - position;
+            wav->format_position = position;
+            found_format = 1;
+        }
+        if (!found_fact && !memcmp(header, "fact", 4)) {
+            stream->fact_offset = size >= 4 ? position : 0; // a "fact" chunk too small for the frame count is metadata
+            found_fact = 1;
+        }
+        position = next;
+    }
+
+    // Return NULL if the audio data does not fit in the file or the sample size is invalid.
+    wav->all_channel_sample_size_in_bytes = wav->num_channels * wav->bits_per_sample / 8;
+    if (wav->data_size < 0 || position + 8 + wav->data_size > stream->source_size) {
+        print_message("File Corrupted. Incorrect data size.\n");
+        stream_close(stream);
+        return NULL;
+    }
+    if (wav->all_channel_sample_size_in_bytes <= 0) {
+        print_message("Error - Invalid sample size.\n");
+        stream_close(stream);
+        return NULL;
+    }
+
+    stream->head_size = position - stream->head_offset;
+
+    // Create the source stage of the audio pipeline.
+    int frame_size = wav->all_channel_sample_size_in_bytes;
+    stream->audio = new_stage(STAGE_SOURCE, NULL, wav->data_size / frame_size, frame_size, block_size);
+    if (stream->audio == NULL) {
+        stream_close(stream);
+        return NULL;
+    }
+    stream->audio->fd = stream->source_fd;
+    stream->audio->offset = position + 8;
+    stream->tail_offset = position + 8 + stream->audio->num_frames * frame_size;
+    stream->tail_size = wav->data_size % frame_size;
+
+    // Index the chunks following the audio data and any pad byte, and take the checksums from any checksum chunk at
+    // the end.
+    off_t audio_end = position + 8 + wav->data_size;
+    if (index_trailing_chunks(stream, audio_end + source_padding(stream, audio_end, wav->data_size)) == -1 ||
+            take_checksums(stream) == -1) {
+        stream_close(stream);
+        return NULL;
+    }
+
+    update_sizes(stream);
+    return stream;
+}
+
+// A function for closing a streamed wav file and freeing its resources.
+void stream_close(stream_file* stream) {
+    while (stream->num_chunks > 0) {
+        remove_chunk(stream, stream->num_chunks - 1);
+    }
+    free(stream->chunks);
+    free_stages(stream->audio);
+    if (stream->checksums != NULL) {
+        free_checksum_list(stream->checksums);
+    }
+    if (stream->source_fd != -1) {
+        close_file(stream->source_fd);
+    }
+    free(stream);
+}
+
+// A function for writing the files of a streamed wav file with a checksum chunk, and for checking its source
+// against its checksum chunk the next time it is written, while the source is read.
+// Returns -1 if the source has no checksums to check.
+int stream_use_checksums(stream_file* stream, int write_checksums, int verify) {
+    if (verify && stream->checksums == NULL) {
+        print_message("The file has no checksums.\n\n");
+        return -1;
+    }
+    stream->verify = verify;
+    stream->wav.write_checksums |= write_checksums;
+    update_sizes(stream);
+    return 0;
+}
+
+// A function for starting to check the ranges of the source of a streamed wav file against its checksum chunk.
+// Returns NULL if a range is outside the source or there is an error.
+static checksum_list* start_source_check(stream_file* stream, checksum_feed** feeds) {
+    checksum_list* expected = stream->checksums;
+    checksum_list* list = new_checksum_list(expected->block_size);
+    *feeds = list != NULL ? malloc((expected->num_ranges > 0 ? expected->num_ranges : 1) * sizeof(checksum_feed)) : NULL;
+    if (*feeds == NULL) {
+        if (list != NULL) {
+            print_message("Error allocating memory for checksums.\n\n");
+            free_checksum_list(list);
+        }
+        return NULL;
+    }
+    for (int i = 0; i < expected->num_ranges; ++i) {
+        checksum_range* range = expected->ranges + i;
+        checksum_range* checked = NULL;
+        if (range->position < 0 || range->size > stream->source_size - range->position) {
+            print_message("Error - Checksum range of the \"%.4s\" chunk is outside the file.\n\n", range->id);
+        } else {
+            checked = add_checksum_range(list, range->id, range->position, range->size);
+        }
+        if (checked == NULL) {
+            free(*feeds);
+            free_checksum_list(list);
+            return NULL;
+        }
+        start_checksum_feed(*feeds + i, checked, list->block_size);
+    }
+    return list;
+}
+
+// A function for finding the feed checking the range of the source of a streamed wav file at a position.
+// Returns NULL if no range of the source is checked there.
+static checksum_feed* find_source_feed(checksum_list* list, checksum_feed* feeds, off_t position) {
+    checksum_range* range = list != NULL ? find_checksum_range(list, position) : NULL;
+    return range != NULL ? feeds + (range - list->ranges) : NULL;
+}
+
+// A function for finishing the check of the source of a streamed wav file, reading the chars of each range that
+// were not read in order while the file was written, and comparing the checksums with its checksum chunk.
+// Returns -1 if there is an error or a block has changed.
+static int finish_source_check(stream_file* stream, checksum_list* list, checksum_feed* feeds, char* buffer,
+                               size_t buffer_size) {
+    off_t verified = 0;
+    for (int i = 0; i < list->num_ranges; ++i) {
+        checksum_range* range = list->ranges + i;
+        while (feeds[i].position < range->size) {
+            off_t remaining = range->size - feeds[i].position;
+            size_t length = remaining < (off_t)buffer_size ? (size_t)remaining : buffer_size;
+            if (read_file_range(stream->source_fd, buffer, length, range->position + feeds[i].position) != (ssize_t)length) {
+                print_message("The file cannot be read to check its checksums.\n\n");
+                return -1;
+            }
+            feed_checksum(feeds + i, buffer, length);
+        }
+        if (check_checksums(stream->checksums->ranges + i, range, list->block_size) == -1) {
+            return -1;
+        }
+        verified += range->size;
+    }
+    print_message("Verified %lld bytes in %i checksum ranges.\n\n", (long long)verified, list->num_ranges);
+    return 0;
+}
+
+// A function for copying chars of a file to the end of an open file through a buffer, adding them to the checksums
+// of the output and of the source when the feeds are not NULL. The source's feed is given the chars at their
+// position in fd_in.
+// Returns -1 if there is an error.
+static int copy_checksummed(int fd_in, off_t offset, int fd_out, size_t size, char* buffer, size_t buffer_size,
+                            checksum_feed* output, checksum_feed* source) {
+    if (output == NULL && source == NULL) {
+        return copy_file_chars(fd_in, offset, fd_out, size, buffer, buffer_size) == -1 ? -1 : 0;
+    }
+    for (size_t copied = 0; copied < size;) {
+        size_t length = size - copied < buffer_size ? size - copied : buffer_size;
+        ssize_t chars_read = read_file_range(fd_in, buffer, length, offset + copied);
+        if (chars_read <= 0) {
+            print_message("Warning, %zu bytes were expected, but %zu bytes were copied.\n\n", size, copied);
+            return chars_read == -1 ? -1 : 0;
+        }
+        if (write_chars(fd_out, buffer, chars_read) == -1) {
+            return -1;
+        }
+        if (output != NULL) {
+            feed_checksum(output, buffer, chars_read);
+        }
+        feed_source(source, offset + copied, buffer, chars_read);
+        copied += chars_read;
+    }
+    return 0;
+}
+
+// A function for writing a checksum chunk to the end of an open file.
+// Returns -1 if there is an error.
+static int write_checksum_chunk(int fd, checksum_list* list) {
+    size_t size = checksum_list_size(list);
+    char* chunk = malloc((size + 8) * sizeof(char));
+    if (chunk == NULL) {
+        print_message("Error allocating memory for checksums.\n\n");
+        return -1;
+    }
+    memcpy(chunk, CHECKSUM_CHUNK_ID, 4);
+    *(uint32_t*)(chunk + 4) = size;
+    write_checksum_list(list, chunk + 8);
+    int result = write_chars(fd, chunk, size + 8) == -1 ? -1 : 0;
+    free(chunk);
+    return result;
+}
+
+// A function for determining whether the frames of a stage are ranges of files, as they are for source stages and
+// for trims and concatenations of them.
+static int copies_ranges(stream_stage* stage) {
+    if (stage->type == STAGE_CONCAT) {
+        return copies_ranges(stage->input) && copies_ranges(stage->appended);
+    }
+    return stage->type == STAGE_SOURCE || (stage->type == STAGE_TRIM && copies_ranges(stage->input));
+}
+
+// A function for copying the frames [first, first + count) of a stage whose frames are ranges of files to the end of
+// an open file, a range at a time, without reading them through the pipeline. The chars of the source file are
+// added to the feeds of check, and all of the chars to output when it is not NULL.
+// Returns -1 if there is an error.
+static int copy_stage(stream_file* stream, stream_stage* stage, size_t first, size_t count, int fd, char* buffer,
+                      size_t buffer_size, checksum_feed* output, checksum_list* check, checksum_feed* check_feeds) {
+    if (stage->type == STAGE_TRIM) {
+        return copy_stage(stream, stage->input, stage->first_frame + first, count, fd, buffer, buffer_size, output, check,
+                          check_feeds);
+    } else if (stage->type == STAGE_CONCAT) {
+        size_t input_frames = stage->input->num_frames;
+        size_t inside = first < input_frames ? (count < input_frames - first ? count : input_frames - first) : 0;
+        if (inside > 0 && copy_stage(stream, stage->input, first, inside, fd, buffer, buffer_size, output, check,
+                                     check_feeds) == -1) {
+            return -1;
+        }
+        return count > inside ? copy_stage(stream, stage->appended, first + inside - input_frames, count - inside, fd,
+                                           buffer, buffer_size, output, check, check_feeds) : 0;
+    }
+    checksum_feed* source_feed = stage->fd == stream->source_fd ? find_source_feed(check, check_feeds, stage->offset) : NULL;
+    return copy_checksummed(stage->fd, stage->offset + (off_t)first * stage->frame_size, fd, count * stage->frame_size,
+                            buffer, buffer_size, output, source_feed);
+}
+
+// A function for copying the chars [first, end) of the chunks preceding the data chunk of a streamed wav file from
+// its source, with the frame count of its "fact" chunk updated when the frames of its encoding are known.
+// Returns -1 if there is an error.
+static int copy_head(stream_file* stream, off_t first, off_t end, int fd, char* buffer, size_t buffer_size) {
+    off_t count_position = stream->fact_offset + 8 - stream->head_offset;
+    if (stream->fact_offset == 0 || stream->wav.encoding == SAMPLE_UNSUPPORTED || count_position < first ||
+            count_position + 4 > end) {
+        return copy_file_chars(stream->source_fd, stream->head_offset + first, fd, end - first, buffer, buffer_size);
+    }
+    uint32_t count = fact_frame_count(&stream->wav);
+    if (copy_file_chars(stream->source_fd, stream->head_offset + first, fd, count_position - first, buffer,
+                        buffer_size) == -1 || write_chars(fd, (char*)&count, 4) == -1) {
+        return -1;
+    }
+    return copy_file_chars(stream->source_fd, stream->head_offset + count_position + 4, fd, end - count_position - 4,
+                           buffer, buffer_size);
+}
+
+// A function for writing the blocks of a streamed wav file to an open file. The checksums of the audio data and
+// the embedded files are added to output as they are written, and the source's chars to the feeds of check as
+// they are read, when these are not NULL.
+// Returns -1 if there is an error.
+static int write_blocks(stream_file* stream, int fd, char* buffer, size_t buffer_size, checksum_list* output,
+                        checksum_list* check, checksum_feed* check_feeds) {
+    wav_file* wav = &stream->wav;
+
+    // Write the RIFF header and any "ds64" chunk, which keeps the table of the source's "ds64" chunk.
+    char header[20 + DS64_SIZE];
+    size_t header_size = 12;
+    size_t table_size = stream->ds64_size > 24 ? stream->ds64_size - 24 : 0;
+    write_riff_header(wav, header);
+    if (stream->ds64_size > 0) {
+        memcpy(header + 12, "ds64", 4);
+        *(uint32_t*)(header + 16) = stream->ds64_size;
+        write_ds64_sizes(wav, header + 20);
+        header_size = 44;
+    } else if (wav->rf64) {
+        write_ds64_chunk(wav, header + 12);
+        header_size = sizeof(header);
+    }
+    if (write_chars(fd, header, header_size) == -1 ||
+            copy_file_chars(stream->source_fd, 44, fd, table_size, buffer, buffer_size) == -1) {
+        return -1;
+    }
+
+    // Write the chunks preceding the data chunk, with the first chars of the "fmt " chunk and the chars after it
+    // from memory, and the frame count of any "fact" chunk when the frames of the encoding are known.
+    off_t format_start = stream->format_offset - stream->head_offset;
+    off_t format_end = format_start + stream->format_read;
+    off_t format_chunk_end = format_start + stream->format_length;
+    if (stream->fact_written > 0 && wav->encoding != SAMPLE_UNSUPPORTED) {
+        *(uint32_t*)(stream->format + stream->fact_written + 8) = fact_frame_count(wav);
+    }
+    if (copy_head(stream, 0, format_start, fd, buffer, buffer_size) == -1 ||
+            write_chars(fd, stream->format, stream->format_read) == -1 ||
+            copy_head(stream, format_end, format_chunk_end, fd, buffer, buffer_size) == -1 ||
+            write_chars(fd, stream->format + stream->format_read, stream->format_written - stream->format_read) == -1 ||
+            copy_head(stream, format_chunk_end, stream->head_size, fd, buffer, buffer_size) == -1) {
+        return -1;
+    }
+
+    // Write the data chunk header and the audio data one block at a time, followed by the pad byte of odd-sized audio
+    // data.
+    memcpy(header, wav->data_id, 4);
+    *(uint32_t*)(header + 4) = wav->rf64 ? RF64_SIZE_MARKER : wav->data_size;
+    if (write_chars(fd, header, 8) == -1) {
+        return -1;
+    }
+    // The checksums of unchanged audio data are those of the source when they were calculated in blocks of the
+    // same size and the source is not being checked.
+    stream_stage* source = stream->audio;
+    while (source->input != NULL) {
+        source = source->input;
+    }
+    checksum_range* range = output != NULL ? add_checksum_range(output, wav->data_id, wav->audio_data_position, wav->data_size) : NULL;
+    checksum_range* source_range = stream->checksums != NULL ? find_checksum_range(stream->checksums, source->offset) : NULL;
+    if (output != NULL && range == NULL) {
+        return -1;
+    }
+    checksum_feed data_feed;
+    checksum_feed* output_feed = NULL;
+    if (range != NULL && check == NULL && stream->audio == source && source_range != NULL &&
+            source_range->size == range->size && stream->checksums->block_size == output->block_size) {
+        memcpy(range->checksums, source_range->checksums, checksum_block_count(range->size, output->block_size) * sizeof(uint32_t));
+    } else if (range != NULL) {
+        start_checksum_feed(&data_feed, range, output->block_size);
+        output_feed = &data_feed;
+    }
+    checksum_feed* source_feed = find_source_feed(check, check_feeds, source->offset);
+
+    int frame_size = stream->audio->frame_size;
+    size_t block_frames = buffer_size / frame_size;
+    if (copies_ranges(stream->audio)) {
+        // Unchanged, trimmed and concatenated audio is copied a range at a time, so only the frames kept are read.
+        if (copy_stage(stream, stream->audio, 0, stream->audio->num_frames, fd, buffer, buffer_size, output_feed, check,
+                       check_feeds) == -1) {
+            return -1;
+        }
+    } else {
+        // The source audio is checked as the pipeline reads it.
+        source->feed = source_feed;
+        for (size_t first = 0; first < stream->audio->num_frames; first += block_frames) {
+            size_t count = stream->audio->num_frames - first < block_frames ? stream->audio->num_frames - first : block_frames;
+            if (read_stage(stream->audio, first, count, buffer) == -1 || write_chars(fd, buffer, count * frame_size) == -1) {
+                source->feed = NULL;
+                return -1;
+            }
+            if (output_feed != NULL) {
+                feed_checksum(output_feed, buffer, count * frame_size);
+            }
+        }
+        source->feed = NULL;
+    }
+    if (copy_checksummed(stream->source_fd, stream->tail_offset, fd, stream->tail_size, buffer, buffer_size,
+                         output_feed, source_feed) == -1 || (wav->data_size % 2 != 0 && write_chars(fd, "", 1) == -1)) {
+        return -1;
+    }
+
+    // Write the chunks following the data chunk, with the checksums of the embedded files.
+    off_t position = wav->data_end_position;
+    for (int i = 0; i < stream->num_chunks; ++i) {
+        stream_chunk* chunk = stream->chunks + i;
+        output_feed = NULL;
+        if (!chunk->raw) {
+            memcpy(header, chunk->id, 4);
+            *(uint32_t*)(header + 4) = chunk->size;
+            if (write_chars(fd, header, 8) == -1) {
+                return -1;
+            }
+            position += 8;
+            if (output != NULL && is_embedded_chunk(chunk->id)) {
+                range = add_checksum_range(output, chunk->id, position, chunk->size);
+                if (range == NULL) {
+                    return -1;
+                }
+                start_checksum_feed(&data_feed, range, output->block_size);
+                output_feed = &data_feed;
+            }
+        }
+        source_feed = chunk->fd == stream->source_fd ? find_source_feed(check, check_feeds, chunk->offset) : NULL;
+        if (chunk->data != NULL) {
+            if (write_chars(fd, chunk->data, chunk->length) == -1) {
+                return -1;
+            }
+            if (output_feed != NULL) {
+                feed_checksum(output_feed, chunk->data, chunk->length);
+            }
+        } else if (copy_checksummed(chunk->fd, chunk->offset, fd, chunk->length, buffer, buffer_size, output_feed,
+                                    source_feed) == -1) {
+            return -1;
+        }
+        if (chunk->padding && write_chars(fd, "", 1) == -1) {
+            return -1;
+        }
+        position += chunk->length + chunk->padding;
+    }
+    return output != NULL ? write_checksum_chunk(fd, output) : 0;
+}
+
+// A function for reporting the analyses of the analyze stages of a streamed wav file that have not been reported,
+// in the order of the stages, after analyzing the frames of each that were not read in order.
+// Returns -1 if there is an error.
+static int report_analyses(stream_stage* stage) {
+    if (stage == NULL) {
+        return 0;
+    }
+    int result = report_analyses(stage->input);
+    audio_analysis* analysis = stage->analysis;
+    if (stage->type != STAGE_ANALYZE || analysis == NULL) {
+        return result;
+    }
+
+    // Analyze the frames before and after the frames analyzed, a block at a time towards each end.
+    while (result != -1 && analysis->first_frame > 0) {
+        size_t count = analysis->first_frame < stage->scratch_frames ? analysis->first_frame : stage->scratch_frames;
+        size_t first = analysis->first_frame - count;
+        result = read_stage(stage->input, first, count, stage->scratch) == -1 ? -1 :
+                 analyze_frames(analysis, stage->scratch, first, count);
+    }
+    while (result != -1 && analysis->first_frame + analysis->num_frames < stage->num_frames) {
+        size_t first = analysis->first_frame + analysis->num_frames;
+        size_t count = stage->num_frames - first < stage->scratch_frames ? stage->num_frames - first : stage->scratch_frames;
+        result = read_stage(stage->input, first, count, stage->scratch) == -1 ? -1 :
+                 analyze_frames(analysis, stage->scratch, first, count);
+    }
+    if (result != -1) {
+        result = report_analysis(analysis, stage->analysis_file_name);
+    }
+    free_audio_analysis(analysis);
+    stage->analysis = NULL;
+    return result;
+}
+
+// A function for writing a streamed wav file to disk one block at a time.
+// Returns -1 if there is an error.
+int stream_write(stream_file* stream, char* file_name) {
+
+    // Allocate memory for the output block unless the caller lent one, return -1 on error.
+    int frame_size = stream->audio->frame_size;
+    size_t buffer_size = stream->block_size / frame_size > 0 ? stream->block_size / frame_size * frame_size : (size_t)frame_size;
+    char* buffer = stream->block != NULL && buffer_size <= stream->block_size ? stream->block : malloc(buffer_size * sizeof(char));
+    if (buffer == NULL) {
+        print_message("Error allocating memory for output block.\n\n");
+        return -1;
+    }
+    if (buffer != stream->block) {
+        profile_allocation(buffer_size);
+    }
+
+    // The source is read while the output is written, so overwriting the source goes through a temporary file.
+    struct stat source_stat, destination_stat;
+    int replace_source = !stat(file_name, &destination_stat) && !fstat(stream->source_fd, &source_stat) &&
+                         source_stat.st_dev == destination_stat.st_dev && source_stat.st_ino == destination_stat.st_ino;
+    char* temporary_name = NULL;
+    int fd;
+    if (replace_source) {
+        temporary_name = malloc(strlen(file_name) + 8);
+        if (temporary_name == NULL) {
+            print_message("Error allocating memory for file name.\n\n");
+            if (buffer != stream->block) {
+                free(buffer);
+            }
+            return -1;
+        }
+        sprintf(temporary_name, "%s.XXXXXX", file_name);
+        fd = mkstemp(temporary_name);
+        if (fd == -1) {
+            print_message("Error writing file. Unable to open %s.\n\n", temporary_name);
+        }
+    } else {
+        fd = create_file(file_name);
+    }
+    if (fd == -1) {
+        free(temporary_name);
+        if (buffer != stream->block) {
+            free(buffer);
+        }
+        return -1;
+    }
+
+    // Write the file, checking the source against its checksums as it is read when asked to. A file whose source
+    // has changed is not kept.
+    checksum_list* output = stream->wav.write_checksums ? new_checksum_list(CHECKSUM_BLOCK_SIZE) : NULL;
+    checksum_feed* check_feeds = NULL;
+    checksum_list* check = stream->verify ? start_source_check(stream, &check_feeds) : NULL;
+    int result = (stream->wav.write_checksums && output == NULL) || (stream->verify && check == NULL) ? -1 :
+                 write_blocks(stream, fd, buffer, buffer_size, output, check, check_feeds);
+    result = close_file(fd) == -1 ? -1 : result;
+    int changed = 0;
+    if (result != -1 && check != NULL) {
+        changed = finish_source_check(stream, check, check_feeds, buffer, buffer_size) == -1;
+        result = changed ? -1 : result;
+        stream->verify = changed;
+    }
+    if (replace_source) {
+        if (result == -1 || rename(temporary_name, file_name)) {
+            unlink(temporary_name);
+            result = -1;
+        }
+        free(temporary_name);
+    } else if (changed) {
+        unlink(file_name);
+    }
+
+    // Report the analyses of the audio read to write the file.
+    if (result != -1 && report_analyses(stream->audio) == -1) {
+        result = -1;
+    }
+    if (output != NULL) {
+        free_checksum_list(output);
+    }
+    if (check != NULL) {
+        free_checksum_list(check);
+        free(check_feeds);
+    }
+    if (buffer != stream->block) {
+        free(buffer);
+    }
+    return result;
+}
+
+// A function for writing the frames [first, first + count) of a streamed wav file to disk as a file of their own,
+// through a trim stage that is removed again once the file is written.
+// Returns -1 if there is an error.
+int stream_write_range(stream_file* stream, char* file_name, size_t first, size_t count) {
+    stream_stage* audio = stream->audio;
+    off_t data_size = stream->wav.data_size;
+    size_t tail_size = stream->tail_size;
+    if (stream_trim_audio(stream, first, count) == -1) {
+        return -1;
+    }
+    int result = stream_write(stream, file_name);
+
+    // Put the audio back as it was.
+    stream->audio->input = NULL;
+    free_stages(stream->audio);
+    stream->audio = audio;
+    stream->wav.data_size = data_size;
+    stream->tail_size = tail_size;
+    update_sizes(stream);
+    return result;
+}
+
+// A function for removing the metadata from a streamed wav file.
+// Returns -1 if there is an error.
+int stream_remove_metadata(stream_file* stream) {
+
+    // Return if there is no metadata in the file. Any "ds64" chunk before the chunks is kept, as is the frame count
+    // of any "fact" chunk, and any checksum chunk only keeps the checksums of the audio data.
+    off_t fact_length = stream->fact_offset > 0 ? FACT_CHUNK_LENGTH : 0;
+    off_t new_head_length = stream->format_length + stream->format_written - stream->format_read + fact_length;
+    off_t new_chunk_size = stream->wav.data_position - head_length(stream) + new_head_length + stream->wav.data_size +
+                           stream->wav.data_size % 2 + checksum_chunk_length(stream, 0);
+    if (new_chunk_size == stream->wav.chunk_size) {
+        print_message("There is no metadata in this file.\n\n");
+        return 0;
+    } else {
+        print_message("Removing %lld bytes of metadata.\n\n", (long long)(stream->wav.chunk_size - new_chunk_size));
+    }
+
+    // Keep only the "fmt " chunk before the data chunk, followed by the header and frame count of any "fact" chunk,
+    // and drop every chunk after it, return -1 on error.
+    if (fact_length > 0) {
+        char* fact = stream->format + stream->format_written;
+        if (read_file_range(stream->source_fd, fact, FACT_CHUNK_LENGTH, stream->fact_offset) != FACT_CHUNK_LENGTH) {
+            print_message("Error reading the \"fact\" chunk.\n\n");
+            return -1;
+        }
+        *(uint32_t*)(fact + 4) = 4;
+        stream->fact_written = stream->format_written;
+        stream->format_written += FACT_CHUNK_LENGTH;
+        stream->fact_offset = 0;
+    }
+    stream->head_offset = stream->format_offset;
+    stream->head_size = stream->format_length;
+    while (stream->num_chunks > 0) {
+        remove_chunk(stream, stream->num_chunks - 1);
+    }
+    update_sizes(stream);
+    stream->wav.format_position = stream->wav.data_position - head_length(stream);
+    return 0;
+}
+
+// A function for calculating the position of a chunk after the end of the data chunk of a streamed wav file.
+static int chunk_offset(stream_file* stream, int index) {
+    int offset = 0;
+    for (int i = 0; i < index; ++i) {
+        offset += stream->chunks[i].length + stream->chunks[i].padding + (stream->chunks[i].raw ? 0 : 8);
+    }
+    return offset;
+}
+
+// A function for reading the directory of the embedded files of a streamed wav file from its last chunk.
+// Returns an empty directory if the file has none, or NULL if there is an error.
+static file_directory* read_directory(stream_file* stream) {
+    stream_chunk* chunk = stream->num_chunks > 0 ? stream->chunks + stream->num_chunks - 1 : NULL;
+    if (chunk == NULL || chunk->raw || memcmp(chunk->id, "fdir", 4)) {
+        return new_directory();
+    }
+    if (chunk->data != NULL) {
+        return parse_directory(chunk->data, chunk->size);
+    }
+
+    // Read the payload of the directory chunk, return NULL on error.
+    char* payload = malloc(chunk->size * sizeof(char));
+    if (payload == NULL) {
+        print_message("Error allocating memory for directory.\n\n");
+        return NULL;
+    }
+    file_directory* directory = NULL;
+    if (read_file_range(chunk->fd, payload, chunk->size, chunk->offset) == chunk->size) {
+        directory = parse_directory(payload, chunk->size);
+    }
+    free(payload);
+    return directory;
+}
+
+// A function for reading the directory of the embedded files of a streamed wav file and removing its chunk,
+// so an operation can change the chunks before it. store_directory writes it back.
+// Returns NULL if there is an error.
+static file_directory* take_directory(stream_file* stream) {
+    file_directory* directory = read_directory(stream);
+    stream_chunk* chunk = stream->num_chunks > 0 ? stream->chunks + stream->num_chunks - 1 : NULL;
+    if (directory != NULL && chunk != NULL && !chunk->raw && !memcmp(chunk->id, "fdir", 4)) {
+        remove_chunk(stream, stream->num_chunks - 1);
+        update_sizes(stream);
+    }
+    return directory;
+}
+
+// A function for appending the directory of the embedded files to the end of a streamed wav file and freeing it.
+// The chunk is left out when there are no entries.
+// Returns -1 if there is an error.
+static int store_directory(stream_file* stream, file_directory* directory) {
+    int result = 0;
+    if (directory->num_entries > 0) {
+        stream_chunk chunk = { .id = "fdir", .size = directory_size(directory), .fd = -1 };
+        chunk.length = chunk.size;
+        chunk.data = malloc(chunk.size * sizeof(char));
+        if (chunk.data == NULL) {
+            print_message("Error allocating memory for directory.\n\n");
+            result = -1;
+        } else {
+            write_directory(directory, chunk.data);
+            result = add_chunk(stream, &chunk);
+            if (result == -1) {
+                free(chunk.data);
+            }
+        }
+    }
+    update_sizes(stream);
+    free_directory(directory);
+    return result;
+}
+
+// A function for finding the chunk of a directory entry.
+// Returns -1 if the entry does not match a chunk.
+static int find_entry_chunk(stream_file* stream, directory_entry* entry) {
+    int offset = 0;
+    for (int i = 0; i < stream->num_chunks && offset <= entry->offset; ++i) {
+        stream_chunk* chunk = stream->chunks + i;
+        if (offset == entry->offset && !chunk->raw && is_embedded_chunk(chunk->id) && chunk->size == entry->size) {
+            return i;
+        }
+        offset += chunk->length + chunk->padding + (chunk->raw ? 0 : 8);
+    }
+    print_message("Error - Embedded file directory does not match the file.\n\n");
+    return -1;
+}
+
+// A function for embedding a hidden file within a streamed wav file and recording it in the directory. The
+// embedded file is read once to calculate its checksum, or compressed into a temporary file.
+// Returns -1 if there is an error.
+int stream_push_back_file(stream_file* stream, char* embedded_filename, int compression) {
+
+    // Take the directory from the end of the file, return -1 on error.
+    file_directory* directory = take_directory(stream);
+    if (directory == NULL) {
+        return -1;
+    }
+
+    // Open the embedded file, return -1 on error.
+    off_t size;
+    int fd = open_file(embedded_filename, &size);
+    if (fd == -1) {
+        store_directory(stream, directory);
+        return -1;
+    }
+
+    // Compress the embedded file into a temporary file, or calculate its checksum, return -1 on error.
+    uint32_t checksum;
+    ssize_t chunk_size = -1;
+    if (compression != COMPRESSION_NONE) {
+        int compressed_fd = create_temporary_file();
+        file_range range = { compressed_fd, 0 };
+        if (compressed_fd != -1) {
+            chunk_size = compress_payload(fd, size, compression, write_file_payload, &range, &checksum);
+        }
+        close_file(fd);
+        fd = compressed_fd;
+    } else {
+        char* buffer = stream->block != NULL ? stream->block : malloc(stream->block_size * sizeof(char));
+        if (buffer == NULL) {
+            print_message("Error allocating memory for output block.\n\n");
+        } else if (copy_payload(fd, 0, -1, 0, size, buffer, stream->block_size, &checksum) != size) {
+            print_message("The file %s cannot be read.\n\n", embedded_filename);
+        } else {
+            chunk_size = size;
+        }
+        if (buffer != stream->block) {
+            free(buffer);
+        }
+    }
+
+    // Record the embedded file in the directory and append a chunk that is copied from the embedded or
+    // compressed file when the output is written. Odd-sized chunks are followed by a pad byte.
+    int result = chunk_size != -1 ? add_entry(directory, embedded_filename, stream->wav.bytes_after_data, chunk_size, checksum) : -1;
+    stream_chunk chunk = { .size = chunk_size, .fd = fd, .offset = 0, .length = chunk_size, .padding = chunk_size % 2, .owns_fd = 1 };
+    memcpy(chunk.id, compression != COMPRESSION_NONE ? "zfil" : "file", 4);
+    if (result == 0 && add_chunk(stream, &chunk) == -1) {
+        remove_entry(directory, directory->num_entries - 1);
+        result = -1;
+    }
+    if (result == -1 && fd != -1) {
+        close_file(fd);
+    }
+    update_sizes(stream);
+    return store_directory(stream, directory) == -1 ? -1 : result;
+}
+
+// A function for removing an embedded file chunk from a streamed wav file and its directory, writing the
+// embedded file to disk unless extracted_file_name is NULL.
+// Returns -1 if there is an error.
+static int remove_file_chunk(stream_file* stream, file_directory* directory, int index, char* extracted_file_name) {
+
+    // Write the extracted file to disk, decompressing it if it was compressed.
+    stream_chunk* chunk = stream->chunks + index;
+    int result = 0;
+    if (extracted_file_name != NULL && !memcmp(chunk->id, "zfil", 4)) {
+        int fd = create_file(extracted_file_name);
+        file_range range = { chunk->fd, chunk->offset };
+        uint32_t checksum;
+        result = fd != -1 && decompress_payload(read_file_payload, &range, chunk->size, fd, &checksum) != -1 ? 0 : -1;
+        if (fd != -1 && close_file(fd) == -1) {
+            result = -1;
+        }
+    } else if (extracted_file_name != NULL) {
+        result = -1;
+        int fd = create_file(extracted_file_name);
+        if (fd != -1) {
+            char* buffer = stream->block != NULL ? stream->block : malloc(stream->block_size * sizeof(char));
+            if (buffer == NULL) {
+                print_message("Error allocating memory for output block.\n\n");
+            } else {
+                result = copy_file_chars(chunk->fd, chunk->offset, fd, chunk->size, buffer, stream->block_size) == chunk->size ? 0 : -1;
+                if (buffer != stream->block) {
+                    free(buffer);
+                }
+            }
+            result = close_file(fd) == -1 ? -1 : result;
+        }
+    }
+
+    // Remove the chunk from the directory and the file.
+    int offset = chunk_offset(stream, index);
+    int entry_index = find_entry_at(directory, offset);
+    if (entry_index != -1) {
+        remove_entry(directory, entry_index);
+    }
+    shift_entries(directory, offset, -(int)(chunk->length + chunk->padding + 8));
+    remove_chunk(stream, index);
+    update_sizes(stream);
+    return result;
+}
+
+// A function for removing the oldest hidden file within a streamed wav file.
+// Returns -1 if there is an error.
+int stream_pop_front_file(stream_file* stream, char* extracted_file_name) {
+
+    // Take the directory from the end of the file, return -1 on error.
+    file_directory* directory = take_directory(stream);
+    if (directory == NULL) {
+        return -1;
+    }
+
+    // Locate the first hidden file, return -1 if none exist.
+    int index = 0;
+    while (index < stream->num_chunks && (stream->chunks[index].raw || !is_embedded_chunk(stream->chunks[index].id))) {
+        ++index;
+    }
+    if (index == stream->num_chunks) {
+        print_message("There are no embedded files.\n\n");
+        store_directory(stream, directory);
+        return -1;
+    }
+
+    int result = remove_file_chunk(stream, directory, index, extracted_file_name);
+    return store_directory(stream, directory) == -1 ? -1 : result;
+}
+
+// A function for listing the embedded files recorded in the directory of a streamed wav file. Only the directory
+// is read.
+// Returns -1 if there is an error.
+int stream_list_files(stream_file* stream) {
+    file_directory* directory = read_directory(stream);
+    if (directory == NULL) {
+        return -1;
+    }
+    print_directory(directory);
+    free_directory(directory);
+    return 0;
+}
+
+// A function for extracting the oldest embedded file with a name from a streamed wav file to a file with that name.
+// Only the directory and the embedded file are read.
+// Returns -1 if there is an error.
+int stream_extract_file(stream_file* stream, char* name) {
+
+    // Look the name up in the directory, return -1 if it is not there.
+    file_directory* directory = read_directory(stream);
+    if (directory == NULL) {
+        return -1;
+    }
+    int entry_index = find_entry(directory, name);
+    int chunk_index = entry_index != -1 ? find_entry_chunk(stream, directory->entries + entry_index) : -1;
+    if (chunk_index == -1) {
+        if (entry_index == -1) {
+            print_message("There is no embedded file named %s.\n\n", name);
+        }
+        free_directory(directory);
+        return -1;
+    }
+
+    // Copy the embedded file to disk, decompressing it if it was compressed and checking its checksum,
+    // return -1 on error.
+    int result = -1;
+    stream_chunk* chunk = stream->chunks + chunk_index;
+    file_range range = { chunk->fd, chunk->offset };
+    char* buffer = !memcmp(chunk->id, "zfil", 4) ? NULL : stream->block != NULL ? stream->block : malloc(stream->block_size * sizeof(char));
+    if (!memcmp(chunk->id, "zfil", 4)) {
+        result = extract_compressed_entry(directory->entries + entry_index, read_file_payload, &range);
+    } else if (buffer == NULL) {
+        print_message("Error allocating memory for output block.\n\n");
+    } else {
+        result = extract_entry(directory->entries + entry_index, chunk->fd, chunk->offset, buffer, stream->block_size);
+        if (buffer != stream->block) {
+            free(buffer);
+        }
+    }
+    free_directory(directory);
+    return result;
+}
+
+// A function for deleting the oldest embedded file with a name from a streamed wav file.
+// Returns -1 if there is an error.
+int stream_delete_file(stream_file* stream, char* name) {
+
+    // Take the directory from the end of the file, return -1 on error.
+    file_directory* directory = take_directory(stream);
+    if (directory == NULL) {
+        return -1;
+    }
+
+    // Look the name up in the directory and remove its chunk.
+    int result = -1;
+    int entry_index = find_entry(directory, name);
+    int chunk_index = entry_index != -1 ? find_entry_chunk(stream, directory->entries + entry_index) : -1;
+    if (entry_index == -1) {
+        print_message("There is no embedded file named %s.\n\n", name);
+    } else if (chunk_index != -1) {
+        result = remove_file_chunk(stream, directory, chunk_index, NULL);
+    }
+    return store_directory(stream, directory) == -1 ? -1 : result;
+}
+
+// A function for time-stretching the audio in a streamed wav file by a given factor, either keeping the pitch
+// or interpolating between frames.
+// Returns -1 if there is an error.
+int stream_stretch_audio(stream_file* stream, double time_multiplier, int interpolation, int method) {
+
+    // Calculate the new audio data size.
+    int frame_size = stream->wav.all_channel_sample_size_in_bytes;
+    off_t new_data_size = (off_t)(stream->wav.data_size * fabs(time_multiplier));
+    new_data_size -= new_data_size % frame_size;
+
+    // Add a pitch-preserving stretch stage, a resample stage when interpolating, or a stretch stage to the
+    // audio pipeline, return -1 on error.
+    wsola* wsola = new_stretch_wsola(&stream->wav, new_data_size / frame_size, time_multiplier, method);
+    wsola_workspace* workspace = wsola != NULL ? new_wsola_workspace(wsola) : NULL;
+    resampler* resampler = wsola == NULL ? new_stretch_resampler(&stream->wav, time_multiplier, interpolation) : NULL;
+    int type = wsola != NULL ? STAGE_WSOLA : resampler != NULL ? STAGE_RESAMPLE : STAGE_STRETCH;
+    stream_stage* stage = (wsola == NULL || workspace != NULL)
+                              ? new_stage(type, stream->audio, new_data_size / frame_size, frame_size, stream->block_size)
+                              : NULL;
+    if (stage == NULL) {
+        if (resampler != NULL) {
+            free_resampler(resampler);
+        }
+        if (wsola != NULL) {
+            free_wsola(wsola);
+        }
+        if (workspace != NULL) {
+            free_wsola_workspace(workspace);
+        }
+        return -1;
+    }
+    stage->wsola = wsola;
+    stage->workspace = workspace;
+    stage->time_multiplier = fabs(time_multiplier);
+    stage->resampler = resampler;
+    stream->audio = stage;
+    stream->tail_size = 0;
+    stream->wav.data_size = new_data_size;
+    update_sizes(stream);
+
+    // Reverse the audio data if stretching by a negative factor.
+    if (time_multiplier < 0) {
+        return stream_reverse_audio(stream);
+    }
+    return 0;
+}
+
+// A function for analyzing the audio of a streamed wav file, adding an analyze stage to its pipeline so the frames
+// are analyzed as they are read to write the file, without reading them again. The analysis is reported, with a
+// sidecar file unless file_name is NULL, once the file is written.
+// Returns -1 if there is an error.
+int stream_analyze_audio(stream_file* stream, char* file_name) {
+    audio_analysis* analysis = new_wave_analysis(&stream->wav);
+    char* name = analysis != NULL && file_name != NULL ? strdup(file_name) : NULL;
+    if (analysis != NULL && file_name != NULL && name == NULL) {
+        print_message("Error allocating memory for file name.\n\n");
+    }
+    stream_stage* stage = analysis != NULL && (file_name == NULL || name != NULL)
+                              ? new_stage(STAGE_ANALYZE, stream->audio, stream->audio->num_frames,
+                                          stream->audio->frame_size, stream->block_size)
+                              : NULL;
+    if (stage == NULL) {
+        if (analysis != NULL) {
+            free_audio_analysis(analysis);
+        }
+        free(name);
+        return -1;
+    }
+    stage->analysis = analysis;
+    stage->analysis_file_name = name;
+    stream->audio = stage;
+    return 0;
+}
+
+// A function for keeping only the frames [first, first + count) of the audio of a streamed wav file, adding a trim
+// stage to its pipeline so only those frames are read.
+// Returns -1 if there is an error.
+int stream_trim_audio(stream_file* stream, size_t first, size_t count) {
+    stream_stage* stage = new_stage(STAGE_TRIM, stream->audio, count, stream->audio->frame_size, stream->block_size);
+    if (stage == NULL) {
+        return -1;
+    }
+    stage->first_frame = first;
+    stream->audio = stage;
+    stream->tail_size = 0;
+    stream->wav.data_size = (off_t)count * stage->frame_size;
+    update_sizes(stream);
+    return 0;
+}
+
+// A function for appending the audio of another wav file to the audio of a streamed wav file. Only the chunk headers
+// of the other file are read, and its audio data is read from it, or copied as a range when it is unchanged, when
+// the file is written. Only whole frames are kept, and its chunks other than its audio data are left out.
+// Returns -1 if there is an error.
+int stream_concat_audio(stream_file* stream, char* file_name) {
+    stream_file* other = stream_open(file_name, stream->block_size);
+    if (other == NULL) {
+        return -1;
+    }
+    stream_stage* stage = check_audio_format(&stream->wav, &other->wav, file_name) != -1
+                              ? new_stage(STAGE_CONCAT, stream->audio, stream->audio->num_frames + other->audio->num_frames,
+                                          stream->audio->frame_size, stream->block_size)
+                              : NULL;
+    if (stage == NULL) {
+        stream_close(other);
+        return -1;
+    }
+
+    // Take the source stage of the other file, which closes the file when it is freed.
+    stage->appended = other->audio;
+    stage->appended->owns_fd = 1;
+    other->audio = NULL;
+    other->source_fd = -1;
+    stream_close(other);
+
+    stream->audio = stage;
+    stream->tail_size = 0;
+    stream->wav.data_size = (off_t)stage->num_frames * stage->frame_size;
+    update_sizes(stream);
+    return 0;
+}
+
+// A function for reversing the audio data in a streamed wav file.
+// Returns -1 if there is an error.
+int stream_reverse_audio(stream_file* stream) {
+    stream_stage* stage = new_stage(STAGE_REVERSE, stream->audio, stream->audio->num_frames, stream->audio->frame_size,
+                                    stream->block_size);
+    if (stage == NULL) {
+        return -1;
+    }
+    stream->audio = stage;
+    return 0;
+}
+
+// A function for giving a streamed wav file whose samples are floats the chunks its format tag needs: a "fmt "
+// chunk with an empty extension instead of a 16-char one, and a "fact" chunk after it when the file has none.
+// Both are written after the first chars of the "fmt " chunk.
+static void add_float_chunks(stream_file* stream) {
+    char* format_end = stream->format + stream->format_read;
+    if (stream->format_read == 24 && stream->format_length == 24 && *(uint32_t*)(stream->format + 4) == 16) {
+        memmove(format_end + 2, format_end, stream->format_written - stream->format_read);
+        memset(format_end, 0, 2);
+        *(uint32_t*)(stream->format + 4) = 18;
+        stream->wav.format_size = 18;
+        stream->format_written += 2;
+        stream->fact_written += stream->fact_written > 0 ? 2 : 0;
+    }
+    if (stream->fact_offset == 0 && stream->fact_written == 0) {
+        write_fact_chunk(&stream->wav, stream->format + stream->format_written);
+        stream->fact_written = stream->format_written;
+        stream->format_written += FACT_CHUNK_LENGTH;
+    }
+}
+
+// A function for converting the samples of a streamed wav file to an encoding and channel mix, or to the same
+// channels when mix is NULL. Samples converted to floats get the "fmt " and "fact" chunks of their format tag.
+// Returns -1 if there is an error.
+int stream_convert_audio(stream_file* stream, int encoding, channel_mix* mix, int dither) {
+    converter* converter = new_format_converter(&stream->wav, encoding, mix, dither);
+    if (converter == NULL) {
+        return -1;
+    }
+
+    // Add a convert stage to the audio pipeline, return -1 on error.
+    stream_stage* stage = new_stage(STAGE_CONVERT, stream->audio, stream->audio->num_frames, converter->frame_size,
+                                    stream->block_size);
+    if (stage == NULL) {
+        free_converter(converter);
+        return -1;
+    }
+    stage->converter = converter;
+    stream->audio = stage;
+    stream->tail_size = 0;
+
+    // Write the new sample format into the "fmt " chunk.
+    update_format(&stream->wav, stream->format, stream->format_read, converter->encoding, converter->num_channels,
+                  stream->wav.sample_rate);
+    if (is_float_encoding(converter->encoding)) {
+        add_float_chunks(stream);
+    }
+    stream->wav.data_size = (off_t)stage->num_frames * stage->frame_size;
+    update_sizes(stream);
+    return 0;
+}
+
+// A function for converting the audio of a streamed wav file to a sample rate, resampling it with the
+// polyphase windowed sinc kernel of the resampler.
+// Returns -1 if there is an error.
+int stream_resample_audio(stream_file* stream, int sample_rate) {
+    double time_multiplier = sample_rate_multiplier(&stream->wav, sample_rate);
+    if (time_multiplier == 0 || stream_stretch_audio(stream, time_multiplier, INTERPOLATION_SINC, STRETCH_RESAMPLE) == -1) {
+        return -1;
+    }
+    update_format(&stream->wav, stream->format, stream->format_read, stream->wav.encoding, stream->wav.num_channels,
+                  sample_rate);
+    return 0;
+}
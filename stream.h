@@ -0,0 +1,184 @@
+#ifndef H_STREAM
+#define H_STREAM
+
+#include "wav.h"
+
+// Default size in bytes of the blocks read and written by the streaming pipeline.
+#define STREAM_DEFAULT_BLOCK_SIZE (1 << 20)
+
+// Types of stage in the streaming audio pipeline.
+enum stage_type { STAGE_SOURCE, STAGE_STRETCH, STAGE_REVERSE, STAGE_RESAMPLE, STAGE_WSOLA, STAGE_CONVERT, STAGE_ANALYZE,
+                  STAGE_TRIM, STAGE_CONCAT };
+
+// A stage of the streaming audio pipeline. Each stage produces its frames on demand
+// by reading the frames it needs from its input stage into a block-sized scratch buffer.
+typedef struct stream_stage {
+    int type;
+    struct stream_stage* input;
+    size_t num_frames;
+    int frame_size;
+
+    // stretch stage
+    double time_multiplier;
+
+    // resample stage
+    resampler* resampler;
+    float* samples;
+    size_t sample_capacity;
+
+    // pitch-preserving stretch stage
+    wsola* wsola;
+    wsola_workspace* workspace;
+
+    // convert stage, which also uses the decoded sample buffer of a resample stage
+    converter* converter;
+
+    // analyze stage, which passes its input's frames through and analyzes those read in order, until the analysis is
+    // reported when the file is written and freed
+    audio_analysis* analysis;
+    char* analysis_file_name;
+
+    // trim stage, whose frames are those of its input from first_frame on
+    size_t first_frame;
+
+    // concatenation stage, whose frames are those of its input followed by those of the appended stage
+    struct stream_stage* appended;
+
+    // source stage, with the checksums of the source audio data calculated as it is read in order, or NULL
+    int fd;
+    off_t offset;
+    checksum_feed* feed;
+    int owns_fd; // the stage reads the audio of an appended file, whose fd is closed with it
+
+    // frames read from the input stage
+    char* scratch;
+    size_t scratch_frames;
+} stream_stage;
+
+// A chunk following the audio data of a streamed wav file. The chunk's payload is
+// read from a range of a file when the output is written.
+typedef struct stream_chunk {
+    char id[4];
+    off_t size;
+    int fd;
+    off_t offset;
+    size_t length; // chars copied from fd, including any pad byte
+    int padding; // zero chars written after the range
+    int raw; // the range is copied as is, without a chunk header
+    int owns_fd;
+    char* data; // payload held in memory and written instead of the range, or NULL
+} stream_chunk;
+
+// A struct describing a wav file being processed in fixed-size blocks. Operations
+// only update the description; audio data is read, transformed and written when
+// the file is written.
+typedef struct stream_file {
+
+    // header information of the current file
+    wav_file wav;
+
+    // source file
+    int source_fd;
+    off_t source_size;
+
+    // payload size of the source's "ds64" chunk, whose table is copied after the new sizes, or 0 if it has none
+    size_t ds64_size;
+
+    // chunks between the RIFF header and the data chunk, copied from the source
+    off_t head_offset;
+    size_t head_size;
+    off_t format_offset;
+    off_t format_length; // the "fmt " chunk, including its header and pad byte
+
+    // the first chars of the "fmt " chunk, written instead of the source's chars so the format can change, followed
+    // by the chars written after the "fmt " chunk: the extension and "fact" chunk added for float samples and the
+    // "fact" chunk kept when the metadata is removed
+    char format[FORMAT_READ_SIZE + 2 + FACT_CHUNK_LENGTH];
+    size_t format_read;
+    size_t format_written;
+    size_t fact_written; // position of the "fact" chunk in format, or 0 if it holds none
+
+    // the source's "fact" chunk before the data chunk, whose frame count is updated when it is copied, or 0 if it
+    // has none
+    off_t fact_offset;
+
+    // audio data, followed by any partial frame left at the end of the source data
+    stream_stage* audio;
+    off_t tail_offset;
+    size_t tail_size;
+
+    // chunks after the data chunk
+    stream_chunk* chunks;
+    int num_chunks;
+    int chunk_capacity;
+
+    size_t block_size;
+
+    // checksums from the checksum chunk of the source, or NULL, which the source is checked against the next time
+    // the file is written when verify is set
+    checksum_list* checksums;
+    int verify;
+
+    // buffer of block_size chars lent by the caller to reuse across files, or NULL to allocate one per write
+    char* block;
+} stream_file;
+
+// A function for opening a wav file for streaming. Only the chunk headers are read.
+stream_file* stream_open(char* file_name, size_t block_size);
+
+// A function for closing a streamed wav file and freeing its resources.
+void stream_close(stream_file* stream);
+
+// A function for writing a streamed wav file to disk one block at a time.
+int stream_write(stream_file* stream, char* file_name);
+
+// A function for writing the frames [first, first + count) of a streamed wav file to disk as a file of their own.
+int stream_write_range(stream_file* stream, char* file_name, size_t first, size_t count);
+
+// A function for writing the files of a streamed wav file with a checksum chunk, and for checking its source
+// against its checksum chunk while it is written.
+int stream_use_checksums(stream_file* stream, int write_checksums, int verify);
+
+// A function for removing the metadata from a streamed wav file.
+int stream_remove_metadata(stream_file* stream);
+
+// A function for embedding a hidden file within a streamed wav file, compressed or as is, and recording it in
+// the directory.
+int stream_push_back_file(stream_file* stream, char* embedded_filename, int compression);
+
+// A function for removing the oldest hidden file within a streamed wav file.
+int stream_pop_front_file(stream_file* stream, char* extracted_file_name);
+
+// A function for listing the embedded files recorded in the directory of a streamed wav file.
+int stream_list_files(stream_file* stream);
+
+// A function for extracting the oldest embedded file with a name from a streamed wav file to a file with that name.
+int stream_extract_file(stream_file* stream, char* name);
+
+// A function for deleting the oldest embedded file with a name from a streamed wav file.
+int stream_delete_file(stream_file* stream, char* name);
+
+// A function for time-stretching the audio in a streamed wav file by a given factor, either keeping the pitch
+// or interpolating between frames.
+int stream_stretch_audio(stream_file* stream, double time_multiplier, int interpolation, int method);
+
+// A function for analyzing the audio of a streamed wav file as it is read to write the file, and reporting the
+// analysis, with a sidecar file unless file_name is NULL, once the file is written.
+int stream_analyze_audio(stream_file* stream, char* file_name);
+
+// A function for keeping only the frames [first, first + count) of the audio of a streamed wav file.
+int stream_trim_audio(stream_file* stream, size_t first, size_t count);
+
+// A function for appending the audio of another wav file to the audio of a streamed wav file.
+int stream_concat_audio(stream_file* stream, char* file_name);
+
+// A function for reversing the audio data in a streamed wav file.
+int stream_reverse_audio(stream_file* stream);
+
+// A function for converting the samples of a streamed wav file to an encoding and channel mix.
+int stream_convert_audio(stream_file* stream, int encoding, channel_mix* mix, int dither);
+
+// A function for converting the audio of a streamed wav file to a sample rate.
+int stream_resample_audio(stream_file* stream, int sample_rate);
+
+#endif
@@ -3,7 +3,7 @@
 // A function for locating the position of a sequence of chars within a char array.
 // Returns -1 if the subsequence cannot be found.
 int find_subsequence_position(char* contents, int search_length, char* search_string, int search_string_length) {
-    for (int i = 0; i < search_length - search_string_length; ++i) {
+    for (int i = 0; i <= search_length - search_string_length; ++i) {
         int found_string = 1;
         for (int j = 0; j < search_string_length; ++j) {
             if (*(contents + i + j) != *(search_string + j)) {
@@ -18,50 +18,440 @@ int find_subsequence_position(char* contents, int search_length, char* search_st
     return -1;
 }
 
-// A function for reading a wav file and detecting errors.
-char* read_wav_file(char* file_name) {
+// A function for reading the RIFF header of a wav file from its first 44 chars. The sizes of an RF64 or BW64
+// file are read from the "ds64" chunk that must follow its RIFF header.
+// Returns -1 if the header is not the header of a wav file.
+int parse_riff_header(char* header, wav_file* wav) {
+    memcpy(wav->chunk_id, header, 4);
+    memcpy(wav->file_format, header + 8, 4);
+    wav->rf64 = !memcmp(header, "RF64", 4) || !memcmp(header, "BW64", 4);
+    wav->chunk_size = *(uint32_t*)(header + 4);
+    wav->ds64_data_size = 0;
+
+    // Return -1 if the file is not a valid wav file
+    if ((memcmp(header, "RIFF", 4) && !wav->rf64) || memcmp(header + 8, "WAVE", 4)) {
+        print_message("Error - Not a WAVE file.\n");
+        return -1;
+    }
+
+    // Return -1 if an RF64 file does not start with a "ds64" chunk
+    if (wav->rf64) {
+        if (memcmp(header + 12, "ds64", 4) || *(uint32_t*)(header + 16) < 24) {
+            print_message("File Corrupted. No \"ds64\" section.\n");
+            return -1;
+        }
+        wav->chunk_size = *(int64_t*)(header + 20);
+        wav->ds64_data_size = *(int64_t*)(header + 28);
+    }
+    return 0;
+}
+
+// A function for reading the payload size from a chunk header. The data chunk of an RF64 or BW64 file holds
+// RF64_SIZE_MARKER, and its size is read from the "ds64" chunk instead.
+off_t chunk_header_size(wav_file* wav, char* header) {
+    uint32_t size = *(uint32_t*)(header + 4);
+    if (wav->rf64 && size == RF64_SIZE_MARKER && !memcmp(header, "data", 4)) {
+        return wav->ds64_data_size;
+    }
+    return size;
+}
+
+// A function for reading a "fmt " chunk into a wav_file, given its first length chars. Fields past the end of a
+// short chunk are zero, and the encoding of an extensible chunk comes from the format tag of its sub-format.
+void parse_format(wav_file* wav, char* chunk, off_t length) {
+    memset(wav->format_id, 0, 24);
+    memcpy(wav->format_id, chunk, length < 24 ? length : 24);
+    int format_tag = (unsigned short)wav->format_type;
+    if (format_tag == WAVE_FORMAT_EXTENSIBLE && wav->format_size >= 40 && length >= 34) {
+        format_tag = *(unsigned short*)(chunk + 32);
+    }
+    wav->encoding = sample_encoding(format_tag, wav->bits_per_sample);
+}
+
+// A function for changing the sample format of a wav file and writing it into its "fmt " chunk, given the
+// chunk's first length chars. The format tag of an extensible chunk is kept and its sub-format and valid
+// bits are changed instead, and its speaker positions are cleared when the number of channels changes.
+void update_format(wav_file* wav, char* chunk, off_t length, int encoding, int num_channels, int sample_rate) {
+    int extensible = (unsigned short)wav->format_type == WAVE_FORMAT_EXTENSIBLE && wav->format_size >= 40 && length >= 34;
+    int new_encoding = encoding != wav->encoding;
+    int new_channels = num_channels != wav->num_channels;
+    if (new_encoding) {
+        int format_tag = is_float_encoding(encoding) ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+        wav->format_type = extensible ? wav->format_type : format_tag;
+        wav->bits_per_sample = 8 * encoding_size(encoding);
+        wav->encoding = encoding;
+        if (extensible) {
+            *(uint16_t*)(chunk + 26) = wav->bits_per_sample;
+            *(uint16_t*)(chunk + 32) = format_tag;
+        }
+    }
+    if (new_channels && extensible) {
+        *(uint32_t*)(chunk + 28) = 0;
+    }
+    if (new_encoding || new_channels) {
+        wav->block_alignment = num_channels * (wav->bits_per_sample / 8);
+    }
+    wav->num_channels = num_channels;
+    wav->sample_rate = sample_rate;
+    wav->byte_rate = sample_rate * wav->block_alignment;
+    wav->all_channel_sample_size_in_bytes = num_channels * (wav->bits_per_sample / 8);
+
+    // Write the fields from the format tag to the bits per sample, as far as the chunk holds them.
+    if (length > 8) {
+        memcpy(chunk + 8, &wav->format_type, length < 24 ? length - 8 : 16);
+    }
+}
+
+// A function for determining whether a wav file's sizes need an RF64 header and a "ds64" chunk. Files that
+// already have a "ds64" chunk keep it.
+int needs_rf64(wav_file* wav) {
+    return wav->rf64 || wav->chunk_size >= RF64_SIZE_MARKER || wav->data_size >= RF64_SIZE_MARKER;
+}
+
+// A function for writing the 12 chars of the RIFF header of a wav file. Files that need a "ds64" chunk get an
+// RF64 header, unless they are BW64 files.
+void write_riff_header(wav_file* wav, char* destination) {
+    int rf64 = needs_rf64(wav);
+    memcpy(destination, !rf64 ? "RIFF" : !memcmp(wav->chunk_id, "BW64", 4) ? "BW64" : "RF64", 4);
+    *(uint32_t*)(destination + 4) = rf64 ? RF64_SIZE_MARKER : wav->chunk_size;
+    memcpy(destination + 8, "WAVE", 4);
+}
+
+// A function for writing the RIFF size, the data size and the sample count of a wav file into the payload of
+// its "ds64" chunk. Any table that follows them is left as it is.
+void write_ds64_sizes(wav_file* wav, char* payload) {
+    *(int64_t*)payload = wav->chunk_size;
+    *(int64_t*)(payload + 8) = wav->data_size;
+    *(int64_t*)(payload + 16) = wav->num_all_channel_samples;
+}
+
+// A function for writing a "ds64" chunk without a table for a wav file.
+void write_ds64_chunk(wav_file* wav, char* destination) {
+    memcpy(destination, "ds64", 4);
+    *(uint32_t*)(destination + 4) = DS64_SIZE;
+    write_ds64_sizes(wav, destination + 8);
+    *(int*)(destination + 8 + DS64_SIZE - 4) = 0;
+}
+
+// A function for detecting errors in the contents of a wav file of a given size.
+// Returns -1 if the contents are not a valid wav file.
+static int check_wav_file(char* contents, size_t size) {
+
+    // Return -1 If the file is not at least the minimum wav file size
+    if (size < 44) {
+        print_message("Error - Not a WAVE file.\n");
+        return -1;
+    }
+
+    // Return -1 if the file is not a valid wav file
+    wav_file header;
+    if (parse_riff_header(contents, &header) == -1) {
+        return -1;
+    }
+
+    // Return -1 if the RIFF chunk size is incorrect
+    if ((off_t)size != header.chunk_size + 8) {
+        print_message("File Corrupted. Incorrect chunk size.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// A function for reading a wav file and detecting errors, storing its size in size.
+char* read_wav_file(char* file_name, size_t* size) {
 
     char* file_in;
-    int bytes_read = read_file(file_name, &file_in);
+    size_t bytes_read = read_file(file_name, &file_in);
 
     // Return NULL If there was an error reading the file
-    if (bytes_read == -1) {
+    if (bytes_read == (size_t)-1) {
         return NULL;
     }
 
-    // Return NULL If the file is not at least the minimum wav file size
-    if (bytes_read < 44) {
-        printf("Error - Not a WAVE file.\n");
+    // Return NULL if the file is not a valid wav file
+    if (check_wav_file(file_in, bytes_read) == -1) {
+        free_file(file_in);
         return NULL;
     }
 
-    // Return NULL if the file is not a valid wav file
-    if (find_subsequence_position(file_in, 4, "RIFF", 4) != 0 ||
-            find_subsequence_position(file_in, 12, "WAVE", 4) != 8) {
-        printf("Error - Not a WAVE file.\n");
-        return NULL;
+    *size = bytes_read;
+    return file_in;
+}
+
+// A function for determining whether a chunk's payload is followed by a pad byte, given the
+// chars that follow the payload. Odd-sized chunks are padded to an even size, but chunks
+// written without a pad byte are recognized when a chunk id follows the payload directly.
+int chunk_padding(off_t size, char* following, int following_length) {
+    if (size % 2 == 0 || following_length == 0 || following[0] == 0) {
+        return size % 2 != 0 && following_length > 0;
+    }
+    if (following_length < 4) {
+        return 1;
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (following[i] < ' ' || following[i] > '~') {
+            return 1;
+        }
     }
+    return 0;
+}
 
-    // Return NULL if the RIFF chunk size is incorrect
-    if (bytes_read != *(int*)(file_in + 4) + 8) {
-        printf("File Corrupted. Incorrect chunk size.\n");
-        return NULL;
+// A function for adding a chunk to the end of a wav_file's chunk index.
+// Returns -1 if there is an error.
+int add_wav_chunk(wav_file* wav, char* id, off_t position, off_t size) {
+    if (wav->num_chunks == wav->chunk_capacity) {
+        int capacity = wav->chunk_capacity > 0 ? wav->chunk_capacity * 2 : 8;
+        wav_chunk* chunks = realloc(wav->chunks, capacity * sizeof(wav_chunk));
+        if (chunks == NULL) {
+            print_message("Error allocating memory for chunk index.\n\n");
+            return -1;
+        }
+        wav->chunks = chunks;
+        wav->chunk_capacity = capacity;
     }
+    wav_chunk* chunk = wav->chunks + wav->num_chunks++;
+    memcpy(chunk->id, id, 4);
+    chunk->position = position;
+    chunk->size = size;
+    return 0;
+}
 
-    return file_in;
+// A function for removing a chunk from a wav_file's chunk index.
+static void remove_chunk(wav_file* wav, int index) {
+    memmove(wav->chunks + index, wav->chunks + index + 1, (wav->num_chunks - index - 1) * sizeof(wav_chunk));
+    --wav->num_chunks;
+}
+
+// A function for moving the chunks from a given index onwards by a number of chars.
+static void shift_chunks(wav_file* wav, int index, off_t offset) {
+    for (int i = index; i < wav->num_chunks; ++i) {
+        wav->chunks[i].position += offset;
+    }
+}
+
+// A function for calculating the number of chars a chunk occupies, including its header and pad byte.
+static off_t chunk_length(wav_file* wav, int index) {
+    off_t end = index + 1 < wav->num_chunks ? wav->chunks[index + 1].position : wav->file_size;
+    return end - wav->chunks[index].position;
+}
+
+// A function for calculating the number of chars audio data of a given size occupies in its chunk, which pads an
+// odd size with a zero char.
+static off_t padded_size(off_t size) {
+    return size + size % 2;
+}
+
+// A function for finding the "fact" chunk before the data chunk of a wav file, which holds the number of frames of
+// a file whose samples are not PCM and is kept with the "fmt " chunk when the metadata is removed. A "fact" chunk
+// too small to hold the frame count is treated as metadata.
+// Returns the chunk's index or -1 if there is none.
+static int find_fact_chunk(wav_file* wav) {
+    int index = find_chunk(wav, "fact", 0);
+    return index != -1 && wav->chunks[index].position < wav->data_position && wav->chunks[index].size >= 4 ? index : -1;
+}
+
+// A function for calculating the number of chars the "fact" chunk of a wav file occupies once the metadata is
+// removed, which only keeps its frame count, or 0 if it has none.
+static off_t fact_length(wav_file* wav) {
+    return find_fact_chunk(wav) != -1 ? FACT_CHUNK_LENGTH : 0;
+}
+
+// A function for copying the header and frame count of the "fact" chunk of a wav file, if it has one.
+static void copy_fact_chunk(wav_file* wav, char* contents, char* destination) {
+    int index = find_fact_chunk(wav);
+    if (index != -1) {
+        memcpy(destination, contents + wav->chunks[index].position, FACT_CHUNK_LENGTH);
+        *(uint32_t*)(destination + 4) = 4;
+    }
+}
+
+// A function for calculating the frame count held in the "fact" chunk of a wav file, which is RF64_SIZE_MARKER
+// when the count does not fit.
+uint32_t fact_frame_count(wav_file* wav) {
+    return wav->num_all_channel_samples < RF64_SIZE_MARKER ? wav->num_all_channel_samples : RF64_SIZE_MARKER;
+}
+
+// A function for writing a "fact" chunk holding the frame count of a wav file.
+void write_fact_chunk(wav_file* wav, char* destination) {
+    memcpy(destination, "fact", 4);
+    *(uint32_t*)(destination + 4) = 4;
+    *(uint32_t*)(destination + 8) = fact_frame_count(wav);
+}
+
+// A function for calculating the RIFF chunk size of a wav file with only its "ds64", "fmt ", "fact" and "data"
+// chunks.
+static off_t metadata_free_chunk_size(wav_file* wav) {
+    off_t head_size = 12 + (wav->rf64 ? chunk_length(wav, 0) : 0);
+    return head_size + chunk_length(wav, find_chunk(wav, "fmt ", 0)) + fact_length(wav) + padded_size(wav->data_size);
+}
+
+// A function for calculating the number of chars of the checksum chunk written after a wav file, which holds the
+// checksums of its audio data and of the embedded files that are written with it.
+static off_t checksum_chunk_length(wav_file* wav) {
+    if (!wav->write_checksums) {
+        return 0;
+    }
+    int num_ranges = 1;
+    size_t num_blocks = checksum_block_count(wav->data_size, CHECKSUM_BLOCK_SIZE);
+    for (int i = 0; i < wav->num_chunks && !wav->strip_metadata; ++i) {
+        if (wav->chunks[i].position >= wav->data_end_position && is_embedded_chunk(wav->chunks[i].id)) {
+            ++num_ranges;
+            num_blocks += checksum_block_count(wav->chunks[i].size, CHECKSUM_BLOCK_SIZE);
+        }
+    }
+    return 8 + checksum_payload_size(num_ranges, num_blocks);
+}
+
+// A function for calculating the RIFF chunk size of a wav file as it is written to disk, which leaves out the
+// metadata when its removal was left to the writer and adds any checksum chunk.
+static off_t written_chunk_size(wav_file* wav) {
+    return (wav->strip_metadata ? metadata_free_chunk_size(wav) : wav->chunk_size) + checksum_chunk_length(wav);
+}
+
+// A function for finding the first chunk with a given id at or after a position.
+// Returns the chunk's index or -1 if there is no such chunk.
+int find_chunk(wav_file* wav, char* id, off_t position) {
+    for (int i = 0; i < wav->num_chunks; ++i) {
+        if (wav->chunks[i].position >= position && !memcmp(wav->chunks[i].id, id, 4)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// A function for building a wav_file's chunk index by walking the chunk headers that follow
+// the RIFF header. A chunk that runs past the end of the file ends the walk, and parse_contents rejects the file.
+// Returns -1 if there is an error.
+static int index_chunks(char* contents, wav_file* wav) {
+    wav->num_chunks = 0;
+    off_t position = 12;
+    while (position <= wav->file_size - 8) {
+        off_t size = chunk_header_size(wav, contents + position);
+        if (add_wav_chunk(wav, contents + position, position, size) == -1) {
+            return -1;
+        }
+        if (size < 0 || size > wav->file_size - position - 8) {
+            break;
+        }
+        off_t payload_end = position + 8 + size;
+        position = payload_end + chunk_padding(size, contents + payload_end, wav->file_size - payload_end);
+    }
+    return 0;
+}
+
+// A function for writing the sizes of a wav file held in memory into its RIFF header, its "ds64" chunk and its
+// data chunk header, and its frame count into any "fact" chunk when the frames of its encoding are known. A file
+// that needs a "ds64" chunk but has none gets one when it is written to disk.
+static void write_sizes(wav_file* wav, char* contents) {
+    write_riff_header(wav, contents);
+    if (wav->rf64) {
+        write_ds64_sizes(wav, contents + 20);
+    }
+    *(uint32_t*)(contents + wav->data_position + 4) = needs_rf64(wav) ? RF64_SIZE_MARKER : wav->data_size;
+    int fact_index = wav->encoding != SAMPLE_UNSUPPORTED ? find_fact_chunk(wav) : -1;
+    if (fact_index != -1) {
+        *(uint32_t*)(contents + wav->chunks[fact_index].position + 8) = fact_frame_count(wav);
+    }
+}
+
+// A function for recalculating the positions and metrics of a wav file from its chunk index, and writing its
+// sizes into its headers. The data chunk ends after the pad byte of odd-sized audio data, if the file has one.
+static void update_positions(wav_file* wav, char* contents) {
+    wav->file_size = wav->chunk_size + 8;
+    wav->format_position = wav->chunks[find_chunk(wav, "fmt ", 0)].position;
+    int data_index = find_chunk(wav, "data", 0);
+    wav->data_position = wav->chunks[data_index].position;
+    wav->data_pointer = contents + wav->data_position + 8;
+    wav->audio_data_position = wav->data_position + 8;
+    off_t next_position = data_index + 1 < wav->num_chunks ? wav->chunks[data_index + 1].position : wav->file_size;
+    wav->data_end_position = wav->audio_data_position + wav->data_size;
+    wav->data_end_position += wav->data_size % 2 != 0 && next_position > wav->data_end_position;
+    wav->bytes_after_data = wav->file_size - wav->data_end_position;
+    wav->all_channel_sample_size_in_bytes = wav->num_channels * wav->bits_per_sample / 8;
+    wav->num_all_channel_samples = wav->data_size / wav->all_channel_sample_size_in_bytes;
+    write_sizes(wav, contents);
 }
 
 // A function for printing information about a wav file to the user.
 void print_stats(wav_file* wav, char* filename) {
 
-    printf("*************************************************\n\n");
-    printf("File name:          %s\n", filename);
-    printf("File size:          %u bytes\n", wav->file_size);
-    printf("Channels:           %i\n", wav->num_channels);
-    printf("Sample rate:        %i Hz\n", wav->sample_rate);
-    printf("Bits per sample:    %i\n", wav->bits_per_sample);
-    printf("Audio data size:    %i bytes\n", wav->data_size);
-    printf("\n*************************************************\n\n");
+    print_message("*************************************************\n\n");
+    print_message("File name:          %s\n", filename);
+    wav_file written = *wav;
+    written.chunk_size = written_chunk_size(wav);
+    off_t ds64_length = needs_rf64(&written) && !wav->rf64 ? 8 + DS64_SIZE : 0; // added when the file is written
+    print_message("File size:          %lld bytes\n", (long long)(written.chunk_size + 8 + ds64_length));
+    print_message("Channels:           %i\n", wav->num_channels);
+    print_message("Sample rate:        %i Hz\n", wav->sample_rate);
+    print_message("Bits per sample:    %i\n", wav->bits_per_sample);
+    print_message("Sample format:      %s\n", wav->encoding == SAMPLE_UNSUPPORTED ? "other" : encoding_name(wav->encoding));
+    print_message("Audio data size:    %lld bytes\n", (long long)wav->data_size);
+    print_message("\n*************************************************\n\n");
+}
+
+// A function for parsing the contents of a wav file into a wav_file struct, reusing its chunk index.
+// Returns -1 if there is an error.
+static int parse_contents(char* contents, wav_file* parsed_file) {
+
+    // Read the RIFF header into the wav_file and index the chunks that follow it
+    if (parse_riff_header(contents, parsed_file) == -1) {
+        return -1;
+    }
+    parsed_file->file_size = parsed_file->chunk_size + 8;
+    parsed_file->strip_metadata = 0;
+    parsed_file->write_checksums = 0;
+    if (index_chunks(contents, parsed_file) == -1) {
+        return -1;
+    }
+
+    // Locate the "fmt " chunk. If there is no "fmt " chunk in the file, print
+    // an error message and return -1
+    int fmt_index = find_chunk(parsed_file, "fmt ", 0);
+    if (fmt_index == -1) {
+        print_message("Error - No \"fmt \" section.");
+        return -1;
+    }
+
+    // Read the "fmt " chunk into the wav_file
+    off_t format_position = parsed_file->chunks[fmt_index].position;
+    off_t format_length = parsed_file->file_size - format_position;
+    if (format_length > 8 + parsed_file->chunks[fmt_index].size) {
+        format_length = 8 + parsed_file->chunks[fmt_index].size;
+    }
+    parse_format(parsed_file, contents + format_position, format_length);
+
+    // Locate the "data" chunk. If there is no "data" chunk in the file, print
+    // an error message and return -1
+    int data_index = find_chunk(parsed_file, "data", 0);
+    if (data_index == -1) {
+        print_message("Error - No \"data\" section.");
+        return -1;
+    }
+
+    // Copy the "data" chunk header into the wav_file
+    memcpy(parsed_file->data_id, contents + parsed_file->chunks[data_index].position, 4);
+    parsed_file->data_size = parsed_file->chunks[data_index].size;
+
+    // Return -1 if the audio data does not fit in the file or the sample size is invalid
+    if (parsed_file->data_size < 0 || parsed_file->data_size > parsed_file->file_size - parsed_file->chunks[data_index].position - 8) {
+        print_message("File Corrupted. Incorrect data size.\n");
+        return -1;
+    }
+    if (parsed_file->num_channels * parsed_file->bits_per_sample / 8 <= 0) {
+        print_message("Error - Invalid sample size.\n");
+        return -1;
+    }
+
+    // Return -1 if the chunk that ended the walk runs past the end of the file, so no chunk is used beyond it
+    wav_chunk* last_chunk = parsed_file->chunks + parsed_file->num_chunks - 1;
+    if (last_chunk->size > parsed_file->file_size - last_chunk->position - 8) {
+        print_message("File Corrupted. Incorrect chunk size.\n");
+        return -1;
+    }
+
+    // Assign data pointer and file metrics
+    update_positions(parsed_file, contents);
+    return 0;
 }
 
 // A function for parsing a wav file and storing information about the file
@@ -69,261 +459,1161 @@ void print_stats(wav_file* wav, char* filename) {
 wav_file* parse(char* contents) {
 
     // Allocate memory for the wav_file
-    wav_file* parsed_file = malloc(sizeof(wav_file));
+    wav_file* parsed_file = calloc(1, sizeof(wav_file));
 
     // If malloc fails to allocate memory, print an error message and return NULL
     if (parsed_file == NULL) {
-        printf("Error allocating memory for wav_file.\n\n");
+        print_message("Error allocating memory for wav_file.\n\n");
         return NULL;
     }
 
-    // Copy the RIFF header into the wav_file
-    memcpy(parsed_file->chunk_id, contents, 12);
-
-    // Locate the "fmt " chunk. If there is no "fmt " chunk in the file, print
-    // an error message and return NULL
-    int fmt_position = find_subsequence_position(contents, parsed_file->chunk_size + 8, "fmt ", 4);
-    if (fmt_position == -1) {
-        printf("Error - No \"fmt \" section.");
+    // Parse the file, return NULL on error
+    if (parse_contents(contents, parsed_file) == -1) {
+        free_wav(parsed_file);
         return NULL;
     }
+    return parsed_file;
+}
 
-    // Copy the "fmt " chunk into the wav_file
-    memcpy(parsed_file->format_id, contents + fmt_position, 24);
+// A function for freeing a wav_file and its chunk index.
+void free_wav(wav_file* wav) {
+    free(wav->chunks);
+    free(wav);
+}
 
-    // Locate the "data" chunk. If there is no "data" chunk in the file, print
-    // an error message and return NULL
-    int data_position = find_subsequence_position(contents, parsed_file->chunk_size + 8, "data", 4);
-    if (data_position == -1) {
-        printf("Error - No \"data\" section.");
-        return NULL;
+// A function for making sure the spare buffer of a context holds at least size chars. The buffer only
+// grows, with room for a few more embedded files, so a chain of operations rarely allocates.
+// Returns the spare buffer or NULL if there is an error.
+static char* reserve_spare(wave_context* context, size_t size) {
+    if (size > context->spare_capacity) {
+        free_file(context->spare);
+        size_t capacity = size + size / 8;
+        context->spare = malloc(capacity * sizeof(char));
+        context->spare_capacity = context->spare != NULL ? capacity : 0;
+        if (context->spare == NULL) {
+            print_message("Error allocating memory for file.\n\n");
+            return NULL;
+        }
+        profile_allocation(capacity);
     }
+    return context->spare;
+}
 
-    // Copy the "data" chunk into the wav_file
-    memcpy(parsed_file->data_id, contents + data_position, 8);
+// A function for making the spare buffer of a context, which an operation has written, the current file.
+// The old file becomes the spare buffer.
+static void swap_buffers(wave_context* context) {
+    char* file = context->file;
+    size_t file_capacity = context->file_capacity;
+    context->file = context->spare;
+    context->file_capacity = context->spare_capacity;
+    context->spare = file;
+    context->spare_capacity = file_capacity;
+}
 
-    // Assign data pointer and file metrics
-    parsed_file->data_pointer = contents + data_position + 8;
-    parsed_file->file_size = parsed_file->chunk_size + 8;
-    parsed_file->format_position = fmt_position;
-    parsed_file->data_position = data_position;
-    parsed_file->audio_data_position = data_position + 8;
-    parsed_file->data_end_position = parsed_file->data_position + parsed_file->data_size;
-    parsed_file->bytes_after_data = parsed_file->file_size - parsed_file->data_end_position;
-    parsed_file->all_channel_sample_size_in_bytes = parsed_file->num_channels * parsed_file->bits_per_sample / 8;
-    parsed_file->num_all_channel_samples = parsed_file->data_size / parsed_file->all_channel_sample_size_in_bytes;
+// A function for creating an empty context for processing wav files in memory.
+// Returns NULL if there is an error.
+wave_context* new_wave_context() {
+    wave_context* new = calloc(1, sizeof(wave_context));
+    if (new == NULL) {
+        print_message("Error allocating memory for context.\n\n");
+    }
+    return new;
+}
 
-    return parsed_file;
+// A function for freeing a context and its buffers.
+void free_wave_context(wave_context* context) {
+    if (context->wav != NULL) {
+        free_wav(context->wav);
+    }
+    if (context->checksums != NULL) {
+        free_checksum_list(context->checksums);
+    }
+    free_file(context->file);
+    free_file(context->spare);
+    free(context);
+}
+
+// A function for taking the checksums from the checksum chunk at the end of the file held by a context and
+// removing the chunk from its index, so operations can append chunks. The chunk is written again with the file.
+// A damaged checksum chunk is dropped.
+static void take_checksums(wave_context* context) {
+    wav_file* wav = context->wav;
+    int index = wav->num_chunks - 1;
+    wav_chunk* chunk = wav->chunks + index;
+    if (memcmp(chunk->id, CHECKSUM_CHUNK_ID, 4) || chunk->position < wav->data_end_position ||
+            chunk->size > wav->file_size - chunk->position - 8) {
+        return;
+    }
+    context->checksums = parse_checksum_list(context->file + chunk->position + 8, chunk->size);
+    wav->write_checksums = context->checksums != NULL;
+    wav->chunk_size -= chunk_length(wav, index);
+    remove_chunk(wav, index);
+    update_positions(wav, context->file);
+}
+
+static void resize_data_chunk(wav_file* wav, off_t new_data_size, char* contents);
+
+// A function for adding the pad byte that odd-sized audio data needs to a file written without one, so the chunks
+// that follow are at even positions. The checksums of the chunks that follow move with them.
+// Returns -1 if there is an error.
+static int add_data_padding(wave_context* context) {
+    wav_file* wav = context->wav;
+    if (wav->data_end_position != wav->audio_data_position + wav->data_size || wav->data_size % 2 == 0) {
+        return 0;
+    }
+    char* file_out = reserve_spare(context, wav->file_size + 1);
+    if (file_out == NULL) {
+        return -1;
+    }
+    memcpy(file_out, context->file, wav->data_end_position);
+    memcpy(file_out + wav->data_end_position + 1, context->file + wav->data_end_position,
+           wav->file_size - wav->data_end_position);
+    for (int i = 0; context->checksums != NULL && i < context->checksums->num_ranges; ++i) {
+        context->checksums->ranges[i].position += context->checksums->ranges[i].position >= wav->data_end_position;
+    }
+    resize_data_chunk(wav, wav->data_size, file_out);
+    swap_buffers(context);
+    return 0;
+}
+
+// A function for reading a wav file into a context, replacing the file it holds. In stdio mode the file
+// is read into the spare buffer, so a context that is reused across files stops allocating once its
+// buffers fit the largest file.
+// Returns -1 if there is an error.
+int load_wave_file(wave_context* context, char* file_name) {
+    char* contents;
+    size_t size;
+    if (get_file_mode() == FILE_MODE_MMAP) {
+        // Mapped files are not copied, return -1 on error.
+        contents = read_wav_file(file_name, &size);
+        if (contents == NULL) {
+            return -1;
+        }
+    } else {
+        // Read the file into the spare buffer, return -1 on error.
+        off_t file_size;
+        int fd = open_file(file_name, &file_size);
+        if (fd == -1) {
+            return -1;
+        }
+        size = file_size;
+        contents = reserve_spare(context, size);
+        if (contents == NULL || read_file_range(fd, contents, size, 0) != (ssize_t)size) {
+            if (contents != NULL) {
+                print_message("The file %s cannot be read.\n\n", file_name);
+            }
+            close_file(fd);
+            return -1;
+        }
+        close_file(fd);
+        if (check_wav_file(contents, size) == -1) {
+            return -1;
+        }
+    }
+
+    // Parse the file into the context's wav_file, return -1 on error.
+    wav_file* wav = context->wav != NULL ? context->wav : calloc(1, sizeof(wav_file));
+    if (wav == NULL || parse_contents(contents, wav) == -1) {
+        if (wav == NULL) {
+            print_message("Error allocating memory for wav_file.\n\n");
+        } else if (context->wav == NULL) {
+            free_wav(wav);
+        }
+        if (contents != context->spare) {
+            free_file(contents);
+        }
+        return -1;
+    }
+    context->wav = wav;
+
+    // Make the new file the current one.
+    if (contents == context->spare) {
+        swap_buffers(context);
+    } else {
+        free_file(context->file);
+        context->file = contents;
+        context->file_capacity = size;
+    }
+    if (context->checksums != NULL) {
+        free_checksum_list(context->checksums);
+        context->checksums = NULL;
+    }
+    take_checksums(context);
+    return add_data_padding(context);
+}
+
+// A function for checking the audio data and embedded files of the file read into a context against the checksums
+// from its checksum chunk. The blocks of each range are checked in parallel.
+// Returns -1 if there is an error or a block has changed.
+int verify_checksums(wave_context* context) {
+    checksum_list* expected = context->checksums;
+    if (expected == NULL) {
+        print_message("The file has no checksums.\n\n");
+        return -1;
+    }
+    checksum_list* actual = new_checksum_list(expected->block_size);
+    if (actual == NULL) {
+        return -1;
+    }
+
+    // Checksum each range and compare it with the checksum chunk, return -1 if they differ.
+    int result = 0;
+    off_t verified = 0;
+    for (int i = 0; i < expected->num_ranges && result == 0; ++i) {
+        checksum_range* range = expected->ranges + i;
+        if (range->position < 0 || range->size > context->wav->file_size - range->position) {
+            print_message("Error - Checksum range of the \"%.4s\" chunk is outside the file.\n\n", range->id);
+            result = -1;
+            break;
+        }
+        checksum_range* checked = add_checksum_range(actual, range->id, range->position, range->size);
+        if (checked == NULL) {
+            result = -1;
+            break;
+        }
+        checksum_chars(checked, actual->block_size, context->file + range->position);
+        result = check_checksums(range, checked, actual->block_size);
+        verified += range->size;
+    }
+    if (result == 0) {
+        print_message("Verified %lld bytes in %i checksum ranges.\n\n", (long long)verified, expected->num_ranges);
+    }
+    free_checksum_list(actual);
+    return result;
+}
+
+// A function for writing the checksum chunk of the file held by a context after its chunks have been written to an
+// open file. The checksums of the audio data and of the embedded files written with it are calculated from memory,
+// in parallel, at their positions in the written file, which a new "ds64" chunk moves by ds64_length chars.
+// Returns -1 if there is an error.
+static int write_checksum_chunk(wave_context* context, int fd, off_t ds64_length) {
+    wav_file* wav = context->wav;
+    checksum_list* list = new_checksum_list(CHECKSUM_BLOCK_SIZE);
+    if (list == NULL) {
+        return -1;
+    }
+
+    // The data chunk follows the "ds64", "fmt " and "fact" chunks when the metadata is left out.
+    off_t data_position = wav->data_position;
+    if (wav->strip_metadata) {
+        data_position = 12 + (wav->rf64 ? chunk_length(wav, 0) : 0) + chunk_length(wav, find_chunk(wav, "fmt ", 0)) +
+                        fact_length(wav);
+    }
+    checksum_range* range = add_checksum_range(list, wav->data_id, data_position + ds64_length + 8, wav->data_size);
+    if (range != NULL) {
+        checksum_chars(range, list->block_size, wav->data_pointer);
+    }
+    for (int i = 0; i < wav->num_chunks && range != NULL && !wav->strip_metadata; ++i) {
+        wav_chunk* chunk = wav->chunks + i;
+        if (chunk->position >= wav->data_end_position && is_embedded_chunk(chunk->id)) {
+            if (chunk->size > wav->file_size - chunk->position - 8) {
+                print_message("Error - The \"%.4s\" chunk runs past the end of the file.\n\n", chunk->id);
+                range = NULL;
+            } else {
+                range = add_checksum_range(list, chunk->id, chunk->position + ds64_length + 8, chunk->size);
+            }
+            if (range != NULL) {
+                checksum_chars(range, list->block_size, context->file + chunk->position + 8);
+            }
+        }
+    }
+
+    // Write the chunk, return -1 on error.
+    size_t size = checksum_list_size(list);
+    char* chunk = range != NULL ? malloc((size + 8) * sizeof(char)) : NULL;
+    int result = -1;
+    if (chunk == NULL && range != NULL) {
+        print_message("Error allocating memory for checksums.\n\n");
+    } else if (chunk != NULL) {
+        memcpy(chunk, CHECKSUM_CHUNK_ID, 4);
+        *(uint32_t*)(chunk + 4) = size;
+        write_checksum_list(list, chunk + 8);
+        result = write_chars(fd, chunk, size + 8) == -1 ? -1 : 0;
+    }
+    free(chunk);
+    free_checksum_list(list);
+    return result;
+}
+
+// A function for writing the file held by a context to disk. A file that has grown past the 32-bit sizes of a
+// RIFF header is written with an RF64 header and a "ds64" chunk, which the file held in memory leaves out. When
+// the removal of the metadata was left to the writer, only the "ds64", "fmt ", "fact" and "data" chunks are
+// written. A checksum chunk is written after the last chunk when the file has checksums or they were asked for.
+// Returns -1 if there is an error.
+int write_wave_file(wave_context* context, char* file_name) {
+    wav_file* wav = context->wav;
+    size_t size = wav->file_size;
+    if (!wav->strip_metadata && !wav->write_checksums && (wav->rf64 || !needs_rf64(wav))) {
+        return write_file(file_name, context->file, size) == size ? 0 : -1;
+    }
+
+    // Write a new RIFF header, followed by a new "ds64" chunk if the file needs one and has none, and update the
+    // sizes of any "ds64" chunk the file has.
+    wav_file written = *wav;
+    written.chunk_size = written_chunk_size(wav);
+    int ds64_length = !wav->rf64 && needs_rf64(&written) ? 8 + DS64_SIZE : 0;
+    written.chunk_size += ds64_length;
+    char header[20 + DS64_SIZE];
+    write_riff_header(&written, header);
+    if (ds64_length > 0) {
+        write_ds64_chunk(&written, header + 12);
+    } else if (wav->rf64) {
+        write_ds64_sizes(&written, context->file + 20);
+    }
+    int fd = create_file(file_name);
+    if (fd == -1) {
+        return -1;
+    }
+    int result = write_chars(fd, header, 12 + ds64_length);
+
+    // Write the chunks after the RIFF header, or only the "ds64", "fmt " and "data" chunks, return -1 on error.
+    if (!wav->strip_metadata) {
+        result = result != -1 ? write_chars(fd, context->file + 12, size - 12) : -1;
+    } else {
+        off_t head_size = 12 + (wav->rf64 ? chunk_length(wav, 0) : 0);
+        off_t format_length = chunk_length(wav, find_chunk(wav, "fmt ", 0));
+        char fact[FACT_CHUNK_LENGTH];
+        copy_fact_chunk(wav, context->file, fact);
+        result = result != -1 ? write_chars(fd, context->file + 12, head_size - 12) : -1;
+        result = result != -1 ? write_chars(fd, context->file + wav->format_position, format_length) : -1;
+        result = result != -1 ? write_chars(fd, fact, fact_length(wav)) : -1;
+        result = result != -1 ? write_chars(fd, context->file + wav->data_position, wav->data_end_position - wav->data_position) : -1;
+    }
+    if (result != -1 && wav->write_checksums) {
+        result = write_checksum_chunk(context, fd, ds64_length);
+    }
+    if (result == -1) {
+        discard_file(fd);
+        return -1;
+    }
+    return close_file(fd) == -1 ? -1 : 0;
 }
 
 // A function for removing the metadata from a wav file.
-void remove_metadata(char** file_in, wav_file** wav_pointer) {
+// Returns -1 if there is an error.
+int remove_metadata(wave_context* context) {
 
-    wav_file* wav_in = *wav_pointer;
+    wav_file* wav_in = context->wav;
+    char* file_in = context->file;
 
-    // Calculate the new chunk size without metadata.
+    // Calculate the new chunk size without metadata. The "ds64" chunk of an RF64 file and any "fact" chunk are kept.
     // Return if there is no metadata in the file.
-    int new_chunk_size = 36 + wav_in->data_size;
+    off_t head_size = 12 + (wav_in->rf64 ? chunk_length(wav_in, 0) : 0);
+    off_t format_length = chunk_length(wav_in, find_chunk(wav_in, "fmt ", 0));
+    off_t fact_chunk_length = fact_length(wav_in);
+    off_t new_chunk_size = metadata_free_chunk_size(wav_in);
     if (new_chunk_size == wav_in->chunk_size) {
-        printf("There is no metadata in this file.\n\n");
-        return;
+        print_message("There is no metadata in this file.\n\n");
+        return 0;
     } else {
-        printf("Removing %i bytes of metadata.\n\n", wav_in->chunk_size - new_chunk_size);
+        print_message("Removing %lld bytes of metadata.\n\n", (long long)(wav_in->chunk_size - new_chunk_size));
     }
 
-    // Allocate memory for the new file, return on error.
-    char* file_out = malloc((new_chunk_size + 8) * sizeof(char));
+    // Reserve the spare buffer for the new file, return -1 on error.
+    char* file_out = reserve_spare(context, new_chunk_size + 8);
     if (file_out == NULL) {
-        printf("Error allocating memory for file.\n\n");
-        return;
+        return -1;
     }
 
-    memcpy(file_out, *file_in, 12); // Copy the RIFF header to the new file
-    *(int*)(file_out + 4) = new_chunk_size; // Update the file's chunk size
-    memcpy(file_out + 12, *file_in + wav_in->format_position, 24); // Copy the "fmt" chunk
-    memcpy(file_out + 36, *file_in + wav_in->data_position, wav_in->data_size + 8); // Copy the "data" chunk
+    memcpy(file_out, file_in, head_size); // Copy the RIFF header and any "ds64" chunk to the new file
+    memcpy(file_out + head_size, file_in + wav_in->format_position, format_length); // Copy the "fmt" chunk
+    copy_fact_chunk(wav_in, file_in, file_out + head_size + format_length); // Copy the frame count of any "fact" chunk
+    memcpy(file_out + head_size + format_length + fact_chunk_length, file_in + wav_in->data_position,
+           wav_in->data_end_position - wav_in->data_position); // Copy the "data" chunk and its pad byte
+    swap_buffers(context);
 
-    // Parse the new file, free new file and return on error.
-    wav_file* wav_out = parse(file_out);
-    if (wav_out == NULL) {
-        free(file_out);
-        return;
+    // Only the "ds64", "fmt ", "fact" and "data" chunks remain in the index.
+    wav_in->num_chunks = wav_in->rf64 ? 1 : 0;
+    add_wav_chunk(wav_in, "fmt ", head_size, wav_in->format_size);
+    if (fact_chunk_length > 0) {
+        add_wav_chunk(wav_in, "fact", head_size + format_length, 4);
     }
+    add_wav_chunk(wav_in, "data", head_size + format_length + fact_chunk_length, wav_in->data_size);
+    wav_in->chunk_size = new_chunk_size;
+    update_positions(wav_in, file_out);
+    return 0;
+}
 
-    // Free the old file and reassign file and wav_file pointers.
-    free(*file_in);
-    *file_in = file_out;
-    free(*wav_pointer);
-    *wav_pointer = wav_out;
+// A function for removing the metadata from a wav file when it is written, instead of copying the file without
+// it. The file must not be changed afterwards.
+// Returns -1 if there is an error.
+int remove_metadata_on_write(wave_context* context) {
+    wav_file* wav = context->wav;
+    off_t new_chunk_size = metadata_free_chunk_size(wav);
+    if (new_chunk_size == wav->chunk_size) {
+        print_message("There is no metadata in this file.\n\n");
+    } else {
+        print_message("Removing %lld bytes of metadata.\n\n", (long long)(wav->chunk_size - new_chunk_size));
+        wav->strip_metadata = 1;
+    }
+    return 0;
 }
 
-// A function for embedding a hidden file within a wav file.
-void push_back_file(char** file_in, wav_file** wav_pointer, char* embedded_filename) {
+// A function for reading the directory of the embedded files of a wav file held by a context from its last
+// chunk. Returns an empty directory if the file has none, or NULL if there is an error.
+static file_directory* read_directory(wave_context* context) {
+    wav_file* wav = context->wav;
+    int index = wav->num_chunks - 1;
+    if (index < 0 || memcmp(wav->chunks[index].id, "fdir", 4) || wav->chunks[index].position < wav->data_end_position) {
+        return new_directory();
+    }
 
-    char* embedded_file;
-    wav_file* wav_in = *wav_pointer;
+    // Return NULL if the directory runs past the end of the file.
+    off_t size = wav->chunks[index].size;
+    if (size > wav->file_size - wav->chunks[index].position - 8) {
+        print_message("Error - Embedded file directory corrupted.\n\n");
+        return NULL;
+    }
+    return parse_directory(context->file + wav->chunks[index].position + 8, size);
+}
 
-    // Read the embedded file, return on error.
-    int embedded_file_size = read_file(embedded_filename, &embedded_file);
-    if (embedded_file_size == -1) {
-        return;
+// A function for reading the directory of the embedded files of a wav file held by a context and removing its
+// chunk, so an operation can change the chunks before it. store_directory writes it back.
+// Returns NULL if there is an error.
+static file_directory* take_directory(wave_context* context) {
+    wav_file* wav = context->wav;
+    file_directory* directory = read_directory(context);
+    if (directory != NULL && wav->num_chunks > 0 && !memcmp(wav->chunks[wav->num_chunks - 1].id, "fdir", 4) &&
+            wav->chunks[wav->num_chunks - 1].position >= wav->data_end_position) {
+        wav->chunk_size -= chunk_length(wav, wav->num_chunks - 1);
+        remove_chunk(wav, wav->num_chunks - 1);
+        update_positions(wav, context->file);
     }
+    return directory;
+}
 
-    // Calculate the embedded file's chunk size and allocate memory for the new file, return on error.
-    int new_chunk_size = embedded_file_size;
-    char* file_out = malloc((wav_in->file_size + new_chunk_size + 8) * sizeof(char));
-    if (file_out == NULL) {
-        printf("Error allocating memory for file.\n\n");
-        return;
+// A function for appending the directory of the embedded files to the end of a wav file held by a context and
+// freeing it. The chunk is left out when there are no entries.
+// Returns -1 if there is an error.
+static int store_directory(wave_context* context, file_directory* directory) {
+    wav_file* wav = context->wav;
+    int result = 0;
+    if (directory->num_entries > 0) {
+
+        // Move the file to the spare buffer if the directory does not fit after it, return -1 on error.
+        int size = directory_size(directory);
+        size_t new_file_size = wav->file_size + 8 + size;
+        if (new_file_size > context->file_capacity) {
+            char* file_out = reserve_spare(context, new_file_size);
+            if (file_out == NULL) {
+                free_directory(directory);
+                return -1;
+            }
+            memcpy(file_out, context->file, wav->file_size);
+            swap_buffers(context);
+        }
+
+        // Write the directory chunk after the last chunk.
+        memcpy(context->file + wav->file_size, "fdir", 4);
+        *(int*)(context->file + wav->file_size + 4) = size;
+        write_directory(directory, context->file + wav->file_size + 8);
+        result = add_wav_chunk(wav, "fdir", wav->file_size, size);
+        if (result == 0) {
+            wav->chunk_size += size + 8;
+        }
     }
+    update_positions(wav, context->file);
+    free_directory(directory);
+    return result;
+}
 
-    // Copy the original file into the new file and update the new file's chunk size.
-    memcpy(file_out, *file_in, wav_in->file_size);
-    *(int*)(file_out + 4) = wav_in->chunk_size + new_chunk_size + 8;
+// A function for finding the first embedded file chunk at or after a position.
+// Returns -1 if there is none.
+static int find_embedded_chunk(wav_file* wav, off_t position) {
+    for (int i = 0; i < wav->num_chunks; ++i) {
+        if (wav->chunks[i].position >= position && is_embedded_chunk(wav->chunks[i].id)) {
+            return i;
+        }
+    }
+    return -1;
+}
 
-    // Create embedded file chunk and copy the embedded file into the new file.
-    memcpy(file_out + wav_in->file_size, "file", 4);
-    *(int*)(file_out + wav_in->file_size + 4) = new_chunk_size;
-    memcpy(file_out + wav_in->file_size + 8, embedded_file, new_chunk_size);
+// A function for finding the chunk of a directory entry.
+// Returns -1 if the entry does not match a chunk.
+static int find_entry_chunk(wav_file* wav, directory_entry* entry) {
+    int index = find_embedded_chunk(wav, wav->data_end_position + entry->offset);
+    if (index == -1 || wav->chunks[index].position != wav->data_end_position + entry->offset ||
+            wav->chunks[index].size != entry->size) {
+        print_message("Error - Embedded file directory does not match the file.\n\n");
+        return -1;
+    }
+    return index;
+}
 
-    // Parse the new file, free new file and return on error.
-    wav_file* wav_out = parse(file_out);
-    if (wav_out == NULL) {
-        free(file_out);
-        return;
+// A function for reading or compressing an embedded file straight into a new chunk after the end of a wav file
+// held by a context, whose buffer has room for the chunk, and recording it in the directory and the chunk index.
+// Returns -1 if there is an error.
+static int append_file_chunk(wave_context* context, file_directory* directory, char* embedded_filename, int fd,
+                             off_t embedded_file_size, int compression) {
+
+    wav_file* wav_in = context->wav;
+    char* chunk = context->file + wav_in->file_size;
+
+    // Read or compress the embedded file after the end of the file, return -1 on error.
+    char* payload = chunk + 8;
+    uint32_t checksum;
+    ssize_t new_chunk_size;
+    if (compression != COMPRESSION_NONE) {
+        new_chunk_size = compress_payload(fd, embedded_file_size, compression, write_memory_payload, payload, &checksum);
+    } else {
+        new_chunk_size = read_file_range(fd, payload, embedded_file_size, 0) == embedded_file_size ? embedded_file_size : -1;
+        if (new_chunk_size == -1) {
+            print_message("The file %s cannot be read.\n\n", embedded_filename);
+        } else {
+            checksum = crc32c(0, payload, new_chunk_size);
+        }
+    }
+    if (new_chunk_size == -1) {
+        return -1;
+    }
+
+    // Record the embedded file in the directory and the chunk index, return -1 on error.
+    // Odd-sized chunks are followed by a pad byte.
+    char* id = compression != COMPRESSION_NONE ? "zfil" : "file";
+    int padding = new_chunk_size % 2;
+    if (add_entry(directory, embedded_filename, wav_in->file_size - wav_in->data_end_position, new_chunk_size, checksum) == -1) {
+        return -1;
+    }
+    if (add_wav_chunk(wav_in, id, wav_in->file_size, new_chunk_size) == -1) {
+        remove_entry(directory, directory->num_entries - 1);
+        return -1;
     }
 
-    // Free the old file and reassign file and wav_file pointers.
-    free(embedded_file);
-    free(*file_in);
-    *file_in = file_out;
-    free(*wav_pointer);
-    *wav_pointer = wav_out;
+    // Create the embedded file chunk's header and pad byte.
+    memcpy(chunk, id, 4);
+    *(int*)(chunk + 4) = new_chunk_size;
+    if (padding) {
+        payload[new_chunk_size] = 0;
+    }
+
+    // Update the file metrics and sizes for the appended chunk.
+    wav_in->chunk_size += new_chunk_size + 8 + padding;
+    update_positions(wav_in, context->file);
+    return 0;
 }
 
-// A function for removing the oldest hidden file within a wav file.
-void pop_front_file(char** file_in, wav_file** wav_pointer, char* extracted_file_name) {
+// A function for embedding hidden files within a wav file and recording them in the directory. The file is
+// copied once, with room for every embedded file, and each embedded file is read or compressed straight into
+// its place in the new file. Files that cannot be embedded are skipped.
+// Returns -1 if there is an error.
+int push_back_files(wave_context* context, char** embedded_filenames, int num_files, int compression) {
 
-    wav_file* wav_in = *wav_pointer;
+    // Take the directory from the end of the file, return -1 on error.
+    file_directory* directory = take_directory(context);
+    if (directory == NULL) {
+        return -1;
+    }
+    wav_file* wav_in = context->wav;
 
-    // Locate the first hidden file, return if none exist.
-    int file_chunk_position = find_subsequence_position(*file_in + wav_in->data_end_position, wav_in->bytes_after_data - 4, "file", 4);
-    if (file_chunk_position == -1) {
-        printf("There are no embedded files.\n\n");
-        return;
+    // Open the embedded files and add up the largest size of the new file, return -1 on error.
+    int* fds = malloc(num_files * sizeof(int));
+    off_t* embedded_file_sizes = malloc(num_files * sizeof(off_t));
+    if (fds == NULL || embedded_file_sizes == NULL) {
+        print_message("Error allocating memory for embedded files.\n\n");
+        free(fds);
+        free(embedded_file_sizes);
+        store_directory(context, directory);
+        return -1;
+    }
+    int result = 0;
+    size_t new_file_size = wav_in->file_size;
+    for (int i = 0; i < num_files; ++i) {
+        fds[i] = open_file(embedded_filenames[i], embedded_file_sizes + i);
+        if (fds[i] == -1) {
+            result = -1;
+            continue;
+        }
+        off_t size = embedded_file_sizes[i];
+        new_file_size += (compression != COMPRESSION_NONE ? compressed_bound(size) : (size_t)size) + 9;
+    }
+
+    // Copy the original file into the spare buffer, which has room for the new chunks, unless no file was opened.
+    char* file_out = new_file_size > (size_t)wav_in->file_size ? reserve_spare(context, new_file_size) : NULL;
+    if (file_out != NULL) {
+        memcpy(file_out, context->file, wav_in->file_size);
+        swap_buffers(context);
+        update_positions(wav_in, file_out);
     }
 
+    // Append a chunk for each embedded file.
+    for (int i = 0; i < num_files; ++i) {
+        if (fds[i] != -1) {
+            if (file_out == NULL || append_file_chunk(context, directory, embedded_filenames[i], fds[i],
+                                                      embedded_file_sizes[i], compression) == -1) {
+                result = -1;
+            }
+            close_file(fds[i]);
+        }
+    }
+    free(fds);
+    free(embedded_file_sizes);
+    return store_directory(context, directory) == -1 ? -1 : result;
+}
+
+// A function for embedding a hidden file within a wav file and recording it in the directory. The embedded
+// file is read or compressed straight into its place in the new file.
+// Returns -1 if there is an error.
+int push_back_file(wave_context* context, char* embedded_filename, int compression) {
+    return push_back_files(context, &embedded_filename, 1, compression);
+}
+
+// A function for removing an embedded file chunk from a wav file and its directory, writing the embedded file
+// to disk unless extracted_file_name is NULL.
+// Returns -1 if there is an error.
+static int remove_file_chunk(wave_context* context, file_directory* directory, int file_chunk_index, char* extracted_file_name) {
+
+    wav_file* wav_in = context->wav;
+    char* file_in = context->file;
+
     // Assign variables for extracting the hidden file.
-    file_chunk_position += wav_in->data_end_position;
-    int file_chunk_size = *(int*)(*file_in + file_chunk_position + 4);
+    off_t file_chunk_position = wav_in->chunks[file_chunk_index].position;
+    off_t file_chunk_size = wav_in->chunks[file_chunk_index].size;
+    off_t file_chunk_length = chunk_length(wav_in, file_chunk_index);
 
-    // Allocate memory for the new file, return on error.
-    char* file_out = malloc((wav_in->file_size - (file_chunk_size + 8)) * sizeof(char));
+    // Reserve the spare buffer for the new file, return -1 on error.
+    char* file_out = reserve_spare(context, wav_in->file_size - file_chunk_length);
     if (file_out == NULL) {
-        printf("Error allocating memory for file.\n\n");
-        return;
+        return -1;
     }
 
-    // Copy to the beginning of the new file and update the new file's chunk size
-    memcpy(file_out, *file_in, file_chunk_position);
-    *(int*)(file_out + 4) = wav_in->chunk_size - (file_chunk_size + 8);
+    // Copy to the beginning of the new file
+    memcpy(file_out, file_in, file_chunk_position);
 
     // Copy to the end of the new file.
-    int end_of_file_chunk = file_chunk_position + file_chunk_size + 8;
-    memcpy(file_out + file_chunk_position, *file_in + end_of_file_chunk, wav_in->file_size - end_of_file_chunk);
+    off_t end_of_file_chunk = file_chunk_position + file_chunk_length;
+    memcpy(file_out + file_chunk_position, file_in + end_of_file_chunk, wav_in->file_size - end_of_file_chunk);
 
-    // Write the extracted file to disk.
-    write_file(extracted_file_name, *file_in + file_chunk_position + 8, file_chunk_size);
+    // Write the extracted file to disk, decompressing it if it was compressed.
+    int result = 0;
+    char* payload = file_in + file_chunk_position + 8;
+    if (extracted_file_name != NULL && !memcmp(wav_in->chunks[file_chunk_index].id, "zfil", 4)) {
+        int fd = create_file(extracted_file_name);
+        uint32_t checksum;
+        result = fd != -1 && decompress_payload(read_memory_payload, payload, file_chunk_size, fd, &checksum) != -1 ? 0 : -1;
+        if (fd != -1 && result == -1) {
+            discard_file(fd);
+        } else if (fd != -1 && close_file(fd) == -1) {
+            result = -1;
+        }
+    } else if (extracted_file_name != NULL) {
+        result = write_file(extracted_file_name, payload, file_chunk_size) == (size_t)file_chunk_size ? 0 : -1;
+    }
+    swap_buffers(context);
 
-    // Parse the new file, free new file and return on error.
-    wav_file* wav_out = parse(file_out);
-    if (wav_out == NULL) {
-        free(file_out);
-        return;
+    // Remove the chunk from the index and the directory, move the chunks that followed it and update the sizes.
+    int offset = file_chunk_position - wav_in->data_end_position;
+    int entry_index = find_entry_at(directory, offset);
+    if (entry_index != -1) {
+        remove_entry(directory, entry_index);
+    }
+    shift_entries(directory, offset, -file_chunk_length);
+    remove_chunk(wav_in, file_chunk_index);
+    shift_chunks(wav_in, file_chunk_index, -file_chunk_length);
+    wav_in->chunk_size -= file_chunk_length;
+    update_positions(wav_in, file_out);
+    return result;
+}
+
+// A function for removing the oldest hidden file within a wav file.
+// Returns -1 if there is an error.
+int pop_front_file(wave_context* context, char* extracted_file_name) {
+
+    // Take the directory from the end of the file, return -1 on error.
+    file_directory* directory = take_directory(context);
+    if (directory == NULL) {
+        return -1;
+    }
+
+    // Locate the first hidden file, return -1 if none exist.
+    int file_chunk_index = find_embedded_chunk(context->wav, context->wav->data_end_position);
+    if (file_chunk_index == -1) {
+        print_message("There are no embedded files.\n\n");
+        store_directory(context, directory);
+        return -1;
     }
 
-    // Free the old file and reassign file and wav_file pointers.
-    free(*file_in);
-    *file_in = file_out;
-    free(wav_in);
-    *wav_pointer = wav_out;
+    int result = remove_file_chunk(context, directory, file_chunk_index, extracted_file_name);
+    return store_directory(context, directory) == -1 ? -1 : result;
 }
 
-// A function for stretching and copying audio data from one wav file to another.
-void stretch_data(char* source, char* destination, int num_samples, int sample_size, double time_multiplier) {
-    for (int i = 0; i < num_samples; ++i) {
-        memcpy(destination + i * sample_size, source + (int)(i / time_multiplier) * sample_size, sample_size);
+// A function for listing the embedded files recorded in the directory of a wav file. Only the directory is read.
+// Returns -1 if there is an error.
+int list_files(wave_context* context) {
+    file_directory* directory = read_directory(context);
+    if (directory == NULL) {
+        return -1;
     }
+    print_directory(directory);
+    free_directory(directory);
+    return 0;
 }
 
-// A function for stretching the audio data chunk in a wav file by a given factor.
-char* stretch_data_chunk(char* file_in, wav_file* wav_in, double time_multiplier) {
+// A function for extracting the oldest embedded file with a name to a file with that name, checking it against
+// the checksum in the directory.
+// Returns -1 if there is an error.
+int extract_file(wave_context* context, char* name) {
 
-    // Calculate the new new file's audio data size and chunk size.
-    int new_data_size = (int)(wav_in->data_size * time_multiplier);
-    new_data_size -= new_data_size % wav_in->all_channel_sample_size_in_bytes;
-    int new_chunk_size = wav_in->chunk_size - wav_in->data_size + new_data_size;
+    // Look the name up in the directory, return -1 if it is not there.
+    file_directory* directory = read_directory(context);
+    if (directory == NULL) {
+        return -1;
+    }
+    int entry_index = find_entry(directory, name);
+    int chunk_index = entry_index != -1 ? find_entry_chunk(context->wav, directory->entries + entry_index) : -1;
+    if (chunk_index == -1) {
+        if (entry_index == -1) {
+            print_message("There is no embedded file named %s.\n\n", name);
+        }
+        free_directory(directory);
+        return -1;
+    }
 
-    // Allocate memory for the new file, return NULL on error.
-    char* file_out = malloc((new_chunk_size + 8) * sizeof(char));
-    if (file_out == NULL) {
-        printf("Error allocating memory for file.\n\n");
-        return NULL;
+    // Write the embedded file to disk if its checksum matches, decompressing it if it was compressed,
+    // return -1 on error.
+    directory_entry* entry = directory->entries + entry_index;
+    char* payload = context->file + context->wav->chunks[chunk_index].position + 8;
+    int result = -1;
+    if (!memcmp(context->wav->chunks[chunk_index].id, "zfil", 4)) {
+        result = extract_compressed_entry(entry, read_memory_payload, payload);
+    } else if (crc32c(0, payload, entry->size) != entry->checksum) {
+        print_message("Error - Checksum of embedded file %s does not match.\n\n", entry->name);
+    } else {
+        result = write_file(entry->name, payload, entry->size) == (size_t)entry->size ? 0 : -1;
+    }
+    free_directory(directory);
+    return result;
+}
+
+// A function for deleting the oldest embedded file with a name from a wav file.
+// Returns -1 if there is an error.
+int delete_file(wave_context* context, char* name) {
+
+    // Take the directory from the end of the file, return -1 on error.
+    file_directory* directory = take_directory(context);
+    if (directory == NULL) {
+        return -1;
     }
 
-    // Copy to the beginning of the new file and reassign the file's chunk size and data size.
+    // Look the name up in the directory and remove its chunk.
+    int result = -1;
+    int entry_index = find_entry(directory, name);
+    int chunk_index = entry_index != -1 ? find_entry_chunk(context->wav, directory->entries + entry_index) : -1;
+    if (entry_index == -1) {
+        print_message("There is no embedded file named %s.\n\n", name);
+    } else if (chunk_index != -1) {
+        result = remove_file_chunk(context, directory, chunk_index, NULL);
+    }
+    return store_directory(context, directory) == -1 ? -1 : result;
+}
+
+// A function for stretching and copying audio data from one wav file to another.
+void stretch_data(char* source, char* destination, size_t num_samples, int sample_size, double time_multiplier) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        memcpy(destination + i * sample_size, source + (size_t)(i / time_multiplier) * sample_size, sample_size);
+    }
+}
+
+// A function for calculating the size of the audio data of a wav file stretched by a given factor.
+off_t stretched_data_size(wav_file* wav, double time_multiplier) {
+    off_t new_data_size = (off_t)(wav->data_size * time_multiplier);
+    return new_data_size - new_data_size % wav->all_channel_sample_size_in_bytes;
+}
+
+// A function for calculating the size of a wav file whose data chunk is resized, with a pad byte after odd-sized
+// audio data.
+static off_t resized_file_size(wav_file* wav, off_t new_data_size) {
+    return wav->file_size - (wav->data_end_position - wav->audio_data_position) + padded_size(new_data_size);
+}
+
+// A function for copying a wav file around its audio data into a new file with a stretched data chunk, leaving
+// room for the pad byte of odd-sized audio data. The pad byte and the sizes in the new file's headers are written
+// once its metrics are updated.
+void stretch_data_chunk(char* file_in, wav_file* wav_in, off_t new_data_size, char* file_out) {
+
+    // Copy to the beginning of the new file.
     memcpy(file_out, file_in, wav_in->audio_data_position);
-    *(int*)(file_out + 4) = new_chunk_size;
-    *(int*)(file_out + wav_in->data_position + 4) = new_data_size;
 
-    // Copy to the end of the new file.
-    memcpy(file_out + wav_in->audio_data_position + new_data_size, file_in + wav_in->audio_data_position + wav_in->data_size,
-           new_chunk_size + 8 - (wav_in->audio_data_position + new_data_size));
+    // Copy the chunks after the data chunk to the end of the new file.
+    memcpy(file_out + wav_in->audio_data_position + padded_size(new_data_size), file_in + wav_in->data_end_position,
+           wav_in->file_size - wav_in->data_end_position);
+}
 
-    return file_out;
+// A function for resizing the data chunk of a wav file in its index and moving the chunks that follow it, then
+// writing the pad byte of odd-sized audio data and updating its metrics for the new file held in contents. The
+// chunks that follow are expected after the pad byte.
+static void resize_data_chunk(wav_file* wav, off_t new_data_size, char* contents) {
+    int data_index = find_chunk(wav, "data", wav->data_position);
+    off_t offset = wav->audio_data_position + padded_size(new_data_size) - wav->data_end_position;
+    if (new_data_size % 2 != 0) {
+        contents[wav->audio_data_position + new_data_size] = 0;
+    }
+    shift_chunks(wav, data_index + 1, offset);
+    wav->chunks[data_index].size = new_data_size;
+    wav->chunk_size += offset;
+    wav->data_size = new_data_size;
+    update_positions(wav, contents);
+}
+
+// A function for creating a resampler that stretches the audio of a wav file with an interpolation.
+// Returns NULL if the audio is stretched by repeating and dropping frames instead.
+resampler* new_stretch_resampler(wav_file* wav, double time_multiplier, int interpolation) {
+    if (interpolation == INTERPOLATION_NEAREST) {
+        return NULL;
+    }
+    if (wav->encoding == SAMPLE_UNSUPPORTED) {
+        print_message("Interpolation is not supported for this sample format. Using nearest-neighbour.\n\n");
+        return NULL;
+    }
+    return new_resampler(fabs(time_multiplier), interpolation, wav->num_channels, wav->encoding,
+                         wav->num_all_channel_samples);
+}
+
+// A function for creating a pitch-preserving stretch of the audio of a wav file into num_frames frames.
+// Returns NULL if the audio is stretched by resampling instead.
+wsola* new_stretch_wsola(wav_file* wav, size_t num_frames, double time_multiplier, int method) {
+    if (method != STRETCH_WSOLA) {
+        return NULL;
+    }
+    if (wav->encoding == SAMPLE_UNSUPPORTED) {
+        print_message("Pitch-preserving stretching is not supported for this sample format. Resampling instead.\n\n");
+        return NULL;
+    }
+    return new_wsola(fabs(time_multiplier), wav->sample_rate, wav->num_channels, wav->encoding,
+                     wav->num_all_channel_samples, num_frames);
 }
 
 // A function for time-stretching the audio in a wav file by a given factor.
-void stretch_audio(char** file_in, wav_file** wav_pointer, double time_multiplier) {
+// Returns -1 if there is an error.
+int stretch_audio(wave_context* context, double time_multiplier, int interpolation, int method) {
 
-    wav_file* wav_in = *wav_pointer;
+    wav_file* wav_in = context->wav;
 
-    // Create a new file with a stretched data chunk, return on error.
-    char* file_out = stretch_data_chunk(*file_in, wav_in, fabs(time_multiplier));
+    // Reserve the spare buffer for a file with a stretched data chunk, return -1 on error.
+    off_t new_data_size = stretched_data_size(wav_in, fabs(time_multiplier));
+    char* file_out = reserve_spare(context, resized_file_size(wav_in, new_data_size));
     if (file_out == NULL) {
-        return;
+        return -1;
     }
+    stretch_data_chunk(context->file, wav_in, new_data_size, file_out);
 
-    // Parse the new file, free new file and return on error.
-    wav_file* wav_out = parse(file_out);
-    if (wav_out == NULL) {
-        free(file_out);
-        return;
-    }
+    // Create a pitch-preserving stretch or a resampler for the source audio.
+    char* source = wav_in->data_pointer;
+    wsola* wsola = new_stretch_wsola(wav_in, new_data_size / wav_in->all_channel_sample_size_in_bytes, time_multiplier, method);
+    resampler* resampler = wsola == NULL ? new_stretch_resampler(wav_in, time_multiplier, interpolation) : NULL;
+
+    resize_data_chunk(wav_in, new_data_size, file_out);
 
-    // Stretch and copy audio data to the new file.
-    stretch_data(wav_in->data_pointer, wav_out->data_pointer, wav_out->num_all_channel_samples, wav_out->all_channel_sample_size_in_bytes,
-                 fabs(time_multiplier));
+    // Stretch and copy audio data to the new file, keeping the pitch if a pitch-preserving stretch was created
+    // and otherwise interpolating between frames if a resampler was created.
+    int result = -1;
+    if (wsola != NULL) {
+        result = wsola_frames(wsola, source, wav_in->data_pointer);
+        free_wsola(wsola);
+    } else if (resampler != NULL) {
+        result = resample_frames(resampler, source, wav_in->data_pointer, wav_in->num_all_channel_samples);
+        free_resampler(resampler);
+    }
+    if (result == -1) {
+        stretch_data(source, wav_in->data_pointer, wav_in->num_all_channel_samples, wav_in->all_channel_sample_size_in_bytes,
+                     fabs(time_multiplier));
+    }
 
     // Reverse the audio data if stretching by a negative factor.
     if (time_multiplier < 0) {
-        reverse_audio(file_out + wav_out->audio_data_position, wav_out->num_all_channel_samples, wav_out->all_channel_sample_size_in_bytes);
+        reverse_audio(wav_in->data_pointer, wav_in->num_all_channel_samples, wav_in->all_channel_sample_size_in_bytes);
+    }
+
+    // Make the stretched file the current one.
+    swap_buffers(context);
+    return 0;
+}
+
+// A function for creating a converter from the samples of a wav file to an encoding and channel mix, or to
+// the same channels when mix is NULL.
+// Returns NULL if there is an error.
+converter* new_format_converter(wav_file* wav, int encoding, channel_mix* mix, int dither) {
+    if (wav->bits_per_sample % 8 != 0 || wav->all_channel_sample_size_in_bytes != wav->num_channels * (wav->bits_per_sample / 8)) {
+        print_message("Converting samples is not supported for this sample format.\n\n");
+        return NULL;
+    }
+    return new_converter(wav->encoding, wav->bits_per_sample / 8, wav->num_channels, encoding, mix, dither);
+}
+
+// A function for giving a wav file whose samples are floats the chunks its format tag needs: a "fmt " chunk with
+// an empty extension instead of a 16-char one, and a "fact" chunk after it, which holds the number of frames, when
+// the file has none.
+// Returns -1 if there is an error.
+static int add_float_chunks(wave_context* context) {
+    wav_file* wav = context->wav;
+    int format_index = find_chunk(wav, "fmt ", 0);
+    int extension_size = wav->chunks[format_index].size == 16 ? 2 : 0;
+    int fact_size = find_fact_chunk(wav) == -1 ? FACT_CHUNK_LENGTH : 0;
+    if (extension_size == 0 && fact_size == 0) {
+        return 0;
     }
 
-    // Free the old file and reassign file and wav_file pointers.
-    free(*file_in);
-    *file_in = file_out;
-    free(*wav_pointer);
-    *wav_pointer = wav_out;
+    // Make room for the "fact" chunk in the index and reserve the spare buffer for the new file, return -1 on error.
+    char* file_out = reserve_spare(context, wav->file_size + extension_size + fact_size);
+    if (file_out == NULL || (fact_size > 0 && add_wav_chunk(wav, "fact", 0, 4) == -1)) {
+        return -1;
+    }
+
+    // Copy the file, with the extension after the "fmt " chunk's payload and the "fact" chunk after the "fmt " chunk.
+    off_t format_position = wav->chunks[format_index].position;
+    off_t format_end = format_position + chunk_length(wav, format_index);
+    memcpy(file_out, context->file, format_end);
+    memset(file_out + format_end, 0, extension_size);
+    write_fact_chunk(wav, file_out + format_end + extension_size);
+    memcpy(file_out + format_end + extension_size + fact_size, context->file + format_end, wav->file_size - format_end);
+    swap_buffers(context);
+
+    // Move the chunks after the "fmt " chunk and put the "fact" chunk in the index after it.
+    wav->chunks[format_index].size += extension_size;
+    wav->format_size += extension_size;
+    *(uint32_t*)(context->file + format_position + 4) = wav->chunks[format_index].size;
+    shift_chunks(wav, format_index + 1, extension_size + fact_size);
+    if (fact_size > 0) {
+        memmove(wav->chunks + format_index + 2, wav->chunks + format_index + 1,
+                (wav->num_chunks - format_index - 2) * sizeof(wav_chunk));
+        memcpy(wav->chunks[format_index + 1].id, "fact", 4);
+        wav->chunks[format_index + 1].position = format_end + extension_size;
+        wav->chunks[format_index + 1].size = 4;
+    }
+    wav->chunk_size += extension_size + fact_size;
+    update_positions(wav, context->file);
+    return 0;
+}
+
+// A function for converting the samples of a wav file to an encoding and channel mix, or to the same channels
+// when mix is NULL. Samples converted to floats get the "fmt " and "fact" chunks of their format tag.
+// Returns -1 if there is an error.
+int convert_audio(wave_context* context, int encoding, channel_mix* mix, int dither) {
+
+    wav_file* wav_in = context->wav;
+    converter* converter = new_format_converter(wav_in, encoding, mix, dither);
+    if (converter == NULL) {
+        return -1;
+    }
+
+    // Reserve the spare buffer for a file with a converted data chunk, return -1 on error.
+    off_t new_data_size = (off_t)wav_in->num_all_channel_samples * converter->frame_size;
+    char* file_out = reserve_spare(context, resized_file_size(wav_in, new_data_size));
+    if (file_out == NULL) {
+        free_converter(converter);
+        return -1;
+    }
+    stretch_data_chunk(context->file, wav_in, new_data_size, file_out);
+
+    // Convert the audio data into the new file, return -1 on error.
+    if (convert_frames(converter, wav_in->data_pointer, file_out + wav_in->audio_data_position,
+                       wav_in->num_all_channel_samples) == -1) {
+        free_converter(converter);
+        return -1;
+    }
+
+    // Write the new sample format into the "fmt " chunk and make the converted file the current one.
+    off_t format_length = chunk_length(wav_in, find_chunk(wav_in, "fmt ", 0));
+    update_format(wav_in, file_out + wav_in->format_position, format_length, converter->encoding, converter->num_channels,
+                  wav_in->sample_rate);
+    resize_data_chunk(wav_in, new_data_size, file_out);
+    swap_buffers(context);
+    int result = is_float_encoding(converter->encoding) ? add_float_chunks(context) : 0;
+    free_converter(converter);
+    return result;
+}
+
+// A function for calculating the time multiplier that converts the audio of a wav file to a sample rate.
+// Returns 0 if the audio cannot be converted.
+double sample_rate_multiplier(wav_file* wav, int sample_rate) {
+    if (sample_rate <= 0 || wav->sample_rate <= 0) {
+        print_message("Invalid sample rate.\n\n");
+        return 0;
+    }
+    if (wav->encoding == SAMPLE_UNSUPPORTED) {
+        print_message("Sample-rate conversion is not supported for this sample format.\n\n");
+        return 0;
+    }
+    return (double)sample_rate / wav->sample_rate;
+}
+
+// A function for converting the audio of a wav file to a sample rate, resampling it with the polyphase
+// windowed sinc kernel of the resampler, whose cutoff is lowered when the sample rate is lowered.
+// Returns -1 if there is an error.
+int resample_audio(wave_context* context, int sample_rate) {
+    wav_file* wav = context->wav;
+    double time_multiplier = sample_rate_multiplier(wav, sample_rate);
+    if (time_multiplier == 0 || stretch_audio(context, time_multiplier, INTERPOLATION_SINC, STRETCH_RESAMPLE) == -1) {
+        return -1;
+    }
+    off_t format_length = chunk_length(wav, find_chunk(wav, "fmt ", 0));
+    update_format(wav, context->file + wav->format_position, format_length, wav->encoding, wav->num_channels, sample_rate);
+    return 0;
+}
+
+// A function for finding the frames of the audio of a wav file from start to end seconds, rounded to the nearest
+// frame, where an end of -1 is the end of the audio. The first frame and the number of frames are stored in first
+// and count.
+// Returns -1 if no frame of the audio is in the range.
+int trim_range(wav_file* wav, double start, double end, size_t* first, size_t* count) {
+    size_t num_frames = wav->num_all_channel_samples;
+    double first_frame = round(start * wav->sample_rate);
+    double end_frame = end < 0 ? (double)num_frames : round(end * wav->sample_rate);
+    if (end_frame > num_frames) {
+        end_frame = num_frames;
+    }
+    if (!(first_frame < end_frame)) {
+        print_message("The trim range is outside the %zu frames of the audio.\n\n", num_frames);
+        return -1;
+    }
+    *first = (size_t)first_frame;
+    *count = (size_t)end_frame - *first;
+    return 0;
+}
+
+// A function for keeping only the frames [first, first + count) of the audio of a wav file. The frames are moved
+// to the start of the data chunk and the chunks that follow are moved after them in place, so the file is not
+// copied.
+void trim_audio(wave_context* context, size_t first, size_t count) {
+    wav_file* wav = context->wav;
+    off_t new_data_size = (off_t)count * wav->all_channel_sample_size_in_bytes;
+    memmove(wav->data_pointer, wav->data_pointer + first * wav->all_channel_sample_size_in_bytes, new_data_size);
+    memmove(wav->data_pointer + padded_size(new_data_size), context->file + wav->data_end_position,
+            wav->file_size - wav->data_end_position);
+    resize_data_chunk(wav, new_data_size, context->file);
+}
+
+// A function for checking that the audio of another wav file has the same sample format, number of channels and
+// sample rate as a wav file, so the frames of one can follow the other.
+// Returns -1 if they differ.
+int check_audio_format(wav_file* wav, wav_file* other, char* other_file_name) {
+    if (wav->encoding != other->encoding || wav->num_channels != other->num_channels ||
+            wav->sample_rate != other->sample_rate || wav->bits_per_sample != other->bits_per_sample ||
+            wav->all_channel_sample_size_in_bytes != other->all_channel_sample_size_in_bytes ||
+            (wav->encoding == SAMPLE_UNSUPPORTED && wav->format_type != other->format_type)) {
+        print_message("The audio of %s has a different sample format, number of channels or sample rate.\n\n",
+                      other_file_name);
+        return -1;
+    }
+    return 0;
+}
+
+// A function for appending the audio of other wav files to the audio of a wav file. The files are read and checked
+// first, so the file is copied once with room for all of their frames. Only whole frames are kept, and the chunks
+// of the appended files other than their audio data are left out.
+// Returns -1 if there is an error.
+int concat_audio(wave_context* context, char** file_names, int num_files) {
+    wav_file* wav_in = context->wav;
+    int frame_size = wav_in->all_channel_sample_size_in_bytes;
+
+    // Read and parse the files and add up the size of the new audio data, return -1 on error.
+    char** contents = calloc(num_files, sizeof(char*));
+    wav_file** parsed = calloc(num_files, sizeof(wav_file*));
+    int result = contents != NULL && parsed != NULL ? 0 : -1;
+    if (result == -1) {
+        print_message("Error allocating memory for appended files.\n\n");
+    }
+    off_t new_data_size = (off_t)wav_in->num_all_channel_samples * frame_size;
+    for (int i = 0; i < num_files && result != -1; ++i) {
+        size_t size;
+        contents[i] = read_wav_file(file_names[i], &size);
+        parsed[i] = contents[i] != NULL ? parse(contents[i]) : NULL;
+        if (parsed[i] == NULL || check_audio_format(wav_in, parsed[i], file_names[i]) == -1) {
+            result = -1;
+        } else {
+            new_data_size += (off_t)parsed[i]->num_all_channel_samples * frame_size;
+        }
+    }
+
+    // Copy the file into the spare buffer around the new audio data, followed by the frames of each file.
+    char* file_out = result != -1 ? reserve_spare(context, resized_file_size(wav_in, new_data_size)) : NULL;
+    if (file_out != NULL) {
+        stretch_data_chunk(context->file, wav_in, new_data_size, file_out);
+        char* destination = file_out + wav_in->audio_data_position;
+        size_t size = wav_in->num_all_channel_samples * frame_size;
+        memcpy(destination, wav_in->data_pointer, size);
+        destination += size;
+        for (int i = 0; i < num_files; ++i) {
+            size = parsed[i]->num_all_channel_samples * frame_size;
+            memcpy(destination, parsed[i]->data_pointer, size);
+            destination += size;
+        }
+        resize_data_chunk(wav_in, new_data_size, file_out);
+        swap_buffers(context);
+    } else {
+        result = -1;
+    }
+
+    for (int i = 0; i < num_files && contents != NULL && parsed != NULL; ++i) {
+        if (parsed[i] != NULL) {
+            free_wav(parsed[i]);
+        }
+        free_file(contents[i]);
+    }
+    free(contents);
+    free(parsed);
+    return result;
+}
+
+// A function for writing the frames [first, first + count) of the file held by a context to disk as a file of their
+// own, with the chunks around the audio data. The file is put together in the spare buffer with a copy of the chunk
+// index, so the file held by the context is left as it is.
+// Returns -1 if there is an error.
+int write_wave_range(wave_context* context, char* file_name, size_t first, size_t count) {
+    wav_file* wav = context->wav;
+    off_t new_data_size = (off_t)count * wav->all_channel_sample_size_in_bytes;
+    char* file_out = reserve_spare(context, resized_file_size(wav, new_data_size));
+    wav_file range = *wav;
+    range.chunks = file_out != NULL ? malloc(wav->chunk_capacity * sizeof(wav_chunk)) : NULL;
+    if (range.chunks == NULL) {
+        if (file_out != NULL) {
+            print_message("Error allocating memory for chunk index.\n\n");
+        }
+        return -1;
+    }
+    memcpy(range.chunks, wav->chunks, wav->num_chunks * sizeof(wav_chunk));
+    stretch_data_chunk(context->file, wav, new_data_size, file_out);
+    memcpy(file_out + wav->audio_data_position, wav->data_pointer + first * wav->all_channel_sample_size_in_bytes,
+           new_data_size);
+    resize_data_chunk(&range, new_data_size, file_out);
+
+    wave_context range_context = *context;
+    range_context.file = file_out;
+    range_context.wav = &range;
+    int result = write_wave_file(&range_context, file_name);
+    free(range.chunks);
+    return result;
+}
+
+// A function for creating an empty analysis of the audio of a wav file.
+// Returns NULL if there is an error.
+audio_analysis* new_wave_analysis(wav_file* wav) {
+    if (wav->encoding == SAMPLE_UNSUPPORTED ||
+            wav->all_channel_sample_size_in_bytes != wav->num_channels * encoding_size(wav->encoding)) {
+        print_message("Analyzing audio is not supported for this sample format.\n\n");
+        return NULL;
+    }
+    return new_audio_analysis(wav->encoding, wav->num_channels, wav->sample_rate);
+}
+
+// A function for analyzing the audio of a wav file in one pass over its frames, split across worker threads, and
+// reporting the peak, RMS, DC offset and clipped samples of each channel and the silences, writing them to a sidecar
+// file unless file_name is NULL.
+// Returns -1 if there is an error.
+int analyze_audio(wave_context* context, char* file_name) {
+    wav_file* wav = context->wav;
+    audio_analysis* analysis = new_wave_analysis(wav);
+    if (analysis == NULL) {
+        return -1;
+    }
+    int result = analyze_frames(analysis, wav->data_pointer, 0, wav->num_all_channel_samples);
+    if (result != -1) {
+        result = report_analysis(analysis, file_name);
+    }
+    free_audio_analysis(analysis);
+    return result;
 }
 
 // A function for reversing the audio data in a wav file.
-void reverse_audio(char* source, int num_samples, int sample_size) {
-    char* temp_sample = malloc(sample_size * sizeof(char));
-    for (int i = 0; i < num_samples / 2; ++i) {
-        memcpy(temp_sample, source + i * sample_size, sample_size);
-        memcpy(source + i * sample_size, source + (num_samples - i - 1) * sample_size, sample_size);
-        memcpy(source + (num_samples - i - 1) * sample_size, temp_sample, sample_size);
-    }
-    free(temp_sample);
+void reverse_audio(char* source, size_t num_samples, int sample_size) {
+    reverse_frames(source, num_samples, sample_size);
 }
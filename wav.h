@@ -5,15 +5,47 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include "analysis.h"
+#include "checksum.h"
+#include "convert.h"
+#include "directory.h"
 #include "file.h"
+#include "resample.h"
+#include "reverse.h"
+#include "sample.h"
+#include "wsola.h"
+
+// RIFF and chunk headers hold 32-bit sizes. Larger files are RF64 or BW64 files, whose header is followed by a
+// "ds64" chunk holding the 64-bit RIFF and data sizes, and whose RIFF and data chunk headers hold RF64_SIZE_MARKER.
+#define RF64_SIZE_MARKER 0xFFFFFFFFu
+
+// The payload size of a "ds64" chunk without a table: the RIFF size, the data size, the sample count and the
+// number of table entries.
+#define DS64_SIZE 28
+
+// The number of chars of a "fmt " chunk read to find the encoding of its samples, which covers the header and
+// payload of a WAVE_FORMAT_EXTENSIBLE fmt chunk.
+#define FORMAT_READ_SIZE 48
+
+// The number of chars of a "fact" chunk holding a frame count.
+#define FACT_CHUNK_LENGTH 12
+
+// A struct for locating a chunk within a wav file.
+typedef struct wav_chunk {
+    char id[4];
+    off_t position; // position of the chunk header
+    off_t size; // size of the chunk's payload, excluding any pad byte
+} wav_chunk;
 
 // A struct for holding information about a wav file.
 typedef struct wav_file {
 
-    // RIFF header chunk
+    // RIFF header chunk, with the sizes from the "ds64" chunk of an RF64 or BW64 file
     char chunk_id[4];
-    int chunk_size;
+    off_t chunk_size;
     char file_format[4];
+    int rf64; // the RIFF header is followed by a "ds64" chunk
+    off_t ds64_data_size;
 
     // fmt chunk
     char format_id[4];
@@ -24,28 +56,85 @@ typedef struct wav_file {
     int byte_rate;
     short block_alignment;
     short bits_per_sample;
+    int encoding; // the sample_encoding of the samples, from the sub-format of an extensible fmt chunk
 
     // data chunk
     char data_id[4];
-    int data_size;
+    off_t data_size;
 
     // data pointer
     char* data_pointer;
 
     // useful file metrics
-    int file_size;
-    int format_position;
-    int data_position;
-    int audio_data_position;
-    int data_end_position;
-    int bytes_after_data;
+    off_t file_size;
+    off_t format_position;
+    off_t data_position;
+    off_t audio_data_position;
+    off_t data_end_position; // after the pad byte of odd-sized audio data
+    off_t bytes_after_data;
     int all_channel_sample_size_in_bytes;
-    int num_all_channel_samples;
+    size_t num_all_channel_samples;
+
+    // only the "ds64", "fmt ", "fact" and "data" chunks are written, after remove_metadata_on_write
+    int strip_metadata;
+
+    // a checksum chunk is written after the last chunk, with the checksums of the audio data and embedded files
+    int write_checksums;
+
+    // index of the file's chunks, in file order
+    wav_chunk* chunks;
+    int num_chunks;
+    int chunk_capacity;
 
 } wav_file;
 
-// A function for reading a wav file and detecting errors.
-char* read_wav_file(char* file_name);
+// A wav file being processed in memory. Operations write the new file into the spare buffer and swap
+// the buffers, so buffers are only allocated when a file grows past the largest one seen so far.
+typedef struct wave_context {
+    char* file;
+    size_t file_capacity;
+    wav_file* wav;
+    char* spare;
+    size_t spare_capacity;
+    checksum_list* checksums; // checksums from the checksum chunk of the file read, or NULL
+} wave_context;
+
+// A function for reading a wav file and detecting errors, storing its size in size.
+char* read_wav_file(char* file_name, size_t* size);
+
+// A function for reading the RIFF header of a wav file, and the "ds64" chunk of an RF64 or BW64 file, from its
+// first 44 chars.
+int parse_riff_header(char* header, wav_file* wav);
+
+// A function for reading the payload size from a chunk header, which is held in the "ds64" chunk for the data
+// chunk of an RF64 or BW64 file.
+off_t chunk_header_size(wav_file* wav, char* header);
+
+// A function for reading a "fmt " chunk into a wav_file, given its first length chars.
+void parse_format(wav_file* wav, char* chunk, off_t length);
+
+// A function for changing the sample format of a wav file and writing it into its "fmt " chunk, given the
+// chunk's first length chars.
+void update_format(wav_file* wav, char* chunk, off_t length, int encoding, int num_channels, int sample_rate);
+
+// A function for determining whether a wav file's sizes need an RF64 header and a "ds64" chunk.
+int needs_rf64(wav_file* wav);
+
+// A function for writing the RIFF header of a wav file.
+void write_riff_header(wav_file* wav, char* destination);
+
+// A function for writing the sizes of a wav file into the payload of its "ds64" chunk.
+void write_ds64_sizes(wav_file* wav, char* payload);
+
+// A function for writing a "ds64" chunk without a table for a wav file.
+void write_ds64_chunk(wav_file* wav, char* destination);
+
+// A function for calculating the frame count held in the "fact" chunk of a wav file, which is RF64_SIZE_MARKER
+// when the count does not fit.
+uint32_t fact_frame_count(wav_file* wav);
+
+// A function for writing a "fact" chunk holding the frame count of a wav file.
+void write_fact_chunk(wav_file* wav, char* destination);
 
 // A function for printing information about a wav file to the user.
 void print_stats(wav_file* wav, char* filename);
@@ -54,19 +143,107 @@ void print_stats(wav_file* wav, char* filename);
 // in a wav_file struct.
 wav_file* parse(char* contents);
 
+// A function for freeing a wav_file and its chunk index.
+void free_wav(wav_file* wav);
+
+// A function for determining whether a chunk's payload is followed by a pad byte, given the
+// chars that follow the payload.
+int chunk_padding(off_t size, char* following, int following_length);
+
+// A function for finding the first chunk with a given id at or after a position.
+int find_chunk(wav_file* wav, char* id, off_t position);
+
+// A function for adding a chunk to the end of a wav_file's chunk index.
+int add_wav_chunk(wav_file* wav, char* id, off_t position, off_t size);
+
+// A function for creating an empty context for processing wav files in memory.
+wave_context* new_wave_context();
+
+// A function for freeing a context and its buffers.
+void free_wave_context(wave_context* context);
+
+// A function for reading a wav file into a context, replacing the file it holds.
+int load_wave_file(wave_context* context, char* file_name);
+
+// A function for writing the file held by a context to disk.
+int write_wave_file(wave_context* context, char* file_name);
+
+// A function for checking the audio data and embedded files of the file read into a context against the checksums
+// from its checksum chunk.
+int verify_checksums(wave_context* context);
+
 // A function for removing the metadata from a wav file.
-void remove_metadata(char** file_in, wav_file** wav_pointer);
+int remove_metadata(wave_context* context);
+
+// A function for removing the metadata from a wav file when it is written, instead of copying the file without it.
+int remove_metadata_on_write(wave_context* context);
 
-// A function for embedding a hidden file within a wav file.
-void push_back_file(char** file_in, wav_file** wav_pointer, char* embedded_filename);
+// A function for embedding hidden files within a wav file, compressed or as is, copying the file only once.
+int push_back_files(wave_context* context, char** embedded_filenames, int num_files, int compression);
+
+// A function for embedding a hidden file within a wav file, compressed or as is, and recording it in the directory.
+int push_back_file(wave_context* context, char* embedded_filename, int compression);
 
 // A function for removing the oldest hidden file within a wav file.
-void pop_front_file(char** file_in, wav_file** wav_pointer, char* extracted_file_name);
+int pop_front_file(wave_context* context, char* extracted_file_name);
+
+// A function for listing the embedded files recorded in the directory of a wav file.
+int list_files(wave_context* context);
+
+// A function for extracting the oldest embedded file with a name to a file with that name.
+int extract_file(wave_context* context, char* name);
+
+// A function for deleting the oldest embedded file with a name from a wav file.
+int delete_file(wave_context* context, char* name);
+
+// A function for creating a resampler that stretches the audio of a wav file with an interpolation.
+resampler* new_stretch_resampler(wav_file* wav, double time_multiplier, int interpolation);
+
+// A function for creating a pitch-preserving stretch of the audio of a wav file into num_frames frames.
+wsola* new_stretch_wsola(wav_file* wav, size_t num_frames, double time_multiplier, int method);
+
+// A function for time-stretching the audio in a wav file by a given factor, either keeping the pitch or
+// interpolating between frames.
+int stretch_audio(wave_context* context, double time_multiplier, int interpolation, int method);
+
+// A function for creating a converter from the samples of a wav file to an encoding and channel mix.
+converter* new_format_converter(wav_file* wav, int encoding, channel_mix* mix, int dither);
+
+// A function for converting the samples of a wav file to an encoding and channel mix.
+int convert_audio(wave_context* context, int encoding, channel_mix* mix, int dither);
+
+// A function for calculating the time multiplier that converts the audio of a wav file to a sample rate.
+double sample_rate_multiplier(wav_file* wav, int sample_rate);
+
+// A function for converting the audio of a wav file to a sample rate.
+int resample_audio(wave_context* context, int sample_rate);
+
+// A function for finding the frames of the audio of a wav file from start to end seconds, where an end of -1 is the
+// end of the audio.
+int trim_range(wav_file* wav, double start, double end, size_t* first, size_t* count);
+
+// A function for keeping only the frames [first, first + count) of the audio of a wav file.
+void trim_audio(wave_context* context, size_t first, size_t count);
+
+// A function for checking that the audio of another wav file has the same sample format, number of channels and
+// sample rate as a wav file.
+int check_audio_format(wav_file* wav, wav_file* other, char* other_file_name);
+
+// A function for appending the audio of other wav files to the audio of a wav file, copying the file only once.
+int concat_audio(wave_context* context, char** file_names, int num_files);
+
+// A function for writing the frames [first, first + count) of the file held by a context to disk as a file of their
+// own.
+int write_wave_range(wave_context* context, char* file_name, size_t first, size_t count);
+
+// A function for creating an empty analysis of the audio of a wav file.
+audio_analysis* new_wave_analysis(wav_file* wav);
 
-// A function for time-stretching the audio in a wav file by a given factor.
-void stretch_audio(char** file_in, wav_file** wav_pointer, double time_multiplier);
+// A function for analyzing the audio of a wav file, reporting the peak, RMS, DC offset and clipped samples of each
+// channel and the silences, and writing them to a sidecar file unless file_name is NULL.
+int analyze_audio(wave_context* context, char* file_name);
 
 // A function for reversing the audio data in a wav file.
-void reverse_audio(char* source, int num_samples, int sample_size);
+void reverse_audio(char* source, size_t num_samples, int sample_size);
 
 #endif
@@ -0,0 +1,395 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "message.h"
+#include "parallel.h"
+#include "sample.h"
+#include "wsola.h"
+
+// Arguments for searching or rendering a range of chains on a worker thread.
+typedef struct wsola_task {
+    wsola* wsola;
+    char* source;
+    char* destination;
+    int failed;
+} wsola_task;
+
+// A function for converting a stretch method name to a stretch method. Returns -1 for unknown names.
+int parse_stretch_method(char* name) {
+    if (!strcmp(name, "resample")) {
+        return STRETCH_RESAMPLE;
+    } else if (!strcmp(name, "wsola")) {
+        return STRETCH_WSOLA;
+    }
+    return -1;
+}
+
+// A function for retrieving the name of a stretch method.
+char* stretch_method_name(int method) {
+    static char* names[] = { "resample", "wsola" };
+    return names[method];
+}
+
+// A function for creating a pitch-preserving stretch of num_source_frames into num_frames frames.
+// Segments are 20 milliseconds long and may move up to half a segment to line up with the previous one.
+// Returns NULL if there is an error.
+wsola* new_wsola(double time_multiplier, int sample_rate, int num_channels, int encoding,
+                 size_t num_source_frames, size_t num_frames) {
+
+    // Allocate memory for the stretch, return NULL on error.
+    wsola* new = calloc(1, sizeof(wsola));
+    if (new == NULL) {
+        print_message("Error allocating memory for stretch.\n\n");
+        return NULL;
+    }
+
+    new->num_channels = num_channels;
+    new->encoding = encoding;
+    new->frame_size = num_channels * encoding_size(encoding);
+    new->num_source_frames = num_source_frames;
+    new->num_frames = num_frames;
+    new->hop_frames = sample_rate / 100 > 32 ? sample_rate / 100 : 32;
+    new->tolerance = new->hop_frames;
+    new->decimation = sample_rate / 12000 > 1 ? sample_rate / 12000 : 1;
+    new->analysis_hop = new->hop_frames / time_multiplier;
+    new->num_hops = (num_frames + new->hop_frames - 1) / new->hop_frames;
+
+    // Allocate the window and the segment positions, return NULL on error.
+    size_t num_chains = (new->num_hops + WSOLA_CHAIN_HOPS - 1) / WSOLA_CHAIN_HOPS;
+    new->window = malloc(new->hop_frames * sizeof(float));
+    new->positions = malloc((new->num_hops + 1) * sizeof(int64_t));
+    new->searched = calloc(num_chains + 1, sizeof(char));
+    if (new->window == NULL || new->positions == NULL || new->searched == NULL) {
+        print_message("Error allocating memory for stretch.\n\n");
+        free_wsola(new);
+        return NULL;
+    }
+
+    // The halves of a Hann window sum to one, so overlapping segments keep the level of the source.
+    for (int i = 0; i < new->hop_frames; ++i) {
+        new->window[i] = 0.5 - 0.5 * cos(M_PI * i / new->hop_frames);
+    }
+    return new;
+}
+
+// A function for freeing a pitch-preserving stretch.
+void free_wsola(wsola* wsola) {
+    free(wsola->window);
+    free(wsola->positions);
+    free(wsola->searched);
+    free(wsola);
+}
+
+// A function for allocating the workspace of one thread. The source window holds four times the
+// frames searched for one segment. Returns NULL if there is an error.
+wsola_workspace* new_wsola_workspace(wsola* wsola) {
+    wsola_workspace* new = calloc(1, sizeof(wsola_workspace));
+    if (new == NULL) {
+        print_message("Error allocating memory for stretch.\n\n");
+        return NULL;
+    }
+
+    int hop = wsola->hop_frames;
+    int decimation = wsola->decimation;
+    size_t capacity = 4 * (2 * wsola->tolerance + 2 * hop) + decimation;
+    new->window_capacity = capacity + (decimation - capacity % decimation) % decimation;
+    new->samples = malloc((wsola->num_channels + 1) * new->window_capacity * sizeof(float));
+    new->decimated = malloc(new->window_capacity / decimation * sizeof(float));
+    new->frames = malloc(new->window_capacity * wsola->frame_size * sizeof(char));
+    new->target = malloc(hop * sizeof(float));
+    new->decimated_target = malloc(hop / decimation * sizeof(float));
+    new->overlap = malloc(wsola->num_channels * hop * sizeof(float));
+    new->output = malloc(wsola->num_channels * hop * sizeof(float));
+    if (new->samples == NULL || new->decimated == NULL || new->frames == NULL || new->target == NULL ||
+        new->decimated_target == NULL || new->overlap == NULL || new->output == NULL) {
+        print_message("Error allocating memory for stretch.\n\n");
+        free_wsola_workspace(new);
+        return NULL;
+    }
+    return new;
+}
+
+// A function for freeing a workspace.
+void free_wsola_workspace(wsola_workspace* workspace) {
+    free(workspace->samples);
+    free(workspace->decimated);
+    free(workspace->frames);
+    free(workspace->target);
+    free(workspace->decimated_target);
+    free(workspace->overlap);
+    free(workspace->output);
+    free(workspace);
+}
+
+// A function for calculating the ideal source position of a segment.
+static int64_t ideal_position(wsola* wsola, size_t hop) {
+    int64_t position = llround(hop * wsola->analysis_hop);
+    return position > (int64_t)wsola->num_source_frames ? (int64_t)wsola->num_source_frames : position;
+}
+
+// A function for making sure source frames [first, first + count) are decoded in the workspace window.
+// Frames outside of the source are silent. The window starts at a multiple of the decimation, so the
+// coarse search compares the same samples wherever the window was loaded.
+// Returns -1 if there is an error.
+static int load_frames(wsola* wsola, wsola_workspace* workspace, int64_t first, size_t count, wsola_reader reader,
+                       void* argument) {
+    size_t capacity = workspace->window_capacity;
+    if (workspace->window_valid && first >= workspace->window_first &&
+        first + (int64_t)count <= workspace->window_first + (int64_t)capacity) {
+        return 0;
+    }
+
+    int decimation = wsola->decimation;
+    int num_channels = wsola->num_channels;
+    int64_t start = first - ((first % decimation) + decimation) % decimation;
+    int64_t low = start < 0 ? 0 : start;
+    int64_t high = start + (int64_t)capacity;
+    high = high > (int64_t)wsola->num_source_frames ? (int64_t)wsola->num_source_frames : high;
+    high = high < low ? low : high;
+
+    // Read and decode the frames inside the source, and silence the rest of the window.
+    workspace->window_valid = 0;
+    if (high > low) {
+        if (reader(argument, low, high - low, workspace->frames) == -1) {
+            return -1;
+        }
+        decode_frames(workspace->frames, workspace->samples + (low - start), high - low, num_channels,
+                      wsola->encoding, capacity);
+    }
+    for (int c = 0; c < num_channels; ++c) {
+        float* x = workspace->samples + c * capacity;
+        memset(x, 0, (low - start) * sizeof(float));
+        memset(x + (high - start), 0, (capacity - (high - start)) * sizeof(float));
+    }
+
+    // Mix the channels to mono and average the mix over the decimation for the coarse search.
+    float* mono = workspace->samples + num_channels * capacity;
+    float scale = 1.0f / num_channels;
+    memcpy(mono, workspace->samples, capacity * sizeof(float));
+    for (int c = 1; c < num_channels; ++c) {
+        float* x = workspace->samples + c * capacity;
+        for (size_t i = 0; i < capacity; ++i) {
+            mono[i] += x[i];
+        }
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        mono[i] *= scale;
+    }
+    for (size_t i = 0; i < capacity / decimation; ++i) {
+        float sum = 0;
+        for (int j = 0; j < decimation; ++j) {
+            sum += mono[i * decimation + j];
+        }
+        workspace->decimated[i] = sum / decimation;
+    }
+
+    workspace->window_first = start;
+    workspace->window_valid = 1;
+    return 0;
+}
+
+// A function for calculating how similar a candidate is to a target, normalized by the candidate's
+// energy. Four partial sums keep the additions independent.
+static float similarity(float* target, float* candidate, int length) {
+    float dot[4] = { 0, 0, 0, 0 };
+    float energy[4] = { 0, 0, 0, 0 };
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        for (int j = 0; j < 4; ++j) {
+            dot[j] += target[i + j] * candidate[i + j];
+            energy[j] += candidate[i + j] * candidate[i + j];
+        }
+    }
+    for (; i < length; ++i) {
+        dot[0] += target[i] * candidate[i];
+        energy[0] += candidate[i] * candidate[i];
+    }
+    return (dot[0] + dot[1] + dot[2] + dot[3]) / sqrtf(energy[0] + energy[1] + energy[2] + energy[3] + 1e-9f);
+}
+
+// A function for searching the segment positions of a chain. Each segment after the first is placed
+// where it best continues the previous one: a coarse search on decimated samples is refined on the
+// full-rate samples around the best match.
+// Returns -1 if there is an error.
+int wsola_search_chain(wsola* wsola, wsola_workspace* workspace, size_t chain, wsola_reader reader, void* argument) {
+    size_t first_hop = chain * WSOLA_CHAIN_HOPS;
+    size_t last_hop = first_hop + WSOLA_CHAIN_HOPS < wsola->num_hops ? first_hop + WSOLA_CHAIN_HOPS : wsola->num_hops;
+    int hop = wsola->hop_frames;
+    int decimation = wsola->decimation;
+    int length = hop / decimation;
+    size_t capacity = workspace->window_capacity;
+    float* mono = workspace->samples + wsola->num_channels * capacity;
+
+    int64_t position = ideal_position(wsola, first_hop);
+    for (size_t k = first_hop; k < last_hop; ++k) {
+        if (k == first_hop) {
+            if (load_frames(wsola, workspace, position, 2 * hop, reader, argument) == -1) {
+                return -1;
+            }
+        } else {
+            int64_t ideal = ideal_position(wsola, k);
+            int64_t low = ideal - wsola->tolerance < 0 ? 0 : ideal - wsola->tolerance;
+            int64_t high = ideal + wsola->tolerance > (int64_t)wsola->num_source_frames ? (int64_t)wsola->num_source_frames
+                                                                                         : ideal + wsola->tolerance;
+            high = high < low ? low : high;
+            if (load_frames(wsola, workspace, low, high - low + 2 * hop, reader, argument) == -1) {
+                return -1;
+            }
+
+            // Compare the decimated candidates that start at multiples of the decimation.
+            int64_t best = low;
+            float best_score = -INFINITY;
+            for (int64_t c = (low + decimation - 1) / decimation * decimation; c <= high; c += decimation) {
+                float score = similarity(workspace->decimated_target,
+                                         workspace->decimated + (c - workspace->window_first) / decimation, length);
+                if (score > best_score) {
+                    best_score = score;
+                    best = c;
+                }
+            }
+
+            // Refine the best coarse candidate on the full-rate samples.
+            int64_t fine_low = best - decimation + 1 < low ? low : best - decimation + 1;
+            int64_t fine_high = best + decimation - 1 > high ? high : best + decimation - 1;
+            best_score = -INFINITY;
+            for (int64_t c = fine_low; c <= fine_high; ++c) {
+                float score = similarity(workspace->target, mono + (c - workspace->window_first), hop);
+                if (score > best_score) {
+                    best_score = score;
+                    best = c;
+                }
+            }
+            position = best;
+        }
+        wsola->positions[k] = position;
+
+        // The mix following the segment is the target of the next search.
+        memcpy(workspace->target, mono + (position + hop - workspace->window_first), hop * sizeof(float));
+        for (int i = 0; i < length; ++i) {
+            float sum = 0;
+            for (int j = 0; j < decimation; ++j) {
+                sum += workspace->target[i * decimation + j];
+            }
+            workspace->decimated_target[i] = sum / decimation;
+        }
+    }
+
+    wsola->searched[chain] = 1;
+    return 0;
+}
+
+// A function for rendering output frames [first, first + count), searching any chains they need.
+// Returns -1 if there is an error.
+int wsola_render(wsola* wsola, wsola_workspace* workspace, size_t first, size_t count, char* destination,
+                 wsola_reader reader, void* argument) {
+    if (count == 0) {
+        return 0;
+    }
+
+    // Search the chains of the hops, and of the segment before the first hop.
+    int hop = wsola->hop_frames;
+    size_t first_hop = first / hop;
+    size_t last_hop = (first + count - 1) / hop + 1;
+    for (size_t chain = (first_hop > 0 ? first_hop - 1 : 0) / WSOLA_CHAIN_HOPS; chain <= (last_hop - 1) / WSOLA_CHAIN_HOPS;
+         ++chain) {
+        if (!wsola->searched[chain] && wsola_search_chain(wsola, workspace, chain, reader, argument) == -1) {
+            return -1;
+        }
+    }
+
+    // Fade out the second half of the segment before the first hop. The first hop overlaps the
+    // segment one hop before the start, which continues the source without a seam.
+    size_t capacity = workspace->window_capacity;
+    int64_t previous = first_hop > 0 ? wsola->positions[first_hop - 1] : -hop;
+    if (load_frames(wsola, workspace, previous + hop, hop, reader, argument) == -1) {
+        return -1;
+    }
+    for (int c = 0; c < wsola->num_channels; ++c) {
+        float* x = workspace->samples + c * capacity + (previous + hop - workspace->window_first);
+        float* overlap = workspace->overlap + c * hop;
+        for (int i = 0; i < hop; ++i) {
+            overlap[i] = (1 - wsola->window[i]) * x[i];
+        }
+    }
+
+    for (size_t k = first_hop; k < last_hop; ++k) {
+        int64_t position = wsola->positions[k];
+        if (load_frames(wsola, workspace, position, 2 * hop, reader, argument) == -1) {
+            return -1;
+        }
+
+        // Add the faded in first half of the segment to the overlap, and keep its faded out second half.
+        for (int c = 0; c < wsola->num_channels; ++c) {
+            float* x = workspace->samples + c * capacity + (position - workspace->window_first);
+            float* overlap = workspace->overlap + c * hop;
+            float* output = workspace->output + c * hop;
+            for (int i = 0; i < hop; ++i) {
+                output[i] = overlap[i] + wsola->window[i] * x[i];
+                overlap[i] = (1 - wsola->window[i]) * x[hop + i];
+            }
+        }
+
+        // Encode the frames of the hop inside the requested range.
+        size_t hop_first = k * hop;
+        size_t low = hop_first > first ? hop_first : first;
+        size_t high = hop_first + hop < first + count ? hop_first + hop : first + count;
+        encode_frames(workspace->output + (low - hop_first), destination + (low - first) * wsola->frame_size, high - low,
+                      wsola->num_channels, wsola->encoding, hop);
+    }
+    return 0;
+}
+
+// A function for reading source frames from a buffer.
+static int read_buffer(void* argument, size_t first, size_t count, char* destination) {
+    wsola_task* task = argument;
+    memcpy(destination, task->source + first * task->wsola->frame_size, count * task->wsola->frame_size);
+    return 0;
+}
+
+// A function for searching a range of chains on a worker thread.
+static void search_range(void* argument, size_t first_chain, size_t last_chain) {
+    wsola_task* task = argument;
+    wsola_workspace* workspace = new_wsola_workspace(task->wsola);
+    if (workspace == NULL) {
+        task->failed = 1;
+        return;
+    }
+    for (size_t chain = first_chain; chain < last_chain; ++chain) {
+        wsola_search_chain(task->wsola, workspace, chain, read_buffer, task);
+    }
+    free_wsola_workspace(workspace);
+}
+
+// A function for rendering the output frames of a range of chains on a worker thread.
+static void render_range(void* argument, size_t first_chain, size_t last_chain) {
+    wsola_task* task = argument;
+    wsola* wsola = task->wsola;
+    wsola_workspace* workspace = new_wsola_workspace(wsola);
+    if (workspace == NULL) {
+        task->failed = 1;
+        return;
+    }
+    size_t chain_frames = (size_t)WSOLA_CHAIN_HOPS * wsola->hop_frames;
+    size_t first = first_chain * chain_frames;
+    size_t last = last_chain * chain_frames < wsola->num_frames ? last_chain * chain_frames : wsola->num_frames;
+    wsola_render(wsola, workspace, first, last - first, task->destination + first * wsola->frame_size, read_buffer, task);
+    free_wsola_workspace(workspace);
+}
+
+// A function for stretching a whole buffer of source frames. All chains are searched before any are
+// rendered, since the first hop of a chain overlaps the last segment of the chain before it.
+// Returns -1 if there is an error.
+int wsola_frames(wsola* wsola, char* source, char* destination) {
+    wsola_task task = { wsola, source, destination, 0 };
+    size_t num_chains = (wsola->num_hops + WSOLA_CHAIN_HOPS - 1) / WSOLA_CHAIN_HOPS;
+    parallel_for(num_chains, 1, search_range, &task);
+    if (!task.failed) {
+        parallel_for(num_chains, 1, render_range, &task);
+    }
+    if (task.failed) {
+        print_message("Error allocating memory for stretching.\n\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef H_WSOLA
+#define H_WSOLA
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Ways of changing the duration of audio. Resampling also shifts the pitch, while WSOLA overlaps
+// segments of the source audio to keep the pitch.
+enum stretch_method { STRETCH_RESAMPLE, STRETCH_WSOLA };
+
+// The number of consecutive segments whose positions are searched in sequence. The first segment
+// of each chain is placed at its ideal position, so chains can be searched independently.
+#define WSOLA_CHAIN_HOPS 256
+
+// A function for reading count source frames starting at frame first into destination.
+// Returns -1 if there is an error.
+typedef int (*wsola_reader)(void* argument, size_t first, size_t count, char* destination);
+
+// A struct describing a pitch-preserving stretch. Output hop k is the overlap of the second half
+// of segment k - 1 and the first half of segment k, where segment k is two hops of source frames
+// starting near the ideal position k * analysis_hop.
+typedef struct wsola {
+    int num_channels;
+    int encoding;
+    int frame_size;
+    size_t num_source_frames;
+    size_t num_frames;
+
+    int hop_frames; // output frames per hop, half the length of a segment
+    int tolerance; // frames a segment may move from its ideal position
+    int decimation; // source frames averaged into one sample of the coarse search
+    double analysis_hop; // source frames between ideal segment positions
+
+    // fade in weights of the first half of a segment; the second half fades out with 1 - weight
+    float* window;
+
+    // source position of each segment, and the chains whose positions have been searched
+    size_t num_hops;
+    int64_t* positions;
+    char* searched;
+} wsola;
+
+// A struct holding the memory used by one thread to search and render a stretch, allocated once.
+typedef struct wsola_workspace {
+
+    // planar window of decoded source frames, with a mono mix after the last channel
+    float* samples;
+    float* decimated;
+    int64_t window_first;
+    size_t window_capacity;
+    int window_valid;
+
+    // undecoded source frames
+    char* frames;
+
+    // mono mix following the last segment placed, and its decimated samples
+    float* target;
+    float* decimated_target;
+
+    // planar faded out halves of the previous segment and the current hop
+    float* overlap;
+    float* output;
+} wsola_workspace;
+
+// A function for converting a stretch method name to a stretch method. Returns -1 for unknown names.
+int parse_stretch_method(char* name);
+
+// A function for retrieving the name of a stretch method.
+char* stretch_method_name(int method);
+
+// A function for creating a pitch-preserving stretch of num_source_frames into num_frames frames.
+wsola* new_wsola(double time_multiplier, int sample_rate, int num_channels, int encoding,
+                 size_t num_source_frames, size_t num_frames);
+
+// A function for freeing a pitch-preserving stretch.
+void free_wsola(wsola* wsola);
+
+// A function for allocating the workspace of one thread.
+wsola_workspace* new_wsola_workspace(wsola* wsola);
+
+// A function for freeing a workspace.
+void free_wsola_workspace(wsola_workspace* workspace);
+
+// A function for searching the segment positions of a chain.
+int wsola_search_chain(wsola* wsola, wsola_workspace* workspace, size_t chain, wsola_reader reader, void* argument);
+
+// A function for rendering output frames [first, first + count), searching any chains they need.
+int wsola_render(wsola* wsola, wsola_workspace* workspace, size_t first, size_t count, char* destination,
+                 wsola_reader reader, void* argument);
+
+// A function for stretching a whole buffer of source frames, splitting the work across worker threads.
+int wsola_frames(wsola* wsola, char* source, char* destination);
+
+#endif